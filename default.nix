@@ -3,7 +3,7 @@ pkgs.stdenv.mkDerivation {
   pname = "pwarPipeWire";
   version = "0.1.0";
   src = ./.;
-  buildInputs = [ pkgs.pipewire.dev pkgs.pkg-config ];
+  buildInputs = [ pkgs.pipewire.dev pkgs.alsa-lib.dev pkgs.libjack2 pkgs.pkg-config ];
   buildPhase = "make -C linux";
   installPhase = ''
     mkdir -p $out/bin
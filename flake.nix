@@ -34,6 +34,8 @@
           gcc
           pkg-config
           pipewire.dev
+          alsa-lib.dev
+          libjack2
         ];
       };
       packages.default = pwarPkg;
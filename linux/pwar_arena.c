@@ -0,0 +1,38 @@
+/*
+ * pwar_arena.c - Preallocated per-session memory for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "pwar_arena.h"
+
+int pwar_arena_init(struct pwar_arena *arena, size_t size) {
+    memset(arena, 0, sizeof(*arena));
+    if (!size)
+        return 0;
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (p == MAP_FAILED)
+        return -errno;
+    arena->base = p;
+    arena->size = size;
+    return 0;
+}
+
+void *pwar_arena_alloc(struct pwar_arena *arena, size_t bytes) {
+    size_t len = pwar_arena_size(bytes);
+    if (len > arena->size - arena->used)
+        return NULL;
+    void *p = arena->base + arena->used;
+    arena->used += len;
+    // Fresh anonymous pages are zero and nothing is handed out twice
+    return p;
+}
+
+void pwar_arena_destroy(struct pwar_arena *arena) {
+    if (arena->base)
+        munmap(arena->base, arena->size);
+}
@@ -0,0 +1,38 @@
+/*
+ * pwar_arena.h - Preallocated per-session memory for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Everything the real-time threads touch is carved out of one mapping that
+ * is sized, faulted in and locked when the session starts. Nothing is ever
+ * freed on its own; the whole arena goes away with the session.
+ */
+
+#ifndef PWAR_ARENA
+#define PWAR_ARENA
+
+#include <stddef.h>
+
+#define PWAR_ARENA_ALIGN 64               // cache line, keeps threads off each other's lines
+
+struct pwar_arena {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+};
+
+// Rounds a request up the way pwar_arena_alloc() will place it, for sizing
+static inline size_t pwar_arena_size(size_t bytes) {
+    return (bytes + PWAR_ARENA_ALIGN - 1) & ~(size_t)(PWAR_ARENA_ALIGN - 1);
+}
+
+// Maps size bytes, populated up front. Returns 0 or a negative errno.
+int pwar_arena_init(struct pwar_arena *arena, size_t size);
+
+// Zeroed, PWAR_ARENA_ALIGN aligned. NULL when the arena was sized too small.
+void *pwar_arena_alloc(struct pwar_arena *arena, size_t bytes);
+
+void pwar_arena_destroy(struct pwar_arena *arena);
+
+#endif /* PWAR_ARENA */
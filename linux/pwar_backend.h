@@ -0,0 +1,31 @@
+/*
+ * pwar_backend.h - Audio backends of the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * A backend owns the audio side: it opens the graph or device, starts the
+ * bridge once it is ready and calls pwar_bridge_process() from its RT
+ * thread every cycle until SIGINT or SIGTERM.
+ */
+
+#ifndef PWAR_BACKEND
+#define PWAR_BACKEND
+
+#include "pwar_bridge.h"
+
+struct pwar_backend {
+    const char *name;
+    int supports_driver;                  // can be clocked by the peer (--driver)
+    // Handles a backend specific option at argv[i], returns like
+    // pwar_bridge_parse_arg().
+    int (*parse_arg)(int argc, char *argv[], int i);
+    // Runs the backend until it is asked to quit. Returns 0 or a negative errno.
+    int (*run)(struct pwar_bridge *bridge, int argc, char *argv[]);
+};
+
+extern const struct pwar_backend pwar_backend_pipewire;
+extern const struct pwar_backend pwar_backend_alsa;
+extern const struct pwar_backend pwar_backend_jack;
+
+#endif /* PWAR_BACKEND */
@@ -0,0 +1,338 @@
+/*
+ * pwar_backend_alsa.c - Direct ALSA backend for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Opens a capture and a playback PCM in mmap mode and runs the bridge from
+ * a plain read-process-write loop, with no PipeWire graph in between. The
+ * playback buffer is filled with silence on start, so the device adds one
+ * capture period plus the playback buffer to the round trip.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <alsa/asoundlib.h>
+#include "pwar_backend.h"
+
+#define ALSA_DEFAULT_DEVICE "default"
+#define ALSA_DEFAULT_PERIODS 2
+
+struct alsa_options {
+    const char *playback;
+    const char *capture;                  // NULL uses the playback device
+    unsigned int periods;
+};
+
+static struct alsa_options options = {
+    .playback = ALSA_DEFAULT_DEVICE,
+    .capture = NULL,
+    .periods = ALSA_DEFAULT_PERIODS,
+};
+
+struct alsa_pcm {
+    snd_pcm_t *pcm;
+    const char *name;
+    snd_pcm_format_t format;
+    unsigned int channels;
+    snd_pcm_uframes_t period;
+    snd_pcm_uframes_t buffer;
+};
+
+// Tried in order; float saves the conversion where the device offers it
+static const snd_pcm_format_t formats[] = {
+    SND_PCM_FORMAT_FLOAT_LE,
+    SND_PCM_FORMAT_S32_LE,
+    SND_PCM_FORMAT_S16_LE,
+};
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int signal_number) {
+    quit = 1;
+}
+
+static int alsa_parse_arg(int argc, char *argv[], int i) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--alsa-device") == 0 && val) {
+        options.playback = val;
+        return 2;
+    } else if (strcmp(arg, "--alsa-capture") == 0 && val) {
+        options.capture = val;
+        return 2;
+    } else if (strcmp(arg, "--alsa-periods") == 0 && val) {
+        options.periods = strtoul(val, NULL, 10);
+        if (options.periods < 2) {
+            fprintf(stderr, "invalid --alsa-periods %s (at least 2)\n", val);
+            return -1;
+        }
+        return 2;
+    }
+    return 0;
+}
+
+static int configure_pcm(struct alsa_pcm *p, const char *dir, const char *name,
+                         unsigned int channels, snd_pcm_uframes_t period, unsigned int periods) {
+    snd_pcm_hw_params_t *hw;
+    snd_pcm_sw_params_t *sw;
+    int err;
+
+    snd_pcm_hw_params_alloca(&hw);
+    snd_pcm_hw_params_any(p->pcm, hw);
+    if ((err = snd_pcm_hw_params_set_access(p->pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+        fprintf(stderr, "[alsa] %s %s: no mmap access: %s\n", dir, name, snd_strerror(err));
+        return err;
+    }
+    err = -EINVAL;
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        if (snd_pcm_hw_params_set_format(p->pcm, hw, formats[i]) == 0) {
+            p->format = formats[i];
+            err = 0;
+            break;
+        }
+    }
+    if (err < 0) {
+        fprintf(stderr, "[alsa] %s %s: no float, S32 or S16 format\n", dir, name);
+        return err;
+    }
+    // Extra device channels are ignored on capture and silent on playback
+    p->channels = channels;
+    if ((err = snd_pcm_hw_params_set_channels_near(p->pcm, hw, &p->channels)) < 0)
+        return err;
+    unsigned int rate = PWAR_BRIDGE_RATE;
+    if ((err = snd_pcm_hw_params_set_rate(p->pcm, hw, rate, 0)) < 0) {
+        fprintf(stderr, "[alsa] %s %s: %u Hz not supported: %s\n", dir, name, rate, snd_strerror(err));
+        return err;
+    }
+    int d = 0;
+    p->period = period;
+    if ((err = snd_pcm_hw_params_set_period_size_near(p->pcm, hw, &p->period, &d)) < 0)
+        return err;
+    if ((err = snd_pcm_hw_params_set_periods_near(p->pcm, hw, &periods, &d)) < 0)
+        return err;
+    if ((err = snd_pcm_hw_params(p->pcm, hw)) < 0) {
+        fprintf(stderr, "[alsa] %s %s: can't apply hw params: %s\n", dir, name, snd_strerror(err));
+        return err;
+    }
+    snd_pcm_hw_params_get_period_size(hw, &p->period, &d);
+    snd_pcm_hw_params_get_buffer_size(hw, &p->buffer);
+
+    // Both streams are started by hand, never by the first write
+    snd_pcm_uframes_t boundary;
+    snd_pcm_sw_params_alloca(&sw);
+    snd_pcm_sw_params_current(p->pcm, sw);
+    snd_pcm_sw_params_get_boundary(sw, &boundary);
+    snd_pcm_sw_params_set_start_threshold(p->pcm, sw, boundary);
+    snd_pcm_sw_params_set_avail_min(p->pcm, sw, p->period);
+    if ((err = snd_pcm_sw_params(p->pcm, sw)) < 0) {
+        fprintf(stderr, "[alsa] %s %s: can't apply sw params: %s\n", dir, name, snd_strerror(err));
+        return err;
+    }
+
+    printf("[alsa] %s %s: %s, %u channels, period %lu, buffer %lu frames\n", dir, name,
+        snd_pcm_format_name(p->format), p->channels, p->period, p->buffer);
+    return 0;
+}
+
+// Opens and configures one stream; on failure nothing stays open
+static int open_pcm(struct alsa_pcm *p, const char *name, snd_pcm_stream_t stream,
+                    unsigned int channels, snd_pcm_uframes_t period, unsigned int periods) {
+    const char *dir = stream == SND_PCM_STREAM_PLAYBACK ? "playback" : "capture";
+    int err;
+
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+    if ((err = snd_pcm_open(&p->pcm, name, stream, 0)) < 0) {
+        fprintf(stderr, "[alsa] can't open %s device %s: %s\n", dir, name, snd_strerror(err));
+        return err;
+    }
+    if ((err = configure_pcm(p, dir, name, channels, period, periods)) < 0) {
+        snd_pcm_close(p->pcm);
+        p->pcm = NULL;
+    }
+    return err;
+}
+
+static inline void *sample_ptr(const snd_pcm_channel_area_t *a, snd_pcm_uframes_t frame) {
+    return (char *)a->addr + (a->first + frame * a->step) / 8;
+}
+
+static inline float sample_get(const snd_pcm_channel_area_t *a, snd_pcm_uframes_t frame, snd_pcm_format_t fmt) {
+    void *s = sample_ptr(a, frame);
+    switch (fmt) {
+    case SND_PCM_FORMAT_FLOAT_LE: return *(float *)s;
+    case SND_PCM_FORMAT_S32_LE: return *(int32_t *)s * (1.0f / 2147483648.0f);
+    default: return *(int16_t *)s * (1.0f / 32768.0f);
+    }
+}
+
+static inline void sample_put(const snd_pcm_channel_area_t *a, snd_pcm_uframes_t frame, snd_pcm_format_t fmt, float v) {
+    void *s = sample_ptr(a, frame);
+    if (fmt == SND_PCM_FORMAT_FLOAT_LE) {
+        *(float *)s = v;
+        return;
+    }
+    if (v > 1.0f)
+        v = 1.0f;
+    else if (v < -1.0f)
+        v = -1.0f;
+    if (fmt == SND_PCM_FORMAT_S32_LE)
+        *(int32_t *)s = (int32_t)(v * 2147483647.0f);
+    else
+        *(int16_t *)s = (int16_t)(v * 32767.0f);
+}
+
+// Moves one period through the mmap area. Capture fills in (channel 0),
+// playback writes out[] with NULL channels and extra device channels silent.
+static int mmap_transfer(struct alsa_pcm *p, float *in, float *const *out, snd_pcm_uframes_t frames) {
+    snd_pcm_uframes_t done = 0;
+    while (done < frames) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset, n = frames - done;
+        int err = snd_pcm_mmap_begin(p->pcm, &areas, &offset, &n);
+        if (err < 0)
+            return err;
+        if (in) {
+            for (snd_pcm_uframes_t i = 0; i < n; ++i)
+                in[done + i] = sample_get(&areas[0], offset + i, p->format);
+        } else {
+            for (unsigned int ch = 0; ch < p->channels; ++ch) {
+                const float *src = ch < PWAR_BRIDGE_OUT_CHANNELS ? (out ? out[ch] : NULL) : NULL;
+                for (snd_pcm_uframes_t i = 0; i < n; ++i)
+                    sample_put(&areas[ch], offset + i, p->format, src ? src[done + i] : 0.0f);
+            }
+        }
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(p->pcm, offset, n);
+        if (committed < 0)
+            return (int)committed;
+        if ((snd_pcm_uframes_t)committed != n)
+            return -EPIPE;
+        done += n;
+    }
+    return 0;
+}
+
+static int start_streams(struct alsa_pcm *capture, struct alsa_pcm *playback, int linked) {
+    int err;
+    if ((err = snd_pcm_prepare(capture->pcm)) < 0)
+        return err;
+    if (!linked && (err = snd_pcm_prepare(playback->pcm)) < 0)
+        return err;
+    // Prime the whole playback buffer so the first capture period has room
+    for (snd_pcm_uframes_t filled = 0; filled < playback->buffer; filled += playback->period) {
+        if ((err = mmap_transfer(playback, NULL, NULL, playback->period)) < 0)
+            return err;
+    }
+    if ((err = snd_pcm_start(capture->pcm)) < 0)
+        return err;
+    if (!linked && (err = snd_pcm_start(playback->pcm)) < 0)
+        return err;
+    return 0;
+}
+
+static int alsa_run(struct pwar_bridge *bridge, int argc, char *argv[]) {
+    struct alsa_pcm playback, capture;
+    const char *capture_name = options.capture ? options.capture : options.playback;
+    int err;
+
+    if (open_pcm(&playback, options.playback, SND_PCM_STREAM_PLAYBACK,
+                 PWAR_BRIDGE_OUT_CHANNELS, bridge->cfg.quantum, options.periods) < 0)
+        return -1;
+    if (open_pcm(&capture, capture_name, SND_PCM_STREAM_CAPTURE,
+                 PWAR_BRIDGE_IN_CHANNELS, playback.period, options.periods) < 0) {
+        snd_pcm_close(playback.pcm);
+        return -1;
+    }
+    if (capture.period != playback.period) {
+        fprintf(stderr, "[alsa] capture period %lu differs from playback period %lu\n", capture.period, playback.period);
+        snd_pcm_close(capture.pcm);
+        snd_pcm_close(playback.pcm);
+        return -1;
+    }
+    snd_pcm_uframes_t period = playback.period;
+    int linked = snd_pcm_link(capture.pcm, playback.pcm) == 0;
+    printf("[alsa] round trip through the device: %.3f ms%s\n",
+        (capture.period + playback.buffer) * 1000.0 / PWAR_BRIDGE_RATE, linked ? "" : " (streams not linked)");
+
+    float *in = calloc(period, sizeof(float));
+    float *out_buf = calloc(period * PWAR_BRIDGE_OUT_CHANNELS, sizeof(float));
+    if (!in || !out_buf) {
+        fprintf(stderr, "out of memory\n");
+        free(in);
+        free(out_buf);
+        return -ENOMEM;
+    }
+    float *out[PWAR_BRIDGE_OUT_CHANNELS] = { out_buf, out_buf + period };
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pwar_bridge_start(bridge);
+    pwar_rt_prefault(in, period * sizeof(float));
+    pwar_rt_prefault(out_buf, period * PWAR_BRIDGE_OUT_CHANNELS * sizeof(float));
+
+    err = start_streams(&capture, &playback, linked);
+    while (!quit) {
+        if (err == 0)
+            err = snd_pcm_wait(capture.pcm, 1000) < 0 ? -EPIPE : 0;
+        snd_pcm_sframes_t avail = err == 0 ? snd_pcm_avail_update(capture.pcm) : err;
+        while (avail >= (snd_pcm_sframes_t)period && !quit) {
+            if ((err = mmap_transfer(&capture, in, NULL, period)) < 0)
+                break;
+            pwar_bridge_process(bridge, in, out, period);
+            // The room for this period is due now, but the playback pointer
+            // may move in coarser steps or, unlinked, a little behind the
+            // capture one. Only a negative avail is an underrun.
+            snd_pcm_sframes_t room = snd_pcm_avail_update(playback.pcm);
+            if (room >= 0 && room < (snd_pcm_sframes_t)period) {
+                int ready = snd_pcm_wait(playback.pcm, 1000);
+                room = ready < 0 ? ready : snd_pcm_avail_update(playback.pcm);
+            }
+            if (room < (snd_pcm_sframes_t)period) {
+                err = room < 0 ? (int)room : -EPIPE;
+                break;
+            }
+            if ((err = mmap_transfer(&playback, NULL, out, period)) < 0)
+                break;
+            avail -= period;
+        }
+        if (avail < 0 && err == 0)
+            err = (int)avail;
+        if (err < 0 && !quit) {
+            // Overrun or underrun: start both streams over from silence
+            pwar_bridge_xrun(bridge);
+            snd_pcm_drop(capture.pcm);
+            if (!linked)
+                snd_pcm_drop(playback.pcm);
+            err = start_streams(&capture, &playback, linked);
+            if (err < 0) {
+                fprintf(stderr, "[alsa] can't restart streams: %s\n", snd_strerror(err));
+                break;
+            }
+        }
+    }
+
+    snd_pcm_drop(capture.pcm);
+    if (linked)
+        snd_pcm_unlink(capture.pcm);
+    snd_pcm_drop(playback.pcm);
+    snd_pcm_close(capture.pcm);
+    snd_pcm_close(playback.pcm);
+    free(in);
+    free(out_buf);
+    return quit ? 0 : -1;
+}
+
+const struct pwar_backend pwar_backend_alsa = {
+    .name = "alsa",
+    .supports_driver = 0,
+    .parse_arg = alsa_parse_arg,
+    .run = alsa_run,
+};
@@ -0,0 +1,198 @@
+/*
+ * pwar_backend_jack.c - Native JACK client backend for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * For rigs that still run jackd. The client registers one port per protocol
+ * channel and runs the bridge from its process callback, which takes no
+ * locks: replies arrive through the bridge's lock-free ring. The latency
+ * callback reports the measured round trip on the ports, so JACK's latency
+ * compensation sees the remote DAW like any other processing delay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <jack/jack.h>
+#include "pwar_backend.h"
+
+#define JACK_DEFAULT_NAME "pwar"
+#define JACK_MAX_FRAMES 8192
+
+struct jack_options {
+    const char *name;
+    const char *server;                   // NULL uses $JACK_DEFAULT_SERVER
+};
+
+static struct jack_options options = {
+    .name = JACK_DEFAULT_NAME,
+    .server = NULL,
+};
+
+struct jack_data {
+    struct pwar_bridge *bridge;
+    jack_client_t *client;
+    jack_port_t *in_ports[PWAR_BRIDGE_IN_CHANNELS];
+    jack_port_t *out_ports[PWAR_BRIDGE_OUT_CHANNELS];
+    float in[JACK_MAX_FRAMES];            // input ports are read only, test signals write here
+    uint32_t latency;                     // reported in the latency callback, atomic
+};
+
+static volatile sig_atomic_t quit;
+
+static void on_signal(int signal_number) {
+    quit = 1;
+}
+
+static int jack_parse_arg(int argc, char *argv[], int i) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--jack-name") == 0 && val) {
+        options.name = val;
+        return 2;
+    } else if (strcmp(arg, "--jack-server") == 0 && val) {
+        options.server = val;
+        return 2;
+    }
+    return 0;
+}
+
+static int on_process(jack_nframes_t nframes, void *arg) {
+    struct jack_data *data = arg;
+    float *out[PWAR_BRIDGE_OUT_CHANNELS];
+    for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch)
+        out[ch] = jack_port_get_buffer(data->out_ports[ch], nframes);
+    if (nframes > JACK_MAX_FRAMES) {
+        for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch)
+            memset(out[ch], 0, nframes * sizeof(float));
+        return 0;
+    }
+    // The protocol carries one input channel
+    memcpy(data->in, jack_port_get_buffer(data->in_ports[0], nframes), nframes * sizeof(float));
+    pwar_bridge_process(data->bridge, data->in, out, nframes);
+    return 0;
+}
+
+static int on_xrun(void *arg) {
+    struct jack_data *data = arg;
+    pwar_bridge_xrun(data->bridge);
+    return 0;
+}
+
+static void on_shutdown(void *arg) {
+    quit = 1;
+}
+
+// Our outputs lag our inputs by the round trip, in both directions of the graph
+static void on_latency(jack_latency_callback_mode_t mode, void *arg) {
+    struct jack_data *data = arg;
+    jack_latency_range_t range;
+    uint32_t latency = __atomic_load_n(&data->latency, __ATOMIC_RELAXED);
+    if (mode == JackCaptureLatency) {
+        jack_port_get_latency_range(data->in_ports[0], mode, &range);
+        range.min += latency;
+        range.max += latency;
+        for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch)
+            jack_port_set_latency_range(data->out_ports[ch], mode, &range);
+    } else {
+        jack_latency_range_t out;
+        range.min = UINT32_MAX;
+        range.max = 0;
+        for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch) {
+            jack_port_get_latency_range(data->out_ports[ch], mode, &out);
+            if (out.min < range.min) range.min = out.min;
+            if (out.max > range.max) range.max = out.max;
+        }
+        range.min += latency;
+        range.max += latency;
+        for (int ch = 0; ch < PWAR_BRIDGE_IN_CHANNELS; ++ch)
+            jack_port_set_latency_range(data->in_ports[ch], mode, &range);
+    }
+}
+
+static int register_ports(struct jack_data *data) {
+    char name[32];
+    for (int ch = 0; ch < PWAR_BRIDGE_IN_CHANNELS; ++ch) {
+        snprintf(name, sizeof(name), "input_%d", ch + 1);
+        data->in_ports[ch] = jack_port_register(data->client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+        if (!data->in_ports[ch])
+            return -1;
+    }
+    for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch) {
+        snprintf(name, sizeof(name), "output_%d", ch + 1);
+        data->out_ports[ch] = jack_port_register(data->client, name, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        if (!data->out_ports[ch])
+            return -1;
+    }
+    return 0;
+}
+
+static int jack_run(struct pwar_bridge *bridge, int argc, char *argv[]) {
+    static struct jack_data data;
+    jack_status_t status;
+    jack_options_t open_options = options.server ? JackServerName : JackNullOption;
+
+    data.bridge = bridge;
+    data.client = jack_client_open(options.name, open_options | JackNoStartServer, &status, options.server);
+    if (!data.client) {
+        fprintf(stderr, "[jack] can't connect to the JACK server (status 0x%x)\n", status);
+        return -1;
+    }
+    jack_nframes_t rate = jack_get_sample_rate(data.client);
+    if (rate != PWAR_BRIDGE_RATE) {
+        fprintf(stderr, "[jack] server runs at %u Hz, the bridge needs %d Hz\n", rate, PWAR_BRIDGE_RATE);
+        jack_client_close(data.client);
+        return -1;
+    }
+    if (register_ports(&data) < 0) {
+        fprintf(stderr, "[jack] can't register ports\n");
+        jack_client_close(data.client);
+        return -1;
+    }
+    jack_set_process_callback(data.client, on_process, &data);
+    jack_set_xrun_callback(data.client, on_xrun, &data);
+    jack_set_latency_callback(data.client, on_latency, &data);
+    jack_on_shutdown(data.client, on_shutdown, &data);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pwar_bridge_start(bridge);
+    pwar_rt_prefault(&data, sizeof(data));
+    if (jack_activate(data.client)) {
+        fprintf(stderr, "[jack] can't activate client\n");
+        jack_client_close(data.client);
+        return -1;
+    }
+    printf("[jack] client %s, buffer %u frames, %u Hz\n",
+        jack_get_client_name(data.client), jack_get_buffer_size(data.client), rate);
+
+    // The round trip only changes with reblocking or a new loopback
+    // measurement, so polling it once a second is plenty.
+    while (!quit) {
+        sleep(1);
+        uint32_t latency = pwar_bridge_latency_frames(bridge);
+        if (latency != __atomic_load_n(&data.latency, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&data.latency, latency, __ATOMIC_RELAXED);
+            printf("[jack] reporting %u frames (%.3f ms) of latency\n", latency, latency * 1000.0 / PWAR_BRIDGE_RATE);
+            jack_recompute_total_latencies(data.client);
+        }
+    }
+
+    jack_deactivate(data.client);
+    jack_client_close(data.client);
+    return 0;
+}
+
+const struct pwar_backend pwar_backend_jack = {
+    .name = "jack",
+    .supports_driver = 0,
+    .parse_arg = jack_parse_arg,
+    .run = jack_run,
+};
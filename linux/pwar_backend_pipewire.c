@@ -0,0 +1,226 @@
+/*
+ * pwar_backend_pipewire.c - PipeWire filter backend for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/iter.h>
+#include <spa/control/control.h>
+#include <spa/param/latency-utils.h>
+#include <pipewire/pipewire.h>
+#include <pipewire/filter.h>
+#include "pwar_backend.h"
+
+struct port {
+    struct pipewire_data *data;
+};
+
+struct pipewire_data {
+    struct pwar_bridge *bridge;
+    struct pw_main_loop *loop;
+    struct pw_filter *filter;
+    struct port *in_port;
+    struct port *left_out_port;
+    struct port *right_out_port;
+    struct port *midi_in_port;
+    struct port *midi_out_port;
+};
+
+// Raw MIDI of the input port's sequence into midi, offsets are frames
+// into the cycle already
+static void read_midi(struct port *port, pwar_midi_block_t *midi) {
+    struct pw_buffer *b = pw_filter_dequeue_buffer(port);
+    if (!b)
+        return;
+    struct spa_data *d = &b->buffer->datas[0];
+    struct spa_pod *pod = d->data ? spa_pod_from_data(d->data, d->maxsize, d->chunk->offset, d->chunk->size) : NULL;
+    if (pod && spa_pod_is_sequence(pod)) {
+        struct spa_pod_control *c;
+        SPA_POD_SEQUENCE_FOREACH((struct spa_pod_sequence *)pod, c) {
+            if (c->type == SPA_CONTROL_Midi)
+                pwar_midi_add(midi, c->offset, SPA_POD_BODY(&c->value), SPA_POD_BODY_SIZE(&c->value));
+        }
+    }
+    pw_filter_queue_buffer(port, b);
+}
+
+// Every cycle gets a sequence, an empty one when nothing plays
+static void write_midi(struct port *port, const pwar_midi_block_t *midi) {
+    struct pw_buffer *b = pw_filter_dequeue_buffer(port);
+    if (!b)
+        return;
+    struct spa_data *d = &b->buffer->datas[0];
+    if (d->data) {
+        struct spa_pod_builder builder;
+        struct spa_pod_frame f;
+        spa_pod_builder_init(&builder, d->data, d->maxsize);
+        spa_pod_builder_push_sequence(&builder, &f, 0);
+        for (uint32_t i = 0; i < midi->count; ++i) {
+            spa_pod_builder_control(&builder, midi->events[i].offset, SPA_CONTROL_Midi);
+            spa_pod_builder_bytes(&builder, midi->events[i].data, midi->events[i].size);
+        }
+        spa_pod_builder_pop(&builder, &f);
+        d->chunk->offset = 0;
+        d->chunk->size = builder.state.offset;
+        d->chunk->stride = 1;
+    }
+    pw_filter_queue_buffer(port, b);
+}
+
+static void on_process(void *userdata, struct spa_io_position *position) {
+    struct pipewire_data *data = userdata;
+    struct pwar_bridge *bridge = data->bridge;
+    if (bridge->cfg.driver) {
+        // We own the graph clock; publish the DLL smoothed timing of the
+        // packet that woke this cycle.
+        struct pwar_driver_clock clk;
+        if (pwar_bridge_driver_begin(bridge, &clk)) {
+            struct spa_io_clock *clock = &position->clock;
+            clock->nsec = clk.nsec;
+            clock->next_nsec = clk.next_nsec;
+            clock->rate_diff = clk.rate_diff;
+            clock->rate.num = 1;
+            clock->rate.denom = PWAR_BRIDGE_RATE;
+            clock->position = clk.position;
+            clock->duration = clk.duration;
+            clock->delay = 0;
+        }
+    }
+    uint32_t n_samples = position->clock.duration;
+    float *in = pw_filter_get_dsp_buffer(data->in_port, n_samples);
+    float *left_out = pw_filter_get_dsp_buffer(data->left_out_port, n_samples);
+    float *right_out = pw_filter_get_dsp_buffer(data->right_out_port, n_samples);
+    float *out[PWAR_BRIDGE_OUT_CHANNELS] = { left_out, right_out };
+    read_midi(data->midi_in_port, &bridge->midi_in);
+    if (bridge->cfg.driver)
+        pwar_bridge_driver_process(bridge, in, out, n_samples);
+    else
+        pwar_bridge_process(bridge, in, out, n_samples);
+    write_midi(data->midi_out_port, &bridge->midi_out);
+}
+
+static const struct pw_filter_events filter_events = {
+    PW_VERSION_FILTER_EVENTS,
+    .process = on_process,
+};
+
+static void trigger_cycle(void *userdata) {
+    struct pipewire_data *data = userdata;
+    pw_filter_trigger_process(data->filter);
+}
+
+static void do_quit(void *userdata, int signal_number) {
+    struct pipewire_data *data = userdata;
+    pw_main_loop_quit(data->loop);
+}
+
+static int pipewire_run(struct pwar_bridge *bridge, int argc, char *argv[]) {
+    struct pipewire_data data = { .bridge = bridge };
+    char latency[32];
+    snprintf(latency, sizeof(latency), "%u/%d", bridge->cfg.quantum, PWAR_BRIDGE_RATE);
+    setenv("PIPEWIRE_LATENCY", latency, 1);
+    const struct spa_pod *params[1];
+    uint8_t buffer[1024];
+    struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+
+    pw_init(&argc, &argv);
+    data.loop = pw_main_loop_new(NULL);
+    pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGINT, do_quit, &data);
+    pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGTERM, do_quit, &data);
+    struct pw_properties *props = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio",
+        PW_KEY_MEDIA_CATEGORY, "Filter",
+        PW_KEY_MEDIA_ROLE, "DSP",
+        NULL);
+    if (bridge->cfg.driver) {
+        // Win against the sound cards so anything linked to us follows the peer
+        pw_properties_set(props, PW_KEY_PRIORITY_DRIVER, "30000");
+        printf("[driver] graph is clocked by packets from %s\n", bridge->cfg.stream_ip);
+    }
+    data.filter = pw_filter_new_simple(
+        pw_main_loop_get_loop(data.loop),
+        "pwar",
+        props,
+        &filter_events,
+        &data);
+    data.in_port = pw_filter_add_port(data.filter,
+        PW_DIRECTION_INPUT,
+        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+        sizeof(struct port),
+        pw_properties_new(
+            PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+            PW_KEY_PORT_NAME, "input",
+            NULL),
+        NULL, 0);
+    data.left_out_port = pw_filter_add_port(data.filter,
+        PW_DIRECTION_OUTPUT,
+        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+        sizeof(struct port),
+        pw_properties_new(
+            PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+            PW_KEY_PORT_NAME, "output-left",
+            NULL),
+        NULL, 0);
+    data.right_out_port = pw_filter_add_port(data.filter,
+        PW_DIRECTION_OUTPUT,
+        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+        sizeof(struct port),
+        pw_properties_new(
+            PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+            PW_KEY_PORT_NAME, "output-right",
+            NULL),
+        NULL, 0);
+    data.midi_in_port = pw_filter_add_port(data.filter,
+        PW_DIRECTION_INPUT,
+        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+        sizeof(struct port),
+        pw_properties_new(
+            PW_KEY_FORMAT_DSP, "8 bit raw midi",
+            PW_KEY_PORT_NAME, "midi-input",
+            NULL),
+        NULL, 0);
+    data.midi_out_port = pw_filter_add_port(data.filter,
+        PW_DIRECTION_OUTPUT,
+        PW_FILTER_PORT_FLAG_MAP_BUFFERS,
+        sizeof(struct port),
+        pw_properties_new(
+            PW_KEY_FORMAT_DSP, "8 bit raw midi",
+            PW_KEY_PORT_NAME, "midi-output",
+            NULL),
+        NULL, 0);
+    if (bridge->cfg.driver)
+        pwar_bridge_set_wake(bridge, trigger_cycle, &data);
+
+    // Threads are started once the PipeWire context exists so that the RT
+    // module can hand out rtkit priorities to unprivileged users.
+    pwar_bridge_start(bridge);
+
+    params[0] = spa_process_latency_build(&b,
+        SPA_PARAM_ProcessLatency,
+        &SPA_PROCESS_LATENCY_INFO_INIT(
+            .ns = 10 * SPA_NSEC_PER_MSEC
+        ));
+    if (pw_filter_connect(data.filter,
+            PW_FILTER_FLAG_RT_PROCESS | (bridge->cfg.driver ? PW_FILTER_FLAG_DRIVER : 0),
+            params, 1) < 0) {
+        fprintf(stderr, "can't connect\n");
+        return -1;
+    }
+    pw_main_loop_run(data.loop);
+    pwar_bridge_set_wake(bridge, NULL, NULL);
+    pw_filter_destroy(data.filter);
+    pw_main_loop_destroy(data.loop);
+    pw_deinit();
+    return 0;
+}
+
+const struct pwar_backend pwar_backend_pipewire = {
+    .name = "pipewire",
+    .supports_driver = 1,
+    .run = pipewire_run,
+};
@@ -0,0 +1,857 @@
+/*
+ * pwar_bench.c - Micro benchmarks for the PWAR real-time paths
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Each benchmark times its operation in batches and reports the mean and
+ * the slowest batch per operation against a budget. Exits non-zero when a
+ * benchmark is over budget, so it can gate a build. Cycles and cache misses
+ * per operation come from the hardware counters when perf_event_open()
+ * allows it, cycles from the TSC otherwise (x86 only, reference cycles).
+ * --json writes the results to FILE ("-" for stdout) for comparing one
+ * release against the next.
+ *
+ * The hot paths are measured the way they run in the bridge and the
+ * driver, with the sockets and the DAW left out: building a packet in
+ * stream_buffer, a reply through the reply ring, the output FIFO and the
+ * playout decisions, the ASIO buffer switch around the DAW's callback,
+ * the payload kernels, a stats window sample and a period handed to
+ * another thread and back through two FIFOs. The auth benchmarks seal and
+ * open a period of 2 channels (the bridge's replies) and of 32, so they
+ * show what a pre-shared key adds per packet on both ends together.
+ *
+ * Usage: pwar_bench [--json FILE] [name]
+ *        pwar_bench dtx CAPTURE [THRESHOLD_DB]
+ *        pwar_bench kernels
+ *        pwar_bench record DIR [CHANNELS] [SECONDS] [wav|w64]
+ *        pwar_bench pool [WORKERS] [CPUS]
+ *
+ * The dtx form replays the audio of a --capture-audio session through the
+ * DTX encoder and reports the bandwidth it saves and what detection costs.
+ * The kernels form times an encode and decode of every specialised payload
+ * shape against the generic kernel for the same shape. The record form
+ * pushes 128 frame periods of CHANNELS (default 64) into a recording tap
+ * in DIR as fast as the writer takes them and reports the sustained
+ * throughput, against what that many channels at 48 kHz need. The pool
+ * form times a cycle's encode, decode and metering of 8 to 128 channels
+ * with 0 (inline) up to WORKERS pool workers, pinned to CPUS when given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "pwar_auth.h"
+#include "pwar_capture.h"
+#include "pwar_catchup.h"
+#include "pwar_dtx.h"
+#include "pwar_kernels.h"
+#include "pwar_playout.h"
+#include "pwar_pool.h"
+#include "pwar_reblock.h"
+#include "pwar_record.h"
+#include "pwar_session.h"
+#include "pwar_stats.h"
+#include "pwar_timeline.h"
+#include "pwar_trace.h"
+
+#define BATCH 1000
+#define BATCHES 10000
+
+struct bench {
+    const char *name;
+    double budget_ns;                     // per operation
+    // setup and teardown may be NULL; run does n operations
+    void (*setup)(void);
+    void (*run)(uint32_t n);
+    void (*teardown)(void);
+    uint32_t batch;                       // operations per batch, 0 for BATCH
+};
+
+static struct pwar_trace trace;
+static struct pwar_trace_ring *ring;
+static volatile int dumper_running;
+static pthread_t dumper;
+static volatile uint64_t clock_sink;
+
+static void trace_setup(void) {
+    pwar_trace_init(&trace);
+    ring = pwar_trace_register(&trace, "bench");
+}
+
+static void trace_run(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i)
+        pwar_trace_point(ring, PWAR_TRACE_SEND, i);
+}
+
+static void *dumper_thread(void *arg) {
+    while (dumper_running) {
+        pwar_trace_dump(&trace, "/dev/null");
+        usleep(1000);
+    }
+    return NULL;
+}
+
+// Same as trace, with another thread dumping the ring all the time
+static void trace_dump_setup(void) {
+    trace_setup();
+    dumper_running = 1;
+    pthread_create(&dumper, NULL, dumper_thread, NULL);
+}
+
+static void trace_dump_teardown(void) {
+    dumper_running = 0;
+    pthread_join(dumper, NULL);
+}
+
+static void clock_run(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i)
+        clock_sink = pwar_trace_now();
+}
+
+// Worst case for detection: a silent period has to be scanned to the end
+static float dtx_period[RT_STREAM_PACKET_FRAME_SIZE / 2];
+static volatile int dtx_sink;
+
+static void dtx_run(uint32_t n) {
+    float threshold = pwar_dtx_level(PWAR_DTX_DEFAULT_THRESHOLD_DB);
+    for (uint32_t i = 0; i < n; ++i)
+        dtx_sink = pwar_dtx_is_silent(dtx_period, RT_STREAM_PACKET_FRAME_SIZE / 2, threshold);
+}
+
+// One packet each way at the usual ASIO shape
+#define KERNEL_MAX_CHANNELS 32
+#define KERNEL_MAX_FRAMES 256
+static float kernel_planar[KERNEL_MAX_CHANNELS][KERNEL_MAX_FRAMES];
+static float kernel_payload[KERNEL_MAX_CHANNELS * KERNEL_MAX_FRAMES];
+static float *kernel_ptrs[KERNEL_MAX_CHANNELS];
+static pwar_kernel_t kernel;
+
+static void kernel_setup(void) {
+    for (int c = 0; c < KERNEL_MAX_CHANNELS; ++c)
+        kernel_ptrs[c] = kernel_planar[c];
+    pwar_kernel_select(&kernel, 2, 128, RT_STREAM_PACKET_FRAME_SIZE / 2, PWAR_FORMAT_F32);
+}
+
+static void kernel_run(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        kernel.encode(&kernel, (const float *const *)kernel_ptrs, kernel_payload);
+        kernel.decode(&kernel, kernel_payload, kernel_ptrs);
+    }
+}
+
+static pwar_kernel_t kernel_s16;
+static int16_t kernel_s16_payload[KERNEL_MAX_CHANNELS * KERNEL_MAX_FRAMES];
+
+static void kernel_s16_setup(void) {
+    kernel_setup();
+    pwar_kernel_select(&kernel_s16, 2, 128, 0, PWAR_FORMAT_S16);
+}
+
+static void kernel_s16_run(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        kernel_s16.encode(&kernel_s16, (const float *const *)kernel_ptrs, kernel_s16_payload);
+        kernel_s16.decode(&kernel_s16, kernel_s16_payload, kernel_ptrs);
+    }
+}
+
+// A period of the usual ASIO shape, with something in it
+#define PERIOD 128
+
+static float period_sine[PWAR_FIFO_MAX_CHANNELS][PERIOD];
+
+static void period_fill(void) {
+    for (int c = 0; c < PWAR_FIFO_MAX_CHANNELS; ++c) {
+        for (int i = 0; i < PERIOD; ++i)
+            period_sine[c][i] = 0.5f * sinf((float)(i + c) * 0.1f);
+    }
+}
+
+// stream_buffer() up to the send: seq, stamp, copy and with DTX the encode
+static rt_stream_packet_t build_packet;
+static uint64_t build_seq;
+static uint8_t build_wire[PWAR_DTX_MAX_PACKET];
+static volatile size_t build_len;
+
+static void build(uint32_t n, int dtx, enum pwar_sample_format format) {
+    float threshold = pwar_dtx_level(PWAR_DTX_DEFAULT_THRESHOLD_DB);
+    for (uint32_t i = 0; i < n; ++i) {
+        build_packet.seq = build_seq;
+        build_seq = pwar_session_next(build_seq);
+        build_packet.session = 1;
+        build_packet.n_samples = PERIOD;
+        memcpy(build_packet.samples_ch1, period_sine[0], PERIOD * sizeof(float));
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        build_packet.ts_pipewire_send = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        size_t len = sizeof(build_packet);
+        if (dtx) {
+            uint32_t silent;
+            build_packet.ts_asio_recv = build_packet.ts_asio_send = 0;
+            len = pwar_dtx_encode_format(&build_packet, 1, threshold, format, build_wire, &silent);
+        }
+        build_len = len;
+    }
+}
+
+static void build_run(uint32_t n) {
+    build(n, 0, PWAR_FORMAT_F32);
+}
+
+static void build_dtx_run(uint32_t n) {
+    build(n, 1, PWAR_FORMAT_F32);
+}
+
+// What --adapt packs smaller
+static void build_s24_run(uint32_t n) {
+    build(n, 1, PWAR_FORMAT_S24);
+}
+
+static void build_s16_run(uint32_t n) {
+    build(n, 1, PWAR_FORMAT_S16);
+}
+
+// One reply from the receiver to the graph: the copy into the reply ring
+// (push_reply), into the output FIFO (take_reply), the catch-up and playout
+// decisions and the graph's read of the period
+#define JITTER_SLOTS 16
+
+static rt_stream_packet_t jitter_arrived;
+static rt_stream_packet_t jitter_slots[JITTER_SLOTS];
+static struct pwar_fifo jitter_out;
+static struct pwar_playout jitter_playout;
+static pwar_catchup_t jitter_catchup;
+static float jitter_graph[PWAR_FIFO_MAX_CHANNELS][PERIOD];
+static uint64_t jitter_seq;
+
+static void jitter_setup(void) {
+    period_fill();
+    jitter_arrived.n_samples = PERIOD;
+    memcpy(jitter_arrived.samples_ch1, period_sine[0], PERIOD * sizeof(float));
+    memcpy(jitter_arrived.samples_ch2, period_sine[1], PERIOD * sizeof(float));
+    pwar_fifo_reset(&jitter_out, PWAR_FIFO_MAX_CHANNELS);
+    pwar_playout_init(&jitter_playout, PWAR_PLAYOUT_DEFAULT_WAIT_NS);
+    pwar_catchup_init(&jitter_catchup, PWAR_CATCHUP_NEWEST, 1);
+}
+
+static void jitter_run(uint32_t n) {
+    float *graph[PWAR_FIFO_MAX_CHANNELS] = { jitter_graph[0], jitter_graph[1] };
+    for (uint32_t i = 0; i < n; ++i, ++jitter_seq) {
+        rt_stream_packet_t *slot = &jitter_slots[jitter_seq % JITTER_SLOTS];
+        jitter_arrived.seq = jitter_seq;
+        *slot = jitter_arrived;
+        const float *reply[PWAR_FIFO_MAX_CHANNELS] = { slot->samples_ch1, slot->samples_ch2 };
+        pwar_fifo_write(&jitter_out, reply, PERIOD);
+        pwar_catchup_update(&jitter_catchup, pwar_fifo_fill(&jitter_out) - PERIOD, PERIOD, jitter_seq);
+        pwar_playout_decide(&jitter_playout, jitter_seq, 1, slot->seq);
+        pwar_fifo_read(&jitter_out, graph, PERIOD);
+    }
+}
+
+// switchBuffersFromPwarPacket() without the DAW: the input copy into the
+// half being switched, the timeline stamp and the reply's encode
+static pwar_kernel_t switch_in, switch_out;
+static pwar_timeline_t switch_timeline;
+static rt_stream_packet_t switch_packet, switch_reply;
+static float switch_inputs[1][2 * PERIOD];
+static float switch_outputs[2][2 * PERIOD];
+static uint64_t switch_seq;
+
+static void switch_setup(void) {
+    period_fill();
+    pwar_kernel_select(&switch_in, 1, PERIOD, 0, PWAR_FORMAT_F32);
+    pwar_kernel_select(&switch_out, 2, PERIOD, RT_STREAM_PACKET_FRAME_SIZE / 2, PWAR_FORMAT_F32);
+    pwar_timeline_init(&switch_timeline, PWAR_DLL_DEFAULT_BANDWIDTH);
+    switch_packet.n_samples = PERIOD;
+    memcpy(switch_packet.samples_ch1, period_sine[0], PERIOD * sizeof(float));
+    for (int c = 0; c < 2; ++c) {
+        memcpy(switch_outputs[c], period_sine[c], PERIOD * sizeof(float));
+        memcpy(switch_outputs[c] + PERIOD, period_sine[c], PERIOD * sizeof(float));
+    }
+}
+
+static void switch_run(uint32_t n) {
+    const uint64_t period_ns = PERIOD * 1000000000ull / 48000;
+    for (uint32_t i = 0; i < n; ++i, ++switch_seq) {
+        const uint32_t half = (switch_seq & 1) ? PERIOD : 0;
+        switch_packet.seq = switch_seq;
+        switch_packet.ts_pipewire_send = switch_seq * period_ns;
+        const float *sources[1] = { switch_packet.samples_ch1 };
+        float *inputs[1] = { switch_inputs[0] + half };
+        switch_in.copy(&switch_in, sources, inputs);
+        pwar_timeline_update(&switch_timeline, switch_packet.seq, switch_packet.ts_pipewire_send,
+                             switch_packet.ts_pipewire_send + 500000, PERIOD, 48000);
+        const float *outputs[2] = { switch_outputs[0] + half, switch_outputs[1] + half };
+        switch_reply.n_samples = PERIOD;
+        switch_out.encode(&switch_out, outputs, switch_reply.samples_ch1);
+        switch_reply.seq = switch_packet.seq;
+        switch_reply.ts_pipewire_send = switch_packet.ts_pipewire_send;
+        switch_reply.ts_asio_recv = switch_timeline.system_ns;
+    }
+}
+
+// A sample into a stats window, as every cycle adds several
+static struct pwar_stat stat_window;
+
+static void stats_setup(void) {
+    pwar_stat_reset(&stat_window);
+}
+
+static void stats_run(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i)
+        pwar_stat_add(&stat_window, (double)(i & 1023) * 0.01);
+}
+
+// A stereo period through a FIFO to another thread and back through a
+// second one, like a reply from the receiver thread to the audio thread.
+// One operation is the round trip. With a single CPU both sides yield
+// instead of spinning, and it is two context switches.
+static struct pwar_fifo handoff_to, handoff_back;
+static float handoff_far[PWAR_FIFO_MAX_CHANNELS][PERIOD];
+static float handoff_near[PWAR_FIFO_MAX_CHANNELS][PERIOD];
+static volatile int handoff_running;
+static int handoff_yield;
+static pthread_t handoff_thread;
+
+static void handoff_relax(void) {
+    if (handoff_yield)
+        sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+    else
+        __builtin_ia32_pause();
+#endif
+}
+
+static int handoff_wait(const struct pwar_fifo *f) {
+    while (pwar_fifo_fill(f) < PERIOD) {
+        if (!handoff_running)
+            return 0;
+        handoff_relax();
+    }
+    return 1;
+}
+
+static void *handoff_echo(void *arg) {
+    float *far[PWAR_FIFO_MAX_CHANNELS] = { handoff_far[0], handoff_far[1] };
+    (void)arg;
+    while (handoff_wait(&handoff_to)) {
+        pwar_fifo_read(&handoff_to, far, PERIOD);
+        pwar_fifo_write(&handoff_back, (const float *const *)far, PERIOD);
+    }
+    return NULL;
+}
+
+static void handoff_setup(void) {
+    period_fill();
+    pwar_fifo_reset(&handoff_to, PWAR_FIFO_MAX_CHANNELS);
+    pwar_fifo_reset(&handoff_back, PWAR_FIFO_MAX_CHANNELS);
+    handoff_yield = sysconf(_SC_NPROCESSORS_ONLN) < 2;
+    handoff_running = 1;
+    pthread_create(&handoff_thread, NULL, handoff_echo, NULL);
+}
+
+static void handoff_run(uint32_t n) {
+    const float *period[PWAR_FIFO_MAX_CHANNELS] = { period_sine[0], period_sine[1] };
+    float *near[PWAR_FIFO_MAX_CHANNELS] = { handoff_near[0], handoff_near[1] };
+    for (uint32_t i = 0; i < n; ++i) {
+        pwar_fifo_write(&handoff_to, period, PERIOD);
+        handoff_wait(&handoff_back);
+        pwar_fifo_read(&handoff_back, near, PERIOD);
+    }
+}
+
+static void handoff_teardown(void) {
+    handoff_running = 0;
+    pthread_join(handoff_thread, NULL);
+}
+
+// Sealed by one side, opened by the other, a 128 frame period of float
+// channels behind a packet header
+#define AUTH_MAX_CHANNELS 32
+
+static pwar_auth_t auth_tx, auth_rx;
+static uint8_t auth_datagram[sizeof(rt_stream_packet_t) + AUTH_MAX_CHANNELS * PERIOD * sizeof(float) + PWAR_AUTH_OVERHEAD];
+static size_t auth_len;
+static volatile int auth_sink;
+
+static void auth_setup(enum pwar_auth_mode mode, uint32_t channels) {
+    uint8_t key[PWAR_AUTH_KEY_SIZE];
+    for (int i = 0; i < PWAR_AUTH_KEY_SIZE; ++i)
+        key[i] = (uint8_t)(i * 7 + 1);
+    pwar_auth_init(&auth_tx, mode, key, 1);
+    pwar_auth_init(&auth_rx, mode, key, 2);
+    auth_len = channels <= 2 ? sizeof(rt_stream_packet_t) : 64 + channels * PERIOD * sizeof(float);
+    for (size_t i = 0; i < auth_len; ++i)
+        auth_datagram[i] = (uint8_t)i;
+}
+
+static void auth_sign_2_setup(void) {
+    auth_setup(PWAR_AUTH_SIGN, 2);
+}
+
+static void auth_encrypt_2_setup(void) {
+    auth_setup(PWAR_AUTH_ENCRYPT, 2);
+}
+
+static void auth_sign_32_setup(void) {
+    auth_setup(PWAR_AUTH_SIGN, 32);
+}
+
+static void auth_encrypt_32_setup(void) {
+    auth_setup(PWAR_AUTH_ENCRYPT, 32);
+}
+
+static void auth_run(uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) {
+        size_t len = pwar_auth_seal(&auth_tx, auth_datagram, auth_len);
+        auth_sink = pwar_auth_open(&auth_rx, auth_datagram, len, 0);
+    }
+}
+
+static const struct bench benches[] = {
+    { "clock", 100.0, NULL, clock_run, NULL },
+    { "trace", 100.0, trace_setup, trace_run, NULL },
+    { "trace-dump", 100.0, trace_dump_setup, trace_run, trace_dump_teardown },
+    { "dtx-detect", 100.0, NULL, dtx_run, NULL },
+    { "kernel-2x128", 100.0, kernel_setup, kernel_run, NULL },
+    { "kernel-s16-2x128", 500.0, kernel_s16_setup, kernel_s16_run, NULL },
+    { "packet-build", 200.0, period_fill, build_run, NULL },
+    { "packet-build-dtx", 300.0, period_fill, build_dtx_run, NULL },
+    { "packet-build-s24", 500.0, period_fill, build_s24_run, NULL },
+    { "packet-build-s16", 500.0, period_fill, build_s16_run, NULL },
+    { "jitter-period", 500.0, jitter_setup, jitter_run, NULL },
+    { "asio-switch", 300.0, switch_setup, switch_run, NULL },
+    { "stats", 20.0, stats_setup, stats_run, NULL },
+    { "handoff-rtt", 5000.0, handoff_setup, handoff_run, handoff_teardown },
+    { "auth-sign-2ch", 5000.0, auth_sign_2_setup, auth_run, NULL, 10 },
+    { "auth-encrypt-2ch", 10000.0, auth_encrypt_2_setup, auth_run, NULL, 10 },
+    { "auth-sign-32ch", 50000.0, auth_sign_32_setup, auth_run, NULL, 1 },
+    { "auth-encrypt-32ch", 150000.0, auth_encrypt_32_setup, auth_run, NULL, 1 },
+};
+
+struct result {
+    const char *name;
+    double mean_ns, worst_ns, budget_ns;
+    double cycles, misses;                // per operation, negative when not counted
+    uint32_t batch;
+    int ok;
+};
+
+// Hardware counters of the calling thread, -1 when the kernel or the
+// machine has none for us (perf_event_paranoid, most VMs)
+static int cycles_fd = -1, misses_fd = -1;
+static const char *cycles_source;
+
+static int perf_open(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void counters_open(void) {
+    cycles_fd = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (cycles_fd >= 0) {
+        misses_fd = perf_open(PERF_COUNT_HW_CACHE_MISSES, cycles_fd);
+        cycles_source = "perf";
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    cycles_source = "tsc";
+#endif
+}
+
+static uint64_t tsc_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void counters_start(uint64_t *tsc) {
+    if (cycles_fd >= 0) {
+        ioctl(cycles_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(cycles_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    *tsc = tsc_now();
+}
+
+// Cycles and misses since counters_start(), -1 when not counted
+static void counters_stop(uint64_t tsc, double *cycles, double *misses) {
+    uint64_t end = tsc_now();
+    *cycles = *misses = -1;
+    if (cycles_fd < 0) {
+        if (cycles_source)
+            *cycles = (double)(end - tsc);
+        return;
+    }
+    ioctl(cycles_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t values[3] = { 0 };           // nr, then one value per counter
+    if (read(cycles_fd, values, sizeof(values)) < (ssize_t)(2 * sizeof(uint64_t)))
+        return;
+    *cycles = (double)values[1];
+    if (values[0] > 1)
+        *misses = (double)values[2];
+}
+
+// Mean ns of one encode plus decode through k
+static double time_kernel(const pwar_kernel_t *k) {
+    const int rounds = 20000;
+    for (int i = 0; i < 1000; ++i) {
+        k->encode(k, (const float *const *)kernel_ptrs, kernel_payload);
+        k->decode(k, kernel_payload, kernel_ptrs);
+    }
+    uint64_t t0 = pwar_trace_now();
+    for (int i = 0; i < rounds; ++i) {
+        k->encode(k, (const float *const *)kernel_ptrs, kernel_payload);
+        k->decode(k, kernel_payload, kernel_ptrs);
+    }
+    return (double)(pwar_trace_now() - t0) / rounds;
+}
+
+static int kernel_shapes(void) {
+    static const uint32_t channels[] = { 1, 2, 8, 16, 32 };
+    static const uint32_t frames[] = { 32, 64, 128, 256 };
+    kernel_setup();
+    printf("%-6s %8s %6s %14s %12s %8s\n", "format", "channels", "frames", "specialised ns", "generic ns", "speedup");
+    for (int f = 0; f < PWAR_FORMAT_COUNT; ++f) {
+        for (size_t c = 0; c < sizeof(channels) / sizeof(channels[0]); ++c) {
+            for (size_t n = 0; n < sizeof(frames) / sizeof(frames[0]); ++n) {
+                pwar_kernel_t spec, gen;
+                pwar_kernel_select(&spec, channels[c], frames[n], 0, (enum pwar_sample_format)f);
+                pwar_kernel_generic(&gen, channels[c], frames[n], 0, (enum pwar_sample_format)f);
+                double s = time_kernel(&spec), g = time_kernel(&gen);
+                printf("%-6s %8u %6u %14.1f %12.1f %7.2fx\n", pwar_kernel_format_name((enum pwar_sample_format)f), channels[c], frames[n], s, g, g / s);
+            }
+        }
+    }
+    return 0;
+}
+
+static int dtx_capture(const char *path, double threshold_db) {
+    struct pwar_capture cap;
+    int rc = pwar_capture_open(&cap, path);
+    if (rc < 0) {
+        fprintf(stderr, "can't open capture %s: %s\n", path, strerror(-rc));
+        return 2;
+    }
+    if (!(cap.header->flags & PWAR_CAPTURE_FLAG_AUDIO)) {
+        fprintf(stderr, "%s has no audio, record it with --capture-audio\n", path);
+        pwar_capture_close(&cap);
+        return 2;
+    }
+
+    float threshold = pwar_dtx_level(threshold_db);
+    uint8_t buf[PWAR_DTX_MAX_PACKET];
+    uint64_t first, end;
+    pwar_capture_range(&cap, &first, &end);
+    // Index 0 is what we send (one channel), 1 what comes back (two)
+    uint64_t packets[2] = { 0 }, bytes[2] = { 0 }, channels[2] = { 0 }, silent[2] = { 0 };
+    uint64_t detect_ns = 0;
+    for (uint64_t i = first; i < end; ++i) {
+        const struct pwar_capture_record *rec = pwar_capture_get(&cap, i);
+        if (!rec || (rec->type != PWAR_CAPTURE_SENT && rec->type != PWAR_CAPTURE_RECEIVED))
+            continue;
+        int dir = rec->type == PWAR_CAPTURE_RECEIVED;
+        uint32_t n_channels = dir ? 2 : 1;
+        const float *audio = pwar_capture_audio(&cap, rec);
+        rt_stream_packet_t pkt;
+        memset(&pkt, 0, sizeof(pkt));
+        pkt.n_samples = rec->n_samples;
+        pkt.seq = rec->seq;
+        memcpy(pkt.samples_ch1, audio, sizeof(pkt.samples_ch1));
+        memcpy(pkt.samples_ch2, audio + RT_STREAM_PACKET_FRAME_SIZE / 2, sizeof(pkt.samples_ch2));
+
+        uint32_t left_out;
+        uint64_t t0 = pwar_trace_now();
+        size_t len = pwar_dtx_encode(&pkt, n_channels, threshold, buf, &left_out);
+        detect_ns += pwar_trace_now() - t0;
+        packets[dir]++;
+        bytes[dir] += len;
+        channels[dir] += n_channels;
+        silent[dir] += left_out;
+    }
+    pwar_capture_close(&cap);
+
+    static const char *const names[2] = { "sent", "received" };
+    uint64_t total_full = 0, total_dtx = 0;
+    printf("DTX on %s at %.1f dBFS\n", path, threshold_db);
+    for (int dir = 0; dir < 2; ++dir) {
+        uint64_t full = packets[dir] * sizeof(rt_stream_packet_t);
+        total_full += full;
+        total_dtx += bytes[dir];
+        printf("%-9s %10lu packets  %5.1f%% channels silent  %12lu -> %12lu bytes (%.1f%%)\n",
+            names[dir], packets[dir], channels[dir] ? silent[dir] * 100.0 / channels[dir] : 0.0,
+            full, bytes[dir], full ? bytes[dir] * 100.0 / full : 0.0);
+    }
+    uint64_t n = packets[0] + packets[1];
+    printf("total     %.1f%% of full size, encode (detect and copy) %.1f ns per packet\n",
+        total_full ? total_dtx * 100.0 / total_full : 0.0, n ? (double)detect_ns / n : 0.0);
+    return 0;
+}
+
+static int record_throughput(const char *dir, uint32_t channels, uint32_t seconds, enum pwar_record_format format) {
+    static struct pwar_record rec;
+    static float period[PWAR_RECORD_MAX_CHANNELS][KERNEL_MAX_FRAMES / 2];
+    const float *ptrs[PWAR_RECORD_MAX_CHANNELS];
+    const uint32_t frames = KERNEL_MAX_FRAMES / 2;
+    char prefix[256];
+    snprintf(prefix, sizeof(prefix), "%s/pwar-bench", dir);
+    for (uint32_t c = 0; c < PWAR_RECORD_MAX_CHANNELS; ++c) {
+        for (uint32_t i = 0; i < frames; ++i)
+            period[c][i] = (float)((c * frames + i) % 1000) / 1000.0f;
+        ptrs[c] = period[c];
+    }
+    int rc = pwar_record_start(&rec, prefix, "bench", format, channels, 48000, 0);
+    if (rc < 0) {
+        fprintf(stderr, "can't record to %s: %s\n", prefix, strerror(-rc));
+        return 2;
+    }
+    // The writer sets the pace: a full ring is waited out here. What was
+    // left out meanwhile is written as silence, which counts the same.
+    uint64_t pushes = 0, full = 0, push_ns = 0, worst_ns = 0;
+    uint64_t t0 = pwar_trace_now(), end = t0 + (uint64_t)seconds * 1000000000;
+    while (pwar_trace_now() < end) {
+        uint64_t p0 = pwar_trace_now();
+        int ok = pwar_record_push(&rec, ptrs, frames) == 0;
+        uint64_t ns = pwar_trace_now() - p0;
+        if (!ok) {
+            full++;
+            usleep(100);
+            continue;
+        }
+        pushes++;
+        push_ns += ns;
+        if (ns > worst_ns)
+            worst_ns = ns;
+    }
+    pwar_record_stop(&rec);
+    double secs = (pwar_trace_now() - t0) / 1e9;
+    double bytes = (double)__atomic_load_n(&rec.bytes_written, __ATOMIC_RELAXED);
+    double need = 48000.0 * channels * sizeof(float);
+    printf("record %s, %u channels, %s: %.1f MB/s sustained, %.1fx what 48 kHz needs (%.1f MB/s)\n",
+        pwar_record_format_name(format), channels, rec.direct ? "O_DIRECT" : "buffered, O_DIRECT refused",
+        bytes / secs / 1e6, bytes / secs / need, need / 1e6);
+    printf("push of %u frames: mean %.1f ns, worst %.1f ns | ring full %lu times | %s\n", frames,
+        pushes ? (double)push_ns / pushes : 0.0, (double)worst_ns, full,
+        rec.error ? strerror(rec.error) : "no write errors");
+    char path[320];
+    for (uint32_t i = 1; i <= rec.file_index; ++i) {
+        snprintf(path, sizeof(path), "%s-bench-%03u.%s", prefix, i, pwar_record_format_name(format));
+        unlink(path);
+    }
+    return rec.error ? 1 : 0;
+}
+
+#define POOL_MAX_CHANNELS 128
+#define POOL_FRAMES 64
+#define POOL_CYCLES 20000
+
+// Mean and worst ns of one cycle: encode, decode, both metered
+static void time_pool(struct pwar_pool *pool, uint32_t channels, double *mean, double *worst) {
+    static float planar[POOL_MAX_CHANNELS][POOL_FRAMES];
+    static float payload[POOL_MAX_CHANNELS * POOL_FRAMES];
+    static float peak[POOL_MAX_CHANNELS];
+    float *ptrs[POOL_MAX_CHANNELS];
+    for (uint32_t c = 0; c < POOL_MAX_CHANNELS; ++c) {
+        for (uint32_t i = 0; i < POOL_FRAMES; ++i)
+            planar[c][i] = (float)((c + i) % 64) / 64.0f - 0.5f;
+        ptrs[c] = planar[c];
+    }
+    struct pwar_pool_kernel pk;
+    pwar_pool_kernel_select(&pk, pool, channels, POOL_FRAMES, 0, PWAR_FORMAT_F32);
+    double sum = 0;
+    *worst = 0;
+    for (int i = -1000; i < POOL_CYCLES; ++i) {
+        uint64_t t0 = pwar_trace_now();
+        pwar_pool_encode(&pk, (const float *const *)ptrs, payload, peak);
+        pwar_pool_decode(&pk, payload, ptrs, peak);
+        double ns = (double)(pwar_trace_now() - t0);
+        if (i < 0)
+            continue;                     // warm up
+        sum += ns;
+        if (ns > *worst)
+            *worst = ns;
+    }
+    *mean = sum / POOL_CYCLES;
+}
+
+static int pool_scaling(uint32_t max_workers, const char *cpus) {
+    static const uint32_t channels[] = { 8, 16, 32, 64, 128 };
+    struct pwar_rt_thread_config rt = { .policy = PWAR_RT_POLICY_INHERIT };
+    if (cpus) {
+        CPU_ZERO(&rt.cpus);
+        for (const char *p = cpus; *p;) {
+            char *end;
+            long a = strtol(p, &end, 10), b = a;
+            if (*end == '-')
+                b = strtol(end + 1, &end, 10);
+            for (long c = a; c <= b && c < CPU_SETSIZE; ++c)
+                CPU_SET(c, &rt.cpus);
+            p = *end == ',' ? end + 1 : end;
+            if (end == p && *p)
+                break;
+        }
+        rt.has_cpus = 1;
+    }
+    // Workers of 0 is the inline path every pool falls back to
+    struct pwar_pool probe;
+    int online = pwar_pool_init(&probe, max_workers, 1, NULL);
+    pwar_pool_destroy(&probe);
+    if (online < 0)
+        return 2;
+    if ((uint32_t)online < max_workers)
+        printf("only %d workers, one less than the online CPUs\n", online);
+    printf("cycle of %u frames (encode + decode, metered), mean / worst us\n%8s", POOL_FRAMES, "channels");
+    for (int w = 0; w <= online; ++w)
+        printf("   %2d workers    ", w);
+    printf("\n");
+    for (size_t c = 0; c < sizeof(channels) / sizeof(channels[0]); ++c) {
+        printf("%8u", channels[c]);
+        for (int w = 0; w <= online; ++w) {
+            struct pwar_pool pool;
+            double mean, worst;
+            pwar_pool_init(&pool, (uint32_t)w, 1, cpus ? &rt : NULL);
+            time_pool(&pool, channels[c], &mean, &worst);
+            pwar_pool_destroy(&pool);
+            printf("  %6.2f / %6.1f", mean / 1000.0, worst / 1000.0);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+static void run_bench(const struct bench *b, struct result *r, FILE *out) {
+    const uint32_t batch = b->batch ? b->batch : BATCH;
+    if (b->setup)
+        b->setup();
+    b->run(batch * 10);                   // warm up caches and the ring
+    double sum = 0, worst = 0, cycles, misses;
+    uint64_t tsc;
+    counters_start(&tsc);
+    for (int i = 0; i < BATCHES; ++i) {
+        uint64_t t0 = pwar_trace_now();
+        b->run(batch);
+        double ns = (double)(pwar_trace_now() - t0) / batch;
+        sum += ns;
+        if (ns > worst)
+            worst = ns;
+    }
+    counters_stop(tsc, &cycles, &misses);
+    if (b->teardown)
+        b->teardown();
+    const double ops = (double)batch * BATCHES;
+    r->name = b->name;
+    r->batch = batch;
+    r->mean_ns = sum / BATCHES;
+    r->worst_ns = worst;
+    r->budget_ns = b->budget_ns;
+    r->cycles = cycles < 0 ? -1 : cycles / ops;
+    r->misses = misses < 0 ? -1 : misses / ops;
+    r->ok = r->mean_ns <= b->budget_ns;
+
+    char cyc[16] = "-", miss[16] = "-";
+    if (r->cycles >= 0)
+        snprintf(cyc, sizeof(cyc), "%.1f", r->cycles);
+    if (r->misses >= 0)
+        snprintf(miss, sizeof(miss), "%.3f", r->misses);
+    fprintf(out, "%-16s mean %8.1f ns %9s cyc %7s miss  worst batch %8.1f ns  budget %6.1f ns  %s\n",
+        b->name, r->mean_ns, cyc, miss, worst, b->budget_ns, r->ok ? "ok" : "OVER BUDGET");
+}
+
+static void json_number(FILE *f, const char *key, double v) {
+    if (v < 0)
+        fprintf(f, "\"%s\": null", key);
+    else
+        fprintf(f, "\"%s\": %.3f", key, v);
+}
+
+static int write_json(const char *path, const struct result *results, int n) {
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "{\n  \"batches\": %d,\n  \"cpus\": %ld,\n", BATCHES, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(f, "  \"cycles_source\": ");
+    fprintf(f, cycles_source ? "\"%s\",\n" : "null,\n", cycles_source);
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (int i = 0; i < n; ++i) {
+        const struct result *r = &results[i];
+        fprintf(f, "    { \"name\": \"%s\", \"batch\": %u, ", r->name, r->batch);
+        json_number(f, "ns_per_op", r->mean_ns);
+        fprintf(f, ", ");
+        json_number(f, "worst_batch_ns", r->worst_ns);
+        fprintf(f, ", ");
+        json_number(f, "cycles_per_op", r->cycles);
+        fprintf(f, ", ");
+        json_number(f, "cache_misses_per_op", r->misses);
+        fprintf(f, ", ");
+        json_number(f, "budget_ns", r->budget_ns);
+        fprintf(f, ", \"ok\": %s }%s\n", r->ok ? "true" : "false", i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f != stdout)
+        fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *json = NULL;
+    if (argc > 2 && strcmp(argv[1], "--json") == 0) {
+        json = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    const char *only = argc > 1 ? argv[1] : NULL;
+    if (only && strcmp(only, "dtx") == 0 && argc > 2)
+        return dtx_capture(argv[2], argc > 3 ? strtod(argv[3], NULL) : PWAR_DTX_DEFAULT_THRESHOLD_DB);
+    if (only && strcmp(only, "kernels") == 0)
+        return kernel_shapes();
+    if (only && strcmp(only, "pool") == 0)
+        return pool_scaling(argc > 2 ? strtoul(argv[2], NULL, 10) : PWAR_POOL_MAX_WORKERS, argc > 3 ? argv[3] : NULL);
+    if (only && strcmp(only, "record") == 0 && argc > 2) {
+        enum pwar_record_format format = PWAR_RECORD_W64;
+        if (argc > 5 && pwar_record_parse_format(argv[5], &format) < 0)
+            return 2;
+        return record_throughput(argv[2], argc > 3 ? strtoul(argv[3], NULL, 10) : 64,
+                                 argc > 4 ? strtoul(argv[4], NULL, 10) : 10, format);
+    }
+    // JSON on stdout moves the table to stderr
+    FILE *out = json && strcmp(json, "-") == 0 ? stderr : stdout;
+    struct result results[sizeof(benches) / sizeof(benches[0])];
+    int failed = 0, ran = 0;
+    counters_open();
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        if (only && strcmp(only, benches[i].name) != 0)
+            continue;
+        run_bench(&benches[i], &results[ran], out);
+        if (!results[ran++].ok)
+            failed++;
+    }
+    if (!ran) {
+        fprintf(stderr, "unknown benchmark %s\n", only);
+        return 2;
+    }
+    if (json && write_json(json, results, ran) < 0)
+        return 2;
+    return failed ? 1 : 0;
+}
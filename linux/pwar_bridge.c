@@ -0,0 +1,1521 @@
+/*
+ * pwar_bridge.c - Network core of the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "pwar_bridge.h"
+#include "pwar_rtcheck.h"
+
+#define STATS_INTERVAL_NS (2 * 1000000000ULL)
+#define MAX_NET_PERIOD PWAR_BRIDGE_MAX_NET_PERIOD
+
+static volatile sig_atomic_t trace_requested;
+
+static void setup_recv_socket(struct pwar_bridge *bridge, int port);
+static void *receiver_thread(void *userdata);
+static void *stats_thread(void *userdata);
+
+static void setup_socket(struct pwar_bridge *bridge, const char *ip, int port);
+
+static void stream_buffer(const float *samples, uint32_t n_samples, void *userdata);
+
+void pwar_bridge_config_defaults(struct pwar_bridge_config *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    strcpy(cfg->stream_ip, PWAR_BRIDGE_DEFAULT_IP);
+    cfg->stream_port = PWAR_BRIDGE_DEFAULT_PORT;
+    cfg->local_port = -1;
+    cfg->mcast_ttl = PWAR_BRIDGE_DEFAULT_MCAST_TTL;
+    cfg->mcast_loop = 1;
+    cfg->quantum = PWAR_BRIDGE_DEFAULT_QUANTUM;
+    cfg->test_signal = PWAR_TEST_NONE;
+    cfg->test_freq = 440.0f;
+    cfg->test_interval_ms = 1000;
+    cfg->ts_mode = PWAR_TSTAMP_SOFTWARE;
+    cfg->wait_ns = PWAR_PLAYOUT_DEFAULT_WAIT_NS;
+    cfg->catchup = PWAR_CATCHUP_NEWEST;
+    cfg->catchup_target = 1;
+    cfg->capture_records = PWAR_CAPTURE_DEFAULT_RECORDS;
+    cfg->dtx_threshold_db = PWAR_DTX_DEFAULT_THRESHOLD_DB;
+    cfg->dscp = PWAR_QOS_UNSET;
+    cfg->so_priority = PWAR_QOS_UNSET;
+    cfg->txtime = PWAR_TXTIME_OFF;
+    cfg->txtime_delay_ns = PWAR_TXTIME_DEFAULT_DELAY_NS;
+    pwar_rt_config_defaults(&cfg->rt);
+}
+
+static int rt_thread_from_name(const char *name) {
+    for (int i = 0; i < PWAR_RT_THREAD_COUNT; ++i) {
+        if (strcmp(name, pwar_rt_thread_name(i)) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int pwar_bridge_parse_arg(struct pwar_bridge_config *cfg, int argc, char *argv[], int i) {
+    const char *arg = argv[i];
+    const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(arg, "--ip") == 0 || strcmp(arg, "-i") == 0) {
+        if (!val)
+            return 0;
+        strncpy(cfg->stream_ip, val, sizeof(cfg->stream_ip) - 1);
+        cfg->stream_ip[sizeof(cfg->stream_ip) - 1] = '\0';
+        return 2;
+    } else if ((strcmp(arg, "--port") == 0 || strcmp(arg, "-p") == 0) && val) {
+        cfg->stream_port = atoi(val);
+        return 2;
+    } else if (strcmp(arg, "--mcast-ttl") == 0 && val) {
+        cfg->mcast_ttl = atoi(val);
+        if (cfg->mcast_ttl < 0 || cfg->mcast_ttl > 255) {
+            fprintf(stderr, "invalid --mcast-ttl %s (0 to 255)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--mcast-iface") == 0 && val) {
+        strncpy(cfg->mcast_iface, val, sizeof(cfg->mcast_iface) - 1);
+        return 2;
+    } else if (strcmp(arg, "--mcast-no-loop") == 0) {
+        cfg->mcast_loop = 0;
+        return 1;
+    } else if (strcmp(arg, "--test") == 0 || strcmp(arg, "-t") == 0) {
+        cfg->test_signal = PWAR_TEST_SINE;
+        return 1;
+    } else if (strcmp(arg, "--passthrough_test") == 0 || strcmp(arg, "-pt") == 0) {
+        cfg->passthrough_test = 1;
+        return 1;
+    } else if (strncmp(arg, "--cpus-", 7) == 0 && val) {
+        int t = rt_thread_from_name(arg + 7);
+        if (t < 0 || pwar_rt_parse_cpus(val, &cfg->rt.threads[t].cpus) < 0) {
+            fprintf(stderr, "invalid %s %s\n", arg, val);
+            return -1;
+        }
+        cfg->rt.threads[t].has_cpus = 1;
+        return 2;
+    } else if (strncmp(arg, "--sched-", 8) == 0 && val) {
+        int t = rt_thread_from_name(arg + 8);
+        if (t < 0 || pwar_rt_parse_sched(val, &cfg->rt.threads[t]) < 0) {
+            fprintf(stderr, "invalid %s %s (expected fifo:PRIO, rr:PRIO, other or inherit)\n", arg, val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--no-mlock") == 0) {
+        cfg->rt.lock_memory = 0;
+        return 1;
+    } else if (strcmp(arg, "--timestamping") == 0 && val) {
+        if (pwar_tstamp_parse_mode(val, &cfg->ts_mode) < 0) {
+            fprintf(stderr, "invalid --timestamping %s (expected off, sw or hw)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--ts-iface") == 0 && val) {
+        strncpy(cfg->ts_iface, val, sizeof(cfg->ts_iface) - 1);
+        return 2;
+    } else if (strcmp(arg, "--test-signal") == 0 && val) {
+        if (pwar_testsignal_parse(val, &cfg->test_signal) < 0) {
+            fprintf(stderr, "invalid --test-signal %s (expected sine, impulse, mls or chirp)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--test-freq") == 0 && val) {
+        cfg->test_freq = strtof(val, NULL);
+        return 2;
+    } else if (strcmp(arg, "--test-interval-ms") == 0 && val) {
+        cfg->test_interval_ms = strtoul(val, NULL, 10);
+        return 2;
+    } else if (strcmp(arg, "--driver") == 0) {
+        cfg->driver = 1;
+        return 1;
+    } else if (strcmp(arg, "--local-port") == 0 && val) {
+        cfg->local_port = atoi(val);
+        return 2;
+    } else if (strcmp(arg, "--quantum") == 0 && val) {
+        cfg->quantum = strtoul(val, NULL, 10);
+        if (!cfg->quantum) {
+            fprintf(stderr, "invalid --quantum %s\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--net-period") == 0 && val) {
+        cfg->net_period = strtoul(val, NULL, 10);
+        if (cfg->net_period > MAX_NET_PERIOD) {
+            fprintf(stderr, "invalid --net-period %u (at most %d frames)\n", cfg->net_period, MAX_NET_PERIOD);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--wait-us") == 0 && val) {
+        cfg->wait_ns = strtoull(val, NULL, 10) * 1000;
+        return 2;
+    } else if (strcmp(arg, "--catchup") == 0 && val) {
+        if (pwar_catchup_parse(val, &cfg->catchup) < 0) {
+            fprintf(stderr, "invalid --catchup %s (expected off, newest, drop or stretch)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--catchup-target") == 0 && val) {
+        cfg->catchup_target = strtoul(val, NULL, 10);
+        return 2;
+    } else if (strcmp(arg, "--capture") == 0 && val) {
+        cfg->capture_path = val;
+        return 2;
+    } else if (strcmp(arg, "--capture-records") == 0 && val) {
+        cfg->capture_records = strtoull(val, NULL, 10);
+        return 2;
+    } else if (strcmp(arg, "--record") == 0 && val) {
+        cfg->record_prefix = val;
+        return 2;
+    } else if (strcmp(arg, "--record-format") == 0 && val) {
+        if (pwar_record_parse_format(val, &cfg->record_format) < 0) {
+            fprintf(stderr, "invalid --record-format %s (expected wav or w64)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--record-rotate-s") == 0 && val) {
+        cfg->record_rotate_s = strtoul(val, NULL, 10);
+        return 2;
+    } else if (strcmp(arg, "--capture-audio") == 0) {
+        cfg->capture_audio = 1;
+        return 1;
+    } else if (strcmp(arg, "--dtx") == 0) {
+        cfg->dtx = 1;
+        return 1;
+    } else if (strcmp(arg, "--dtx-threshold") == 0 && val) {
+        cfg->dtx_threshold_db = strtod(val, NULL);
+        if (cfg->dtx_threshold_db >= 0) {
+            fprintf(stderr, "invalid --dtx-threshold %s (dBFS, below 0)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--dtx-noise") == 0 && val) {
+        cfg->dtx_noise_db = strtod(val, NULL);
+        if (cfg->dtx_noise_db >= 0) {
+            fprintf(stderr, "invalid --dtx-noise %s (dBFS, below 0)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--adapt") == 0) {
+        cfg->adapt = 1;
+        return 1;
+    } else if (strcmp(arg, "--auth-key-file") == 0 && val) {
+        cfg->auth_key_file = val;
+        return 2;
+    } else if (strcmp(arg, "--encrypt") == 0) {
+        cfg->encrypt = 1;
+        return 1;
+    } else if (strcmp(arg, "--dscp") == 0 && val) {
+        if (pwar_qos_parse_dscp(val, &cfg->dscp) < 0) {
+            fprintf(stderr, "invalid --dscp %s (0 to 63, ef, csN or afXY)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--so-priority") == 0 && val) {
+        cfg->so_priority = atoi(val);
+        if (cfg->so_priority < 0) {
+            fprintf(stderr, "invalid --so-priority %s\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--txtime") == 0 && val) {
+        if (pwar_txtime_parse_mode(val, &cfg->txtime) < 0) {
+            fprintf(stderr, "invalid --txtime %s (expected off, pace or etf)\n", val);
+            return -1;
+        }
+        return 2;
+    } else if (strcmp(arg, "--txtime-delay-us") == 0 && val) {
+        cfg->txtime_delay_ns = strtoull(val, NULL, 10) * 1000;
+        return 2;
+    } else if (strcmp(arg, "--trace") == 0 && val) {
+        cfg->trace_path = val;
+        return 2;
+    }
+    return 0;
+}
+
+static void setup_recv_socket(struct pwar_bridge *bridge, int port) {
+    bridge->recv_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bridge->recv_sockfd < 0) {
+        perror("recv socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    // Increase UDP receive buffer to 1MB to reduce risk of overrun
+    int rcvbuf = 1024 * 1024;
+    if (setsockopt(bridge->recv_sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+        perror("setsockopt SO_RCVBUF failed");
+    }
+    struct sockaddr_in recv_addr;
+    memset(&recv_addr, 0, sizeof(recv_addr));
+    recv_addr.sin_family = AF_INET;
+    recv_addr.sin_addr.s_addr = INADDR_ANY;
+    recv_addr.sin_port = htons(port);
+    if (bind(bridge->recv_sockfd, (struct sockaddr *)&recv_addr, sizeof(recv_addr)) < 0) {
+        perror("recv socket bind failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void latency_stats_reset(struct pwar_latency_stats *st) {
+    pwar_stat_reset(&st->total);
+    pwar_stat_reset(&st->daw);
+    pwar_stat_reset(&st->net);
+    pwar_stat_reset(&st->upstream);
+    pwar_stat_reset(&st->downstream);
+    pwar_stat_reset(&st->send);
+    pwar_stat_reset(&st->wire);
+    pwar_stat_reset(&st->wakeup);
+    pwar_stat_reset(&st->queue);
+    pwar_stat_reset(&st->jitter);
+    pwar_stat_reset(&st->departure);
+    st->count = 0;
+}
+
+// Hands the window over every 2 seconds. If the stats thread holds the lock
+// we keep accumulating and try again on the next packet.
+static void publish_stats(struct pwar_bridge *bridge, struct pwar_latency_stats *st, int publish,
+                          uint64_t *last_print_ns, uint64_t now_ns) {
+    if (publish && pthread_mutex_trylock(&bridge->stats_mutex) == 0) {
+        bridge->stats_report = *st;
+        bridge->stats_report_ready = 1;
+        pthread_cond_signal(&bridge->stats_cond);
+        pthread_mutex_unlock(&bridge->stats_mutex);
+        latency_stats_reset(st);
+        *last_print_ns = now_ns;
+    }
+}
+
+// Receiver side of the reply ring. When the audio thread has stalled for a
+// whole ring the new packet is dropped; it would only be stale by the time
+// the audio thread catches up.
+static void push_reply(struct pwar_bridge *bridge, const rt_stream_packet_t *packet,
+                       const pwar_midi_block_t *midi, uint64_t recv_ns) {
+    uint32_t w = bridge->reply_write;
+    if (w - __atomic_load_n(&bridge->reply_read, __ATOMIC_ACQUIRE) >= PWAR_BRIDGE_REPLY_SLOTS) {
+        __atomic_add_fetch(&bridge->midi_dropped, midi->count, __ATOMIC_RELAXED);
+        return;
+    }
+    struct pwar_reply *r = &bridge->replies[w % PWAR_BRIDGE_REPLY_SLOTS];
+    r->packet = *packet;
+    pwar_midi_copy(&bridge->reply_midi[w % PWAR_BRIDGE_REPLY_SLOTS], midi);
+    r->recv_ns = recv_ns;
+    if (bridge->cfg.driver) {
+        r->driver_nsec = pwar_dll_period_ns(&bridge->driver_dll);
+        r->driver_next_nsec = pwar_dll_next_ns(&bridge->driver_dll);
+        r->driver_rate_diff = pwar_dll_rate_ratio(&bridge->driver_dll);
+    }
+    __atomic_store_n(&bridge->reply_write, w + 1, __ATOMIC_RELEASE);
+    sem_post(&bridge->reply_sem);
+}
+
+// Audio side: copies the newest reply into bridge->reply. In driver mode
+// (period 0) the older ones are dropped, their MIDI kept though, a lost note
+// off would hang. Otherwise every reply goes into the output FIFO in order,
+// cut or padded to the period so the FIFO keeps its timing, and the catch-up
+// policy decides at playout what a backlog of late replies costs.
+static int take_reply(struct pwar_bridge *bridge, uint32_t period) {
+    static const float *const silence[2] = { NULL, NULL };
+    struct pwar_reblock *rb = bridge->reblock;
+    uint32_t r = bridge->reply_read;
+    uint32_t w = __atomic_load_n(&bridge->reply_write, __ATOMIC_ACQUIRE);
+    if (r == w)
+        return 0;
+    bridge->reply = bridge->replies[(w - 1) % PWAR_BRIDGE_REPLY_SLOTS];
+    for (; r != w; ++r) {
+        const pwar_midi_block_t *midi = &bridge->reply_midi[r % PWAR_BRIDGE_REPLY_SLOTS];
+        if (!period) {
+            pwar_midi_append(&bridge->midi_reply, midi, 0);
+            continue;
+        }
+        const rt_stream_packet_t *pkt = &bridge->replies[r % PWAR_BRIDGE_REPLY_SLOTS].packet;
+        uint32_t n = pkt->n_samples < period ? pkt->n_samples : period;
+        const float *reply[2] = { pkt->samples_ch1, pkt->samples_ch2 };
+        pwar_midi_fifo_write(&rb->midi_out, rb->out.write_pos, midi);
+        if (midi->dropped)
+            __atomic_add_fetch(&bridge->midi_dropped, midi->dropped, __ATOMIC_RELAXED);
+        pwar_fifo_write(&rb->out, reply, n);
+        pwar_fifo_write(&rb->out, silence, period - n);
+    }
+    __atomic_store_n(&bridge->reply_read, w, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int wait_reply(struct pwar_bridge *bridge, uint32_t period, const struct timespec *deadline) {
+    while (!take_reply(bridge, period)) {
+        if (sem_timedwait(&bridge->reply_sem, deadline) < 0 && errno == ETIMEDOUT)
+            return take_reply(bridge, period);
+    }
+    return 1;
+}
+
+// Hands the queue window to the receiver, which prints it with the rest
+static void publish_queue_stat(struct pwar_bridge *bridge, uint64_t now_ns) {
+    if (now_ns - bridge->queue_since_ns < STATS_INTERVAL_NS ||
+        __atomic_load_n(&bridge->queue_ready, __ATOMIC_ACQUIRE))
+        return;
+    bridge->queue_report = bridge->queue_stat;
+    __atomic_store_n(&bridge->queue_ready, 1, __ATOMIC_RELEASE);
+    pwar_stat_reset(&bridge->queue_stat);
+    bridge->queue_since_ns = now_ns;
+}
+
+// Replies to our previous run, in flight from the peer's previous run, or
+// behind the newest one already taken come back as STALE. On a restart or
+// jump of the peer everything learned about it is dropped and the audio
+// thread is told to resync.
+static enum pwar_session_event check_session(struct pwar_bridge *bridge, const rt_stream_packet_t *packet) {
+    // In driver mode the peer numbers the periods, otherwise we do
+    if (!bridge->cfg.driver && PWAR_SESSION_OF(packet->seq) != bridge->session) {
+        __atomic_add_fetch(&bridge->stale_replies, 1, __ATOMIC_RELAXED);
+        return PWAR_SESSION_STALE;
+    }
+    enum pwar_session_event ev = pwar_session_check(&bridge->peer, packet->session, packet->seq);
+    switch (ev) {
+    case PWAR_SESSION_STALE:
+        __atomic_add_fetch(&bridge->stale_replies, 1, __ATOMIC_RELAXED);
+        break;
+    case PWAR_SESSION_DUPLICATE:
+        __atomic_add_fetch(&bridge->copies_dropped, 1, __ATOMIC_RELAXED);
+        break;
+    case PWAR_SESSION_RESTART:
+    case PWAR_SESSION_JUMP:
+        pwar_clock_init(&bridge->clock);
+        bridge->driver_dll.running = 0;
+        __atomic_add_fetch(&bridge->resyncs, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&bridge->resync, 1, __ATOMIC_RELEASE);
+        // fall through
+    case PWAR_SESSION_FIRST:
+        __atomic_store_n(&bridge->peer_session, bridge->peer.peer, __ATOMIC_RELAXED);
+        break;
+    case PWAR_SESSION_SAME:
+        break;
+    }
+    return ev;
+}
+
+// Takes full packets and DTX packets alike, with or without MIDI behind
+// them. Returns 0 for anything else, MIDI only datagrams included: their
+// events come out with the audio of their period. *copy is which copy of
+// its period the packet is.
+static int decode_packet(struct pwar_bridge *bridge, const uint8_t *buf, ssize_t n, rt_stream_packet_t *packet,
+                         pwar_midi_block_t *midi, uint32_t *copy) {
+    *copy = 0;
+    if (n <= 0)
+        return 0;
+    size_t audio = pwar_midi_receive(&bridge->midi_rx, buf, n, midi);
+    if (!audio)
+        return 0;
+    if (pwar_dtx_is_dtx(buf, audio)) {
+        int silent = pwar_dtx_decode(buf, audio, packet, &bridge->dtx_noise);
+        if (silent < 0)
+            return 0;
+        __atomic_add_fetch(&bridge->rx_bytes, n, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bridge->rx_raw_bytes, sizeof(*packet), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bridge->rx_channels, ((const struct pwar_dtx_header *)buf)->channels, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bridge->rx_silent, silent, __ATOMIC_RELAXED);
+        *copy = ((const struct pwar_dtx_header *)buf)->copy;
+        return 1;
+    }
+    memcpy(packet, buf, sizeof(*packet));
+    return 1;
+}
+
+static void *receiver_thread(void *userdata) {
+    struct pwar_bridge *bridge = userdata;
+    // Set real-time scheduling and affinity to minimize jitter
+    pwar_rt_apply_thread(&bridge->cfg.rt, PWAR_RT_THREAD_RECEIVER, &bridge->rt_result[PWAR_RT_THREAD_RECEIVER]);
+    pwar_rt_prefault_stack(bridge->cfg.rt.stack_size);
+    if (bridge->trace)
+        bridge->trace_recv = pwar_trace_register(bridge->trace, "receiver");
+
+    rt_stream_packet_t packet;
+    pwar_midi_block_t midi;
+    // Full and DTX packets with MIDI behind them stay within this too
+    uint8_t buf[PWAR_MIDI_MAX_DATAGRAM];
+    uint32_t copy;
+    uint64_t driver_seq = 0;
+    // Latency stats
+    struct pwar_latency_stats st;
+    latency_stats_reset(&st);
+    uint64_t last_print_ns = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    last_print_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+    while (1) {
+        struct pwar_tstamp rx;
+        PWAR_RT_SECTION_END();
+        ssize_t n = pwar_tstamp_recv(bridge->recv_sockfd, buf, sizeof(buf), &rx);
+        // From here to the next receive the packet is on its way to the
+        // audio thread, nothing in between may block or allocate.
+        PWAR_RT_SECTION_BEGIN();
+        if (bridge->auth_enabled && n > 0) {
+            int len = pwar_auth_open(&bridge->auth, buf, n, rx.user_ns);
+            n = len < 0 ? 0 : len;
+        }
+        if (decode_packet(bridge, buf, n, &packet, &midi, &copy) && packet.n_samples <= MAX_NET_PERIOD) {
+            enum pwar_session_event ev = check_session(bridge, &packet);
+            if (ev == PWAR_SESSION_STALE || ev == PWAR_SESSION_DUPLICATE)
+                continue;
+            if (copy)
+                __atomic_add_fetch(&bridge->copies_saved, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&bridge->midi_rx_events, midi.count, __ATOMIC_RELAXED);
+            if (ev == PWAR_SESSION_RESTART || ev == PWAR_SESSION_JUMP) {
+                // What was measured belongs to the previous run
+                latency_stats_reset(&st);
+            }
+            uint64_t ts_return = rx.user_ns;
+            int publish = ts_return - last_print_ns >= STATS_INTERVAL_NS;
+            if (bridge->cfg.driver) {
+                if (!packet.n_samples)
+                    continue;
+                // A gap in the peer's seq means the period length we measure
+                // next is off by whole periods, so the loop starts over.
+                if (bridge->driver_dll.running && packet.seq != driver_seq + 1)
+                    bridge->driver_dll.running = 0;
+                driver_seq = packet.seq;
+                pwar_dll_update(&bridge->driver_dll, rx.kernel_ns ? rx.kernel_ns : rx.user_ns,
+                                packet.n_samples, PWAR_BRIDGE_RATE);
+            }
+
+            push_reply(bridge, &packet, &midi, ts_return);
+            pwar_trace_point(bridge->trace_recv, PWAR_TRACE_REPLY_RECV, (uint32_t)packet.seq);
+            if (publish && __atomic_load_n(&bridge->queue_ready, __ATOMIC_ACQUIRE)) {
+                st.queue = bridge->queue_report;
+                __atomic_store_n(&bridge->queue_ready, 0, __ATOMIC_RELEASE);
+            }
+
+            if (bridge->capture_enabled) {
+                struct pwar_capture_record rec = {
+                    .ts_ns = ts_return,
+                    .seq = packet.seq,
+                    .ts_pipewire_send = packet.ts_pipewire_send,
+                    .ts_asio_recv = packet.ts_asio_recv,
+                    .ts_asio_send = packet.ts_asio_send,
+                    .kernel_ns = rx.kernel_ns,
+                    .n_samples = packet.n_samples,
+                    .type = PWAR_CAPTURE_RECEIVED,
+                };
+                pwar_capture_write(&bridge->capture, &rec, packet.samples_ch1, packet.samples_ch2);
+            }
+            if (bridge->recording) {
+                const float *reply[PWAR_BRIDGE_OUT_CHANNELS] = { packet.samples_ch1, packet.samples_ch2 };
+                uint32_t n = packet.n_samples < RT_STREAM_PACKET_FRAME_SIZE / 2 ? packet.n_samples : RT_STREAM_PACKET_FRAME_SIZE / 2;
+                pwar_record_push(&bridge->record_rx, reply, n);
+            }
+
+            if (bridge->cfg.driver) {
+                if (bridge->wake) {
+                    // The wake-up is a non-blocking eventfd write in the backend
+                    PWAR_RT_SECTION_END();
+                    bridge->wake(bridge->wake_data);
+                    PWAR_RT_SECTION_BEGIN();
+                }
+                pwar_stat_add(&st.jitter, bridge->driver_dll.error_ns / 1000000.0);
+                st.rate_ppm = (pwar_dll_rate_ratio(&bridge->driver_dll) - 1.0) * 1e6;
+                st.count++;
+                publish_stats(bridge, &st, publish, &last_print_ns, ts_return);
+                continue;
+            }
+
+            // Prefer the kernel receive stamp for the clock estimate, it
+            // keeps our own wake-up jitter out of the offset.
+            uint64_t t4 = rx.kernel_ns ? rx.kernel_ns : ts_return;
+            uint64_t total_latency = ts_return - packet.ts_pipewire_send;
+            uint64_t daw_latency = packet.ts_asio_send - packet.ts_asio_recv;
+            uint64_t network_latency = total_latency - daw_latency;
+            pwar_clock_update(&bridge->clock, packet.ts_pipewire_send, packet.ts_asio_recv, packet.ts_asio_send, t4);
+
+            // Update stats
+            pwar_stat_add(&st.total, total_latency / 1000000.0);
+            pwar_stat_add(&st.daw, daw_latency / 1000000.0);
+            pwar_stat_add(&st.net, network_latency / 1000000.0);
+            if (bridge->clock.valid) {
+                uint64_t asio_recv = pwar_clock_remote_to_local(&bridge->clock, packet.ts_asio_recv);
+                uint64_t asio_send = pwar_clock_remote_to_local(&bridge->clock, packet.ts_asio_send);
+                pwar_stat_add(&st.upstream, (int64_t)(asio_recv - packet.ts_pipewire_send) / 1000000.0);
+                pwar_stat_add(&st.downstream, (int64_t)(t4 - asio_send) / 1000000.0);
+                st.offset_ms = pwar_clock_offset_at(&bridge->clock, t4) / 1000000.0;
+                st.skew_ppm = bridge->clock.skew * 1e6;
+            }
+
+            // The error queue also carries the ETF qdisc's drops
+            if (bridge->ts_mode != PWAR_TSTAMP_OFF || bridge->txtime == PWAR_TXTIME_ETF)
+                pwar_tstamp_collect_tx(bridge->sockfd, &bridge->tx_stamps);
+            uint32_t slot = packet.seq & (PWAR_TSTAMP_TX_SLOTS - 1);
+            uint64_t tx_ns = 0;
+            if (rx.kernel_ns) {
+                pwar_stat_add(&st.wakeup, (int64_t)(rx.user_ns - rx.kernel_ns) / 1000000.0);
+                tx_ns = pwar_tstamp_tx_lookup(&bridge->tx_stamps, __atomic_load_n(&bridge->tx_id[slot], __ATOMIC_RELAXED));
+                if (tx_ns) {
+                    pwar_stat_add(&st.send, (int64_t)(tx_ns - packet.ts_pipewire_send) / 1000000.0);
+                    pwar_stat_add(&st.wire, ((int64_t)(rx.kernel_ns - tx_ns) - (int64_t)daw_latency) / 1000000.0);
+                }
+            }
+            // Under ETF sendmsg returns long before the datagram leaves, only
+            // a TX timestamp tells when it did
+            uint64_t departed = tx_ns ? tx_ns : bridge->txtime != PWAR_TXTIME_ETF ?
+                __atomic_load_n(&bridge->tx_sent[slot], __ATOMIC_RELAXED) : 0;
+            if (departed) {
+                int64_t off = (int64_t)(departed - __atomic_load_n(&bridge->tx_due[slot], __ATOMIC_RELAXED));
+                pwar_stat_add(&st.departure, (off < 0 ? -off : off) / 1000000.0);
+                st.departure_kernel = tx_ns != 0;
+            }
+
+            st.count++;
+            publish_stats(bridge, &st, publish, &last_print_ns, ts_return);
+        }
+    }
+    return NULL;
+}
+
+static void report_rt_results(struct pwar_bridge *bridge) {
+    char line[256];
+    for (int i = 0; i < PWAR_RT_THREAD_COUNT; ++i) {
+        if (bridge->rt_reported[i] || !__atomic_load_n(&bridge->rt_result[i].applied, __ATOMIC_ACQUIRE))
+            continue;
+        pwar_rt_format_result(&bridge->rt_result[i], line, sizeof(line));
+        printf("[rt] %s thread: %s\n", pwar_rt_thread_name(i), line);
+        bridge->rt_reported[i] = 1;
+    }
+}
+
+static void print_loopback(struct pwar_bridge *bridge) {
+    if (!bridge->test_signal || !pwar_testsignal_measures(bridge->test_signal))
+        return;
+    const struct pwar_test_results *r = &bridge->test_signal->results;
+    if (r->have_latency)
+        printf("[2s] Loopback (%s): latency %d samples (%.3f ms), min %d, max %d | bursts %lu, missing %lu | periods dropped %lu, duplicated %lu\n",
+            pwar_testsignal_name(bridge->test_signal->type), r->latency,
+            r->latency * 1000.0 / PWAR_TEST_SAMPLE_RATE, r->min_latency, r->max_latency,
+            r->bursts, r->missing, r->dropped_periods, r->duplicated_periods);
+    else
+        printf("[2s] Loopback (%s): no burst found yet (bursts %lu, missing %lu)\n",
+            pwar_testsignal_name(bridge->test_signal->type), r->bursts, r->missing);
+    // Only when the peer loops MIDI back as well
+    if (r->have_midi)
+        printf("[2s] Loopback MIDI: latency %d samples, %+d against the audio, worst %+d | notes missing %lu\n",
+            r->midi_latency, r->midi_error, r->midi_max_error, r->midi_missing);
+}
+
+static void on_trace_signal(int signal_number) {
+    trace_requested = 1;
+}
+
+static void dump_trace(struct pwar_bridge *bridge, const char *reason) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s-%04u.json", bridge->cfg.trace_path, ++bridge->trace_dumps);
+    int n = pwar_trace_dump(bridge->trace, path);
+    if (n < 0)
+        fprintf(stderr, "[trace] can't write %s: %s\n", path, strerror(-n));
+    else
+        printf("[trace] %s: %d events written to %s\n", reason, n, path);
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? part * 100.0 / whole : 0.0;
+}
+
+static void print_dtx(struct pwar_bridge *bridge) {
+    uint64_t rx_channels = __atomic_load_n(&bridge->rx_channels, __ATOMIC_RELAXED);
+    if (!bridge->cfg.dtx && !rx_channels)
+        return;
+    uint64_t tx_raw = __atomic_load_n(&bridge->tx_raw_bytes, __ATOMIC_RELAXED);
+    uint64_t rx_raw = __atomic_load_n(&bridge->rx_raw_bytes, __ATOMIC_RELAXED);
+    printf("[2s] DTX since start: sent %.1f%% of full size, %.1f%% channels silent | received %.1f%% of full size, %.1f%% channels silent\n",
+        percent(__atomic_load_n(&bridge->tx_bytes, __ATOMIC_RELAXED), tx_raw),
+        percent(__atomic_load_n(&bridge->tx_silent, __ATOMIC_RELAXED), __atomic_load_n(&bridge->tx_channels, __ATOMIC_RELAXED)),
+        percent(__atomic_load_n(&bridge->rx_bytes, __ATOMIC_RELAXED), rx_raw),
+        percent(__atomic_load_n(&bridge->rx_silent, __ATOMIC_RELAXED), rx_channels));
+}
+
+static void print_auth(struct pwar_bridge *bridge) {
+    if (!bridge->auth_enabled)
+        return;
+    const pwar_auth_t *a = &bridge->auth;
+    printf("[2s] Auth (%s) since start: %lu datagrams verified, %lu peer changes | refused %lu with a bad tag, %lu replayed, %lu from an unconfirmed peer\n",
+        pwar_auth_mode_name(a->mode), __atomic_load_n(&a->opened, __ATOMIC_RELAXED),
+        __atomic_load_n(&a->peer_changes, __ATOMIC_RELAXED),
+        __atomic_load_n(&a->bad_tag, __ATOMIC_RELAXED), __atomic_load_n(&a->replayed, __ATOMIC_RELAXED),
+        __atomic_load_n(&a->unconfirmed, __ATOMIC_RELAXED));
+}
+
+// Feeds the stats window and the periods played since the last one to the
+// adaptive encoding, and hands a new choice to the audio thread
+static void adapt_window(struct pwar_bridge *bridge, const struct pwar_latency_stats *st, uint64_t *seen) {
+    uint64_t counts[PWAR_PLAYOUT_N_DECISIONS];
+    uint64_t periods = 0;
+    for (int d = 0; d < PWAR_PLAYOUT_N_DECISIONS; ++d) {
+        counts[d] = __atomic_load_n(&bridge->playout.counts[d], __ATOMIC_RELAXED);
+        periods += counts[d] - seen[d];
+    }
+    struct pwar_adapt_window w = {
+        .periods = (uint32_t)periods,
+        .lost = (uint32_t)(counts[PWAR_PLAYOUT_CONCEALED] - seen[PWAR_PLAYOUT_CONCEALED] +
+                           counts[PWAR_PLAYOUT_LATE] - seen[PWAR_PLAYOUT_LATE]),
+        .rtt_ms = pwar_stat_avg(&st->net),
+        .jitter_ms = st->net.count ? pwar_stat_avg(&st->net) - st->net.min : 0.0,
+        .period_ms = bridge->reblock->period * 1000.0 / PWAR_BRIDGE_RATE,
+    };
+    memcpy(seen, counts, sizeof(counts));
+    if (pwar_adapt_update(&bridge->adapt, &w)) {
+        char line[192];
+        pwar_adapt_describe(&bridge->adapt, &w, line, sizeof(line));
+        printf("[adapt] now sending %s\n", line);
+        __atomic_store_n(&bridge->adapt_choice, pwar_adapt_pack(&bridge->adapt.choice), __ATOMIC_RELAXED);
+    }
+}
+
+static void print_adapt(struct pwar_bridge *bridge) {
+    uint64_t dropped = __atomic_load_n(&bridge->copies_dropped, __ATOMIC_RELAXED);
+    if (!bridge->cfg.adapt && !dropped)
+        return;
+    printf("[2s] Adapt:");
+    if (bridge->cfg.adapt) {
+        const pwar_adapt_t *a = &bridge->adapt;
+        printf(" sending %s x%u | loss %.2f%%%s | %lu switches since start |",
+            pwar_kernel_format_name(a->choice.format), a->choice.copies, a->loss,
+            a->congested ? ", congested" : "", a->switches);
+    }
+    printf(" received copies: %lu dropped, %lu periods saved by one\n", dropped,
+        __atomic_load_n(&bridge->copies_saved, __ATOMIC_RELAXED));
+}
+
+static void print_midi(struct pwar_bridge *bridge) {
+    uint64_t tx = __atomic_load_n(&bridge->midi_tx_events, __ATOMIC_RELAXED);
+    uint64_t rx = __atomic_load_n(&bridge->midi_rx_events, __ATOMIC_RELAXED);
+    if (!tx && !rx)
+        return;
+    printf("[2s] MIDI since start: sent %lu events, received %lu | dropped %lu, lost with their audio %lu\n",
+        tx, rx, __atomic_load_n(&bridge->midi_dropped, __ATOMIC_RELAXED),
+        __atomic_load_n(&bridge->midi_rx.lost, __ATOMIC_RELAXED));
+}
+
+// Once per backlog, after it has been worked off
+static void print_catchup(struct pwar_bridge *bridge, uint64_t *seen) {
+    const pwar_catchup_t *c = &bridge->catchup;
+    uint64_t backlogs = __atomic_load_n(&c->backlogs, __ATOMIC_RELAXED);
+    if (backlogs == *seen || __atomic_load_n(&c->backlogged, __ATOMIC_RELAXED))
+        return;
+    *seen = backlogs;
+    uint32_t depth = __atomic_load_n(&c->last_depth, __ATOMIC_RELAXED);
+    uint32_t period = __atomic_load_n(&c->last_period, __ATOMIC_RELAXED);
+    printf("[catchup] %s: backlog of %u frames (%.1f periods) worked off in %.3f ms, worst %.3f ms | since start: %lu backlogs, dropped %lu frames, stretched %lu\n",
+        pwar_catchup_policy_name(c->policy), depth, period ? (double)depth / period : 0.0,
+        __atomic_load_n(&c->last_recovery_ns, __ATOMIC_RELAXED) / 1000000.0,
+        __atomic_load_n(&c->max_recovery_ns, __ATOMIC_RELAXED) / 1000000.0, backlogs,
+        __atomic_load_n(&c->dropped_frames, __ATOMIC_RELAXED),
+        __atomic_load_n(&c->stretched_frames, __ATOMIC_RELAXED));
+}
+
+static void print_record(struct pwar_bridge *bridge) {
+    if (!bridge->recording)
+        return;
+    const struct pwar_record *rec[2] = { &bridge->record_tx, &bridge->record_rx };
+    printf("[2s] Recording:");
+    for (int i = 0; i < 2; ++i) {
+        printf("%s %s %.1f MB in %lu files, %lu frames left out", i ? " |" : "", rec[i]->name,
+            __atomic_load_n(&rec[i]->bytes_written, __ATOMIC_RELAXED) / 1e6,
+            __atomic_load_n(&rec[i]->files, __ATOMIC_RELAXED),
+            __atomic_load_n(&rec[i]->dropped_frames, __ATOMIC_RELAXED));
+        int error = __atomic_load_n(&rec[i]->error, __ATOMIC_RELAXED);
+        if (error)
+            printf(" (%s)", strerror(error));
+    }
+    printf("\n");
+}
+
+static void *stats_thread(void *userdata) {
+    struct pwar_bridge *bridge = userdata;
+    pwar_rt_apply_thread(&bridge->cfg.rt, PWAR_RT_THREAD_STATS, &bridge->rt_result[PWAR_RT_THREAD_STATS]);
+
+    uint32_t reblock_seen = 0;
+    uint64_t xruns_seen = 0;
+    uint64_t concealed_seen = 0;
+    uint64_t send_errors_seen = 0;
+    uint64_t bad_tag_seen = 0;
+    uint64_t adapt_seen[PWAR_PLAYOUT_N_DECISIONS] = { 0 };
+    uint32_t peer_seen = 0, clean_seen = 0;
+    uint64_t resyncs_seen = 0, stale_seen = 0;
+    uint64_t backlogs_seen = 0;
+    pthread_mutex_lock(&bridge->stats_mutex);
+    while (1) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        while (!bridge->stats_report_ready) {
+            if (pthread_cond_timedwait(&bridge->stats_cond, &bridge->stats_mutex, &ts) == ETIMEDOUT)
+                break;
+        }
+        report_rt_results(bridge);
+        uint32_t generation = __atomic_load_n(&bridge->reblock->generation, __ATOMIC_ACQUIRE);
+        if (generation != reblock_seen) {
+            reblock_seen = generation;
+            printf("[reblock] quantum %u, network period %u, added latency %u frames (%.3f ms)\n",
+                bridge->reblock->quantum, bridge->reblock->period, bridge->reblock->latency,
+                bridge->reblock->latency * 1000.0 / PWAR_BRIDGE_RATE);
+        }
+        uint64_t xruns = __atomic_load_n(&bridge->xruns, __ATOMIC_RELAXED);
+        uint64_t concealed = __atomic_load_n(&bridge->playout.counts[PWAR_PLAYOUT_CONCEALED], __ATOMIC_RELAXED);
+        if (xruns != xruns_seen)
+            printf("[xrun] audio backend: %lu xruns since start\n", xruns);
+        if (concealed != concealed_seen) {
+            printf("\033[0;31m--- ERROR -- %lu cycles without a valid packet, output silence (last wanted seq %lu, got seq %lu)\033[0m\n",
+                concealed - concealed_seen,
+                __atomic_load_n(&bridge->missed_wanted_seq, __ATOMIC_RELAXED),
+                __atomic_load_n(&bridge->missed_got_seq, __ATOMIC_RELAXED));
+        }
+        uint64_t send_errors = __atomic_load_n(&bridge->send_errors, __ATOMIC_RELAXED);
+        if (send_errors != send_errors_seen) {
+            printf("[net] sendto failed %lu times since start: %s\n", send_errors,
+                strerror(__atomic_load_n(&bridge->send_errno, __ATOMIC_RELAXED)));
+            send_errors_seen = send_errors;
+        }
+        uint64_t bad_tag = __atomic_load_n(&bridge->auth.bad_tag, __ATOMIC_RELAXED);
+        if (bad_tag != bad_tag_seen) {
+            // Shown even when nothing gets through and no report follows
+            printf("[auth] refused %lu datagrams with a bad tag since start, does the peer use the same key?\n", bad_tag);
+            bad_tag_seen = bad_tag;
+        }
+        uint32_t peer = __atomic_load_n(&bridge->peer_session, __ATOMIC_RELAXED);
+        uint64_t resyncs = __atomic_load_n(&bridge->resyncs, __ATOMIC_RELAXED);
+        uint64_t stale = __atomic_load_n(&bridge->stale_replies, __ATOMIC_RELAXED);
+        uint32_t clean = __atomic_load_n(&bridge->resync_clean_cycles, __ATOMIC_RELAXED);
+        if (peer != peer_seen || resyncs != resyncs_seen || stale != stale_seen || clean != clean_seen) {
+            printf("[session] peer %08x: %lu resyncs, %lu stale packets dropped", peer, resyncs, stale);
+            if (clean)
+                printf(", last resync clean after %u cycles", clean);
+            printf("\n");
+            peer_seen = peer;
+            resyncs_seen = resyncs;
+            stale_seen = stale;
+            clean_seen = clean;
+        }
+        print_catchup(bridge, &backlogs_seen);
+        if (bridge->trace) {
+            // Dumping takes a while, do it without the lock like the analysis below
+            const char *reason = trace_requested ? "requested" : xruns != xruns_seen ? "xrun" :
+                concealed != concealed_seen ? "missed deadline" : NULL;
+            if (reason) {
+                trace_requested = 0;
+                pthread_mutex_unlock(&bridge->stats_mutex);
+                dump_trace(bridge, reason);
+                pthread_mutex_lock(&bridge->stats_mutex);
+            }
+        }
+        xruns_seen = xruns;
+        concealed_seen = concealed;
+        if (bridge->test_signal && pwar_testsignal_measures(bridge->test_signal)) {
+            // Correlating a burst takes a few ms, drop the lock meanwhile
+            pthread_mutex_unlock(&bridge->stats_mutex);
+            pwar_testsignal_analyze(bridge->test_signal);
+            pthread_mutex_lock(&bridge->stats_mutex);
+        }
+        if (!bridge->stats_report_ready)
+            continue;
+        struct pwar_latency_stats st = bridge->stats_report;
+        bridge->stats_report_ready = 0;
+        pthread_mutex_unlock(&bridge->stats_mutex);
+
+        if (bridge->cfg.driver) {
+            printf("[2s] Driver: packets %d | Peer rate %+.1f ppm | Arrival vs DLL: min %.3f ms, max %.3f ms, avg %.3f ms\n",
+                st.count, st.rate_ppm, st.jitter.min, st.jitter.max, pwar_stat_avg(&st.jitter));
+            print_loopback(bridge);
+            print_dtx(bridge);
+            print_midi(bridge);
+            print_record(bridge);
+            print_auth(bridge);
+            print_adapt(bridge);
+            pthread_mutex_lock(&bridge->stats_mutex);
+            continue;
+        }
+        printf("[2s] Packets: %d | Total Latency: min %.2f ms, max %.2f ms, avg %.2f ms | DAW: min %.2f ms, max %.2f ms, avg %.2f ms | Net: min %.2f ms, max %.2f ms, avg %.2f ms\n",
+            st.count, st.total.min, st.total.max, pwar_stat_avg(&st.total),
+            st.daw.min, st.daw.max, pwar_stat_avg(&st.daw),
+            st.net.min, st.net.max, pwar_stat_avg(&st.net));
+        printf("[2s] Playout since start: played %lu, concealed %lu, late %lu, duplicate %lu\n",
+            __atomic_load_n(&bridge->playout.counts[PWAR_PLAYOUT_PLAYED], __ATOMIC_RELAXED),
+            __atomic_load_n(&bridge->playout.counts[PWAR_PLAYOUT_CONCEALED], __ATOMIC_RELAXED),
+            __atomic_load_n(&bridge->playout.counts[PWAR_PLAYOUT_LATE], __ATOMIC_RELAXED),
+            __atomic_load_n(&bridge->playout.counts[PWAR_PLAYOUT_DUPLICATE], __ATOMIC_RELAXED));
+        print_loopback(bridge);
+        print_dtx(bridge);
+        print_midi(bridge);
+        print_record(bridge);
+        print_auth(bridge);
+        if (bridge->cfg.adapt)
+            adapt_window(bridge, &st, adapt_seen);
+        print_adapt(bridge);
+        if (st.upstream.count) {
+            printf("[2s] Upstream: min %.3f ms, max %.3f ms, avg %.3f ms | DAW: avg %.3f ms | Downstream: min %.3f ms, max %.3f ms, avg %.3f ms | Clock offset %.3f ms, skew %.1f ppm\n",
+                st.upstream.min, st.upstream.max, pwar_stat_avg(&st.upstream),
+                pwar_stat_avg(&st.daw),
+                st.downstream.min, st.downstream.max, pwar_stat_avg(&st.downstream),
+                st.offset_ms, st.skew_ppm);
+        }
+        if (st.wire.count) {
+            printf("[2s] %s timestamps | Send: avg %.3f ms, max %.3f ms | Wire: min %.3f ms, max %.3f ms, avg %.3f ms | Wake-up: avg %.3f ms, max %.3f ms | Queued: avg %.3f ms, max %.3f ms\n",
+                pwar_tstamp_mode_name(bridge->ts_mode),
+                pwar_stat_avg(&st.send), st.send.max,
+                st.wire.min, st.wire.max, pwar_stat_avg(&st.wire),
+                pwar_stat_avg(&st.wakeup), st.wakeup.max,
+                pwar_stat_avg(&st.queue), st.queue.max);
+        }
+        if (st.departure.count) {
+            printf("[2s] Departure (txtime %s, %s): off the schedule avg %.3f ms, max %.3f ms | late %lu, dropped by the qdisc %lu since start\n",
+                pwar_txtime_mode_name(bridge->txtime), st.departure_kernel ? "TX timestamps" : "sendmsg returns",
+                pwar_stat_avg(&st.departure), st.departure.max,
+                __atomic_load_n(&bridge->tx_late, __ATOMIC_RELAXED),
+                __atomic_load_n(&bridge->tx_stamps.txtime_dropped, __ATOMIC_RELAXED));
+            // Leaving a whole delay early is what a route without ETF does
+            if (bridge->txtime == PWAR_TXTIME_ETF && st.departure_kernel &&
+                pwar_stat_avg(&st.departure) > 0.8 * bridge->cfg.txtime_delay_ns / 1000000.0)
+                printf("[2s] Departure: the txtimes look ignored, is the ETF qdisc on this interface?\n");
+        }
+
+        pthread_mutex_lock(&bridge->stats_mutex);
+    }
+    return NULL;
+}
+
+// One sendto per period reaches every listener that joined the group, so
+// the sender's cost does not depend on how many there are. Replies still
+// come back by unicast to our receive port.
+static void setup_multicast(struct pwar_bridge *bridge) {
+    const struct pwar_bridge_config *cfg = &bridge->cfg;
+    unsigned char ttl = (unsigned char)cfg->mcast_ttl;
+    unsigned char loop = cfg->mcast_loop ? 1 : 0;
+    if (setsockopt(bridge->sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0)
+        perror("IP_MULTICAST_TTL");
+    if (setsockopt(bridge->sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+        perror("IP_MULTICAST_LOOP");
+    if (cfg->mcast_iface[0]) {
+        struct ip_mreqn mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.imr_ifindex = if_nametoindex(cfg->mcast_iface);
+        if (!mreq.imr_ifindex) {
+            fprintf(stderr, "unknown --mcast-iface %s\n", cfg->mcast_iface);
+            exit(EXIT_FAILURE);
+        }
+        if (setsockopt(bridge->sockfd, IPPROTO_IP, IP_MULTICAST_IF, &mreq, sizeof(mreq)) < 0)
+            perror("IP_MULTICAST_IF");
+    }
+    printf("[mcast] sending to group %s:%d, ttl %d, via %s%s\n", cfg->stream_ip, cfg->stream_port, cfg->mcast_ttl,
+        cfg->mcast_iface[0] ? cfg->mcast_iface : "default route", cfg->mcast_loop ? "" : ", no local loop");
+}
+
+static void setup_socket(struct pwar_bridge *bridge, const char *ip, int port) {
+    bridge->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bridge->sockfd < 0) {
+        perror("socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(&bridge->servaddr, 0, sizeof(bridge->servaddr));
+    bridge->servaddr.sin_family = AF_INET;
+    bridge->servaddr.sin_port = htons(port);
+    bridge->servaddr.sin_addr.s_addr = inet_addr(ip);
+    if (IN_MULTICAST(ntohl(bridge->servaddr.sin_addr.s_addr)))
+        setup_multicast(bridge);
+}
+
+// The audio thread's counters of what it dropped and cleared
+static void midi_done(struct pwar_bridge *bridge, pwar_midi_block_t *b) {
+    if (b->dropped)
+        __atomic_add_fetch(&bridge->midi_dropped, b->dropped, __ATOMIC_RELAXED);
+    pwar_midi_clear(b);
+}
+
+static void send_failed(struct pwar_bridge *bridge, int err) {
+    __atomic_store_n(&bridge->send_errno, err, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bridge->send_errors, 1, __ATOMIC_RELAXED);
+}
+
+// Audio side of the pacer's ring: the datagram is put together and sealed
+// in its slot, nothing here waits for the departure
+static void queue_datagram(struct pwar_bridge *bridge, const void *audio, size_t len,
+                           const void *trailer, size_t trailer_len, int32_t slot) {
+    uint32_t w = bridge->paced_write;
+    if (w - __atomic_load_n(&bridge->paced_read, __ATOMIC_ACQUIRE) >= PWAR_BRIDGE_PACED_SLOTS) {
+        send_failed(bridge, ENOBUFS);
+        return;
+    }
+    struct pwar_paced *p = &bridge->paced[w % PWAR_BRIDGE_PACED_SLOTS];
+    memcpy(p->buf, audio, len);
+    if (trailer_len)
+        memcpy(p->buf + len, trailer, trailer_len);
+    p->len = len + trailer_len;
+    if (bridge->auth_enabled)
+        p->len = pwar_auth_seal(&bridge->auth, p->buf, p->len);
+    p->due_ns = bridge->tx_due_ns;
+    p->slot = slot;
+    __atomic_store_n(&bridge->paced_write, w + 1, __ATOMIC_RELEASE);
+    sem_post(&bridge->paced_sem);
+    bridge->tx_datagrams++;
+}
+
+static void *pacer_thread(void *userdata) {
+    struct pwar_bridge *bridge = userdata;
+    pwar_rt_apply_thread(&bridge->cfg.rt, PWAR_RT_THREAD_PACER, &bridge->rt_result[PWAR_RT_THREAD_PACER]);
+    pwar_rt_prefault_stack(bridge->cfg.rt.stack_size);
+    while (1) {
+        uint32_t r = bridge->paced_read;
+        if (r == __atomic_load_n(&bridge->paced_write, __ATOMIC_ACQUIRE)) {
+            sem_wait(&bridge->paced_sem);
+            continue;
+        }
+        const struct pwar_paced *p = &bridge->paced[r % PWAR_BRIDGE_PACED_SLOTS];
+        pwar_txtime_pace(p->due_ns);
+        if (sendto(bridge->sockfd, p->buf, p->len, 0, (struct sockaddr *)&bridge->servaddr, sizeof(bridge->servaddr)) < 0)
+            send_failed(bridge, errno);
+        if (p->slot >= 0)
+            __atomic_store_n(&bridge->tx_sent[p->slot], pwar_tstamp_now_ns(), __ATOMIC_RELAXED);
+        __atomic_store_n(&bridge->paced_read, r + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// Every datagram of a period goes out at the period's departure time. slot
+// is the period's tx_sent slot when this is its audio, -1 otherwise.
+static void send_datagram(struct pwar_bridge *bridge, const void *audio, size_t len,
+                          const void *trailer, size_t trailer_len, int32_t slot) {
+    if (bridge->txtime == PWAR_TXTIME_PACE) {
+        queue_datagram(bridge, audio, len, trailer, trailer_len, slot);
+        return;
+    }
+    if (bridge->auth_enabled) {
+        // Sealed in one piece; send_period() left room for the auth trailer
+        memcpy(bridge->auth_buf, audio, len);
+        if (trailer_len)
+            memcpy(bridge->auth_buf + len, trailer, trailer_len);
+        len = pwar_auth_seal(&bridge->auth, bridge->auth_buf, len + trailer_len);
+        audio = bridge->auth_buf;
+        trailer_len = 0;
+    }
+    struct iovec iov[2] = {
+        { .iov_base = (void *)audio, .iov_len = len },
+        { .iov_base = (void *)trailer, .iov_len = trailer_len },
+    };
+    struct msghdr msg = {
+        .msg_name = &bridge->servaddr,
+        .msg_namelen = sizeof(bridge->servaddr),
+        .msg_iov = iov,
+        .msg_iovlen = trailer_len ? 2 : 1,
+    };
+    uint8_t control[PWAR_TXTIME_CONTROL_SIZE];
+    if (bridge->txtime == PWAR_TXTIME_ETF)
+        pwar_txtime_set(&msg, control, bridge->tx_due_ns);
+    if (sendmsg(bridge->sockfd, &msg, 0) < 0)
+        send_failed(bridge, errno);
+    if (slot >= 0)
+        __atomic_store_n(&bridge->tx_sent[slot], pwar_tstamp_now_ns(), __ATOMIC_RELAXED);
+    bridge->tx_datagrams++;
+}
+
+// When the period handed over at now_ns is due to leave. Only a period per
+// cycle or fewer follows the period clock: several per cycle go back to back
+// after each other's replies, and in driver mode the peer is waiting.
+static uint64_t schedule_period(struct pwar_bridge *bridge, uint32_t n_samples, uint64_t now_ns) {
+    uint64_t delay = bridge->txtime == PWAR_TXTIME_OFF ? 0 : bridge->cfg.txtime_delay_ns;
+    if (bridge->cfg.driver || bridge->reblock->period < bridge->reblock->quantum)
+        return now_ns + delay;
+    pwar_dll_t *dll = &bridge->tx_dll;
+    // After an xrun or a stall the clock starts over instead of chasing it
+    if (dll->running && llabs((int64_t)(now_ns - pwar_dll_next_ns(dll))) > dll->nominal_ns / 2)
+        dll->running = 0;
+    pwar_dll_update(dll, now_ns, n_samples, PWAR_BRIDGE_RATE);
+    uint64_t due = pwar_dll_period_ns(dll) + delay;
+    if (bridge->txtime != PWAR_TXTIME_OFF && due < now_ns) {
+        __atomic_add_fetch(&bridge->tx_late, 1, __ATOMIC_RELAXED);
+        due = now_ns;
+    }
+    return due;
+}
+
+// Sends the period's MIDI behind the audio. Only when it does not all fit
+// in one datagram the first events go ahead of it on their own. copies
+// above 1 need a DTX packet, each copy goes out marked with its number.
+static void send_period(struct pwar_bridge *bridge, void *audio, size_t len, uint64_t seq, uint32_t copies) {
+    const pwar_midi_block_t *midi = &bridge->midi_tx;
+    uint32_t slot = seq & (PWAR_TSTAMP_TX_SLOTS - 1);
+    __atomic_store_n(&bridge->tx_due[slot], bridge->tx_due_ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&bridge->tx_sent[slot], 0, __ATOMIC_RELAXED);
+    const size_t max = PWAR_MIDI_MAX_DATAGRAM - (bridge->auth_enabled ? PWAR_AUTH_OVERHEAD : 0);
+    uint8_t trailer[PWAR_MIDI_MAX_DATAGRAM];
+    uint32_t first = 0;
+    while (pwar_midi_size(midi, first) > max - len) {
+        size_t n = pwar_midi_encode(midi, &first, bridge->session, seq, trailer, max);
+        send_datagram(bridge, trailer, n, NULL, 0, -1);
+    }
+    size_t trailer_len = pwar_midi_encode(midi, &first, bridge->session, seq, trailer, max - len);
+    __atomic_store_n(&bridge->tx_id[slot], bridge->tx_datagrams, __ATOMIC_RELAXED);
+    send_datagram(bridge, audio, len, trailer, trailer_len, (int32_t)slot);
+    for (uint32_t copy = 1; copy < copies; ++copy) {
+        pwar_dtx_set_copy(audio, copy);
+        send_datagram(bridge, audio, len, trailer, trailer_len, -1);
+    }
+    __atomic_add_fetch(&bridge->midi_tx_events, midi->count, __ATOMIC_RELAXED);
+    midi_done(bridge, &bridge->midi_tx);
+}
+
+static void stream_buffer(const float *samples, uint32_t n_samples, void *userdata) {
+    struct pwar_bridge *bridge = userdata;
+    rt_stream_packet_t packet;
+    packet.seq = bridge->sent_seq = bridge->seq;
+    bridge->seq = pwar_session_next(bridge->seq);
+    packet.session = bridge->session;
+    packet.n_samples = n_samples;
+    memcpy(packet.samples_ch1, samples, n_samples * sizeof(float));
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t timestamp = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    packet.ts_pipewire_send = timestamp;
+    bridge->tx_due_ns = schedule_period(bridge, n_samples, timestamp);
+    void *wire = &packet;
+    size_t len = sizeof(packet);
+    uint8_t dtx_buf[PWAR_DTX_MAX_PACKET];
+    // Taken once per period, so a switch lands on the period boundary
+    struct pwar_adapt_choice choice = pwar_adapt_unpack(__atomic_load_n(&bridge->adapt_choice, __ATOMIC_RELAXED));
+    if (bridge->cfg.dtx || bridge->cfg.adapt) {
+        uint32_t silent;
+        packet.ts_asio_recv = packet.ts_asio_send = 0;
+        len = pwar_dtx_encode_format(&packet, PWAR_BRIDGE_IN_CHANNELS, bridge->cfg.dtx ? bridge->dtx_threshold : 0.0f,
+                                     choice.format, dtx_buf, &silent);
+        wire = dtx_buf;
+        __atomic_add_fetch(&bridge->tx_channels, PWAR_BRIDGE_IN_CHANNELS, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&bridge->tx_silent, silent, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&bridge->tx_bytes, len * choice.copies, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bridge->tx_raw_bytes, sizeof(packet), __ATOMIC_RELAXED);
+    send_period(bridge, wire, len, packet.seq, choice.copies);
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_SEND, (uint32_t)packet.seq);
+    if (bridge->capture_enabled) {
+        struct pwar_capture_record rec = {
+            .ts_ns = timestamp,
+            .seq = packet.seq,
+            .ts_pipewire_send = timestamp,
+            .n_samples = packet.n_samples,
+            .type = PWAR_CAPTURE_SENT,
+        };
+        pwar_capture_write(&bridge->capture, &rec, packet.samples_ch1, NULL);
+    }
+    if (bridge->recording)
+        pwar_record_push(&bridge->record_tx, &samples, n_samples);
+}
+
+// Sends one network period and waits for its reply, which take_reply()
+// queues for the graph. This is what a whole cycle did before reblocking.
+static void exchange_period(struct pwar_bridge *bridge, const float *samples, uint32_t period) {
+    static const float *const silence[2] = { NULL, NULL };
+    struct pwar_reblock *rb = bridge->reblock;
+    stream_buffer(samples, period, bridge);
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_WAIT_BEGIN, (uint32_t)bridge->sent_seq);
+    int got_packet = 0;
+    uint64_t got_seq = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += bridge->playout.wait_ns / 1000000000;
+    ts.tv_nsec += bridge->playout.wait_ns % 1000000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+    if (wait_reply(bridge, period, &ts)) {
+        uint64_t now_ns = pwar_tstamp_now_ns();
+        pwar_stat_add(&bridge->queue_stat, (int64_t)(now_ns - bridge->reply.recv_ns) / 1000000.0);
+        publish_queue_stat(bridge, now_ns);
+        got_packet = 1;
+        got_seq = bridge->reply.packet.seq;
+    }
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_WAIT_END, (uint32_t)got_seq);
+    enum pwar_playout_decision decision = pwar_playout_decide(&bridge->playout, bridge->sent_seq, got_packet, got_seq);
+    if (bridge->resync_cycles) {
+        // Counting from the cycle that saw the resync up to the first one
+        // that plays the reply to its own packet
+        if (decision == PWAR_PLAYOUT_PLAYED) {
+            __atomic_store_n(&bridge->resync_clean_cycles, bridge->resync_cycles, __ATOMIC_RELAXED);
+            bridge->resync_cycles = 0;
+        } else {
+            bridge->resync_cycles++;
+        }
+    }
+    if (bridge->capture_enabled) {
+        struct pwar_capture_record rec = {
+            .ts_ns = pwar_tstamp_now_ns(),
+            .seq = bridge->sent_seq,
+            .played_seq = got_seq,
+            .n_samples = period,
+            .type = PWAR_CAPTURE_CYCLE,
+            .decision = decision,
+        };
+        pwar_capture_write(&bridge->capture, &rec, NULL, NULL);
+    }
+    if (!got_packet) {
+        // Counted as concealed by the playout; the stats thread reports it
+        __atomic_store_n(&bridge->missed_wanted_seq, (uint32_t)bridge->sent_seq, __ATOMIC_RELAXED);
+        __atomic_store_n(&bridge->missed_got_seq, (uint32_t)bridge->reply.packet.seq, __ATOMIC_RELAXED);
+        pwar_fifo_write(&rb->out, silence, period);
+    }
+}
+
+// Plays one quantum from the output FIFO. What it holds beyond the
+// reblocking latency was left by late replies, and the catch-up policy
+// works it off: skipped, with its MIDI moved to the start of the quantum,
+// or played slightly faster.
+static uint32_t read_output(struct pwar_bridge *bridge, float *const *out, uint32_t n) {
+    static float *const discard[PWAR_FIFO_MAX_CHANNELS] = { NULL, NULL };
+    struct pwar_reblock *rb = bridge->reblock;
+    pwar_midi_block_t *midi = &bridge->midi_out;
+    uint32_t fill = pwar_fifo_fill(&rb->out);
+    uint32_t normal = n + rb->latency;
+    pwar_catchup_action_t act = pwar_catchup_update(&bridge->catchup, fill > normal ? fill - normal : 0, n,
+                                                    pwar_tstamp_now_ns());
+    if (act.drop) {
+        pwar_midi_fifo_read(&rb->midi_out, rb->out.read_pos, act.drop, midi);
+        for (uint32_t i = 0; i < midi->count; ++i)
+            midi->events[i].offset = 0;
+        pwar_fifo_read(&rb->out, discard, act.drop);
+    }
+    if (!act.stretch || !bridge->catchup_buf) {
+        pwar_midi_fifo_read(&rb->midi_out, rb->out.read_pos, n, midi);
+        return pwar_fifo_read(&rb->out, out, n);
+    }
+    uint32_t m = n + act.stretch;
+    uint32_t first = midi->count;
+    pwar_midi_fifo_read(&rb->midi_out, rb->out.read_pos, m, midi);
+    for (uint32_t i = first; i < midi->count; ++i)
+        midi->events[i].offset = (uint16_t)((uint64_t)midi->events[i].offset * n / m);
+    float *buf[PWAR_FIFO_MAX_CHANNELS] = { bridge->catchup_buf, bridge->catchup_buf + PWAR_FIFO_FRAMES };
+    pwar_fifo_read(&rb->out, buf, m);
+    for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch) {
+        if (out[ch])
+            pwar_catchup_stretch(buf[ch], m, out[ch], n);
+    }
+    return n;
+}
+
+static void apply_sender_rt(struct pwar_bridge *bridge) {
+    if (!bridge->sender_rt_applied) {
+        // First cycle on the audio thread; the result is reported by the stats thread
+        pwar_rt_apply_thread(&bridge->cfg.rt, PWAR_RT_THREAD_SENDER, &bridge->rt_result[PWAR_RT_THREAD_SENDER]);
+        if (bridge->trace)
+            bridge->trace_audio = pwar_trace_register(bridge->trace, "audio");
+        bridge->sender_rt_applied = 1;
+    }
+}
+
+void pwar_bridge_process(struct pwar_bridge *bridge, float *in, float *const *out, uint32_t n_samples) {
+    apply_sender_rt(bridge);
+    PWAR_RT_SECTION_BEGIN();
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_PROCESS_BEGIN, (uint32_t)bridge->seq);
+    if (bridge->cfg.passthrough_test) {
+        for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch) {
+            if (out[ch])
+                memcpy(out[ch], in, n_samples * sizeof(float));
+        }
+        pwar_midi_copy(&bridge->midi_out, &bridge->midi_in);
+        pwar_midi_clear(&bridge->midi_in);
+        pwar_trace_point(bridge->trace_audio, PWAR_TRACE_PROCESS_END, (uint32_t)bridge->seq);
+        PWAR_RT_SECTION_END();
+        return;
+    }
+    midi_done(bridge, &bridge->midi_out);
+    if (bridge->test_signal) {
+        pwar_testsignal_generate(bridge->test_signal, in, n_samples);
+        pwar_testsignal_midi_generate(bridge->test_signal, &bridge->midi_in);
+    }
+
+    struct pwar_reblock *rb = bridge->reblock;
+    uint32_t period = bridge->cfg.net_period;
+    if (!period)
+        period = n_samples < MAX_NET_PERIOD ? n_samples : MAX_NET_PERIOD;
+    if (__atomic_exchange_n(&bridge->resync, 0, __ATOMIC_ACQUIRE)) {
+        // The peer restarted: its old audio still queued is flushed with the
+        // FIFOs, and the playout forgets what it played last.
+        bridge->playout.have_last = 0;
+        bridge->resync_cycles = 1;
+        pwar_reblock_configure(rb, n_samples, period);
+    }
+    if (n_samples != rb->quantum || period != rb->period)
+        pwar_reblock_configure(rb, n_samples, period);
+
+    const float *src[1] = { in };
+    pwar_midi_fifo_write(&rb->midi_in, rb->in.write_pos, &bridge->midi_in);
+    midi_done(bridge, &bridge->midi_in);
+    pwar_fifo_write(&rb->in, src, n_samples);
+    while (pwar_fifo_fill(&rb->in) >= period) {
+        float block[MAX_NET_PERIOD];
+        float *dst[1] = { block };
+        pwar_midi_fifo_read(&rb->midi_in, rb->in.read_pos, period, &bridge->midi_tx);
+        pwar_fifo_read(&rb->in, dst, period);
+        exchange_period(bridge, block, period);
+    }
+
+    // Priming guarantees a full quantum here, only a quantum larger than
+    // the FIFO itself can come up short.
+    uint32_t got = read_output(bridge, out, n_samples);
+    for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch) {
+        if (out[ch] && got < n_samples)
+            memset(out[ch] + got, 0, (n_samples - got) * sizeof(float));
+    }
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_OUTPUT_WRITE, (uint32_t)bridge->seq);
+    if (bridge->test_signal) {
+        pwar_testsignal_midi_capture(bridge->test_signal, &bridge->midi_out);
+        pwar_testsignal_capture(bridge->test_signal, out[0], n_samples);
+    }
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_PROCESS_END, (uint32_t)bridge->seq);
+    PWAR_RT_SECTION_END();
+}
+
+void pwar_bridge_set_wake(struct pwar_bridge *bridge, pwar_bridge_wake_fn wake, void *userdata) {
+    bridge->wake = wake;
+    bridge->wake_data = userdata;
+}
+
+int pwar_bridge_driver_begin(struct pwar_bridge *bridge, struct pwar_driver_clock *clock) {
+    const rt_stream_packet_t *pkt = &bridge->reply.packet;
+    apply_sender_rt(bridge);
+    PWAR_RT_SECTION_BEGIN();
+    bridge->driver_have_packet = take_reply(bridge, 0);
+    PWAR_RT_SECTION_END();
+    if (!bridge->driver_have_packet)
+        return 0;
+    clock->nsec = bridge->reply.driver_nsec;
+    clock->next_nsec = bridge->reply.driver_next_nsec;
+    clock->rate_diff = bridge->reply.driver_rate_diff;
+    clock->position = bridge->driver_position;
+    clock->duration = pkt->n_samples;
+    bridge->driver_position += pkt->n_samples;
+    return 1;
+}
+
+// Plays the peer's audio and answers with our input under the peer's seq.
+// The period is the peer's, so there is no reblocking.
+void pwar_bridge_driver_process(struct pwar_bridge *bridge, float *in, float *const *out, uint32_t n_samples) {
+    const rt_stream_packet_t *pkt = &bridge->reply.packet;
+    const float *reply[PWAR_BRIDGE_OUT_CHANNELS] = { pkt->samples_ch1, pkt->samples_ch2 };
+    PWAR_RT_SECTION_BEGIN();
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_PROCESS_BEGIN, (uint32_t)pkt->seq);
+    if (bridge->test_signal && in) {
+        pwar_testsignal_generate(bridge->test_signal, in, n_samples);
+        pwar_testsignal_midi_generate(bridge->test_signal, &bridge->midi_in);
+    }
+    midi_done(bridge, &bridge->midi_out);
+    if (bridge->driver_have_packet) {
+        // The period is the peer's, its MIDI plays at the offsets it was sent with
+        pwar_midi_copy(&bridge->midi_out, &bridge->midi_reply);
+        pwar_midi_clear(&bridge->midi_reply);
+    }
+
+    uint32_t n = bridge->driver_have_packet ? (pkt->n_samples < n_samples ? pkt->n_samples : n_samples) : 0;
+    if (n == n_samples) {
+        // The usual case, a full period: picked again only when the quantum changes
+        if (bridge->driver_kernel.frames != n)
+            pwar_kernel_select(&bridge->driver_kernel, PWAR_BRIDGE_OUT_CHANNELS, n,
+                               RT_STREAM_PACKET_FRAME_SIZE / 2, PWAR_FORMAT_F32);
+        bridge->driver_kernel.decode(&bridge->driver_kernel, pkt->samples_ch1, out);
+    } else {
+        for (int ch = 0; ch < PWAR_BRIDGE_OUT_CHANNELS; ++ch) {
+            if (!out[ch])
+                continue;
+            memcpy(out[ch], reply[ch], n * sizeof(float));
+            memset(out[ch] + n, 0, (n_samples - n) * sizeof(float));
+        }
+    }
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_OUTPUT_WRITE, (uint32_t)pkt->seq);
+    if (bridge->driver_have_packet && in) {
+        // Echo the peer's seq so it can pair the reply with its period
+        bridge->seq = pkt->seq;
+        pwar_midi_copy(&bridge->midi_tx, &bridge->midi_in);
+        stream_buffer(in, n, bridge);
+    }
+    midi_done(bridge, &bridge->midi_in);
+    if (bridge->test_signal) {
+        pwar_testsignal_midi_capture(bridge->test_signal, &bridge->midi_out);
+        pwar_testsignal_capture(bridge->test_signal, out[0], n_samples);
+    }
+    pwar_trace_point(bridge->trace_audio, PWAR_TRACE_PROCESS_END, (uint32_t)pkt->seq);
+    PWAR_RT_SECTION_END();
+}
+
+void pwar_bridge_xrun(struct pwar_bridge *bridge) {
+    __atomic_add_fetch(&bridge->xruns, 1, __ATOMIC_RELAXED);
+}
+
+uint32_t pwar_bridge_latency_frames(struct pwar_bridge *bridge) {
+    struct pwar_testsignal *ts = bridge->test_signal;
+    if (ts && pwar_testsignal_measures(ts) && __atomic_load_n(&ts->results.have_latency, __ATOMIC_ACQUIRE))
+        return (uint32_t)__atomic_load_n(&ts->results.latency, __ATOMIC_RELAXED);
+    return __atomic_load_n(&bridge->reblock->latency, __ATOMIC_RELAXED);
+}
+
+int pwar_bridge_init(struct pwar_bridge *bridge, const struct pwar_bridge_config *cfg) {
+    memset(bridge, 0, sizeof(*bridge));
+    bridge->cfg = *cfg;
+
+    setup_socket(bridge, cfg->stream_ip, cfg->stream_port);
+
+    setup_recv_socket(bridge, cfg->local_port >= 0 ? cfg->local_port : cfg->stream_port);
+    bridge->ts_mode = pwar_tstamp_enable(bridge->recv_sockfd, cfg->ts_mode, cfg->ts_iface, 0);
+    if (bridge->ts_mode != PWAR_TSTAMP_OFF)
+        bridge->ts_mode = pwar_tstamp_enable(bridge->sockfd, bridge->ts_mode, cfg->ts_iface, 1);
+    printf("[ts] kernel timestamping: %s\n", pwar_tstamp_mode_name(bridge->ts_mode));
+    // Replies and reports leave through the receive socket too
+    pwar_qos_mark(bridge->sockfd, cfg->dscp, cfg->so_priority);
+    pwar_qos_mark(bridge->recv_sockfd, cfg->dscp, cfg->so_priority);
+    bridge->txtime = pwar_txtime_enable(bridge->sockfd, cfg->txtime);
+    pwar_dll_init(&bridge->tx_dll, PWAR_DLL_DEFAULT_BANDWIDTH);
+    if (cfg->dscp != PWAR_QOS_UNSET || cfg->so_priority != PWAR_QOS_UNSET || bridge->txtime != PWAR_TXTIME_OFF) {
+        printf("[qos] dscp %d, priority %d, txtime %s", cfg->dscp, cfg->so_priority, pwar_txtime_mode_name(bridge->txtime));
+        if (bridge->txtime != PWAR_TXTIME_OFF)
+            printf(" %.3f ms after the period clock", cfg->txtime_delay_ns / 1000000.0);
+        printf("\n");
+    }
+    pwar_stat_reset(&bridge->queue_stat);
+    pwar_clock_init(&bridge->clock);
+    pwar_playout_init(&bridge->playout, cfg->wait_ns);
+    pwar_catchup_init(&bridge->catchup, cfg->catchup, cfg->catchup_target);
+    if (cfg->catchup != PWAR_CATCHUP_NEWEST)
+        printf("[catchup] %s, target %u periods\n", pwar_catchup_policy_name(cfg->catchup), bridge->catchup.target);
+    pwar_session_init(&bridge->peer);
+    pwar_midi_rx_init(&bridge->midi_rx);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    bridge->session = pwar_session_new_id(((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec) ^ ((uint64_t)getpid() << 32));
+    bridge->seq = PWAR_SESSION_SEQ(bridge->session, 0);
+    printf("[session] %08x\n", bridge->session);
+    pwar_dll_init(&bridge->driver_dll, PWAR_DLL_DEFAULT_BANDWIDTH);
+    bridge->dtx_threshold = pwar_dtx_level(cfg->dtx_threshold_db);
+    pwar_dtx_noise_init(&bridge->dtx_noise, cfg->dtx_noise_db < 0 ? pwar_dtx_level(cfg->dtx_noise_db) : 0.0f);
+    if (cfg->dtx)
+        printf("[dtx] sending silent channels as a bit below %.1f dBFS\n", cfg->dtx_threshold_db);
+    pwar_adapt_init(&bridge->adapt);
+    bridge->adapt_choice = pwar_adapt_pack(&bridge->adapt.choice);
+    if (cfg->adapt && cfg->driver) {
+        // Loss is judged from the playout decisions, which driver mode lacks
+        fprintf(stderr, "--adapt does not work with --driver\n");
+        return -EINVAL;
+    }
+    if (cfg->adapt)
+        printf("[adapt] packing and copies follow the link: f32, s24 or s16, up to %d copies\n", PWAR_ADAPT_MAX_COPIES);
+    if (cfg->auth_key_file) {
+        uint8_t key[PWAR_AUTH_KEY_SIZE];
+        int rc = pwar_auth_load_key(cfg->auth_key_file, key);
+        if (rc < 0) {
+            fprintf(stderr, "can't read a key of %d hex bytes from %s: %s\n", PWAR_AUTH_KEY_SIZE,
+                cfg->auth_key_file, strerror(-rc));
+            return rc;
+        }
+        pwar_auth_init(&bridge->auth, cfg->encrypt ? PWAR_AUTH_ENCRYPT : PWAR_AUTH_SIGN, key, bridge->session);
+        memset(key, 0, sizeof(key));
+        bridge->auth_enabled = 1;
+        printf("[auth] %s with the key from the file, %d byte tags\n",
+            pwar_auth_mode_name(bridge->auth.mode), PWAR_AUTH_TAG_SIZE);
+    } else if (cfg->encrypt) {
+        fprintf(stderr, "--encrypt needs --auth-key-file\n");
+        return -EINVAL;
+    }
+    if (cfg->capture_path) {
+        int rc = cfg->capture_records ?
+            pwar_capture_create(&bridge->capture, cfg->capture_path, cfg->capture_records, cfg->capture_audio, cfg->wait_ns) :
+            -EINVAL;
+        if (rc < 0) {
+            fprintf(stderr, "can't create capture %s: %s\n", cfg->capture_path, strerror(-rc));
+            return rc;
+        }
+        bridge->capture_enabled = 1;
+        printf("[capture] %s: %lu records%s\n", cfg->capture_path, cfg->capture_records, cfg->capture_audio ? " with audio" : "");
+    }
+    if (cfg->record_prefix) {
+        int rc = pwar_record_start(&bridge->record_tx, cfg->record_prefix, "tx", cfg->record_format,
+                                   PWAR_BRIDGE_IN_CHANNELS, PWAR_BRIDGE_RATE, cfg->record_rotate_s);
+        if (rc == 0) {
+            rc = pwar_record_start(&bridge->record_rx, cfg->record_prefix, "rx", cfg->record_format,
+                                   PWAR_BRIDGE_OUT_CHANNELS, PWAR_BRIDGE_RATE, cfg->record_rotate_s);
+            if (rc < 0)
+                pwar_record_stop(&bridge->record_tx);
+        }
+        if (rc < 0) {
+            fprintf(stderr, "can't record to %s: %s\n", cfg->record_prefix, strerror(-rc));
+            return rc;
+        }
+        bridge->recording = 1;
+        printf("[record] %s-tx-001.%s and %s-rx-001.%s%s\n", cfg->record_prefix, pwar_record_format_name(cfg->record_format),
+            cfg->record_prefix, pwar_record_format_name(cfg->record_format),
+            bridge->record_tx.direct ? "" : ", O_DIRECT not supported there");
+    }
+    sem_init(&bridge->reply_sem, 0, 0);
+    sem_init(&bridge->paced_sem, 0, 0);
+    pthread_mutex_init(&bridge->stats_mutex, NULL);
+    pthread_cond_init(&bridge->stats_cond, NULL);
+    // The session's state is sized here once, the RT threads never allocate
+    size_t arena_size = pwar_arena_size(sizeof(*bridge->reblock));
+    size_t catchup_size = PWAR_FIFO_MAX_CHANNELS * PWAR_FIFO_FRAMES * sizeof(float);
+    if (cfg->catchup == PWAR_CATCHUP_STRETCH)
+        arena_size += pwar_arena_size(catchup_size);
+    if (cfg->test_signal != PWAR_TEST_NONE)
+        arena_size += pwar_arena_size(sizeof(*bridge->test_signal));
+    if (cfg->trace_path)
+        arena_size += pwar_arena_size(sizeof(*bridge->trace));
+    int rc = pwar_arena_init(&bridge->arena, arena_size);
+    if (rc < 0) {
+        fprintf(stderr, "can't map %zu bytes of session memory: %s\n", arena_size, strerror(-rc));
+        return rc;
+    }
+    bridge->reblock = pwar_arena_alloc(&bridge->arena, sizeof(*bridge->reblock));
+    if (cfg->catchup == PWAR_CATCHUP_STRETCH)
+        bridge->catchup_buf = pwar_arena_alloc(&bridge->arena, catchup_size);
+    if (cfg->test_signal != PWAR_TEST_NONE) {
+        bridge->test_signal = pwar_arena_alloc(&bridge->arena, sizeof(*bridge->test_signal));
+        pwar_testsignal_init(bridge->test_signal, cfg->test_signal, cfg->test_freq, cfg->test_interval_ms);
+    }
+    if (cfg->trace_path) {
+        bridge->trace = pwar_arena_alloc(&bridge->arena, sizeof(*bridge->trace));
+        pwar_trace_init(bridge->trace);
+        printf("[trace] tracing to %s-NNNN.json, kill -USR1 %d dumps on demand\n", cfg->trace_path, getpid());
+    }
+    return 0;
+}
+
+void pwar_bridge_start(struct pwar_bridge *bridge) {
+    printf("[rt] memory: %s\n", pwar_rt_lock_memory(&bridge->cfg.rt));
+    pwar_rt_prefault(bridge, sizeof(*bridge));
+    pwar_rt_prefault(bridge->arena.base, bridge->arena.size);
+    if (bridge->trace) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_trace_signal;
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+    pthread_attr_t attr;
+    pwar_rt_thread_attr_init(&attr, &bridge->cfg.rt);
+    pthread_t recv_thread, stats_tid;
+    pthread_create(&recv_thread, &attr, receiver_thread, bridge);
+    pthread_create(&stats_tid, &attr, stats_thread, bridge);
+    if (bridge->txtime == PWAR_TXTIME_PACE) {
+        pthread_t pacer_tid;
+        pthread_create(&pacer_tid, &attr, pacer_thread, bridge);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void pwar_bridge_destroy(struct pwar_bridge *bridge) {
+    if (bridge->trace)
+        dump_trace(bridge, "exit");
+    if (bridge->capture_enabled)
+        pwar_capture_close(&bridge->capture);
+    if (bridge->recording) {
+        pwar_record_stop(&bridge->record_tx);
+        pwar_record_stop(&bridge->record_rx);
+    }
+    pwar_arena_destroy(&bridge->arena);
+    sem_destroy(&bridge->reply_sem);
+    sem_destroy(&bridge->paced_sem);
+}
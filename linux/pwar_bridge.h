@@ -0,0 +1,322 @@
+/*
+ * pwar_bridge.h - Network core of the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Everything between the audio callback and the wire: sockets, the receiver
+ * and stats threads, reblocking, playout decisions, captures and test
+ * signals. An audio backend (see pwar_backend.h) owns the device or graph
+ * and calls pwar_bridge_process() once per cycle from its RT thread.
+ */
+
+#ifndef PWAR_BRIDGE
+#define PWAR_BRIDGE
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include "pwar_packet.h"
+#include "pwar_adapt.h"
+#include "pwar_arena.h"
+#include "pwar_auth.h"
+#include "pwar_clock.h"
+#include "pwar_dll.h"
+#include "pwar_dtx.h"
+#include "pwar_kernels.h"
+#include "pwar_midi.h"
+#include "pwar_capture.h"
+#include "pwar_catchup.h"
+#include "pwar_record.h"
+#include "pwar_playout.h"
+#include "pwar_qos.h"
+#include "pwar_session.h"
+#include "pwar_reblock.h"
+#include "pwar_rt.h"
+#include "pwar_stats.h"
+#include "pwar_testsignal.h"
+#include "pwar_trace.h"
+#include "pwar_tstamp.h"
+
+#define PWAR_BRIDGE_DEFAULT_IP "192.168.66.3"
+#define PWAR_BRIDGE_DEFAULT_PORT 8321
+#define PWAR_BRIDGE_DEFAULT_QUANTUM 128
+#define PWAR_BRIDGE_RATE 48000
+#define PWAR_BRIDGE_IN_CHANNELS 1
+#define PWAR_BRIDGE_OUT_CHANNELS 2
+#define PWAR_BRIDGE_MAX_NET_PERIOD (RT_STREAM_PACKET_FRAME_SIZE / 2)
+#define PWAR_BRIDGE_REPLY_SLOTS 16
+#define PWAR_BRIDGE_PACED_SLOTS 32        // datagrams, several periods with MIDI and copies
+#define PWAR_BRIDGE_DEFAULT_MCAST_TTL 1
+
+struct pwar_bridge_config {
+    char stream_ip[64];                   // a multicast group sends to every listener at once
+    int stream_port;
+    int mcast_ttl;
+    char mcast_iface[IFNAMSIZ];           // empty lets the routing table pick
+    int mcast_loop;                       // deliver to listeners on this host too
+    int local_port;                       // -1 uses stream_port
+    uint32_t quantum;                     // frames per audio cycle asked from the backend
+    uint32_t net_period;                  // frames per packet, 0 follows the quantum
+    int driver;
+    int passthrough_test;
+    enum pwar_test_signal test_signal;
+    float test_freq;
+    uint32_t test_interval_ms;
+    enum pwar_tstamp_mode ts_mode;
+    char ts_iface[IFNAMSIZ];
+    uint64_t wait_ns;
+    enum pwar_catchup_policy catchup;     // for replies that queued up behind a stall
+    uint32_t catchup_target;              // periods, drop and stretch
+    const char *capture_path;
+    uint64_t capture_records;
+    int capture_audio;
+    const char *record_prefix;            // audio of each direction to files, NULL disables
+    enum pwar_record_format record_format;
+    uint32_t record_rotate_s;
+    const char *trace_path;               // dump prefix, NULL disables tracing
+    int dtx;                              // send silent channels as a bit only
+    double dtx_threshold_db;
+    double dtx_noise_db;                  // comfort noise for silent channels we receive, 0 is off
+    int adapt;                            // packing and copies follow the link, see pwar_adapt.h
+    const char *auth_key_file;            // pre-shared key, NULL sends and takes anything
+    int encrypt;                          // the payload too, not only a tag
+    int dscp;                             // PWAR_QOS_UNSET leaves the sockets alone
+    int so_priority;
+    enum pwar_txtime_mode txtime;
+    uint64_t txtime_delay_ns;             // departure after the period clock's tick
+    struct pwar_rt_config rt;
+};
+
+struct pwar_latency_stats {
+    struct pwar_stat total, daw, net;
+    // One-way split using the estimated clock offset
+    struct pwar_stat upstream, downstream;
+    double offset_ms;
+    double skew_ppm;
+    // Breakdown from kernel timestamps, all in ms
+    struct pwar_stat send;                // process sendto -> packet left the host
+    struct pwar_stat wire;                // left the host -> reply arrived, minus the DAW part
+    struct pwar_stat wakeup;              // reply arrived -> receiver_thread got it
+    struct pwar_stat queue;               // receiver_thread got it -> process consumed it
+    // Left the host against the departure it was due, either way
+    struct pwar_stat departure;
+    int departure_kernel;                 // from TX timestamps, else from sendmsg returning
+    // Driver mode: packet arrivals against the DLL prediction
+    struct pwar_stat jitter;
+    double rate_ppm;
+    int count;
+};
+
+// Graph clock for one driver mode cycle, derived from the peer's packets
+struct pwar_driver_clock {
+    uint64_t nsec;                        // smoothed start of this period
+    uint64_t next_nsec;
+    double rate_diff;
+    uint64_t position;                    // frames since the first cycle
+    uint32_t duration;                    // frames in this period
+};
+
+// One received packet on its way from the receiver to the audio thread
+struct pwar_reply {
+    rt_stream_packet_t packet;
+    uint64_t recv_ns;
+    uint64_t driver_nsec;                 // driver mode: smoothed period start
+    uint64_t driver_next_nsec;
+    double driver_rate_diff;
+};
+
+// One datagram on its way from the audio thread to the pacer, sealed
+struct pwar_paced {
+    uint8_t buf[PWAR_MIDI_MAX_DATAGRAM];
+    size_t len;
+    uint64_t due_ns;
+    int32_t slot;                         // tx_sent slot to stamp, -1 for MIDI ahead and copies
+};
+
+typedef void (*pwar_bridge_wake_fn)(void *userdata);
+
+struct pwar_bridge {
+    struct pwar_bridge_config cfg;
+    struct pwar_arena arena;              // holds everything allocated below, sized in init
+    struct pwar_testsignal *test_signal;  // NULL unless --test / --test-signal
+    uint64_t seq;                         // next to send, our session in the top half
+    uint64_t sent_seq;                    // audio thread only
+    uint32_t session;                     // ours, new on every run
+    int sockfd;
+    struct sockaddr_in servaddr;
+    int recv_sockfd;
+
+    // Replies reach the audio thread through a single producer ring. The
+    // semaphore only wakes a waiting audio thread, so the audio thread never
+    // blocks on a lock the lower priority receiver could be holding.
+    struct pwar_reply replies[PWAR_BRIDGE_REPLY_SLOTS];
+    // The MIDI of each slot is kept apart so taking a reply only copies the
+    // events in use
+    pwar_midi_block_t reply_midi[PWAR_BRIDGE_REPLY_SLOTS];
+    uint32_t reply_write;                 // receiver_thread, atomic
+    uint32_t reply_read;                  // audio thread, atomic
+    sem_t reply_sem;
+    struct pwar_reply reply;              // audio thread only, newest reply taken
+    pwar_midi_block_t midi_reply;         // audio thread only, MIDI of every reply taken and not yet played
+    struct pwar_stat queue_stat;          // audio thread only
+    struct pwar_stat queue_report;        // handed to the receiver while queue_ready
+    int queue_ready;                      // atomic
+    uint64_t queue_since_ns;              // audio thread only
+
+    enum pwar_tstamp_mode ts_mode;
+    struct pwar_tstamp_tx tx_stamps;      // receiver_thread only
+    // MIDI only datagrams shift the socket's OPT_ID counter away from seq,
+    // so the audio thread files each period's datagram id here, atomic.
+    uint32_t tx_id[PWAR_TSTAMP_TX_SLOTS];
+    uint32_t tx_datagrams;                // audio thread only
+
+    // Departure scheduling (see pwar_qos.h). The period clock is a DLL over
+    // the times periods are handed to the sender; each leaves txtime_delay
+    // after its tick. With txtime off the same clock measures the jitter.
+    enum pwar_txtime_mode txtime;
+    pwar_dll_t tx_dll;                    // audio thread only
+    uint64_t tx_due_ns;                   // audio thread only, the period being sent
+    // Per period, atomic: when it was due to leave and when sendmsg returned
+    uint64_t tx_due[PWAR_TSTAMP_TX_SLOTS];
+    uint64_t tx_sent[PWAR_TSTAMP_TX_SLOTS];
+    uint64_t tx_late;                     // atomic, handed over after their departure time
+    // --txtime pace: the audio thread only queues each datagram, the pacer
+    // thread waits for its departure and sends it. A single producer ring
+    // like the replies', a full one drops the datagram as a send error.
+    struct pwar_paced paced[PWAR_BRIDGE_PACED_SLOTS];
+    uint32_t paced_write;                 // audio thread, atomic
+    uint32_t paced_read;                  // pacer_thread, atomic
+    sem_t paced_sem;
+    pwar_clock_t clock;                   // receiver_thread only
+
+    struct pwar_playout playout;          // audio thread only
+
+    // The peer's session. When it restarts or its seq jumps the receiver
+    // flushes its own estimates and raises resync for the audio thread,
+    // which counts the cycles until a reply plays again.
+    pwar_session_t peer;                  // receiver_thread only
+    int resync;                           // atomic
+    uint32_t resync_cycles;               // audio thread only, 0 when not resyncing
+    uint32_t peer_session;                // atomic, for reporting
+    uint64_t resyncs, stale_replies;      // atomic
+    uint32_t resync_clean_cycles;         // atomic, last time to a played reply
+    struct pwar_reblock *reblock;         // audio thread only, generation read by the stats thread
+    // Works off what the output FIFO holds beyond the reblocking latency
+    pwar_catchup_t catchup;               // audio thread only, counters read by the stats thread
+    float *catchup_buf;                   // stretch only, PWAR_FIFO_MAX_CHANNELS * PWAR_FIFO_FRAMES
+
+    // Driver mode: the peer sends on its own clock and every packet drives
+    // one audio cycle, so the whole graph runs locked to the remote side.
+    pwar_dll_t driver_dll;                // receiver_thread only
+    uint64_t driver_position;             // audio thread only
+    int driver_have_packet;               // audio thread only
+    pwar_kernel_t driver_kernel;          // audio thread only, for the current quantum
+    pwar_bridge_wake_fn wake;
+    void *wake_data;
+
+    // MIDI of the current cycle, audio thread only. The backend fills
+    // midi_in before pwar_bridge_process() and plays midi_out after it,
+    // offsets are frames into the cycle.
+    pwar_midi_block_t midi_in;
+    pwar_midi_block_t midi_out;
+    pwar_midi_block_t midi_tx;            // audio thread only, the network period being sent
+    pwar_midi_rx_t midi_rx;               // receiver_thread only
+    uint64_t midi_tx_events, midi_rx_events, midi_dropped;  // atomic
+
+    struct pwar_capture capture;
+    int capture_enabled;
+
+    // Recording tap: what we send (audio thread) and what comes back
+    // (receiver_thread), each the single producer of its recording
+    struct pwar_record record_tx;
+    struct pwar_record record_rx;
+    int recording;
+
+    // Timeline tracing, dumped by the stats thread on SIGUSR1, on xruns and
+    // on concealed cycles, and once more on exit.
+    struct pwar_trace *trace;             // NULL unless --trace
+    struct pwar_trace_ring *trace_audio;  // audio thread only
+    struct pwar_trace_ring *trace_recv;   // receiver_thread only
+    uint32_t trace_dumps;
+
+    uint64_t xruns;                       // reported by the backend, atomic
+
+    // Errors on the audio thread are only counted there and printed by the
+    // stats thread, all atomic.
+    uint64_t missed_wanted_seq, missed_got_seq;
+    uint64_t send_errors;
+    int send_errno;
+
+    // DTX: totals since start, atomic. raw is what full packets would have taken.
+    float dtx_threshold;
+    pwar_dtx_noise_t dtx_noise;           // receiver_thread only
+    uint64_t tx_bytes, tx_raw_bytes, tx_channels, tx_silent;
+    uint64_t rx_bytes, rx_raw_bytes, rx_channels, rx_silent;
+
+    // Adaptive encoding: the stats thread decides from every stats window,
+    // the audio thread packs each period with the choice it finds as the
+    // period starts
+    pwar_adapt_t adapt;                   // stats thread only
+    uint32_t adapt_choice;                // atomic, pwar_adapt_pack()
+    uint64_t copies_dropped;              // atomic, redundant copies of the peer's periods
+    uint64_t copies_saved;                // atomic, periods whose first copy never came
+
+    // Pre-shared key: the audio thread seals, receiver_thread opens and the
+    // stats thread reads the counters
+    pwar_auth_t auth;
+    int auth_enabled;
+    uint8_t auth_buf[PWAR_MIDI_MAX_DATAGRAM]; // audio thread only, the datagram being sealed
+
+    struct pwar_rt_thread_result rt_result[PWAR_RT_THREAD_COUNT];
+    int rt_reported[PWAR_RT_THREAD_COUNT];
+    int sender_rt_applied;
+
+    // Latency windows are handed from the receiver to the stats thread, which
+    // does the printing so the receiver never blocks on stdout.
+    pthread_mutex_t stats_mutex;
+    pthread_cond_t stats_cond;
+    struct pwar_latency_stats stats_report;
+    int stats_report_ready;
+};
+
+void pwar_bridge_config_defaults(struct pwar_bridge_config *cfg);
+
+// Handles the option at argv[i]. Returns how many arguments it used, 0 if
+// the option is not a bridge option and -1 after printing an error.
+int pwar_bridge_parse_arg(struct pwar_bridge_config *cfg, int argc, char *argv[], int i);
+
+// Opens the sockets and allocates everything the audio thread touches.
+// Exits on socket errors like the bridge always did, returns < 0 otherwise.
+int pwar_bridge_init(struct pwar_bridge *bridge, const struct pwar_bridge_config *cfg);
+
+// Locks memory and starts the receiver and stats threads. Backends call it
+// once their audio side exists, PipeWire's RT module must be loaded first
+// for rtkit to hand out priorities.
+void pwar_bridge_start(struct pwar_bridge *bridge);
+
+void pwar_bridge_destroy(struct pwar_bridge *bridge);
+
+// Audio thread, once per cycle. in is overwritten when a test signal runs,
+// out[ch] may be NULL for an unconnected channel. MIDI goes in and out
+// through bridge->midi_in and bridge->midi_out.
+void pwar_bridge_process(struct pwar_bridge *bridge, float *in, float *const *out, uint32_t n_samples);
+
+// Driver mode. wake is called from the receiver for every packet and must
+// make the backend run a cycle; that cycle calls driver_begin for the clock
+// and then driver_process with the buffers.
+void pwar_bridge_set_wake(struct pwar_bridge *bridge, pwar_bridge_wake_fn wake, void *userdata);
+int pwar_bridge_driver_begin(struct pwar_bridge *bridge, struct pwar_driver_clock *clock);
+void pwar_bridge_driver_process(struct pwar_bridge *bridge, float *in, float *const *out, uint32_t n_samples);
+
+// Backends report their own overruns and underruns here
+void pwar_bridge_xrun(struct pwar_bridge *bridge);
+
+// Frames between a sample entering pwar_bridge_process() and the remote
+// result leaving it: the loopback measurement when a test signal measures
+// one, the reblocking delay otherwise. Safe from any thread.
+uint32_t pwar_bridge_latency_frames(struct pwar_bridge *bridge);
+
+#endif /* PWAR_BRIDGE */
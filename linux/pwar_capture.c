@@ -0,0 +1,141 @@
+/*
+ * pwar_capture.c - Session capture for offline replay of PWAR bridge sessions
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pwar_capture.h"
+
+static void capture_init_layout(struct pwar_capture *cap, void *map, size_t map_size) {
+    cap->header = map;
+    cap->records = (uint8_t *)map + PWAR_CAPTURE_HEADER_SIZE;
+    cap->map_size = map_size;
+    cap->record_size = cap->header->record_size;
+    cap->capacity = cap->header->capacity;
+}
+
+int pwar_capture_create(struct pwar_capture *cap, const char *path, uint64_t capacity,
+                        int with_audio, uint64_t wait_ns) {
+    uint32_t record_size = sizeof(struct pwar_capture_record) + (with_audio ? PWAR_CAPTURE_AUDIO_SIZE : 0);
+    size_t map_size = PWAR_CAPTURE_HEADER_SIZE + (size_t)capacity * record_size;
+
+    memset(cap, 0, sizeof(*cap));
+    if (capacity == 0)
+        return -EINVAL;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -errno;
+    // Reserve the blocks up front: a full disk must fail here and not as a
+    // SIGBUS on the audio thread later on.
+    int rc = posix_fallocate(fd, 0, (off_t)map_size);
+    if (rc != 0) {
+        close(fd);
+        return -rc;
+    }
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -errno;
+
+    struct pwar_capture_header *h = map;
+    memcpy(h->magic, PWAR_CAPTURE_MAGIC, sizeof(h->magic));
+    h->version = PWAR_CAPTURE_VERSION;
+    h->flags = with_audio ? PWAR_CAPTURE_FLAG_AUDIO : 0;
+    h->record_size = record_size;
+    h->capacity = capacity;
+    h->wait_ns = wait_ns;
+    h->write_index = 0;
+    capture_init_layout(cap, map, map_size);
+    // Keep the ring resident; MAP_POPULATE already touched every page
+    mlock(map, map_size);
+    return 0;
+}
+
+int pwar_capture_open(struct pwar_capture *cap, const char *path) {
+    memset(cap, 0, sizeof(*cap));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < PWAR_CAPTURE_HEADER_SIZE) {
+        close(fd);
+        return -EINVAL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -errno;
+    // The header comes from disk: a capacity of 0 would divide by zero in
+    // every lookup, and capacity * record_size must not wrap around past
+    // the size check
+    const struct pwar_capture_header *h = map;
+    uint64_t records_size;
+    if (memcmp(h->magic, PWAR_CAPTURE_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != PWAR_CAPTURE_VERSION ||
+        h->record_size < sizeof(struct pwar_capture_record) ||
+        h->capacity == 0 ||
+        __builtin_mul_overflow(h->capacity, (uint64_t)h->record_size, &records_size) ||
+        records_size > (uint64_t)st.st_size - PWAR_CAPTURE_HEADER_SIZE) {
+        munmap(map, st.st_size);
+        return -EINVAL;
+    }
+    capture_init_layout(cap, map, st.st_size);
+    return 0;
+}
+
+void pwar_capture_close(struct pwar_capture *cap) {
+    if (cap->header)
+        munmap(cap->header, cap->map_size);
+    memset(cap, 0, sizeof(*cap));
+}
+
+void pwar_capture_write(struct pwar_capture *cap, const struct pwar_capture_record *rec,
+                        const float *ch1, const float *ch2) {
+    uint64_t index = __atomic_fetch_add(&cap->header->write_index, 1, __ATOMIC_RELAXED);
+    struct pwar_capture_record *dst =
+        (struct pwar_capture_record *)(cap->records + (index % cap->capacity) * cap->record_size);
+
+    // Invalidate first so a reader never pairs the old commit with new contents
+    __atomic_store_n(&dst->commit, 0, __ATOMIC_RELEASE);
+    uint64_t commit = index + 1;
+    memcpy((uint8_t *)dst + sizeof(dst->commit), (const uint8_t *)rec + sizeof(rec->commit),
+           sizeof(*rec) - sizeof(rec->commit));
+    if (cap->header->flags & PWAR_CAPTURE_FLAG_AUDIO) {
+        float *audio = (float *)(dst + 1);
+        size_t ch_size = PWAR_CAPTURE_AUDIO_SIZE / 2;
+        if (ch1)
+            memcpy(audio, ch1, ch_size);
+        else
+            memset(audio, 0, ch_size);
+        if (ch2)
+            memcpy(audio + RT_STREAM_PACKET_FRAME_SIZE / 2, ch2, ch_size);
+        else
+            memset(audio + RT_STREAM_PACKET_FRAME_SIZE / 2, 0, ch_size);
+    }
+    __atomic_store_n(&dst->commit, commit, __ATOMIC_RELEASE);
+}
+
+void pwar_capture_range(const struct pwar_capture *cap, uint64_t *first, uint64_t *end) {
+    uint64_t written = __atomic_load_n(&cap->header->write_index, __ATOMIC_ACQUIRE);
+    *end = written;
+    *first = written > cap->capacity ? written - cap->capacity : 0;
+}
+
+const struct pwar_capture_record *pwar_capture_get(const struct pwar_capture *cap, uint64_t index) {
+    const struct pwar_capture_record *rec =
+        (const struct pwar_capture_record *)(cap->records + (index % cap->capacity) * cap->record_size);
+    // A record that was being written when the session ended is skipped
+    return __atomic_load_n(&rec->commit, __ATOMIC_ACQUIRE) == index + 1 ? rec : NULL;
+}
+
+const float *pwar_capture_audio(const struct pwar_capture *cap, const struct pwar_capture_record *rec) {
+    return (cap->header->flags & PWAR_CAPTURE_FLAG_AUDIO) ? (const float *)(rec + 1) : NULL;
+}
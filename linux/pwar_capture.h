@@ -0,0 +1,86 @@
+/*
+ * pwar_capture.h - Session capture for offline replay of PWAR bridge sessions
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * A capture is a memory-mapped file holding a header followed by a ring of
+ * fixed-size records. Writers claim a slot with an atomic increment and
+ * publish it by storing its index last, so on_process and receiver_thread
+ * can both record without locks or syscalls. Once the ring is full the
+ * oldest records are overwritten.
+ */
+
+#ifndef PWAR_CAPTURE
+#define PWAR_CAPTURE
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pwar_packet.h"
+
+#define PWAR_CAPTURE_MAGIC "PWARCAP1"
+#define PWAR_CAPTURE_VERSION 1
+#define PWAR_CAPTURE_DEFAULT_RECORDS (1u << 20)
+#define PWAR_CAPTURE_HEADER_SIZE 4096
+
+#define PWAR_CAPTURE_FLAG_AUDIO (1u << 0)
+
+enum pwar_capture_type {
+    PWAR_CAPTURE_SENT = 1,                // packet sent from on_process
+    PWAR_CAPTURE_RECEIVED = 2,            // reply received by receiver_thread
+    PWAR_CAPTURE_CYCLE = 3,               // playout decision of one on_process cycle
+};
+
+struct pwar_capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t capacity;                    // records in the ring
+    uint64_t wait_ns;                     // playout wait used during the session
+    uint64_t write_index;                 // total records ever claimed
+};
+
+struct pwar_capture_record {
+    uint64_t commit;                      // index + 1 once the record is complete
+    uint64_t ts_ns;                       // CLOCK_MONOTONIC when recorded
+    uint64_t seq;                         // packet seq, or the expected seq for a cycle
+    uint64_t ts_pipewire_send;
+    uint64_t ts_asio_recv;
+    uint64_t ts_asio_send;
+    uint64_t kernel_ns;                   // kernel RX stamp for received packets, 0 if none
+    uint64_t played_seq;                  // cycles only
+    uint16_t n_samples;
+    uint8_t type;
+    uint8_t decision;                     // enum pwar_playout_decision, cycles only
+    uint32_t reserved;
+    // followed by float samples[2][RT_STREAM_PACKET_FRAME_SIZE / 2] with PWAR_CAPTURE_FLAG_AUDIO
+};
+
+#define PWAR_CAPTURE_AUDIO_SIZE (sizeof(float) * RT_STREAM_PACKET_FRAME_SIZE)
+
+struct pwar_capture {
+    struct pwar_capture_header *header;
+    uint8_t *records;
+    size_t map_size;
+    uint32_t record_size;
+    uint64_t capacity;
+};
+
+// Creates (truncating) a capture file, preallocates and pre-faults it.
+int pwar_capture_create(struct pwar_capture *cap, const char *path, uint64_t capacity,
+                        int with_audio, uint64_t wait_ns);
+int pwar_capture_open(struct pwar_capture *cap, const char *path);
+void pwar_capture_close(struct pwar_capture *cap);
+
+// RT safe: no locks, no syscalls. samples may be NULL.
+void pwar_capture_write(struct pwar_capture *cap, const struct pwar_capture_record *rec,
+                        const float *ch1, const float *ch2);
+
+// Reader side: range of indices still present and access to one of them.
+void pwar_capture_range(const struct pwar_capture *cap, uint64_t *first, uint64_t *end);
+const struct pwar_capture_record *pwar_capture_get(const struct pwar_capture *cap, uint64_t index);
+const float *pwar_capture_audio(const struct pwar_capture *cap, const struct pwar_capture_record *rec);
+
+#endif /* PWAR_CAPTURE */
@@ -0,0 +1,260 @@
+/*
+ * pwar_listen.c - Multicast listener for the PWAR stream
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Usage: pwar_listen [--iface NAME] [--reply PORT] [--dscp CLASS] [--stall MS]
+ *                    [--drop PCT] [--auth-key-file PATH [--encrypt]] GROUP [PORT]
+ *
+ * Joins the group a bridge sends to with --ip GROUP and reports every 2s
+ * what arrived: packets, lost and stale periods, sender restarts and the
+ * rate. Any number of listeners can run, on one host or many; the sender
+ * does the same work for all of them. With --reply the listener answers
+ * every packet to the sender's address at PORT like a loopback DAW does,
+ * MIDI included, so the bridge has a return path. Only one listener should
+ * reply, --dscp marks its replies like the bridge's --dscp.
+ * --stall holds the replies back for MS every 5s, so that they reach the
+ * bridge all at once like after a stall of the DAW and its catch-up policy
+ * can be watched working the backlog off. --drop throws away PCT percent
+ * of the datagrams at random as they arrive, a lossy link for --adapt to
+ * work against. With the bridge's key file it
+ * verifies (and with --encrypt decrypts) what arrives and seals replies.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include "pwar_auth.h"
+#include "pwar_dtx.h"
+#include "pwar_midi.h"
+#include "pwar_packet.h"
+#include "pwar_qos.h"
+#include "pwar_session.h"
+
+#define REPORT_NS (2 * 1000000000ULL)
+#define STALL_EVERY_NS (5 * 1000000000ULL)
+
+static pwar_auth_t auth;
+static int auth_enabled;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void send_to(int sockfd, const struct sockaddr_in *to, const void *buf, size_t len,
+                    const void *trailer, size_t trailer_len) {
+    uint8_t sealed[PWAR_MIDI_MAX_DATAGRAM];
+    if (auth_enabled) {
+        memcpy(sealed, buf, len);
+        if (trailer_len)
+            memcpy(sealed + len, trailer, trailer_len);
+        len = pwar_auth_seal(&auth, sealed, len + trailer_len);
+        buf = sealed;
+        trailer_len = 0;
+    }
+    struct iovec iov[2] = {
+        { .iov_base = (void *)buf, .iov_len = len },
+        { .iov_base = (void *)trailer, .iov_len = trailer_len },
+    };
+    struct msghdr msg = {
+        .msg_name = (void *)to,
+        .msg_namelen = sizeof(*to),
+        .msg_iov = iov,
+        .msg_iovlen = trailer_len ? 2 : 1,
+    };
+    sendmsg(sockfd, &msg, 0);
+}
+
+// The period's MIDI goes back behind the audio, what does not fit ahead of it
+static void reply(int sockfd, const struct sockaddr_in *to, const rt_stream_packet_t *pkt, const pwar_midi_block_t *midi) {
+    const size_t max = PWAR_MIDI_MAX_DATAGRAM - (auth_enabled ? PWAR_AUTH_OVERHEAD : 0);
+    uint8_t trailer[PWAR_MIDI_MAX_DATAGRAM];
+    uint32_t first = 0;
+    while (pwar_midi_size(midi, first) > max - sizeof(*pkt))
+        send_to(sockfd, to, trailer, pwar_midi_encode(midi, &first, pkt->session, pkt->seq, trailer, max), NULL, 0);
+    size_t trailer_len = pwar_midi_encode(midi, &first, pkt->session, pkt->seq, trailer, max - sizeof(*pkt));
+    send_to(sockfd, to, pkt, sizeof(*pkt), trailer, trailer_len);
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: pwar_listen [--iface NAME] [--reply PORT] [--dscp CLASS] [--stall MS]\n"
+                    "                   [--drop PCT] [--auth-key-file PATH [--encrypt]] GROUP [PORT]\n");
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    const char *iface = NULL;
+    int reply_port = 0;
+    int dscp = PWAR_QOS_UNSET;
+    int stall_ms = 0;
+    double drop_pct = 0.0;
+    const char *key_file = NULL;
+    int encrypt = 0;
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+        if (strcmp(argv[i], "--encrypt") == 0) {
+            encrypt = 1;
+            i--;                          // a flag, no value
+            continue;
+        }
+        if (i + 1 >= argc)
+            return usage();
+        if (strcmp(argv[i], "--iface") == 0)
+            iface = argv[i + 1];
+        else if (strcmp(argv[i], "--reply") == 0)
+            reply_port = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--dscp") == 0 && pwar_qos_parse_dscp(argv[i + 1], &dscp) == 0)
+            ;
+        else if (strcmp(argv[i], "--stall") == 0)
+            stall_ms = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--drop") == 0)
+            drop_pct = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--auth-key-file") == 0)
+            key_file = argv[i + 1];
+        else
+            return usage();
+    }
+    if (i >= argc || (encrypt && !key_file))
+        return usage();
+    const char *group = argv[i];
+    int port = i + 1 < argc ? atoi(argv[i + 1]) : 8321;
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("socket");
+        return 1;
+    }
+    // Several listeners on one host all get every packet of the group
+    int one = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    pwar_qos_mark(sockfd, dscp, PWAR_QOS_UNSET);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(group);
+    if (!IN_MULTICAST(ntohl(addr.sin_addr.s_addr))) {
+        fprintf(stderr, "%s is not a multicast group\n", group);
+        return 2;
+    }
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = addr.sin_addr;
+    if (iface && !(mreq.imr_ifindex = if_nametoindex(iface))) {
+        fprintf(stderr, "unknown interface %s\n", iface);
+        return 2;
+    }
+    if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("IP_ADD_MEMBERSHIP");
+        return 1;
+    }
+    printf("listening on %s:%d%s\n", group, port, reply_port ? ", replying" : ", receive only");
+
+    pwar_session_t session;
+    pwar_session_init(&session);
+    uint32_t listener_id = pwar_session_new_id(now_ns() ^ ((uint64_t)getpid() << 32));
+    if (key_file) {
+        uint8_t key[PWAR_AUTH_KEY_SIZE];
+        int rc = pwar_auth_load_key(key_file, key);
+        if (rc < 0) {
+            fprintf(stderr, "can't read a key of %d hex bytes from %s: %s\n", PWAR_AUTH_KEY_SIZE, key_file, strerror(-rc));
+            return 2;
+        }
+        pwar_auth_init(&auth, encrypt ? PWAR_AUTH_ENCRYPT : PWAR_AUTH_SIGN, key, listener_id);
+        auth_enabled = 1;
+    }
+    pwar_midi_rx_t midi_rx;
+    pwar_midi_rx_init(&midi_rx);
+    pwar_midi_block_t midi;
+    uint8_t buf[PWAR_MIDI_MAX_DATAGRAM];
+    uint64_t packets = 0, lost = 0, bytes = 0, midi_events = 0, next_seq = 0;
+    int have_seq = 0;
+    uint64_t last_report = now_ns();
+    uint64_t last_stall = last_report;
+    uint32_t drop_state = listener_id;
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(sockfd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        // Reported before the datagram is looked at, refused ones included
+        uint64_t now = now_ns();
+        if (now - last_report >= REPORT_NS) {
+            double secs = (now - last_report) / 1e9;
+            printf("%lu packets, %lu lost, %lu stale, %lu restarts, %.1f kB/s, %lu MIDI events",
+                packets, lost, session.stale, session.restarts, bytes / secs / 1000.0, midi_events);
+            if (session.duplicates)
+                printf(", %lu redundant copies dropped", session.duplicates);
+            if (auth_enabled)
+                printf(", refused %lu with a bad tag, %lu replayed, %lu from an unconfirmed peer",
+                    auth.bad_tag, auth.replayed, auth.unconfirmed);
+            printf("\n");
+            packets = lost = bytes = midi_events = 0;
+            last_report = now;
+        }
+        if (auth_enabled && n > 0)
+            n = pwar_auth_open(&auth, buf, n, now);
+        if (n <= 0)
+            continue;
+        if (drop_pct > 0.0) {
+            drop_state ^= drop_state << 13;
+            drop_state ^= drop_state >> 17;
+            drop_state ^= drop_state << 5;
+            if (drop_state < drop_pct / 100.0 * 4294967296.0)
+                continue;
+        }
+        rt_stream_packet_t pkt;
+        size_t audio = pwar_midi_receive(&midi_rx, buf, n, &midi);
+        if (!audio)
+            continue;
+        if (pwar_dtx_is_dtx(buf, audio)) {
+            if (pwar_dtx_decode(buf, audio, &pkt, NULL) < 0)
+                continue;
+        } else {
+            memcpy(&pkt, buf, sizeof(pkt));
+        }
+
+        enum pwar_session_event ev = pwar_session_check(&session, pkt.session, pkt.seq);
+        if (ev == PWAR_SESSION_STALE || ev == PWAR_SESSION_DUPLICATE)
+            continue;
+        if (ev == PWAR_SESSION_RESTART || ev == PWAR_SESSION_JUMP)
+            printf("sender %s, session %08x\n", pwar_session_event_name(ev), session.peer);
+        else if (have_seq && pkt.seq > next_seq)
+            lost += pkt.seq - next_seq;
+        next_seq = pkt.seq + 1;
+        have_seq = 1;
+        packets++;
+        bytes += n;
+        midi_events += midi.count;
+
+        if (reply_port && stall_ms && now_ns() - last_stall >= STALL_EVERY_NS) {
+            // What arrives meanwhile queues in the socket and is answered
+            // back to back afterwards
+            struct timespec ts = { stall_ms / 1000, (stall_ms % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+            last_stall = now_ns();
+        }
+        if (reply_port) {
+            // Loopback: the input comes straight back on both channels
+            memcpy(pkt.samples_ch2, pkt.samples_ch1, sizeof(pkt.samples_ch2));
+            pkt.session = listener_id;
+            pkt.ts_asio_recv = pkt.ts_asio_send = now_ns();
+            from.sin_port = htons(reply_port);
+            reply(sockfd, &from, &pkt, &midi);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * pwar_playout.c - Per-cycle playout decisions for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include "pwar_playout.h"
+
+static const char *decision_names[PWAR_PLAYOUT_N_DECISIONS] = {
+    [PWAR_PLAYOUT_PLAYED] = "played",
+    [PWAR_PLAYOUT_CONCEALED] = "concealed",
+    [PWAR_PLAYOUT_LATE] = "late",
+    [PWAR_PLAYOUT_DUPLICATE] = "duplicate",
+};
+
+void pwar_playout_init(struct pwar_playout *p, uint64_t wait_ns) {
+    memset(p, 0, sizeof(*p));
+    p->wait_ns = wait_ns;
+}
+
+enum pwar_playout_decision pwar_playout_decide(struct pwar_playout *p, uint64_t expected_seq,
+                                               int have_packet, uint64_t packet_seq) {
+    enum pwar_playout_decision d;
+    if (!have_packet)
+        d = PWAR_PLAYOUT_CONCEALED;
+    else if (p->have_last && packet_seq == p->last_played_seq)
+        d = PWAR_PLAYOUT_DUPLICATE;
+    else if (packet_seq != expected_seq)
+        d = PWAR_PLAYOUT_LATE;
+    else
+        d = PWAR_PLAYOUT_PLAYED;
+
+    if (have_packet) {
+        p->last_played_seq = packet_seq;
+        p->have_last = 1;
+    }
+    p->counts[d]++;
+    return d;
+}
+
+const char *pwar_playout_decision_name(enum pwar_playout_decision d) {
+    return d < PWAR_PLAYOUT_N_DECISIONS ? decision_names[d] : "unknown";
+}
@@ -0,0 +1,42 @@
+/*
+ * pwar_playout.h - Per-cycle playout decisions for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Kept free of PipeWire and socket code so that pwar_replay can run captured
+ * sessions through exactly the same logic as on_process.
+ */
+
+#ifndef PWAR_PLAYOUT
+#define PWAR_PLAYOUT
+
+#include <stdint.h>
+
+#define PWAR_PLAYOUT_DEFAULT_WAIT_NS (2 * 1000 * 1000)
+
+enum pwar_playout_decision {
+    PWAR_PLAYOUT_PLAYED,                  // the reply to this cycle's packet
+    PWAR_PLAYOUT_CONCEALED,               // nothing arrived in time, silence was output
+    PWAR_PLAYOUT_LATE,                    // an older reply arrived in time and was played instead
+    PWAR_PLAYOUT_DUPLICATE,               // the same reply was handed to us twice
+    PWAR_PLAYOUT_N_DECISIONS
+};
+
+struct pwar_playout {
+    uint64_t wait_ns;                     // how long on_process waits for the reply
+    uint64_t last_played_seq;
+    int have_last;
+    uint64_t counts[PWAR_PLAYOUT_N_DECISIONS];
+};
+
+void pwar_playout_init(struct pwar_playout *p, uint64_t wait_ns);
+
+// expected_seq is the seq sent this cycle; have_packet says whether a reply
+// was available before the wait ran out and packet_seq is its seq.
+enum pwar_playout_decision pwar_playout_decide(struct pwar_playout *p, uint64_t expected_seq,
+                                               int have_packet, uint64_t packet_seq);
+
+const char *pwar_playout_decision_name(enum pwar_playout_decision d);
+
+#endif /* PWAR_PLAYOUT */
@@ -0,0 +1,206 @@
+/*
+ * pwar_pool.c - Fork-join worker pool for per-channel work in the PWAR cycle
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "pwar_pool.h"
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+void pwar_pool_slice(uint32_t items, uint32_t slices, uint32_t slice, uint32_t *first, uint32_t *count) {
+    uint32_t begin = (uint32_t)((uint64_t)items * slice / slices);
+    uint32_t end = (uint32_t)((uint64_t)items * (slice + 1) / slices);
+    *first = begin;
+    *count = end - begin;
+}
+
+uint32_t pwar_pool_slices(const struct pwar_pool *pool, uint32_t items) {
+    if (!pool || !pool->workers || items < pool->min_items)
+        return 1;
+    return pool->workers + 1 < items ? pool->workers + 1 : items;
+}
+
+static void run_slice(struct pwar_pool *pool, uint32_t slice) {
+    uint32_t first, count;
+    if (slice >= pool->slices)
+        return;
+    pwar_pool_slice(pool->items, pool->slices, slice, &first, &count);
+    if (count)
+        pool->fn(pool->arg, slice, first, count);
+}
+
+static void *worker_thread(void *userdata) {
+    struct pwar_pool_worker *w = userdata;
+    struct pwar_pool *pool = w->pool;
+    uint32_t seen = 0;
+    while (1) {
+        uint32_t gen;
+        while ((gen = __atomic_load_n(&pool->generation, __ATOMIC_ACQUIRE)) == seen)
+            cpu_relax();
+        seen = gen;
+        if (__atomic_load_n(&pool->stop, __ATOMIC_RELAXED))
+            break;
+        run_slice(pool, w->slice);
+        __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+// The n-th CPU of the set, round robin
+static int nth_cpu(const cpu_set_t *set, uint32_t n) {
+    int count = CPU_COUNT(set);
+    if (!count)
+        return -1;
+    n %= count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, set) && n-- == 0)
+            return cpu;
+    }
+    return -1;
+}
+
+int pwar_pool_init(struct pwar_pool *pool, uint32_t workers, uint32_t min_items,
+                   const struct pwar_rt_thread_config *rt) {
+    memset(pool, 0, sizeof(*pool));
+    pool->min_items = min_items;
+    // A spinning worker without a core of its own only steals the caller's
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online > 0 && workers > (uint32_t)online - 1)
+        workers = (uint32_t)online - 1;
+    if (workers > PWAR_POOL_MAX_WORKERS)
+        workers = PWAR_POOL_MAX_WORKERS;
+
+    for (uint32_t i = 0; i < workers; ++i) {
+        struct pwar_pool_worker *w = &pool->worker[i];
+        w->pool = pool;
+        w->slice = i + 1;
+        w->cpu = rt && rt->has_cpus ? nth_cpu(&rt->cpus, i) : -1;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (w->cpu >= 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(w->cpu, &one);
+            pthread_attr_setaffinity_np(&attr, sizeof(one), &one);
+        }
+        if (rt && rt->policy != PWAR_RT_POLICY_INHERIT) {
+            struct sched_param sp = { .sched_priority = rt->priority };
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, rt->policy);
+            pthread_attr_setschedparam(&attr, &sp);
+        }
+        int rc = pthread_create(&w->thread, &attr, worker_thread, w);
+        if (rc == EPERM && rt && rt->policy != PWAR_RT_POLICY_INHERIT) {
+            // Unprivileged: the workers still run, only without the priority
+            pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+            rc = pthread_create(&w->thread, &attr, worker_thread, w);
+        }
+        pthread_attr_destroy(&attr);
+        if (rc != 0) {
+            pwar_pool_destroy(pool);
+            return -rc;
+        }
+        pool->workers = i + 1;
+    }
+    return (int)pool->workers;
+}
+
+void pwar_pool_destroy(struct pwar_pool *pool) {
+    __atomic_store_n(&pool->stop, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < pool->workers; ++i)
+        pthread_join(pool->worker[i].thread, NULL);
+    pool->workers = 0;
+}
+
+void pwar_pool_run(struct pwar_pool *pool, pwar_pool_fn fn, void *arg, uint32_t items) {
+    uint32_t slices = pwar_pool_slices(pool, items);
+    if (slices == 1) {
+        fn(arg, 0, 0, items);
+        return;
+    }
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->items = items;
+    pool->slices = slices;
+    __atomic_store_n(&pool->pending, pool->workers, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pool->generation, 1, __ATOMIC_RELEASE);
+    run_slice(pool, 0);
+    while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE))
+        cpu_relax();
+}
+
+void pwar_pool_kernel_select(struct pwar_pool_kernel *pk, struct pwar_pool *pool, uint32_t channels,
+                             uint32_t frames, uint32_t stride, enum pwar_sample_format format) {
+    memset(pk, 0, sizeof(*pk));
+    pk->pool = pool;
+    pk->channels = channels;
+    pk->slices = pwar_pool_slices(pool, channels);
+    pk->sample_size = pwar_kernel_sample_size(format);
+    for (uint32_t s = 0; s < pk->slices; ++s) {
+        uint32_t count;
+        pwar_pool_slice(channels, pk->slices, s, &pk->first[s], &count);
+        // Every slice keeps the whole payload's stride
+        pwar_kernel_select(&pk->slice[s], count, frames, stride ? stride : frames, format);
+    }
+}
+
+static void meter(const float *const *ch, uint32_t count, uint32_t frames, float *peak) {
+    for (uint32_t c = 0; c < count; ++c) {
+        float p = 0.0f;
+        if (ch[c]) {
+            for (uint32_t i = 0; i < frames; ++i)
+                p = fmaxf(p, fabsf(ch[c][i]));
+        }
+        peak[c] = p;
+    }
+}
+
+static void *slice_payload(const struct pwar_pool_kernel *pk, uint32_t s) {
+    const pwar_kernel_t *k = &pk->slice[s];
+    return (uint8_t *)pk->payload + (size_t)pk->first[s] * k->stride * pk->sample_size;
+}
+
+static void encode_slice(void *arg, uint32_t slice, uint32_t first, uint32_t count) {
+    struct pwar_pool_kernel *pk = arg;
+    const pwar_kernel_t *k = &pk->slice[slice];
+    (void)count;
+    k->encode(k, pk->src + first, slice_payload(pk, slice));
+    if (pk->peak)
+        meter(pk->src + first, k->channels, k->frames, pk->peak + first);
+}
+
+static void decode_slice(void *arg, uint32_t slice, uint32_t first, uint32_t count) {
+    struct pwar_pool_kernel *pk = arg;
+    const pwar_kernel_t *k = &pk->slice[slice];
+    (void)count;
+    k->decode(k, slice_payload(pk, slice), pk->dst + first);
+    if (pk->peak)
+        meter((const float *const *)pk->dst + first, k->channels, k->frames, pk->peak + first);
+}
+
+void pwar_pool_encode(struct pwar_pool_kernel *pk, const float *const *src, void *payload, float *peak) {
+    pk->src = src;
+    pk->payload = payload;
+    pk->peak = peak;
+    pwar_pool_run(pk->pool, encode_slice, pk, pk->channels);
+}
+
+void pwar_pool_decode(struct pwar_pool_kernel *pk, const void *payload, float *const *dst, float *peak) {
+    pk->dst = dst;
+    pk->payload = (void *)payload;
+    pk->peak = peak;
+    pwar_pool_run(pk->pool, decode_slice, pk, pk->channels);
+}
@@ -0,0 +1,91 @@
+/*
+ * pwar_pool.h - Fork-join worker pool for per-channel work in the PWAR cycle
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * At high channel counts and small quanta, encoding, decoding and metering
+ * every channel one after the other no longer fits a period on one core.
+ * The pool splits such a job into one contiguous slice of channels per
+ * thread: the calling thread takes the first slice, every worker one of
+ * the others. Workers are pinned and spin on a generation counter instead
+ * of sleeping, so a fork costs a cache line transfer and not a futex wake-
+ * up; each worker owns its core for as long as the pool lives. Jobs with
+ * fewer than min_items channels run inline, where the fork and join would
+ * cost more than they save.
+ */
+
+#ifndef PWAR_POOL
+#define PWAR_POOL
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pwar_kernels.h"
+#include "pwar_rt.h"
+
+#define PWAR_POOL_MAX_WORKERS 31
+#define PWAR_POOL_DEFAULT_MIN_ITEMS 16
+
+// Runs items first .. first + count - 1 of a job; slice is 0 for the caller
+typedef void (*pwar_pool_fn)(void *arg, uint32_t slice, uint32_t first, uint32_t count);
+
+struct pwar_pool_worker {
+    struct pwar_pool *pool;
+    uint32_t slice;
+    int cpu;                              // -1 when not pinned
+    pthread_t thread;
+};
+
+struct pwar_pool {
+    uint32_t workers;
+    uint32_t min_items;
+    struct pwar_pool_worker worker[PWAR_POOL_MAX_WORKERS];
+    // The job, written by the caller before it bumps the generation
+    pwar_pool_fn fn;
+    void *arg;
+    uint32_t items;
+    uint32_t slices;
+    uint32_t generation;
+    uint32_t pending;                     // workers not done with this generation
+    int stop;
+};
+
+// Starts workers threads (clamped to the online CPUs but one), pinned in
+// turn to the CPUs of rt->cpus and scheduled by rt->policy when rt is not
+// NULL. Returns the number of workers started, or a negative errno.
+int pwar_pool_init(struct pwar_pool *pool, uint32_t workers, uint32_t min_items,
+                   const struct pwar_rt_thread_config *rt);
+void pwar_pool_destroy(struct pwar_pool *pool);
+
+// How a job of items splits: 1 slice inline, else one per thread
+uint32_t pwar_pool_slices(const struct pwar_pool *pool, uint32_t items);
+void pwar_pool_slice(uint32_t items, uint32_t slices, uint32_t slice, uint32_t *first, uint32_t *count);
+
+// Real-time safe: runs fn over items across the pool and returns when
+// every slice is done. One caller at a time.
+void pwar_pool_run(struct pwar_pool *pool, pwar_pool_fn fn, void *arg, uint32_t items);
+
+// A payload kernel split the way the pool splits its channels, with a
+// kernel of its own picked for every slice. Encoding and decoding also
+// meter each channel's peak on the way, which the caller reads from peak.
+struct pwar_pool_kernel {
+    struct pwar_pool *pool;
+    uint32_t channels;
+    uint32_t slices;
+    uint32_t sample_size;
+    pwar_kernel_t slice[PWAR_POOL_MAX_WORKERS + 1];
+    uint32_t first[PWAR_POOL_MAX_WORKERS + 1];
+    // The call in progress
+    const float *const *src;
+    float *const *dst;
+    void *payload;
+    float *peak;                          // channels entries, NULL skips metering
+};
+
+void pwar_pool_kernel_select(struct pwar_pool_kernel *pk, struct pwar_pool *pool, uint32_t channels,
+                             uint32_t frames, uint32_t stride, enum pwar_sample_format format);
+void pwar_pool_encode(struct pwar_pool_kernel *pk, const float *const *src, void *payload, float *peak);
+void pwar_pool_decode(struct pwar_pool_kernel *pk, const void *payload, float *const *dst, float *peak);
+
+#endif /* PWAR_POOL */
@@ -0,0 +1,132 @@
+/*
+ * pwar_qos.c - Priority marking and timed transmission (SO_TXTIME) for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <linux/net_tstamp.h>
+#include "pwar_qos.h"
+
+// Older libc headers lack these
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+
+#define PACE_SPIN_NS 20000
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int pwar_qos_parse_dscp(const char *name, int *dscp) {
+    char *end;
+    long v;
+    if (strcasecmp(name, "ef") == 0) {
+        v = 46;
+    } else if (strncasecmp(name, "cs", 2) == 0 && name[2] >= '0' && name[2] <= '7' && !name[3]) {
+        v = (name[2] - '0') * 8;
+    } else if (strncasecmp(name, "af", 2) == 0 && name[2] >= '1' && name[2] <= '4' &&
+               name[3] >= '1' && name[3] <= '3' && !name[4]) {
+        v = (name[2] - '0') * 8 + (name[3] - '0') * 2;
+    } else {
+        v = strtol(name, &end, 0);
+        if (end == name || *end || v < 0 || v > 63)
+            return -EINVAL;
+    }
+    *dscp = (int)v;
+    return 0;
+}
+
+int pwar_qos_mark(int fd, int dscp, int priority) {
+    int rc = 0;
+    if (dscp != PWAR_QOS_UNSET) {
+        int tos = dscp << 2;              // ECN bits stay 0
+        if (setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0) {
+            perror("Warning: setsockopt IP_TOS failed");
+            rc = -1;
+        }
+    }
+    if (priority != PWAR_QOS_UNSET) {
+        // Above 6 needs CAP_NET_ADMIN
+        if (setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) < 0) {
+            perror("Warning: setsockopt SO_PRIORITY failed");
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+const char *pwar_txtime_mode_name(enum pwar_txtime_mode mode) {
+    switch (mode) {
+    case PWAR_TXTIME_OFF: return "off";
+    case PWAR_TXTIME_PACE: return "pace";
+    case PWAR_TXTIME_ETF: return "etf";
+    }
+    return "unknown";
+}
+
+int pwar_txtime_parse_mode(const char *name, enum pwar_txtime_mode *mode) {
+    if (strcmp(name, "off") == 0)
+        *mode = PWAR_TXTIME_OFF;
+    else if (strcmp(name, "pace") == 0)
+        *mode = PWAR_TXTIME_PACE;
+    else if (strcmp(name, "etf") == 0)
+        *mode = PWAR_TXTIME_ETF;
+    else
+        return -EINVAL;
+    return 0;
+}
+
+enum pwar_txtime_mode pwar_txtime_enable(int fd, enum pwar_txtime_mode want) {
+    if (want != PWAR_TXTIME_ETF)
+        return want;
+    // Without an ETF qdisc on the route the kernel accepts this just the
+    // same and ignores the times; the departure stats show that.
+    struct sock_txtime cfg = {
+        .clockid = CLOCK_TAI,
+        .flags = SOF_TXTIME_REPORT_ERRORS,
+    };
+    if (setsockopt(fd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)) < 0) {
+        perror("Warning: setsockopt SO_TXTIME failed, sending without a txtime");
+        return PWAR_TXTIME_OFF;
+    }
+    return PWAR_TXTIME_ETF;
+}
+
+// Like the timestamp conversion in pwar_tstamp.c, both clocks come from
+// the vDSO so this is cheap enough per packet.
+void pwar_txtime_set(struct msghdr *msg, void *control, uint64_t mono_ns) {
+    uint64_t tai_ns = mono_ns + (clock_ns(CLOCK_TAI) - clock_ns(CLOCK_MONOTONIC));
+    memset(control, 0, PWAR_TXTIME_CONTROL_SIZE);
+    msg->msg_control = control;
+    msg->msg_controllen = CMSG_SPACE(sizeof(tai_ns));
+    struct cmsghdr *cm = CMSG_FIRSTHDR(msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_TXTIME;
+    cm->cmsg_len = CMSG_LEN(sizeof(tai_ns));
+    memcpy(CMSG_DATA(cm), &tai_ns, sizeof(tai_ns));
+}
+
+void pwar_txtime_pace(uint64_t mono_ns) {
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    if (now + PACE_SPIN_NS < mono_ns) {
+        uint64_t wake = mono_ns - PACE_SPIN_NS;
+        struct timespec ts = { .tv_sec = wake / 1000000000, .tv_nsec = wake % 1000000000 };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+            ;
+    }
+    while (clock_ns(CLOCK_MONOTONIC) < mono_ns)
+        ;
+}
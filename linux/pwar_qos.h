@@ -0,0 +1,53 @@
+/*
+ * pwar_qos.h - Priority marking and timed transmission (SO_TXTIME) for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * DSCP marks our datagrams for switches and routers that honour it,
+ * SO_PRIORITY picks the band of the local qdisc. With a txtime every period
+ * leaves at a fixed point of the period clock instead of whenever the
+ * process callback got to it: the ETF qdisc holds the datagram until then
+ * (see the README for the tc setup), or a thread of ours sleeps until then.
+ */
+
+#ifndef PWAR_QOS
+#define PWAR_QOS
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define PWAR_QOS_UNSET -1
+#define PWAR_TXTIME_DEFAULT_DELAY_NS 250000ULL
+
+enum pwar_txtime_mode {
+    PWAR_TXTIME_OFF,
+    PWAR_TXTIME_PACE,                     // a pacer thread sleeps until the departure time, then sends
+    PWAR_TXTIME_ETF,                      // hand the departure time to the ETF qdisc
+};
+
+// Takes a DSCP number (0 to 63) or a class name: ef, csN, afXY
+int pwar_qos_parse_dscp(const char *name, int *dscp);
+
+// Sets the DSCP and SO_PRIORITY of fd, PWAR_QOS_UNSET leaves one alone.
+// Prints a warning for what the kernel refuses and returns -1 then.
+int pwar_qos_mark(int fd, int dscp, int priority);
+
+const char *pwar_txtime_mode_name(enum pwar_txtime_mode mode);
+int pwar_txtime_parse_mode(const char *name, enum pwar_txtime_mode *mode);
+
+// Enables SO_TXTIME on fd for ETF, on CLOCK_TAI and with drops reported on
+// the error queue. When the kernel refuses, the datagrams go out without a
+// txtime. Returns the mode actually obtained.
+enum pwar_txtime_mode pwar_txtime_enable(int fd, enum pwar_txtime_mode want);
+
+// Adds the SCM_TXTIME control message for a departure at mono_ns
+// (CLOCK_MONOTONIC) to msg. control must hold PWAR_TXTIME_CONTROL_SIZE bytes.
+#define PWAR_TXTIME_CONTROL_SIZE 32
+void pwar_txtime_set(struct msghdr *msg, void *control, uint64_t mono_ns);
+
+// Returns at mono_ns: sleeps most of the way and spins the rest, a timer
+// wake-up alone is off by tens of microseconds.
+void pwar_txtime_pace(uint64_t mono_ns);
+
+#endif /* PWAR_QOS */
@@ -0,0 +1,125 @@
+/*
+ * pwar_reblock.c - Reblocking between the PipeWire quantum and the network period
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include "pwar_reblock.h"
+
+#define FIFO_MASK (PWAR_FIFO_FRAMES - 1)
+#define MIDI_FIFO_MASK (PWAR_MIDI_FIFO_EVENTS - 1)
+
+void pwar_fifo_reset(struct pwar_fifo *f, uint32_t channels) {
+    f->channels = channels > PWAR_FIFO_MAX_CHANNELS ? PWAR_FIFO_MAX_CHANNELS : channels;
+    __atomic_store_n(&f->write_pos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&f->read_pos, 0, __ATOMIC_RELEASE);
+}
+
+uint32_t pwar_fifo_fill(const struct pwar_fifo *f) {
+    uint32_t w = __atomic_load_n(&f->write_pos, __ATOMIC_ACQUIRE);
+    uint32_t r = __atomic_load_n(&f->read_pos, __ATOMIC_ACQUIRE);
+    return w - r;
+}
+
+uint32_t pwar_fifo_space(const struct pwar_fifo *f) {
+    return PWAR_FIFO_FRAMES - pwar_fifo_fill(f);
+}
+
+uint32_t pwar_fifo_write(struct pwar_fifo *f, const float *const *src, uint32_t n) {
+    uint32_t w = f->write_pos;
+    uint32_t r = __atomic_load_n(&f->read_pos, __ATOMIC_ACQUIRE);
+    uint32_t space = PWAR_FIFO_FRAMES - (w - r);
+    if (n > space)
+        n = space;
+    uint32_t off = w & FIFO_MASK;
+    uint32_t first = PWAR_FIFO_FRAMES - off < n ? PWAR_FIFO_FRAMES - off : n;
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        if (src[ch]) {
+            memcpy(&f->buf[ch][off], src[ch], first * sizeof(float));
+            memcpy(&f->buf[ch][0], src[ch] + first, (n - first) * sizeof(float));
+        } else {
+            memset(&f->buf[ch][off], 0, first * sizeof(float));
+            memset(&f->buf[ch][0], 0, (n - first) * sizeof(float));
+        }
+    }
+    __atomic_store_n(&f->write_pos, w + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+uint32_t pwar_fifo_read(struct pwar_fifo *f, float *const *dst, uint32_t n) {
+    uint32_t r = f->read_pos;
+    uint32_t w = __atomic_load_n(&f->write_pos, __ATOMIC_ACQUIRE);
+    if (n > w - r)
+        n = w - r;
+    uint32_t off = r & FIFO_MASK;
+    uint32_t first = PWAR_FIFO_FRAMES - off < n ? PWAR_FIFO_FRAMES - off : n;
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        if (!dst[ch])
+            continue;
+        memcpy(dst[ch], &f->buf[ch][off], first * sizeof(float));
+        memcpy(dst[ch] + first, &f->buf[ch][0], (n - first) * sizeof(float));
+    }
+    __atomic_store_n(&f->read_pos, r + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+void pwar_midi_fifo_reset(struct pwar_midi_fifo *f) {
+    f->write_pos = 0;
+    f->read_pos = 0;
+    f->dropped = 0;
+}
+
+void pwar_midi_fifo_write(struct pwar_midi_fifo *f, uint32_t pos, const pwar_midi_block_t *b) {
+    for (uint32_t i = 0; i < b->count; ++i) {
+        if (f->write_pos - f->read_pos >= PWAR_MIDI_FIFO_EVENTS) {
+            f->dropped += b->count - i;
+            return;
+        }
+        uint32_t slot = f->write_pos++ & MIDI_FIFO_MASK;
+        f->frame[slot] = pos + b->events[i].offset;
+        f->events[slot] = b->events[i];
+    }
+}
+
+void pwar_midi_fifo_read(struct pwar_midi_fifo *f, uint32_t pos, uint32_t n, pwar_midi_block_t *out) {
+    while (f->read_pos != f->write_pos) {
+        uint32_t slot = f->read_pos & MIDI_FIFO_MASK;
+        int32_t offset = (int32_t)(f->frame[slot] - pos);
+        if (offset >= (int32_t)n)
+            break;
+        // Behind pos only when the FIFO came up short; play it right away
+        const pwar_midi_event_t *ev = &f->events[slot];
+        pwar_midi_add(out, offset > 0 ? (uint32_t)offset : 0, ev->data, ev->size);
+        f->read_pos++;
+    }
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+uint32_t pwar_reblock_latency(uint32_t quantum, uint32_t period) {
+    if (!quantum || !period)
+        return 0;
+    return period - gcd(quantum, period);
+}
+
+void pwar_reblock_configure(struct pwar_reblock *rb, uint32_t quantum, uint32_t period) {
+    static const float *const silence[PWAR_FIFO_MAX_CHANNELS] = { NULL, NULL };
+    rb->quantum = quantum;
+    rb->period = period;
+    rb->latency = pwar_reblock_latency(quantum, period);
+    pwar_fifo_reset(&rb->in, 1);
+    pwar_fifo_reset(&rb->out, 2);
+    pwar_fifo_write(&rb->out, silence, rb->latency);
+    pwar_midi_fifo_reset(&rb->midi_in);
+    pwar_midi_fifo_reset(&rb->midi_out);
+    __atomic_add_fetch(&rb->generation, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,81 @@
+/*
+ * pwar_reblock.h - Reblocking between the PipeWire quantum and the network period
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * The graph runs at whatever quantum PipeWire picks while packets carry a
+ * fixed network period, normally the ASIO buffer size. Input is collected in
+ * one FIFO and leaves in network periods; replies go into a second FIFO that
+ * the graph drains one quantum at a time.
+ *
+ * The output FIFO is primed with period - gcd(quantum, period) frames of
+ * silence. That is the most it can run short between two replies, so the
+ * added latency is constant and known up front: zero when the quantum is a
+ * multiple of the period, period - quantum when it divides it.
+ *
+ * MIDI follows the audio through the same FIFOs: each event is queued with
+ * the FIFO frame it belongs to and leaves with that frame, so reblocking
+ * delays it by exactly as much as the audio.
+ */
+
+#ifndef PWAR_REBLOCK
+#define PWAR_REBLOCK
+
+#include <stdint.h>
+#include "pwar_midi.h"
+
+#define PWAR_FIFO_FRAMES 16384            // power of two, covers the largest quantum plus priming
+#define PWAR_FIFO_MAX_CHANNELS 2
+#define PWAR_MIDI_FIFO_EVENTS 256         // power of two
+
+// Single producer, single consumer; both sides are lock-free and never block.
+struct pwar_fifo {
+    uint32_t channels;
+    uint32_t write_pos;                   // producer only, free running
+    uint32_t read_pos;                    // consumer only, free running
+    float buf[PWAR_FIFO_MAX_CHANNELS][PWAR_FIFO_FRAMES];
+};
+
+void pwar_fifo_reset(struct pwar_fifo *f, uint32_t channels);
+uint32_t pwar_fifo_fill(const struct pwar_fifo *f);
+uint32_t pwar_fifo_space(const struct pwar_fifo *f);
+// src[ch] == NULL writes silence, dst[ch] == NULL discards. Both return the
+// number of frames actually moved.
+uint32_t pwar_fifo_write(struct pwar_fifo *f, const float *const *src, uint32_t n);
+uint32_t pwar_fifo_read(struct pwar_fifo *f, float *const *dst, uint32_t n);
+
+// Events stamped with free running FIFO frame positions. Both ends run on
+// the audio thread, so it needs no atomics.
+struct pwar_midi_fifo {
+    uint32_t write_pos;
+    uint32_t read_pos;
+    uint32_t dropped;                     // did not fit, since the last reset
+    uint32_t frame[PWAR_MIDI_FIFO_EVENTS];
+    pwar_midi_event_t events[PWAR_MIDI_FIFO_EVENTS];
+};
+
+void pwar_midi_fifo_reset(struct pwar_midi_fifo *f);
+// Queues the events of b at frame pos plus their offset
+void pwar_midi_fifo_write(struct pwar_midi_fifo *f, uint32_t pos, const pwar_midi_block_t *b);
+// Adds the events before frame pos + n to out, with offsets from pos
+void pwar_midi_fifo_read(struct pwar_midi_fifo *f, uint32_t pos, uint32_t n, pwar_midi_block_t *out);
+
+struct pwar_reblock {
+    uint32_t quantum;                     // graph cycle the FIFOs are primed for, 0 before the first cycle
+    uint32_t period;                      // network period in frames
+    uint32_t latency;                     // added by reblocking, frames
+    uint32_t generation;                  // bumped on every reconfigure, for reporting
+    struct pwar_fifo in;                  // graph -> network, mono
+    struct pwar_fifo out;                 // network -> graph, stereo
+    struct pwar_midi_fifo midi_in;        // at frames of in
+    struct pwar_midi_fifo midi_out;       // at frames of out
+};
+
+uint32_t pwar_reblock_latency(uint32_t quantum, uint32_t period);
+
+// Flushes both FIFOs and primes the output for the new quantum. Called from
+// the process callback when the quantum changes, so it must stay RT safe.
+void pwar_reblock_configure(struct pwar_reblock *rb, uint32_t quantum, uint32_t period);
+
+#endif /* PWAR_REBLOCK */
@@ -0,0 +1,311 @@
+/*
+ * pwar_record.c - Recording tap for the audio PWAR relays
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "pwar_record.h"
+
+#define WRITER_POLL_NS 10000000           // the ring holds seconds, polling is plenty
+#define SILENCE_PERIODS 4                 // most silence one push writes, in pushed periods
+#define WAV_MAX_DATA (0xffffffffULL - (PWAR_RECORD_HEADER - 8))
+
+// Wave64 chunk ids, the four letters followed by a fixed GUID tail
+static const uint8_t w64_riff[16] = { 'r', 'i', 'f', 'f', 0x2e, 0x91, 0xcf, 0x11,
+                                      0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00 };
+static const uint8_t w64_tail[12] = { 0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0,
+                                      0x4f, 0x8e, 0xdb, 0x8a };
+
+const char *pwar_record_format_name(enum pwar_record_format format) {
+    switch (format) {
+    case PWAR_RECORD_WAV: return "wav";
+    case PWAR_RECORD_W64: return "w64";
+    }
+    return "unknown";
+}
+
+int pwar_record_parse_format(const char *name, enum pwar_record_format *format) {
+    if (strcmp(name, "wav") == 0)
+        *format = PWAR_RECORD_WAV;
+    else if (strcmp(name, "w64") == 0)
+        *format = PWAR_RECORD_W64;
+    else
+        return -EINVAL;
+    return 0;
+}
+
+static void put16(uint8_t *p, uint16_t v) { memcpy(p, &v, sizeof(v)); }
+static void put32(uint8_t *p, uint32_t v) { memcpy(p, &v, sizeof(v)); }
+static void put64(uint8_t *p, uint64_t v) { memcpy(p, &v, sizeof(v)); }
+
+static void w64_id(uint8_t *p, const char *fourcc) {
+    memcpy(p, fourcc, 4);
+    memcpy(p + 4, w64_tail, sizeof(w64_tail));
+}
+
+// IEEE float format chunk body, 18 bytes
+static void put_fmt(uint8_t *p, const struct pwar_record *rec) {
+    uint32_t block = rec->channels * sizeof(float);
+    put16(p, 3);
+    put16(p + 2, (uint16_t)rec->channels);
+    put32(p + 4, rec->rate);
+    put32(p + 8, rec->rate * block);
+    put16(p + 12, (uint16_t)block);
+    put16(p + 14, 32);
+    put16(p + 16, 0);
+}
+
+// Both layouts pad with a junk chunk so the samples start at PWAR_RECORD_HEADER
+static void build_header(struct pwar_record *rec) {
+    uint8_t *h = rec->header;
+    uint64_t data = rec->file_bytes;
+    memset(h, 0, PWAR_RECORD_HEADER);
+    if (rec->format == PWAR_RECORD_WAV) {
+        memcpy(h, "RIFF", 4);
+        put32(h + 4, (uint32_t)(PWAR_RECORD_HEADER - 8 + data));
+        memcpy(h + 8, "WAVEfmt ", 8);
+        put32(h + 16, 18);
+        put_fmt(h + 20, rec);
+        memcpy(h + 38, "JUNK", 4);
+        put32(h + 42, PWAR_RECORD_HEADER - 8 - 46);
+        memcpy(h + PWAR_RECORD_HEADER - 8, "data", 4);
+        put32(h + PWAR_RECORD_HEADER - 4, (uint32_t)data);
+    } else {
+        // Wave64 sizes count the 24 byte chunk header, chunks are 8 byte aligned
+        memcpy(h, w64_riff, 16);
+        put64(h + 16, PWAR_RECORD_HEADER + data);
+        w64_id(h + 24, "wave");
+        w64_id(h + 40, "fmt ");
+        put64(h + 56, 24 + 18);
+        put_fmt(h + 64, rec);
+        w64_id(h + 88, "junk");
+        put64(h + 104, PWAR_RECORD_HEADER - 24 - 88);
+        w64_id(h + PWAR_RECORD_HEADER - 24, "data");
+        put64(h + PWAR_RECORD_HEADER - 8, 24 + data);
+    }
+}
+
+static int write_at(struct pwar_record *rec, const void *buf, size_t len, uint64_t off) {
+    while (len) {
+        ssize_t n = pwrite(rec->fd, buf, len, (off_t)off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EINVAL && rec->direct) {
+            // Some filesystems open O_DIRECT and then refuse the writes
+            fcntl(rec->fd, F_SETFL, fcntl(rec->fd, F_GETFL) & ~O_DIRECT);
+            rec->direct = 0;
+            continue;
+        }
+        if (n <= 0) {
+            __atomic_store_n(&rec->error, n < 0 ? errno : ENOSPC, __ATOMIC_RELAXED);
+            return -1;
+        }
+        buf = (const uint8_t *)buf + n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+static void write_header(struct pwar_record *rec) {
+    build_header(rec);
+    write_at(rec, rec->header, PWAR_RECORD_HEADER, 0);
+}
+
+// Keeps the blocks ahead of the writer reserved, without growing the file
+// past what was written so a crashed recording still reads to its end
+static void reserve(struct pwar_record *rec) {
+    uint64_t end = PWAR_RECORD_HEADER + rec->file_bytes;
+    if (end + PWAR_RECORD_PREALLOC / 2 <= rec->allocated)
+        return;
+    if (fallocate(rec->fd, FALLOC_FL_KEEP_SIZE, (off_t)end, PWAR_RECORD_PREALLOC) == 0)
+        rec->allocated = end + PWAR_RECORD_PREALLOC;
+    else
+        rec->allocated = UINT64_MAX;      // not supported here, don't ask again
+}
+
+static int open_file(struct pwar_record *rec) {
+    char path[320];
+    rec->file_index++;
+    snprintf(path, sizeof(path), "%s-%s-%03u.%s", rec->prefix, rec->name, rec->file_index,
+             pwar_record_format_name(rec->format));
+    rec->direct = 1;
+    rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (rec->fd < 0 && errno == EINVAL) {
+        rec->direct = 0;
+        rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (rec->fd < 0)
+        return -errno;
+    rec->file_bytes = 0;
+    rec->allocated = 0;
+    reserve(rec);
+    write_header(rec);
+    __atomic_add_fetch(&rec->files, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// The last write was padded to the block size, cut that off again
+static void finish_file(struct pwar_record *rec) {
+    if (rec->fd < 0)
+        return;
+    write_header(rec);
+    if (ftruncate(rec->fd, (off_t)(PWAR_RECORD_HEADER + rec->file_bytes)) < 0)
+        __atomic_store_n(&rec->error, errno, __ATOMIC_RELAXED);
+    close(rec->fd);
+    rec->fd = -1;
+}
+
+// Writes every whole chunk in the ring, and with final what is left of the
+// last one. Chunks never wrap: the ring is a multiple of them and the
+// writer only ever advances by one.
+static void drain(struct pwar_record *rec, int final) {
+    const uint64_t chunk = PWAR_RECORD_CHUNK / sizeof(float);
+    uint64_t w = __atomic_load_n(&rec->write_pos, __ATOMIC_ACQUIRE);
+    while (rec->fd >= 0 && (w - rec->read_pos >= chunk || (final && w > rec->read_pos))) {
+        uint64_t n = w - rec->read_pos < chunk ? w - rec->read_pos : chunk;
+        size_t bytes = n * sizeof(float);
+        size_t padded = (bytes + PWAR_RECORD_HEADER - 1) & ~(size_t)(PWAR_RECORD_HEADER - 1);
+        if (write_at(rec, rec->ring + (rec->read_pos & rec->ring_mask), padded,
+                     PWAR_RECORD_HEADER + rec->file_bytes) < 0) {
+            // Keep the timeline: what could not be written is skipped
+            __atomic_store_n(&rec->read_pos, rec->read_pos + n, __ATOMIC_RELEASE);
+            continue;
+        }
+        rec->file_bytes += bytes;
+        __atomic_add_fetch(&rec->bytes_written, bytes, __ATOMIC_RELAXED);
+        __atomic_store_n(&rec->read_pos, rec->read_pos + n, __ATOMIC_RELEASE);
+        if (n < chunk)
+            break;
+        write_header(rec);
+        if (rec->file_bytes >= rec->rotate_bytes) {
+            finish_file(rec);
+            if (open_file(rec) < 0)
+                __atomic_store_n(&rec->error, errno, __ATOMIC_RELAXED);
+        } else {
+            reserve(rec);
+        }
+    }
+}
+
+static void *writer_thread(void *userdata) {
+    struct pwar_record *rec = userdata;
+    struct timespec ts = { 0, WRITER_POLL_NS };
+    while (__atomic_load_n(&rec->running, __ATOMIC_ACQUIRE)) {
+        drain(rec, 0);
+        nanosleep(&ts, NULL);
+    }
+    drain(rec, 1);
+    finish_file(rec);
+    return NULL;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int pwar_record_start(struct pwar_record *rec, const char *prefix, const char *name,
+                      enum pwar_record_format format, uint32_t channels, uint32_t rate, uint32_t rotate_s) {
+    memset(rec, 0, sizeof(*rec));
+    if (!channels || channels > PWAR_RECORD_MAX_CHANNELS)
+        return -EINVAL;
+    snprintf(rec->prefix, sizeof(rec->prefix), "%s", prefix);
+    rec->name = name;
+    rec->format = format;
+    rec->channels = channels;
+    rec->rate = rate;
+    rec->fd = -1;
+
+    // Files hold whole frames and whole chunks
+    uint64_t frame = channels * sizeof(float);
+    uint64_t unit = PWAR_RECORD_CHUNK / gcd(PWAR_RECORD_CHUNK, frame) * frame;
+    uint64_t rotate = rotate_s ? (uint64_t)rotate_s * rate * frame : UINT64_MAX;
+    if (format == PWAR_RECORD_WAV && rotate > WAV_MAX_DATA)
+        rotate = WAV_MAX_DATA;
+    rec->rotate_bytes = rotate / unit ? rotate / unit * unit : unit;
+
+    void *ring = mmap(NULL, PWAR_RECORD_RING, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED)
+        return -errno;
+    mlock(ring, PWAR_RECORD_RING);
+    rec->ring = ring;
+    rec->ring_mask = PWAR_RECORD_RING / sizeof(float) - 1;
+    int rc = posix_memalign(&rec->header, PWAR_RECORD_HEADER, PWAR_RECORD_HEADER);
+    if (rc == 0)
+        rc = -open_file(rec);
+    if (rc == 0) {
+        rec->running = 1;
+        rc = pthread_create(&rec->thread, NULL, writer_thread, rec);
+    }
+    if (rc != 0) {
+        finish_file(rec);
+        free(rec->header);
+        munmap(rec->ring, PWAR_RECORD_RING);
+        rec->ring = NULL;
+        return -rc;
+    }
+    return 0;
+}
+
+void pwar_record_stop(struct pwar_record *rec) {
+    if (!rec->ring)
+        return;
+    __atomic_store_n(&rec->running, 0, __ATOMIC_RELEASE);
+    pthread_join(rec->thread, NULL);
+    free(rec->header);
+    munmap(rec->ring, PWAR_RECORD_RING);
+    rec->ring = NULL;
+}
+
+int pwar_record_push(struct pwar_record *rec, const float *const *channels, uint32_t n) {
+    const uint32_t ch = rec->channels;
+    float *ring = rec->ring;
+    uint64_t w = rec->write_pos;
+    uint64_t room = (rec->ring_mask + 1 - (w - __atomic_load_n(&rec->read_pos, __ATOMIC_ACQUIRE))) / ch;
+    // A gap is filled a few periods at a time, this is the audio thread
+    uint64_t silence = rec->gap_frames;
+    if (silence > room)
+        silence = room;
+    if (silence > (uint64_t)SILENCE_PERIODS * n)
+        silence = (uint64_t)SILENCE_PERIODS * n;
+    for (uint64_t i = 0; i < silence * ch; ++i)
+        ring[w++ & rec->ring_mask] = 0.0f;
+    rec->gap_frames -= silence;
+    room -= silence;
+
+    int rc = 0;
+    if (rec->gap_frames || room < n) {
+        rec->gap_frames += n;
+        __atomic_add_fetch(&rec->dropped_frames, n, __ATOMIC_RELAXED);
+        rc = -1;
+    } else if ((w & rec->ring_mask) + (uint64_t)n * ch <= rec->ring_mask + 1) {
+        float *dst = ring + (w & rec->ring_mask);
+        for (uint32_t i = 0; i < n; ++i) {
+            for (uint32_t c = 0; c < ch; ++c)
+                *dst++ = channels[c] ? channels[c][i] : 0.0f;
+        }
+        w += (uint64_t)n * ch;
+    } else {
+        for (uint32_t i = 0; i < n; ++i) {
+            for (uint32_t c = 0; c < ch; ++c)
+                ring[w++ & rec->ring_mask] = channels[c] ? channels[c][i] : 0.0f;
+        }
+    }
+    __atomic_store_n(&rec->write_pos, w, __ATOMIC_RELEASE);
+    return rc;
+}
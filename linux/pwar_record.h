@@ -0,0 +1,85 @@
+/*
+ * pwar_record.h - Recording tap for the audio PWAR relays
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Archives the audio that went over the wire, one file per direction, for
+ * forensics after a session and as a safety recording. The thread that
+ * sent or received a period interleaves it into a lock-free single
+ * producer ring, kept in locked memory, and never waits. A writer thread
+ * moves whole chunks from the ring to disk with O_DIRECT, into a file
+ * preallocated ahead of it, and rotates to a new file every so often.
+ * When the ring is full the period is left out and written as silence
+ * once there is room again, so the file keeps the session's timeline.
+ *
+ * Files are 32 bit float WAV or Wave64 (W64, no 4 GB limit). The header
+ * takes the first 4 KB so the samples start block aligned; it is rewritten
+ * after every chunk, a crash loses at most the chunk in flight.
+ */
+
+#ifndef PWAR_RECORD
+#define PWAR_RECORD
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define PWAR_RECORD_MAX_CHANNELS 64
+#define PWAR_RECORD_CHUNK (1u << 20)       // bytes per write
+#define PWAR_RECORD_RING (16u << 20)       // bytes, a power of two and a multiple of the chunk
+#define PWAR_RECORD_PREALLOC (64u << 20)   // file space reserved ahead of the writer
+#define PWAR_RECORD_HEADER 4096
+
+enum pwar_record_format {
+    PWAR_RECORD_WAV,                      // rotated before 4 GB at the latest
+    PWAR_RECORD_W64,
+};
+
+struct pwar_record {
+    // Set up by pwar_record_start()
+    char prefix[256];
+    const char *name;                     // the direction, part of the file names
+    enum pwar_record_format format;
+    uint32_t channels;
+    uint32_t rate;
+    uint64_t rotate_bytes;                // of samples per file
+    float *ring;
+    uint32_t ring_mask;                   // in floats
+    // Producer: the thread that pushes
+    uint64_t write_pos;                   // floats ever written, published with release
+    uint64_t gap_frames;                  // left out, still to be written as silence
+    uint64_t dropped_frames;              // ever left out
+    // Writer thread
+    uint64_t read_pos;
+    int fd;
+    int direct;                           // fd is O_DIRECT
+    uint32_t file_index;
+    uint64_t file_bytes;                  // of samples in the current file
+    uint64_t allocated;
+    void *header;                         // PWAR_RECORD_HEADER bytes, aligned
+    pthread_t thread;
+    volatile int running;
+    // Read by the stats thread
+    uint64_t bytes_written;
+    uint64_t files;
+    int error;                            // errno of the last failed write, 0 when fine
+};
+
+const char *pwar_record_format_name(enum pwar_record_format format);
+int pwar_record_parse_format(const char *name, enum pwar_record_format *format);
+
+// Maps and locks the ring, opens PREFIX-NAME-001.wav (or .w64) and starts
+// the writer. rotate_s of 0 only rotates where the format needs it.
+// Returns 0 or a negative errno.
+int pwar_record_start(struct pwar_record *rec, const char *prefix, const char *name,
+                      enum pwar_record_format format, uint32_t channels, uint32_t rate, uint32_t rotate_s);
+
+// Writes what is left, finishes the file and frees the ring
+void pwar_record_stop(struct pwar_record *rec);
+
+// Real-time safe, one producer per recording: appends n frames of
+// channels[0..channels-1]. A NULL channel records silence. Returns 0, or
+// -1 when the ring had no room and the frames were left out.
+int pwar_record_push(struct pwar_record *rec, const float *const *channels, uint32_t n);
+
+#endif /* PWAR_RECORD */
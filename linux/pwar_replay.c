@@ -0,0 +1,213 @@
+/*
+ * pwar_replay.c - Offline analysis and replay of PWAR bridge captures
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Usage: pwar_replay [--dump] [--wait-us N] [--catchup POLICY] [--catchup-target N] capture.bin
+ *
+ * Prints what happened in a captured session and replays the received
+ * packets through the playout logic of the bridge, optionally with a
+ * different wait or catch-up policy, so tuning changes can be checked
+ * against real traces. The policy is not in the capture; it defaults to
+ * the bridge's default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "pwar_capture.h"
+#include "pwar_catchup.h"
+#include "pwar_playout.h"
+#include "pwar_stats.h"
+
+struct event {
+    uint64_t ts_ns;
+    const struct pwar_capture_record *rec;
+};
+
+static int cmp_event(const void *a, const void *b) {
+    const struct event *ea = a, *eb = b;
+    if (ea->ts_ns != eb->ts_ns)
+        return ea->ts_ns < eb->ts_ns ? -1 : 1;
+    return 0;
+}
+
+static const char *type_name(uint8_t type) {
+    switch (type) {
+    case PWAR_CAPTURE_SENT: return "sent";
+    case PWAR_CAPTURE_RECEIVED: return "recv";
+    case PWAR_CAPTURE_CYCLE: return "cycle";
+    }
+    return "?";
+}
+
+static void dump(const struct event *ev, size_t n) {
+    uint64_t t0 = n ? ev[0].ts_ns : 0;
+    for (size_t i = 0; i < n; ++i) {
+        const struct pwar_capture_record *r = ev[i].rec;
+        printf("%12.6f ms %-5s seq %-10" PRIu64, (r->ts_ns - t0) / 1000000.0, type_name(r->type), r->seq);
+        if (r->type == PWAR_CAPTURE_RECEIVED)
+            printf(" rtt %.3f ms%s", (int64_t)(r->ts_ns - r->ts_pipewire_send) / 1000000.0,
+                r->kernel_ns ? "" : " (no kernel stamp)");
+        else if (r->type == PWAR_CAPTURE_CYCLE)
+            printf(" %s (played seq %" PRIu64 ")", pwar_playout_decision_name(r->decision), r->played_seq);
+        printf("\n");
+    }
+}
+
+// Mirrors exchange_period and read_output: every reply queued since the
+// last cycle goes into the output FIFO in order, the cycle waits up to
+// wait_ns after sending for one to show up and queues a period of silence
+// when none does, and the catch-up policy works off what the FIFO holds
+// beyond the period about to be played. The FIFO is counted in periods of
+// the sent packet's length, as with a quantum equal to the network period.
+static void replay(const struct event *ev, size_t n, uint64_t wait_ns, pwar_catchup_t *catchup,
+                   struct pwar_playout *result, uint64_t *changed) {
+    pwar_playout_init(result, wait_ns);
+    *changed = 0;
+
+    uint64_t fill = 0;                    // frames in the output FIFO
+    size_t next_recv = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const struct pwar_capture_record *sent = ev[i].rec;
+        if (sent->type != PWAR_CAPTURE_SENT)
+            continue;
+        uint64_t start = sent->ts_ns;
+        uint64_t deadline = start + wait_ns;
+        uint32_t period = sent->n_samples;
+
+        // Everything that arrived before this cycle started is queued
+        uint32_t queued = 0;
+        uint64_t latest_seq = 0;
+        for (; next_recv < n && ev[next_recv].ts_ns <= start; ++next_recv) {
+            if (ev[next_recv].rec->type == PWAR_CAPTURE_RECEIVED) {
+                latest_seq = ev[next_recv].rec->seq;
+                queued++;
+            }
+        }
+        // Otherwise we wake on the first arrival before the deadline
+        if (!queued) {
+            for (; next_recv < n && ev[next_recv].ts_ns <= deadline; ++next_recv) {
+                if (ev[next_recv].rec->type == PWAR_CAPTURE_RECEIVED) {
+                    latest_seq = ev[next_recv].rec->seq;
+                    queued++;
+                    ++next_recv;
+                    break;
+                }
+            }
+        }
+        enum pwar_playout_decision d = pwar_playout_decide(result, sent->seq, queued > 0, latest_seq);
+        fill += (uint64_t)(queued ? queued : 1) * period;
+
+        // The graph plays one period; the policy decides about the rest
+        uint64_t behind = fill > period ? fill - period : 0;
+        pwar_catchup_action_t act = pwar_catchup_update(catchup, (uint32_t)behind, period, start);
+        uint64_t played = (uint64_t)period + act.drop + act.stretch;
+        fill = fill > played ? fill - played : 0;
+
+        // Compare with what the bridge decided for the same cycle
+        for (size_t j = i + 1; j < n; ++j) {
+            const struct pwar_capture_record *r = ev[j].rec;
+            if (r->type == PWAR_CAPTURE_CYCLE && r->seq == sent->seq) {
+                if (r->decision != d)
+                    (*changed)++;
+                break;
+            }
+            if (r->type == PWAR_CAPTURE_SENT)
+                break;
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    int do_dump = 0;
+    int64_t wait_us = -1;
+    // The bridge's defaults
+    enum pwar_catchup_policy policy = PWAR_CATCHUP_NEWEST;
+    uint32_t target = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--dump") == 0) {
+            do_dump = 1;
+        } else if (strcmp(argv[i], "--wait-us") == 0 && i + 1 < argc) {
+            wait_us = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--catchup") == 0 && i + 1 < argc) {
+            if (pwar_catchup_parse(argv[++i], &policy) < 0) {
+                fprintf(stderr, "invalid --catchup %s (expected off, newest, drop or stretch)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--catchup-target") == 0 && i + 1 < argc) {
+            target = strtoul(argv[++i], NULL, 10);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [--dump] [--wait-us N] [--catchup POLICY] [--catchup-target N] capture.bin\n",
+            argv[0]);
+        return 1;
+    }
+
+    struct pwar_capture cap;
+    int rc = pwar_capture_open(&cap, path);
+    if (rc < 0) {
+        fprintf(stderr, "can't open capture %s: %s\n", path, strerror(-rc));
+        return 1;
+    }
+
+    uint64_t first, end;
+    pwar_capture_range(&cap, &first, &end);
+    struct event *ev = calloc(end - first + 1, sizeof(*ev));
+    if (!ev) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    size_t n = 0;
+    uint64_t recorded[PWAR_PLAYOUT_N_DECISIONS] = { 0 };
+    struct pwar_stat rtt;
+    pwar_stat_reset(&rtt);
+    for (uint64_t idx = first; idx < end; ++idx) {
+        const struct pwar_capture_record *r = pwar_capture_get(&cap, idx);
+        if (!r)
+            continue;
+        ev[n].ts_ns = r->ts_ns;
+        ev[n].rec = r;
+        n++;
+        if (r->type == PWAR_CAPTURE_CYCLE && r->decision < PWAR_PLAYOUT_N_DECISIONS)
+            recorded[r->decision]++;
+        else if (r->type == PWAR_CAPTURE_RECEIVED)
+            pwar_stat_add(&rtt, (int64_t)(r->ts_ns - r->ts_pipewire_send) / 1000000.0);
+    }
+    // Records are claimed by two threads; order them by time for the replay
+    qsort(ev, n, sizeof(*ev), cmp_event);
+
+    printf("Capture %s: %" PRIu64 " records kept of %" PRIu64 " written, audio %s, session wait %.3f ms\n",
+        path, (uint64_t)n, end, (cap.header->flags & PWAR_CAPTURE_FLAG_AUDIO) ? "yes" : "no",
+        cap.header->wait_ns / 1000000.0);
+    if (n)
+        printf("Span: %.3f s | Round trip: min %.3f ms, max %.3f ms, avg %.3f ms\n",
+            (ev[n - 1].ts_ns - ev[0].ts_ns) / 1e9, rtt.min, rtt.max, pwar_stat_avg(&rtt));
+    if (do_dump)
+        dump(ev, n);
+
+    uint64_t wait_ns = wait_us >= 0 ? (uint64_t)wait_us * 1000 : cap.header->wait_ns;
+    struct pwar_playout replayed;
+    pwar_catchup_t catchup;
+    uint64_t changed;
+    pwar_catchup_init(&catchup, policy, target);
+    replay(ev, n, wait_ns, &catchup, &replayed, &changed);
+
+    printf("%-10s %12s %12s\n", "decision", "recorded", "replayed");
+    for (int d = 0; d < PWAR_PLAYOUT_N_DECISIONS; ++d)
+        printf("%-10s %12" PRIu64 " %12" PRIu64 "\n", pwar_playout_decision_name(d), recorded[d], replayed.counts[d]);
+    printf("Replayed with wait %.3f ms: %" PRIu64 " cycles decided differently\n", wait_ns / 1000000.0, changed);
+    printf("Catch-up %s: %" PRIu64 " backlogs worked off in at most %.3f ms, dropped %" PRIu64
+        " frames, stretched %" PRIu64 "\n", pwar_catchup_policy_name(policy), catchup.backlogs,
+        catchup.max_recovery_ns / 1000000.0, catchup.dropped_frames, catchup.stretched_frames);
+
+    free(ev);
+    pwar_capture_close(&cap);
+    return 0;
+}
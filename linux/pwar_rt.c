@@ -0,0 +1,216 @@
+/*
+ * pwar_rt.c - Real-time thread configuration for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <alloca.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <pipewire/pipewire.h>
+#include "pwar_rt.h"
+
+static const char *thread_names[PWAR_RT_THREAD_COUNT] = {
+    [PWAR_RT_THREAD_RECEIVER] = "receiver",
+    [PWAR_RT_THREAD_SENDER] = "sender",
+    [PWAR_RT_THREAD_STATS] = "stats",
+    [PWAR_RT_THREAD_PACER] = "pacer",
+};
+
+static const char *policy_name(int policy) {
+    switch (policy) {
+    case SCHED_FIFO: return "SCHED_FIFO";
+    case SCHED_RR: return "SCHED_RR";
+    case SCHED_OTHER: return "SCHED_OTHER";
+    case SCHED_BATCH: return "SCHED_BATCH";
+    case SCHED_IDLE: return "SCHED_IDLE";
+    }
+    return "unknown";
+}
+
+const char *pwar_rt_thread_name(enum pwar_rt_thread thread) {
+    return thread_names[thread];
+}
+
+void pwar_rt_config_defaults(struct pwar_rt_config *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    for (int i = 0; i < PWAR_RT_THREAD_COUNT; ++i) {
+        cfg->threads[i].policy = PWAR_RT_POLICY_INHERIT;
+        CPU_ZERO(&cfg->threads[i].cpus);
+    }
+    // The receiver has always run at SCHED_FIFO 90; PipeWire owns the sender's
+    // scheduling and the stats thread stays a normal thread. The pacer's
+    // wake-up is the departure time, so it runs like the receiver.
+    cfg->threads[PWAR_RT_THREAD_RECEIVER].policy = SCHED_FIFO;
+    cfg->threads[PWAR_RT_THREAD_RECEIVER].priority = 90;
+    cfg->threads[PWAR_RT_THREAD_PACER].policy = SCHED_FIFO;
+    cfg->threads[PWAR_RT_THREAD_PACER].priority = 90;
+    cfg->threads[PWAR_RT_THREAD_STATS].policy = SCHED_OTHER;
+    cfg->lock_memory = 1;
+    cfg->stack_size = PWAR_RT_DEFAULT_STACK_SIZE;
+}
+
+// Parses a cpu list such as "2,3,6-7"
+int pwar_rt_parse_cpus(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return -EINVAL;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE)
+                return -EINVAL;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, set);
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return -EINVAL;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -EINVAL;
+}
+
+// Parses "fifo:90", "rr:70", "other" or "inherit"
+int pwar_rt_parse_sched(const char *spec, struct pwar_rt_thread_config *thread) {
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    int policy;
+    if (len == 4 && strncmp(spec, "fifo", len) == 0)
+        policy = SCHED_FIFO;
+    else if (len == 2 && strncmp(spec, "rr", len) == 0)
+        policy = SCHED_RR;
+    else if (len == 5 && strncmp(spec, "other", len) == 0)
+        policy = SCHED_OTHER;
+    else if (len == 7 && strncmp(spec, "inherit", len) == 0)
+        policy = PWAR_RT_POLICY_INHERIT;
+    else
+        return -EINVAL;
+
+    int priority = 0;
+    if (colon) {
+        char *end;
+        priority = (int)strtol(colon + 1, &end, 10);
+        if (*end != '\0')
+            return -EINVAL;
+    }
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        if (priority < sched_get_priority_min(policy) || priority > sched_get_priority_max(policy))
+            return -EINVAL;
+    } else {
+        priority = 0;
+    }
+    thread->policy = policy;
+    thread->priority = priority;
+    return 0;
+}
+
+const char *pwar_rt_lock_memory(const struct pwar_rt_config *cfg) {
+    if (!cfg->lock_memory)
+        return "disabled";
+    // MCL_FUTURE with a finite RLIMIT_MEMLOCK makes later mmaps fail once the
+    // limit is reached, so only lock what is mapped now in that case.
+    struct rlimit rl;
+    int future = getrlimit(RLIMIT_MEMLOCK, &rl) == 0 && rl.rlim_cur == RLIM_INFINITY;
+    if (future && mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+        return "locked (current and future)";
+    if (mlockall(MCL_CURRENT) == 0)
+        return "locked (current only, RLIMIT_MEMLOCK is finite)";
+    return errno == ENOMEM ? "failed (RLIMIT_MEMLOCK too small)" : "failed (not permitted)";
+}
+
+int pwar_rt_thread_attr_init(pthread_attr_t *attr, const struct pwar_rt_config *cfg) {
+    int rc = pthread_attr_init(attr);
+    if (rc == 0 && cfg->stack_size)
+        rc = pthread_attr_setstacksize(attr, cfg->stack_size);
+    return rc;
+}
+
+void pwar_rt_apply_thread(const struct pwar_rt_config *cfg, enum pwar_rt_thread thread,
+                          struct pwar_rt_thread_result *result) {
+    const struct pwar_rt_thread_config *tc = &cfg->threads[thread];
+    pthread_t self = pthread_self();
+
+    memset(result, 0, sizeof(*result));
+    if (tc->has_cpus) {
+        int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &tc->cpus);
+        result->affinity_err = rc;
+    }
+    if (tc->policy != PWAR_RT_POLICY_INHERIT) {
+        struct sched_param sp = { .sched_priority = tc->priority };
+        int rc = pthread_setschedparam(self, tc->policy, &sp);
+        if (rc == EPERM && (tc->policy == SCHED_FIFO || tc->policy == SCHED_RR)) {
+            // Unprivileged: ask rtkit through the PipeWire RT module. It picks
+            // SCHED_RR and may clamp the priority to the rtkit limit.
+            if (pw_thread_utils_acquire_rt((struct spa_thread *)self, tc->priority) == 0) {
+                result->via_rtkit = 1;
+                rc = 0;
+            }
+        }
+        result->sched_err = rc;
+    }
+
+    struct sched_param sp;
+    if (pthread_getschedparam(self, &result->policy, &sp) == 0)
+        result->priority = sp.sched_priority;
+    CPU_ZERO(&result->cpus);
+    pthread_getaffinity_np(self, sizeof(cpu_set_t), &result->cpus);
+    __atomic_store_n(&result->applied, 1, __ATOMIC_RELEASE);
+}
+
+void pwar_rt_prefault_stack(size_t bytes) {
+    // Leave some headroom below the configured stack size for our own frames
+    if (bytes > 16 * 1024)
+        bytes -= 16 * 1024;
+    volatile unsigned char *stack = alloca(bytes);
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < bytes; i += (size_t)page)
+        stack[i] = 0;
+}
+
+void pwar_rt_prefault(void *buf, size_t len) {
+    volatile unsigned char *p = buf;
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < len; i += (size_t)page)
+        p[i] = p[i];
+    if (len)
+        p[len - 1] = p[len - 1];
+}
+
+void pwar_rt_format_result(const struct pwar_rt_thread_result *result, char *out, size_t out_len) {
+    char cpus[128];
+    size_t n = 0;
+    cpus[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && n + 8 < sizeof(cpus); ++cpu) {
+        if (!CPU_ISSET(cpu, &result->cpus))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &result->cpus))
+            last++;
+        if (last > cpu)
+            n += snprintf(cpus + n, sizeof(cpus) - n, "%s%d-%d", n ? "," : "", cpu, last);
+        else
+            n += snprintf(cpus + n, sizeof(cpus) - n, "%s%d", n ? "," : "", cpu);
+        cpu = last;
+    }
+    char sched_note[96] = "", affinity_note[96] = "";
+    if (result->sched_err)
+        snprintf(sched_note, sizeof(sched_note), " [policy request failed: %s]", strerror(result->sched_err));
+    if (result->affinity_err)
+        snprintf(affinity_note, sizeof(affinity_note), " [affinity request failed: %s]", strerror(result->affinity_err));
+    snprintf(out, out_len, "%s prio %d%s%s, cpus %s%s",
+        policy_name(result->policy), result->priority,
+        result->via_rtkit ? " (rtkit)" : "", sched_note, cpus, affinity_note);
+}
@@ -0,0 +1,71 @@
+/*
+ * pwar_rt.h - Real-time thread configuration for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#ifndef PWAR_RT
+#define PWAR_RT
+
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+
+#define PWAR_RT_POLICY_INHERIT -1         // leave the thread as it was created
+#define PWAR_RT_DEFAULT_STACK_SIZE (256 * 1024)
+
+enum pwar_rt_thread {
+    PWAR_RT_THREAD_RECEIVER,
+    PWAR_RT_THREAD_SENDER,                // the PipeWire data thread running on_process
+    PWAR_RT_THREAD_STATS,
+    PWAR_RT_THREAD_PACER,                 // sends at the departure times, --txtime pace only
+    PWAR_RT_THREAD_COUNT
+};
+
+struct pwar_rt_thread_config {
+    int policy;                           // SCHED_FIFO, SCHED_RR, SCHED_OTHER or PWAR_RT_POLICY_INHERIT
+    int priority;
+    int has_cpus;
+    cpu_set_t cpus;
+};
+
+struct pwar_rt_config {
+    struct pwar_rt_thread_config threads[PWAR_RT_THREAD_COUNT];
+    int lock_memory;
+    size_t stack_size;                    // stack size for threads we create, pre-faulted on start
+};
+
+// What a thread actually obtained, filled in by pwar_rt_apply_thread
+struct pwar_rt_thread_result {
+    int applied;
+    int policy;
+    int priority;
+    int via_rtkit;
+    int sched_err;                        // errno of the failed request, 0 if it succeeded
+    int affinity_err;
+    cpu_set_t cpus;
+};
+
+void pwar_rt_config_defaults(struct pwar_rt_config *cfg);
+int pwar_rt_parse_cpus(const char *list, cpu_set_t *set);
+int pwar_rt_parse_sched(const char *spec, struct pwar_rt_thread_config *thread);
+const char *pwar_rt_thread_name(enum pwar_rt_thread thread);
+
+// Locks current (and, when the limit allows it, future) mappings. Returns a
+// static string describing what was obtained.
+const char *pwar_rt_lock_memory(const struct pwar_rt_config *cfg);
+
+int pwar_rt_thread_attr_init(pthread_attr_t *attr, const struct pwar_rt_config *cfg);
+
+// Applies policy, priority and affinity to the calling thread. Falls back to
+// rtkit (through the PipeWire RT module) when unprivileged.
+void pwar_rt_apply_thread(const struct pwar_rt_config *cfg, enum pwar_rt_thread thread,
+                          struct pwar_rt_thread_result *result);
+
+void pwar_rt_prefault_stack(size_t bytes);
+void pwar_rt_prefault(void *buf, size_t len);
+
+void pwar_rt_format_result(const struct pwar_rt_thread_result *result, char *out, size_t out_len);
+
+#endif /* PWAR_RT */
@@ -0,0 +1,218 @@
+/*
+ * pwar_rtcheck.c - Real-time section checker for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Only linked with RTCHECK=1. The definitions here take precedence over
+ * libc's for the whole process, so they catch calls made by libraries on
+ * our behalf as well; outside a section they only forward.
+ */
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include "pwar_rtcheck.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *p);
+
+static __thread int in_section;
+static __thread int reporting;
+static int warn_only;
+
+static int (*real_mutex_lock)(pthread_mutex_t *);
+static int (*real_cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+static int (*real_cond_timedwait)(pthread_cond_t *, pthread_mutex_t *, const struct timespec *);
+static int (*real_sem_wait)(sem_t *);
+static int (*real_nanosleep)(const struct timespec *, struct timespec *);
+static int (*real_clock_nanosleep)(clockid_t, int, const struct timespec *, struct timespec *);
+static int (*real_usleep)(useconds_t);
+static int (*real_poll)(struct pollfd *, nfds_t, int);
+static int (*real_select)(int, fd_set *, fd_set *, fd_set *, struct timeval *);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static int (*real_fsync)(int);
+static int (*real_puts)(const char *);
+static void (*real_perror)(const char *);
+
+// Resolved before main so no lookup (which may allocate) happens in a section
+__attribute__((constructor)) static void rtcheck_init(void) {
+    void *frames[1];
+    const char *mode = getenv("PWAR_RTCHECK");
+    warn_only = mode && strcmp(mode, "warn") == 0;
+    real_mutex_lock = dlsym(RTLD_NEXT, "pthread_mutex_lock");
+    real_cond_wait = dlsym(RTLD_NEXT, "pthread_cond_wait");
+    real_cond_timedwait = dlsym(RTLD_NEXT, "pthread_cond_timedwait");
+    real_sem_wait = dlsym(RTLD_NEXT, "sem_wait");
+    real_nanosleep = dlsym(RTLD_NEXT, "nanosleep");
+    real_clock_nanosleep = dlsym(RTLD_NEXT, "clock_nanosleep");
+    real_usleep = dlsym(RTLD_NEXT, "usleep");
+    real_poll = dlsym(RTLD_NEXT, "poll");
+    real_select = dlsym(RTLD_NEXT, "select");
+    real_read = dlsym(RTLD_NEXT, "read");
+    real_write = dlsym(RTLD_NEXT, "write");
+    real_fsync = dlsym(RTLD_NEXT, "fsync");
+    real_puts = dlsym(RTLD_NEXT, "puts");
+    real_perror = dlsym(RTLD_NEXT, "perror");
+    // The first backtrace() loads libgcc, which allocates; get it done now
+    backtrace(frames, 1);
+}
+
+void pwar_rtcheck_enter(void) {
+    in_section = 1;
+}
+
+void pwar_rtcheck_leave(void) {
+    in_section = 0;
+}
+
+static void violation(const char *what) {
+    if (!in_section || reporting)
+        return;
+    reporting = 1;
+    char msg[128];
+    int n = snprintf(msg, sizeof(msg), "[rtcheck] %s inside a real-time section\n", what);
+    syscall(SYS_write, 2, msg, (size_t)n);
+    void *frames[32];
+    backtrace_symbols_fd(frames, backtrace(frames, 32), 2);
+    if (!warn_only)
+        abort();
+    reporting = 0;
+}
+
+void *malloc(size_t size) {
+    violation("malloc");
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    violation("calloc");
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+    violation("realloc");
+    return __libc_realloc(p, size);
+}
+
+void free(void *p) {
+    if (p)
+        violation("free");
+    __libc_free(p);
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+    violation("posix_memalign");
+    void *p = __libc_memalign(align, size);
+    if (!p)
+        return 12;                        // ENOMEM
+    *out = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+    violation("aligned_alloc");
+    return __libc_memalign(align, size);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *m) {
+    violation("pthread_mutex_lock");
+    return real_mutex_lock(m);
+}
+
+int pthread_cond_wait(pthread_cond_t *c, pthread_mutex_t *m) {
+    violation("pthread_cond_wait");
+    return real_cond_wait(c, m);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *c, pthread_mutex_t *m, const struct timespec *t) {
+    violation("pthread_cond_timedwait");
+    return real_cond_timedwait(c, m, t);
+}
+
+int sem_wait(sem_t *s) {
+    violation("sem_wait");
+    return real_sem_wait(s);
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+    violation("nanosleep");
+    return real_nanosleep(req, rem);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *req, struct timespec *rem) {
+    violation("clock_nanosleep");
+    return real_clock_nanosleep(clock, flags, req, rem);
+}
+
+int usleep(useconds_t usec) {
+    violation("usleep");
+    return real_usleep(usec);
+}
+
+int poll(struct pollfd *fds, nfds_t n, int timeout) {
+    violation("poll");
+    return real_poll(fds, n, timeout);
+}
+
+int select(int n, fd_set *r, fd_set *w, fd_set *e, struct timeval *t) {
+    violation("select");
+    return real_select(n, r, w, e, t);
+}
+
+ssize_t read(int fd, void *buf, size_t len) {
+    violation("read");
+    return real_read(fd, buf, len);
+}
+
+ssize_t write(int fd, const void *buf, size_t len) {
+    violation("write");
+    return real_write(fd, buf, len);
+}
+
+int fsync(int fd) {
+    violation("fsync");
+    return real_fsync(fd);
+}
+
+int printf(const char *fmt, ...) {
+    violation("printf");
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int fprintf(FILE *f, const char *fmt, ...) {
+    violation("fprintf");
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vfprintf(f, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int puts(const char *s) {
+    violation("puts");
+    return real_puts(s);
+}
+
+void perror(const char *s) {
+    violation("perror");
+    real_perror(s);
+}
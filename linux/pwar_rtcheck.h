@@ -0,0 +1,30 @@
+/*
+ * pwar_rtcheck.h - Real-time section checker for the PWAR Linux bridge
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * The audio cycle and the receiver's packet handling are marked as
+ * real-time sections. Built with `make RTCHECK=1`, the bridge interposes
+ * the allocator, blocking locks, sleeps, stdio and blocking file syscalls,
+ * and aborts with a backtrace when one of them runs inside a section
+ * (PWAR_RTCHECK=warn only reports). Otherwise the markers compile away.
+ *
+ * The one deliberate wait is the bounded reply wait (sem_timedwait, see
+ * --wait-us), which is not interposed.
+ */
+
+#ifndef PWAR_RTCHECK
+#define PWAR_RTCHECK
+
+#ifdef PWAR_RTCHECK_ENABLED
+void pwar_rtcheck_enter(void);
+void pwar_rtcheck_leave(void);
+#define PWAR_RT_SECTION_BEGIN() pwar_rtcheck_enter()
+#define PWAR_RT_SECTION_END() pwar_rtcheck_leave()
+#else
+#define PWAR_RT_SECTION_BEGIN() ((void)0)
+#define PWAR_RT_SECTION_END() ((void)0)
+#endif
+
+#endif /* PWAR_RTCHECK */
@@ -0,0 +1,36 @@
+/*
+ * pwar_stats.h - Min/max/average accumulators for the PWAR stats windows
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#ifndef PWAR_STATS
+#define PWAR_STATS
+
+#include <stdint.h>
+
+struct pwar_stat {
+    double min, max, sum;
+    uint32_t count;
+};
+
+static inline void pwar_stat_reset(struct pwar_stat *s) {
+    s->min = 1e9;
+    s->max = 0;
+    s->sum = 0;
+    s->count = 0;
+}
+
+static inline void pwar_stat_add(struct pwar_stat *s, double v) {
+    if (v < s->min) s->min = v;
+    if (v > s->max) s->max = v;
+    s->sum += v;
+    s->count++;
+}
+
+static inline double pwar_stat_avg(const struct pwar_stat *s) {
+    return s->count ? s->sum / s->count : 0;
+}
+
+#endif /* PWAR_STATS */
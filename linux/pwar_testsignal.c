@@ -0,0 +1,249 @@
+/*
+ * pwar_testsignal.c - Test signal generator and loopback latency measurement for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "pwar_testsignal.h"
+
+#define MLS_ORDER 12
+#define CHIRP_LEN 2048
+#define CHIRP_F0 100.0
+#define CHIRP_F1 12000.0
+
+int pwar_testsignal_parse(const char *name, enum pwar_test_signal *type) {
+    if (strcmp(name, "sine") == 0)
+        *type = PWAR_TEST_SINE;
+    else if (strcmp(name, "impulse") == 0)
+        *type = PWAR_TEST_IMPULSE;
+    else if (strcmp(name, "mls") == 0)
+        *type = PWAR_TEST_MLS;
+    else if (strcmp(name, "chirp") == 0)
+        *type = PWAR_TEST_CHIRP;
+    else
+        return -EINVAL;
+    return 0;
+}
+
+const char *pwar_testsignal_name(enum pwar_test_signal type) {
+    switch (type) {
+    case PWAR_TEST_NONE: return "none";
+    case PWAR_TEST_SINE: return "sine";
+    case PWAR_TEST_IMPULSE: return "impulse";
+    case PWAR_TEST_MLS: return "mls";
+    case PWAR_TEST_CHIRP: return "chirp";
+    }
+    return "unknown";
+}
+
+// Maximum length sequence from a Fibonacci LFSR, taps for x^12 + x^11 + x^10 + x^4 + 1
+static uint32_t render_mls(float *out, float amplitude) {
+    uint32_t len = (1u << MLS_ORDER) - 1;
+    uint32_t lfsr = 1;
+    for (uint32_t i = 0; i < len; ++i) {
+        out[i] = (lfsr & 1) ? amplitude : -amplitude;
+        uint32_t bit = ((lfsr >> 0) ^ (lfsr >> 1) ^ (lfsr >> 2) ^ (lfsr >> 8)) & 1;
+        lfsr = (lfsr >> 1) | (bit << (MLS_ORDER - 1));
+    }
+    return len;
+}
+
+static uint32_t render_chirp(float *out, float amplitude) {
+    double k = (CHIRP_F1 - CHIRP_F0) / ((double)CHIRP_LEN / PWAR_TEST_SAMPLE_RATE);
+    for (uint32_t i = 0; i < CHIRP_LEN; ++i) {
+        double t = (double)i / PWAR_TEST_SAMPLE_RATE;
+        // Hann window keeps the edges from smearing the correlation peak
+        double w = 0.5 - 0.5 * cos(2 * M_PI * i / (CHIRP_LEN - 1));
+        out[i] = (float)(amplitude * w * sin(2 * M_PI * (CHIRP_F0 * t + 0.5 * k * t * t)));
+    }
+    return CHIRP_LEN;
+}
+
+void pwar_testsignal_init(struct pwar_testsignal *ts, enum pwar_test_signal type,
+                          float freq, uint32_t interval_ms) {
+    memset(ts, 0, sizeof(*ts));
+    ts->type = type;
+    ts->amplitude = 0.5f;
+    ts->midi_offset = -1;
+    for (uint32_t i = 0; i <= PWAR_TEST_TABLE_SIZE; ++i)
+        ts->table[i] = (float)sin(2 * M_PI * i / PWAR_TEST_TABLE_SIZE);
+    ts->phase_inc = (uint32_t)(freq / PWAR_TEST_SAMPLE_RATE * 4294967296.0);
+
+    switch (type) {
+    case PWAR_TEST_IMPULSE:
+        ts->burst[0] = ts->amplitude;
+        ts->burst_len = 1;
+        break;
+    case PWAR_TEST_MLS:
+        ts->burst_len = render_mls(ts->burst, ts->amplitude);
+        break;
+    case PWAR_TEST_CHIRP:
+        ts->burst_len = render_chirp(ts->burst, ts->amplitude);
+        break;
+    default:
+        break;
+    }
+    ts->interval = (uint64_t)interval_ms * PWAR_TEST_SAMPLE_RATE / 1000;
+    if (ts->interval < PWAR_TEST_MAX_LATENCY + ts->burst_len)
+        ts->interval = PWAR_TEST_MAX_LATENCY + ts->burst_len;
+    ts->capture_len = PWAR_TEST_MAX_LATENCY + ts->burst_len;
+    ts->next_burst = PWAR_TEST_SAMPLE_RATE / 2;   // let the graph settle first
+    ts->results.min_latency = INT32_MAX;
+}
+
+static void generate_sine(struct pwar_testsignal *ts, float *out, uint32_t n) {
+    const uint32_t frac_bits = 32 - PWAR_TEST_TABLE_BITS;
+    const float frac_scale = 1.0f / (float)(1u << frac_bits);
+    uint32_t phase = ts->phase;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t idx = phase >> frac_bits;
+        float frac = (float)(phase & ((1u << frac_bits) - 1)) * frac_scale;
+        float a = ts->table[idx];
+        out[i] = (a + (ts->table[idx + 1] - a) * frac) * ts->amplitude;
+        phase += ts->phase_inc;
+    }
+    ts->phase = phase;
+}
+
+void pwar_testsignal_generate(struct pwar_testsignal *ts, float *out, uint32_t n) {
+    ts->period = n;
+    if (ts->type == PWAR_TEST_SINE) {
+        generate_sine(ts, out, n);
+        ts->gen_pos += n;
+        return;
+    }
+
+    memset(out, 0, n * sizeof(float));
+    ts->midi_offset = -1;
+    uint64_t start = ts->gen_pos, end = ts->gen_pos + n;
+    while (ts->next_burst < end) {
+        uint64_t b = ts->next_burst;
+        if (b >= start && __atomic_load_n(&ts->capture_state, __ATOMIC_ACQUIRE) == PWAR_TEST_CAPTURE_IDLE) {
+            ts->capture_start = b;
+            ts->capture_fill = 0;
+            ts->midi_offset = (int32_t)(b - start);
+            ts->midi_back = 0;
+            __atomic_store_n(&ts->capture_state, PWAR_TEST_CAPTURE_RECORDING, __ATOMIC_RELAXED);
+        }
+        // Copy the part of the burst that falls into this period
+        uint64_t from = b > start ? b : start;
+        uint64_t to = b + ts->burst_len < end ? b + ts->burst_len : end;
+        if (from < to)
+            memcpy(out + (from - start), ts->burst + (from - b), (to - from) * sizeof(float));
+        if (b + ts->burst_len > end)
+            break;                        // continues next period
+        ts->next_burst += ts->interval;
+    }
+    ts->gen_pos = end;
+}
+
+void pwar_testsignal_capture(struct pwar_testsignal *ts, const float *ret, uint32_t n) {
+    uint64_t start = ts->ret_pos;
+    ts->ret_pos += n;
+    if (__atomic_load_n(&ts->capture_state, __ATOMIC_RELAXED) != PWAR_TEST_CAPTURE_RECORDING ||
+        ts->ret_pos <= ts->capture_start)
+        return;
+    uint32_t skip = ts->capture_start > start ? (uint32_t)(ts->capture_start - start) : 0;
+    uint32_t count = n - skip;
+    if (count > ts->capture_len - ts->capture_fill)
+        count = ts->capture_len - ts->capture_fill;
+    if (ret)
+        memcpy(ts->capture + ts->capture_fill, ret + skip, count * sizeof(float));
+    else
+        memset(ts->capture + ts->capture_fill, 0, count * sizeof(float));
+    ts->capture_fill += count;
+    if (ts->capture_fill == ts->capture_len)
+        __atomic_store_n(&ts->capture_state, PWAR_TEST_CAPTURE_READY, __ATOMIC_RELEASE);
+}
+
+void pwar_testsignal_midi_generate(struct pwar_testsignal *ts, pwar_midi_block_t *out) {
+    static const uint8_t note_on[3] = { 0x90, PWAR_TEST_MIDI_NOTE, 100 };
+    static const uint8_t note_off[3] = { 0x80, PWAR_TEST_MIDI_NOTE, 0 };
+    if (ts->midi_offset < 0)
+        return;
+    pwar_midi_add(out, (uint32_t)ts->midi_offset, note_on, sizeof(note_on));
+    pwar_midi_add(out, (uint32_t)ts->midi_offset, note_off, sizeof(note_off));
+}
+
+void pwar_testsignal_midi_capture(struct pwar_testsignal *ts, const pwar_midi_block_t *ret) {
+    if (ts->midi_back || __atomic_load_n(&ts->capture_state, __ATOMIC_RELAXED) != PWAR_TEST_CAPTURE_RECORDING)
+        return;
+    for (uint32_t i = 0; i < ret->count; ++i) {
+        const pwar_midi_event_t *ev = &ret->events[i];
+        if (ev->size == 3 && (ev->data[0] & 0xf0) == 0x90 && ev->data[1] == PWAR_TEST_MIDI_NOTE && ev->data[2] &&
+            ts->ret_pos + ev->offset >= ts->capture_start) {
+            ts->midi_ret = ts->ret_pos + ev->offset;
+            ts->midi_back = 1;
+            return;
+        }
+    }
+}
+
+int pwar_testsignal_analyze(struct pwar_testsignal *ts) {
+    if (__atomic_load_n(&ts->capture_state, __ATOMIC_ACQUIRE) != PWAR_TEST_CAPTURE_READY)
+        return 0;
+
+    const float *ref = ts->burst;
+    const float *sig = ts->capture;
+    uint32_t len = ts->burst_len;
+    double ref_energy = 0;
+    for (uint32_t i = 0; i < len; ++i)
+        ref_energy += (double)ref[i] * ref[i];
+
+    // Energy of the signal under the sliding reference window
+    double sig_energy = 0;
+    for (uint32_t i = 0; i < len; ++i)
+        sig_energy += (double)sig[i] * sig[i];
+
+    int32_t best_lag = -1;
+    double best = 0, best_norm = 0;
+    for (uint32_t lag = 0; lag < PWAR_TEST_MAX_LATENCY; ++lag) {
+        double c = 0;
+        for (uint32_t i = 0; i < len; ++i)
+            c += (double)ref[i] * sig[lag + i];
+        if (fabs(c) > best && sig_energy > 0) {
+            best = fabs(c);
+            best_norm = best / sqrt(ref_energy * sig_energy);
+            best_lag = (int32_t)lag;
+        }
+        sig_energy += (double)sig[lag + len] * sig[lag + len] - (double)sig[lag] * sig[lag];
+        if (sig_energy < 0)
+            sig_energy = 0;
+    }
+
+    struct pwar_test_results *r = &ts->results;
+    r->bursts++;
+    // Accept a peak that is well correlated and not buried more than 26 dB down
+    if (best_lag < 0 || best_norm < 0.5 || best / ref_energy < 0.05) {
+        r->missing++;
+    } else {
+        if (r->have_latency && ts->period) {
+            int32_t diff = best_lag - r->latency;
+            int32_t periods = (abs(diff) + (int32_t)ts->period / 2) / (int32_t)ts->period;
+            if (diff > 0)
+                r->duplicated_periods += periods;
+            else
+                r->dropped_periods += periods;
+        }
+        r->latency = best_lag;
+        r->have_latency = 1;
+        if (best_lag < r->min_latency) r->min_latency = best_lag;
+        if (best_lag > r->max_latency) r->max_latency = best_lag;
+        if (ts->midi_back) {
+            r->midi_latency = (int32_t)(ts->midi_ret - ts->capture_start);
+            r->midi_error = r->midi_latency - best_lag;
+            if (abs(r->midi_error) > abs(r->midi_max_error))
+                r->midi_max_error = r->midi_error;
+            r->have_midi = 1;
+        } else {
+            r->midi_missing++;
+        }
+    }
+    __atomic_store_n(&ts->capture_state, PWAR_TEST_CAPTURE_IDLE, __ATOMIC_RELEASE);
+    return 1;
+}
@@ -0,0 +1,117 @@
+/*
+ * pwar_testsignal.h - Test signal generator and loopback latency measurement for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * on_process injects the signal into the input and feeds every returned
+ * period back in. Bursts (impulse, MLS or chirp) are emitted at a fixed
+ * interval and the return stream after each one is recorded; the stats
+ * thread then correlates it against the reference to get the round trip in
+ * samples. A jump of the measured latency by about a period means the audio
+ * path dropped or repeated a period.
+ *
+ * A MIDI note goes out at the first sample of every recorded burst. When
+ * the peer loops MIDI back too, the analysis checks that the note returns
+ * at exactly the sample the burst does.
+ */
+
+#ifndef PWAR_TESTSIGNAL
+#define PWAR_TESTSIGNAL
+
+#include <stdint.h>
+#include "pwar_midi.h"
+
+#define PWAR_TEST_SAMPLE_RATE 48000
+#define PWAR_TEST_TABLE_BITS 12
+#define PWAR_TEST_TABLE_SIZE (1u << PWAR_TEST_TABLE_BITS)
+#define PWAR_TEST_MAX_BURST 4096
+#define PWAR_TEST_MAX_LATENCY 16384       // longest round trip searched, in samples
+#define PWAR_TEST_MIDI_NOTE 60
+
+enum pwar_test_signal {
+    PWAR_TEST_NONE,
+    PWAR_TEST_SINE,
+    PWAR_TEST_IMPULSE,
+    PWAR_TEST_MLS,
+    PWAR_TEST_CHIRP,
+};
+
+enum {
+    PWAR_TEST_CAPTURE_IDLE,
+    PWAR_TEST_CAPTURE_RECORDING,
+    PWAR_TEST_CAPTURE_READY,
+};
+
+struct pwar_test_results {
+    uint64_t bursts;                      // analysed bursts
+    uint64_t missing;                     // bursts not found in the return stream
+    uint64_t dropped_periods;
+    uint64_t duplicated_periods;
+    int have_latency;
+    int32_t latency;                      // last measurement, samples
+    int32_t min_latency, max_latency;
+    // MIDI against the audio of the same burst, in samples
+    int have_midi;
+    int32_t midi_latency;
+    int32_t midi_error;                   // midi_latency - latency, 0 when sample accurate
+    int32_t midi_max_error;               // largest magnitude so far
+    uint64_t midi_missing;                // bursts found whose note never came back
+};
+
+struct pwar_testsignal {
+    enum pwar_test_signal type;
+    float amplitude;
+
+    // Sine: phase accumulator over a wavetable, the top bits index the
+    // table and the rest interpolate.
+    float table[PWAR_TEST_TABLE_SIZE + 1];
+    uint32_t phase;
+    uint32_t phase_inc;
+
+    // Bursts, rendered once at init
+    float burst[PWAR_TEST_MAX_BURST];
+    uint32_t burst_len;
+    uint64_t interval;
+    uint64_t gen_pos;                     // samples generated so far
+    uint64_t next_burst;
+    uint32_t period;                      // last cycle size, for slip detection
+
+    // Return stream after the last burst; handed to the analysis when full
+    float capture[PWAR_TEST_MAX_LATENCY + PWAR_TEST_MAX_BURST];
+    uint32_t capture_len;
+    uint32_t capture_fill;
+    uint64_t capture_start;
+    uint64_t ret_pos;                     // samples returned so far
+    int capture_state;
+
+    int32_t midi_offset;                  // note in the cycle just generated, -1 for none
+    uint64_t midi_ret;                    // sample the note came back at
+    int midi_back;
+
+    struct pwar_test_results results;     // analysis side only
+};
+
+int pwar_testsignal_parse(const char *name, enum pwar_test_signal *type);
+const char *pwar_testsignal_name(enum pwar_test_signal type);
+
+void pwar_testsignal_init(struct pwar_testsignal *ts, enum pwar_test_signal type,
+                          float freq, uint32_t interval_ms);
+
+static inline int pwar_testsignal_measures(const struct pwar_testsignal *ts) {
+    return ts->type != PWAR_TEST_SINE && ts->type != PWAR_TEST_NONE;
+}
+
+// RT side, called once per cycle in this order
+void pwar_testsignal_generate(struct pwar_testsignal *ts, float *out, uint32_t n);
+void pwar_testsignal_capture(struct pwar_testsignal *ts, const float *ret, uint32_t n);
+
+// RT side MIDI, generate right after pwar_testsignal_generate() and capture
+// right before pwar_testsignal_capture()
+void pwar_testsignal_midi_generate(struct pwar_testsignal *ts, pwar_midi_block_t *out);
+void pwar_testsignal_midi_capture(struct pwar_testsignal *ts, const pwar_midi_block_t *ret);
+
+// Non-RT side. Returns 1 when a burst was analysed.
+int pwar_testsignal_analyze(struct pwar_testsignal *ts);
+
+#endif /* PWAR_TESTSIGNAL */
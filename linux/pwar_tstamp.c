@@ -0,0 +1,194 @@
+/*
+ * pwar_tstamp.c - Kernel socket timestamping (SO_TIMESTAMPING) helpers for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include "pwar_tstamp.h"
+
+#ifndef SO_EE_ORIGIN_TXTIME
+#define SO_EE_ORIGIN_TXTIME 6
+#endif
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+uint64_t pwar_tstamp_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return timespec_ns(&ts);
+}
+
+// Both clocks are read through the vDSO so this stays cheap enough to call
+// per packet, which also tracks NTP steps of CLOCK_REALTIME.
+static uint64_t realtime_to_monotonic(uint64_t real_ns) {
+    struct timespec mono, real;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &real);
+    return real_ns - (timespec_ns(&real) - timespec_ns(&mono));
+}
+
+const char *pwar_tstamp_mode_name(enum pwar_tstamp_mode mode) {
+    switch (mode) {
+    case PWAR_TSTAMP_OFF: return "off";
+    case PWAR_TSTAMP_SOFTWARE: return "software";
+    case PWAR_TSTAMP_HARDWARE: return "hardware";
+    }
+    return "unknown";
+}
+
+int pwar_tstamp_parse_mode(const char *name, enum pwar_tstamp_mode *mode) {
+    if (strcmp(name, "off") == 0)
+        *mode = PWAR_TSTAMP_OFF;
+    else if (strcmp(name, "sw") == 0 || strcmp(name, "software") == 0)
+        *mode = PWAR_TSTAMP_SOFTWARE;
+    else if (strcmp(name, "hw") == 0 || strcmp(name, "hardware") == 0)
+        *mode = PWAR_TSTAMP_HARDWARE;
+    else
+        return -EINVAL;
+    return 0;
+}
+
+static int enable_nic_hw_stamping(int fd, const char *ifname) {
+    struct hwtstamp_config cfg;
+    struct ifreq ifr;
+    memset(&cfg, 0, sizeof(cfg));
+    memset(&ifr, 0, sizeof(ifr));
+    cfg.tx_type = HWTSTAMP_TX_ON;
+    cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+    strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+    ifr.ifr_data = (void *)&cfg;
+    if (ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0)
+        return -errno;
+    // Some NICs can only stamp PTP frames; that is useless for our UDP traffic
+    return cfg.rx_filter == HWTSTAMP_FILTER_NONE ? -EOPNOTSUPP : 0;
+}
+
+enum pwar_tstamp_mode pwar_tstamp_enable(int fd, enum pwar_tstamp_mode want, const char *ifname, int tx) {
+    if (want == PWAR_TSTAMP_OFF)
+        return PWAR_TSTAMP_OFF;
+
+    if (want == PWAR_TSTAMP_HARDWARE) {
+        int rc = ifname && *ifname ? enable_nic_hw_stamping(fd, ifname) : -EINVAL;
+        if (rc == 0) {
+            unsigned int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |
+                                 SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+            // Only the NIC's send stamp: with TX_SOFTWARE too, each send
+            // would queue two stamps under the same id
+            if (tx)
+                flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+            if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0)
+                return PWAR_TSTAMP_HARDWARE;
+        }
+        fprintf(stderr, "Warning: hardware timestamping unavailable on %s (%s), using software\n",
+            ifname && *ifname ? ifname : "<no interface given>", strerror(rc ? -rc : errno));
+    }
+
+    unsigned int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (tx)
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        perror("Warning: setsockopt SO_TIMESTAMPING failed");
+        return PWAR_TSTAMP_OFF;
+    }
+    return PWAR_TSTAMP_SOFTWARE;
+}
+
+// ts[0] is the software stamp, ts[2] the raw hardware stamp
+static uint64_t pick_stamp(const struct scm_timestamping *stamps, int *hardware) {
+    if (stamps->ts[2].tv_sec || stamps->ts[2].tv_nsec) {
+        *hardware = 1;
+        return realtime_to_monotonic(timespec_ns(&stamps->ts[2]));
+    }
+    *hardware = 0;
+    if (stamps->ts[0].tv_sec || stamps->ts[0].tv_nsec)
+        return realtime_to_monotonic(timespec_ns(&stamps->ts[0]));
+    return 0;
+}
+
+ssize_t pwar_tstamp_recv(int fd, void *buf, size_t len, struct pwar_tstamp *ts) {
+    char control[256];
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(fd, &msg, 0);
+    ts->user_ns = pwar_tstamp_now_ns();
+    ts->kernel_ns = 0;
+    ts->hardware = 0;
+    if (n < 0)
+        return n;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING) {
+            ts->kernel_ns = pick_stamp((const struct scm_timestamping *)CMSG_DATA(cm), &ts->hardware);
+        }
+    }
+    return n;
+}
+
+int pwar_tstamp_collect_tx(int fd, struct pwar_tstamp_tx *tx) {
+    int collected = 0;
+    for (;;) {
+        char control[256];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        // OPT_TSONLY: no payload comes back, only the control messages
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        uint64_t stamp = 0;
+        int hardware = 0;
+        int have_id = 0;
+        uint32_t id = 0;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SO_TIMESTAMPING) {
+                stamp = pick_stamp((const struct scm_timestamping *)CMSG_DATA(cm), &hardware);
+            } else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                       (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                const struct sock_extended_err *err = (const struct sock_extended_err *)CMSG_DATA(cm);
+                if (err->ee_errno == ENOMSG && err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+                    id = err->ee_data;
+                    have_id = 1;
+                } else if (err->ee_origin == SO_EE_ORIGIN_TXTIME) {
+                    // Missed its departure time or had an invalid one
+                    __atomic_add_fetch(&tx->txtime_dropped, 1, __ATOMIC_RELAXED);
+                }
+            }
+        }
+        if (stamp && have_id) {
+            uint32_t slot = id & (PWAR_TSTAMP_TX_SLOTS - 1);
+            // A software stamp never replaces the hardware one of the same send
+            if (!hardware && tx->id[slot] == id && tx->hardware[slot])
+                continue;
+            tx->ns[slot] = stamp;
+            tx->id[slot] = id;
+            tx->hardware[slot] = (uint8_t)hardware;
+            collected++;
+        }
+    }
+    return collected;
+}
+
+uint64_t pwar_tstamp_tx_lookup(const struct pwar_tstamp_tx *tx, uint32_t id) {
+    uint32_t slot = id & (PWAR_TSTAMP_TX_SLOTS - 1);
+    return tx->id[slot] == id ? tx->ns[slot] : 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * pwar_tstamp.h - Kernel socket timestamping (SO_TIMESTAMPING) helpers for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#ifndef PWAR_TSTAMP
+#define PWAR_TSTAMP
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define PWAR_TSTAMP_TX_SLOTS 64           // power of two, indexed by the socket's OPT_ID counter
+
+enum pwar_tstamp_mode {
+    PWAR_TSTAMP_OFF,
+    PWAR_TSTAMP_SOFTWARE,
+    PWAR_TSTAMP_HARDWARE,
+};
+
+// Kernel timestamps are taken on CLOCK_REALTIME (software) or the NIC's PHC
+// (hardware, assumed to be disciplined to CLOCK_REALTIME by phc2sys). Every
+// value returned here has already been moved onto CLOCK_MONOTONIC so it can
+// be compared with the rest of the bridge's timestamps.
+struct pwar_tstamp {
+    uint64_t kernel_ns;                   // 0 when the kernel did not stamp the datagram
+    uint64_t user_ns;                     // when recvmsg returned
+    int hardware;
+};
+
+struct pwar_tstamp_tx {
+    uint64_t ns[PWAR_TSTAMP_TX_SLOTS];
+    uint32_t id[PWAR_TSTAMP_TX_SLOTS];
+    uint8_t hardware[PWAR_TSTAMP_TX_SLOTS];
+    uint64_t txtime_dropped;              // atomic, datagrams the ETF qdisc dropped (see pwar_qos.h)
+};
+
+const char *pwar_tstamp_mode_name(enum pwar_tstamp_mode mode);
+int pwar_tstamp_parse_mode(const char *name, enum pwar_tstamp_mode *mode);
+
+// Enables RX (and with tx set, TX) timestamps on fd. Hardware stamping needs
+// the interface name; when it cannot be enabled we fall back to software,
+// which is what loopback always gets. Returns the mode actually obtained.
+enum pwar_tstamp_mode pwar_tstamp_enable(int fd, enum pwar_tstamp_mode want, const char *ifname, int tx);
+
+ssize_t pwar_tstamp_recv(int fd, void *buf, size_t len, struct pwar_tstamp *ts);
+
+// Drains pending TX timestamps from the socket error queue without blocking
+// and files them by OPT_ID, counting SO_TXTIME drops on the way. Returns the
+// number of timestamps collected.
+int pwar_tstamp_collect_tx(int fd, struct pwar_tstamp_tx *tx);
+
+// Looks up the TX timestamp of the id'th datagram sent on the socket.
+uint64_t pwar_tstamp_tx_lookup(const struct pwar_tstamp_tx *tx, uint32_t id);
+
+uint64_t pwar_tstamp_now_ns(void);
+
+#endif /* PWAR_TSTAMP */
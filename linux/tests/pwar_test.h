@@ -0,0 +1,50 @@
+/*
+ * pwar_test.h - Checks shared by the PWAR unit tests
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Every test is a program of its own, run by `make -C linux test`. A failed
+ * check prints where and why and the test carries on, so one run shows
+ * every failure; pwar_test_done() then gives the exit status.
+ */
+
+#ifndef PWAR_TEST
+#define PWAR_TEST
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static int pwar_test_failures;
+
+#define PWAR_CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s failed: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            pwar_test_failures++; \
+        } \
+    } while (0)
+
+// Same seed, same run: a failure can be reproduced
+static inline double pwar_test_random(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x / 4294967296.0;
+}
+
+// Queueing delay: mostly short, now and then long
+static inline double pwar_test_exponential(uint32_t *state, double mean) {
+    return -mean * log(1.0 - pwar_test_random(state));
+}
+
+static inline int pwar_test_done(const char *name) {
+    printf("%-16s %s\n", name, pwar_test_failures ? "FAIL" : "ok");
+    return pwar_test_failures ? 1 : 0;
+}
+
+#endif /* PWAR_TEST */
@@ -0,0 +1,96 @@
+/*
+ * test_adapt.c - The adaptive encoding against simulated links
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Runs the controller in the bridge's place through links that turn lossy,
+ * congested and clean again, one after the other. Over the second half of
+ * each, when the controller had time, the periods lost despite the copies
+ * and the bytes sent must stay within what that link allows, and a clean
+ * link must bring it back to f32 and a single copy. Every switch is
+ * printed. The seed is the first argument, 1 by default.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pwar_adapt.h"
+#include "pwar_test.h"
+
+#define PERIODS 750                       // a 2 s window of 128 frame periods
+
+// capacity is what the link carries against one f32 copy of every period:
+// sending more fills a queue, which adds queue_ms to the round trip and
+// spreads the arrivals, and what does not fit is lost.
+struct link_profile {
+    const char *name;
+    uint32_t windows;
+    double loss_pct;                      // random, per datagram
+    double rtt_ms;
+    double jitter_ms;
+    double capacity;
+    double queue_ms;
+    // Over the profile's second half
+    double max_residual_pct;              // periods lost despite the copies
+    double max_cost;                      // bytes sent against one f32 copy, on average
+    int ends_f32;                         // back to f32 and 1 copy at the end
+};
+
+static const struct link_profile link_profiles[] = {
+    { "lan", 20, 0.0, 0.3, 0.02, 4.0, 5.0, 0.0, 1.0, 1 },
+    { "lossy wifi", 60, 3.0, 2.0, 0.2, 4.0, 5.0, 0.3, 1.5, 0 },
+    { "congested", 60, 0.0, 1.0, 0.1, 0.8, 5.0, 1.0, 0.85, 0 },
+    { "lossy, congested", 60, 2.0, 1.0, 0.1, 1.0, 5.0, 0.3, 1.05, 0 },
+    { "lan again", 60, 0.0, 0.3, 0.02, 4.0, 5.0, 0.0, 1.0, 1 },
+};
+
+int main(int argc, char **argv) {
+    uint32_t state = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    if (!state)
+        state = 1;
+    pwar_adapt_t a;
+    pwar_adapt_init(&a);
+    const double period_ms = 128 * 1000.0 / 48000;
+    for (size_t p = 0; p < sizeof(link_profiles) / sizeof(link_profiles[0]); ++p) {
+        const struct link_profile *lp = &link_profiles[p];
+        uint64_t lost_half = 0, periods_half = 0, switches = a.switches;
+        double cost_half = 0;
+        for (uint32_t win = 0; win < lp->windows; ++win) {
+            double cost = pwar_adapt_cost(&a.choice);
+            double over = cost > lp->capacity ? (cost - lp->capacity) / cost : 0.0;
+            double p_copy = 1.0 - (1.0 - lp->loss_pct / 100.0) * (1.0 - over);
+            struct pwar_adapt_window w = {
+                .periods = PERIODS,
+                .rtt_ms = lp->rtt_ms + (over > 0 ? lp->queue_ms : 0.0),
+                .jitter_ms = lp->jitter_ms + (over > 0 ? period_ms : 0.0),
+                .period_ms = period_ms,
+            };
+            for (uint32_t i = 0; i < PERIODS; ++i) {
+                uint32_t arrived = 0;
+                for (uint32_t c = 0; c < a.choice.copies; ++c)
+                    arrived += pwar_test_random(&state) >= p_copy;
+                w.lost += !arrived;
+            }
+            if (win >= lp->windows / 2) {
+                lost_half += w.lost;
+                periods_half += w.periods;
+                cost_half += cost;
+            }
+            if (pwar_adapt_update(&a, &w)) {
+                char line[192];
+                pwar_adapt_describe(&a, &w, line, sizeof(line));
+                printf("    window %3u: %s\n", win, line);
+            }
+        }
+        double residual = 100.0 * lost_half / periods_half;
+        double cost = cost_half / (lp->windows - lp->windows / 2);
+        printf("  %-17s %.3f%% lost, cost %.2f, %lu switches, ends %s x%u\n", lp->name, residual, cost,
+            (unsigned long)(a.switches - switches), pwar_kernel_format_name(a.choice.format), a.choice.copies);
+        PWAR_CHECK(residual <= lp->max_residual_pct, "%s: %.3f%% of the periods lost, allowed %.3f%%", lp->name,
+            residual, lp->max_residual_pct);
+        PWAR_CHECK(cost <= lp->max_cost, "%s: cost %.2f, allowed %.2f", lp->name, cost, lp->max_cost);
+        PWAR_CHECK(!lp->ends_f32 || (a.choice.format == PWAR_FORMAT_F32 && a.choice.copies == 1),
+            "%s: ends %s x%u, not f32 x1", lp->name, pwar_kernel_format_name(a.choice.format), a.choice.copies);
+    }
+    return pwar_test_done("adapt");
+}
@@ -0,0 +1,176 @@
+/*
+ * test_alsa.c - The ALSA backend against a device that needs no hardware
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Runs the backend's own loop on the snd-aloop card when it is loaded, on
+ * the null plugin otherwise. The period asked for must be the one
+ * negotiated with the buffer --alsa-periods long, the bridge must keep
+ * sending while it runs, and after the audio thread is held up for longer
+ * than the buffer the backend must count the xrun and get going again.
+ * Only aloop is paced by a clock, the null plugin has room at any time and
+ * can't overrun, so there the xrun is only reported. Skipped when neither
+ * device opens.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+#include "pwar_backend.h"
+#include "pwar_test.h"
+
+#define QUANTUM 128
+#define PERIODS 2
+#define PORT 47350                        // the bridge sends here, nobody answers
+#define MAX_ARGS 16
+#define WINDOW_MS 200
+#define STALL_MS 100                      // far beyond PERIODS * QUANTUM at 48 kHz
+
+static FILE *report;                      // stdout of the test, the backend's goes to a file
+static struct pwar_bridge bridge;
+
+struct run {
+    char *argv[MAX_ARGS];
+    int argc;
+    int result;
+};
+
+static void *run_thread(void *userdata) {
+    struct run *r = userdata;
+    r->result = pwar_backend_alsa.run(&bridge, r->argc, r->argv);
+    return NULL;
+}
+
+// Sent to the audio thread, which stalls in the middle of its loop
+static void on_stall(int signal_number) {
+    struct timespec ts = { 0, STALL_MS * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// Periods the bridge sent within one window
+static uint64_t sent_in_window(void) {
+    uint64_t first = __atomic_load_n(&bridge.seq, __ATOMIC_RELAXED);
+    sleep_ms(WINDOW_MS);
+    return __atomic_load_n(&bridge.seq, __ATOMIC_RELAXED) - first;
+}
+
+static int can_open(const char *name, snd_pcm_stream_t stream) {
+    snd_pcm_t *pcm;
+    int err = snd_pcm_open(&pcm, name, stream, SND_PCM_NONBLOCK);
+    if (err < 0) {
+        fprintf(report, "  %s: %s\n", name, snd_strerror(err));
+        return 0;
+    }
+    snd_pcm_close(pcm);
+    return 1;
+}
+
+int main(void) {
+    int test_stdout = dup(STDOUT_FILENO);
+    report = fdopen(dup(test_stdout), "w");
+    setvbuf(report, NULL, _IOLBF, 0);
+
+    // aloop: what is played on subdevice 0 of device 0 is captured on
+    // subdevice 0 of device 1
+    int aloop = access("/proc/asound/Loopback", F_OK) == 0;
+    const char *playback = aloop ? "hw:Loopback,0,0" : "null";
+    const char *capture = aloop ? "hw:Loopback,1,0" : "null";
+    if (!can_open(playback, SND_PCM_STREAM_PLAYBACK) || !can_open(capture, SND_PCM_STREAM_CAPTURE)) {
+        fprintf(report, "  skipped, no ALSA device to run on\n");
+        fclose(report);
+        return pwar_test_done("alsa");
+    }
+
+    char port_arg[16], local_arg[16], quantum_arg[16], periods_arg[16];
+    snprintf(port_arg, sizeof(port_arg), "%d", PORT);
+    snprintf(local_arg, sizeof(local_arg), "%d", PORT + 1);
+    snprintf(quantum_arg, sizeof(quantum_arg), "%d", QUANTUM);
+    snprintf(periods_arg, sizeof(periods_arg), "%d", PERIODS);
+    struct run r = {
+        .argv = { "test_alsa", "--ip", "127.0.0.1", "--port", port_arg, "--local-port", local_arg,
+            "--quantum", quantum_arg, "--no-mlock", "--alsa-device", (char *)playback,
+            "--alsa-capture", (char *)capture, "--alsa-periods", periods_arg },
+        .argc = MAX_ARGS,
+    };
+    struct pwar_bridge_config cfg;
+    pwar_bridge_config_defaults(&cfg);
+    for (int i = 1; i < r.argc;) {
+        int used = pwar_bridge_parse_arg(&cfg, r.argc, r.argv, i);
+        if (used == 0)
+            used = pwar_backend_alsa.parse_arg(r.argc, r.argv, i);
+        if (used <= 0) {
+            fprintf(stderr, "bad option %s\n", r.argv[i]);
+            return 1;
+        }
+        i += used;
+    }
+    if (pwar_bridge_init(&bridge, &cfg) < 0)
+        return 1;
+
+    // What the backend prints about the streams is parsed afterwards
+    FILE *log = tmpfile();
+    if (!log) {
+        perror("tmpfile");
+        return 1;
+    }
+    fflush(stdout);
+    dup2(fileno(log), STDOUT_FILENO);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stall;
+    sigaction(SIGUSR2, &sa, NULL);
+
+    pthread_t audio;
+    pthread_create(&audio, NULL, run_thread, &r);
+    sleep_ms(WINDOW_MS);
+    uint64_t before = sent_in_window();
+    PWAR_CHECK(before > 0, "%s: nothing sent while running", playback);
+
+    uint64_t xruns = __atomic_load_n(&bridge.xruns, __ATOMIC_RELAXED);
+    pthread_kill(audio, SIGUSR2);
+    sleep_ms(STALL_MS + WINDOW_MS);
+    xruns = __atomic_load_n(&bridge.xruns, __ATOMIC_RELAXED) - xruns;
+    if (aloop)
+        PWAR_CHECK(xruns >= 1, "%s: a %d ms stall was no xrun", playback, STALL_MS);
+    uint64_t after = sent_in_window();
+    PWAR_CHECK(after > 0, "%s: nothing sent after the stall", playback);
+
+    kill(getpid(), SIGTERM);
+    pthread_join(audio, NULL);
+    PWAR_CHECK(r.result == 0, "%s: run returned %d", playback, r.result);
+
+    fflush(stdout);
+    dup2(test_stdout, STDOUT_FILENO);
+    rewind(log);
+    char line[256];
+    int streams = 0;
+    while (fgets(line, sizeof(line), log)) {
+        char dir[16];
+        unsigned long period, buffer;
+        const char *at = strstr(line, "period ");
+        if (sscanf(line, "[alsa] %15s", dir) != 1 || !at || sscanf(at, "period %lu, buffer %lu", &period, &buffer) != 2)
+            continue;
+        streams++;
+        PWAR_CHECK(period == QUANTUM, "%s: %s period %lu, not %d", playback, dir, period, QUANTUM);
+        PWAR_CHECK(buffer == PERIODS * QUANTUM, "%s: %s buffer %lu, not %d", playback, dir, buffer, PERIODS * QUANTUM);
+    }
+    PWAR_CHECK(streams == 2, "%s: %d streams configured, not 2", playback, streams);
+
+    fprintf(report, "  %-16s %lu and %lu periods sent in %d ms, %lu xruns after a %d ms stall%s\n", playback,
+        (unsigned long)before, (unsigned long)after, WINDOW_MS, (unsigned long)xruns, STALL_MS,
+        aloop ? "" : " (can't overrun)");
+    fclose(report);
+    return pwar_test_done("alsa");
+}
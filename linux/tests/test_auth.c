@@ -0,0 +1,230 @@
+/*
+ * test_auth.c - Replays against a receiver that already has a peer
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * A datagram recorded from an earlier session authenticates under the key
+ * like any other. Played back at a receiver with a live peer, alone, mixed
+ * into the live traffic or as a burst of PWAR_AUTH_CONFIRM and more, it
+ * must be refused and the live peer must carry on. A real restart, a new
+ * id sending on its own once the peer went quiet, takes over after
+ * PWAR_AUTH_SILENCE_NS; so does a recording played while the peer is gone,
+ * but then the live peer takes back over the same way, nothing shuts it
+ * out for good. Runs in sign and encrypt mode, on a clock of its own that
+ * moves a period per datagram.
+ *
+ * Before that the cipher and the MAC are checked against the test vectors
+ * of RFC 8439, section 2.8.2 for the AEAD and 2.5.2 for Poly1305 on its
+ * own. They are static in pwar_auth.c, so the test includes it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pwar_auth.c"
+#include "pwar_test.h"
+
+#define PAYLOAD 64
+#define RECORDED 32
+#define LIVE_ID 0x11111111u
+#define OLD_ID 0x22222222u
+#define RESTART_ID 0x33333333u
+#define RECEIVER_ID 0x44444444u
+#define PERIOD_NS 2666667ULL              // 128 frames at 48 kHz
+// Datagrams a period apart until a new id may take over from a quiet peer
+#define SILENT_PERIODS ((PWAR_AUTH_SILENCE_NS + PERIOD_NS - 1) / PERIOD_NS)
+
+static uint64_t now_ns;
+
+static const char sunscreen[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for "
+    "the future, sunscreen would be it.";
+
+static const uint8_t sunscreen_ct[] = {
+    0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+    0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe, 0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+    0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+    0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+    0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c, 0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+    0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+    0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+    0x61, 0x16,
+};
+
+// RFC 8439 2.8.2: ChaCha20-Poly1305 with 12 bytes of AAD
+static void check_aead_vector(void) {
+    uint8_t key_bytes[32];
+    for (int i = 0; i < 32; ++i)
+        key_bytes[i] = (uint8_t)(0x80 + i);
+    uint32_t key[8];
+    for (int i = 0; i < 8; ++i)
+        key[i] = load32(key_bytes + 4 * i);
+    static const uint8_t nonce[PWAR_AUTH_NONCE_SIZE] = { 0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43,
+        0x44, 0x45, 0x46, 0x47 };
+    static const uint8_t aad[] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+    static const uint8_t want_tag[16] = { 0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a, 0x7e, 0x90, 0x2e, 0xcb,
+        0xd0, 0x60, 0x06, 0x91 };
+    const size_t len = sizeof(sunscreen) - 1;
+    uint8_t buf[sizeof(sunscreen)];
+    memcpy(buf, sunscreen, len);
+    chacha_xor(key, nonce, buf, len);
+    PWAR_CHECK(len == sizeof(sunscreen_ct) && memcmp(buf, sunscreen_ct, len) == 0, "RFC 8439 2.8.2: ciphertext differs");
+    uint8_t tag[16];
+    aead_tag(key, nonce, aad, sizeof(aad), buf, len, tag);
+    PWAR_CHECK(memcmp(tag, want_tag, sizeof(tag)) == 0, "RFC 8439 2.8.2: tag differs");
+    chacha_xor(key, nonce, buf, len);
+    PWAR_CHECK(memcmp(buf, sunscreen, len) == 0, "RFC 8439 2.8.2: does not decrypt back");
+}
+
+// RFC 8439 2.5.2: Poly1305 over a message that ends in a partial block
+static void check_poly1305_vector(void) {
+    static const uint8_t key[32] = { 0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe,
+        0x42, 0xd5, 0x06, 0xa8, 0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf,
+        0x41, 0x49, 0xf5, 0x1b };
+    static const uint8_t want[16] = { 0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf,
+        0x0c, 0x01, 0x27, 0xa9 };
+    static const char msg[] = "Cryptographic Forum Research Group";
+    poly1305_t p;
+    uint8_t mac[16];
+    poly_init(&p, key);
+    poly_update(&p, (const uint8_t *)msg, sizeof(msg) - 1);
+    poly_finish(&p, mac);
+    PWAR_CHECK(memcmp(mac, want, sizeof(mac)) == 0, "RFC 8439 2.5.2: Poly1305 tag differs");
+}
+
+struct datagram {
+    uint8_t buf[PAYLOAD + PWAR_AUTH_OVERHEAD];
+    size_t len;
+    uint8_t fill;
+};
+
+static void seal(pwar_auth_t *sender, struct datagram *d) {
+    d->fill = (uint8_t)(sender->id + sender->counter);
+    memset(d->buf, d->fill, PAYLOAD);
+    d->len = pwar_auth_seal(sender, d->buf, PAYLOAD);
+}
+
+// Opens a copy, the recording stays sealed for the next replay
+static int open_copy(pwar_auth_t *rx, const struct datagram *d) {
+    uint8_t buf[sizeof(d->buf)];
+    memcpy(buf, d->buf, d->len);
+    now_ns += PERIOD_NS;
+    int n = pwar_auth_open(rx, buf, d->len, now_ns);
+    if (n == PAYLOAD) {
+        for (int i = 0; i < PAYLOAD; ++i) {
+            if (buf[i] != d->fill)
+                return -EINVAL;
+        }
+    }
+    return n;
+}
+
+// A fresh datagram of sender, which must get through
+static void live(pwar_auth_t *rx, pwar_auth_t *sender, const char *mode, const char *when) {
+    struct datagram d;
+    seal(sender, &d);
+    int n = open_copy(rx, &d);
+    PWAR_CHECK(n == PAYLOAD, "%s, %s: datagram %lu of %08x refused (%d)", mode, when,
+        (unsigned long)(sender->counter - 1), sender->id, n);
+}
+
+static void run(enum pwar_auth_mode mode, const uint8_t *key) {
+    const char *name = pwar_auth_mode_name(mode);
+    pwar_auth_t rx, live_tx, old_tx, restart_tx;
+    pwar_auth_init(&rx, mode, key, RECEIVER_ID);
+    pwar_auth_init(&live_tx, mode, key, LIVE_ID);
+    pwar_auth_init(&old_tx, mode, key, OLD_ID);
+    pwar_auth_init(&restart_tx, mode, key, RESTART_ID);
+
+    // Recorded from a session the receiver never saw
+    static struct datagram recorded[RECORDED];
+    for (int i = 0; i < RECORDED; ++i)
+        seal(&old_tx, &recorded[i]);
+
+    for (int i = 0; i < 10; ++i)
+        live(&rx, &live_tx, name, "before the replay");
+    PWAR_CHECK(rx.have_peer && rx.peer == LIVE_ID, "%s: live peer not taken", name);
+
+    // One recorded datagram, and then the recording between live ones
+    int n = open_copy(&rx, &recorded[0]);
+    PWAR_CHECK(n < 0, "%s: a single replayed datagram opened (%d)", name, n);
+    PWAR_CHECK(rx.peer == LIVE_ID, "%s: a single replayed datagram made %08x the peer", name, rx.peer);
+    for (int i = 0; i < 10; ++i)
+        live(&rx, &live_tx, name, "after a single replay");
+    for (int i = 0; i < RECORDED; ++i) {
+        n = open_copy(&rx, &recorded[i]);
+        PWAR_CHECK(n < 0, "%s: replayed datagram %d opened between live ones (%d)", name, i, n);
+        live(&rx, &live_tx, name, "with replays in between");
+    }
+    PWAR_CHECK(rx.peer == LIVE_ID && rx.peer_changes == 0, "%s: replays moved the peer to %08x", name, rx.peer);
+
+    // The live peer's own datagrams played back are plain replays
+    struct datagram again;
+    seal(&live_tx, &again);
+    PWAR_CHECK(open_copy(&rx, &again) == PAYLOAD, "%s: live datagram refused", name);
+    n = open_copy(&rx, &again);
+    PWAR_CHECK(n == -EALREADY, "%s: live datagram opened twice (%d)", name, n);
+
+    // A burst of the whole recording in the gap between two live periods
+    // is refused, the peer was heard too recently
+    for (int i = 0; i < RECORDED; ++i) {
+        now_ns -= PERIOD_NS;
+        n = open_copy(&rx, &recorded[i]);
+        PWAR_CHECK(n == -EAGAIN, "%s: burst datagram %d over the live peer gave %d", name, i, n);
+    }
+    PWAR_CHECK(rx.peer == LIVE_ID, "%s: a burst of %d over the live peer took over", name, RECORDED);
+    live(&rx, &live_tx, name, "after a burst of replays");
+
+    // Played at a steady pace with the live peer gone the recording does
+    // take over, and the live peer takes back over the same way once it
+    // is back and the recording has ended
+    static struct datagram longer[SILENT_PERIODS + 1];
+    for (uint32_t i = 0; i < SILENT_PERIODS + 1; ++i)
+        seal(&old_tx, &longer[i]);
+    for (uint32_t i = 0; i < SILENT_PERIODS + 1; ++i) {
+        n = open_copy(&rx, &longer[i]);
+        PWAR_CHECK((n < 0) == (i < SILENT_PERIODS - 1), "%s: recording datagram %u with the peer gone gave %d",
+            name, i, n);
+    }
+    PWAR_CHECK(rx.peer == OLD_ID, "%s: the recording did not take over from a peer gone for %llu ms", name,
+        (unsigned long long)(SILENT_PERIODS * PERIOD_NS / 1000000));
+    for (uint32_t i = 0; i < SILENT_PERIODS - 1; ++i) {
+        struct datagram d;
+        seal(&live_tx, &d);
+        PWAR_CHECK(open_copy(&rx, &d) == -EAGAIN, "%s: live peer back after %u periods", name, i + 1);
+    }
+    live(&rx, &live_tx, name, "taking back over");
+    PWAR_CHECK(rx.peer == LIVE_ID, "%s: live peer shut out after a recording", name);
+
+    // A real restart: the new id sends on its own with the old run gone,
+    // and what the old run still had in flight is refused afterwards
+    struct datagram in_flight;
+    seal(&live_tx, &in_flight);
+    for (uint32_t i = 0; i < SILENT_PERIODS - 1; ++i) {
+        struct datagram d;
+        seal(&restart_tx, &d);
+        PWAR_CHECK(open_copy(&rx, &d) == -EAGAIN, "%s: restarted peer datagram %u opened early", name, i);
+    }
+    live(&rx, &restart_tx, name, "restarting");
+    PWAR_CHECK(rx.peer == RESTART_ID, "%s: restart not taken", name);
+    PWAR_CHECK(open_copy(&rx, &in_flight) < 0, "%s: in-flight datagram of the previous run opened", name);
+    for (int i = 0; i < 10; ++i)
+        live(&rx, &restart_tx, name, "after the restart");
+    PWAR_CHECK(rx.peer_changes == 3, "%s: %lu peer changes, not 3", name, (unsigned long)rx.peer_changes);
+    printf("  %-8s %lu opened, %lu replayed, %lu unconfirmed, %lu peer changes\n", name,
+        (unsigned long)rx.opened, (unsigned long)rx.replayed, (unsigned long)rx.unconfirmed,
+        (unsigned long)rx.peer_changes);
+}
+
+int main(void) {
+    check_aead_vector();
+    check_poly1305_vector();
+    printf("  RFC 8439 vectors checked\n");
+    uint8_t key[PWAR_AUTH_KEY_SIZE];
+    for (int i = 0; i < PWAR_AUTH_KEY_SIZE; ++i)
+        key[i] = (uint8_t)(i * 37 + 11);
+    run(PWAR_AUTH_SIGN, key);
+    run(PWAR_AUTH_ENCRYPT, key);
+    return pwar_test_done("auth");
+}
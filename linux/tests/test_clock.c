@@ -0,0 +1,79 @@
+/*
+ * test_clock.c - Offset and skew estimation against simulated links
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * The remote clock runs at a known offset and skew from the local one and
+ * every exchange takes a fixed one-way delay plus exponential queueing in
+ * each direction. Round trips cannot tell the two directions apart, so the
+ * offset is expected off by half the difference of the fixed delays and by
+ * little more than that.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pwar_clock.h"
+#include "pwar_test.h"
+
+struct link {
+    const char *name;
+    double offset_ns;                     // remote - local at local time 0
+    double skew_ppm;
+    double up_us, down_us;                // fixed one-way delays
+    double jitter_us;                     // mean queueing, each direction
+    double max_skew_error_ppm;
+};
+
+static const struct link links[] = {
+    { "symmetric", 3.0e12, 0.0, 150, 150, 50, 2.0 },
+    { "asymmetric", 3.0e12, 0.0, 600, 100, 50, 2.0 },
+    { "skewed", -7.5e11, 100.0, 150, 150, 50, 2.0 },
+    { "skewed, asymmetric", 4.2e15, -80.0, 100, 800, 200, 8.0 },
+};
+
+#define PERIOD_NS 2666667                 // 128 frames at 48 kHz
+#define EXCHANGES 7500                    // 20 s
+#define DAW_NS 1000000
+
+static void run(const struct link *l, uint32_t seed) {
+    pwar_clock_t clk;
+    pwar_clock_init(&clk);
+    uint32_t state = seed;
+    const double skew = l->skew_ppm * 1e-6;
+    const uint64_t start = 1000000000000ull;
+    uint64_t t1 = start;
+    for (uint32_t i = 0; i < EXCHANGES; ++i, t1 += PERIOD_NS) {
+        double arrive = t1 + l->up_us * 1e3 + pwar_test_exponential(&state, l->jitter_us * 1e3);
+        double leave = arrive + DAW_NS / (1.0 + skew);
+        uint64_t t4 = (uint64_t)(leave + l->down_us * 1e3 + pwar_test_exponential(&state, l->jitter_us * 1e3));
+        uint64_t t2 = (uint64_t)(arrive + l->offset_ns + skew * (arrive - start));
+        uint64_t t3 = (uint64_t)(leave + l->offset_ns + skew * (leave - start));
+        pwar_clock_update(&clk, t1, t2, t3, t4);
+    }
+
+    // The estimate can only be as good as the delays are symmetric
+    double bias_ns = (l->up_us - l->down_us) * 1e3 / 2;
+    double true_ns = l->offset_ns + skew * (double)(t1 - start);
+    double error_ns = (double)pwar_clock_offset_at(&clk, t1) - true_ns - bias_ns;
+    double skew_error_ppm = clk.skew * 1e6 - l->skew_ppm;
+    PWAR_CHECK(clk.valid, "%s: no estimate", l->name);
+    PWAR_CHECK(fabs(error_ns) < 20000, "%s: offset off by %.0f ns beyond the %.0f ns of asymmetry",
+        l->name, error_ns, bias_ns);
+    PWAR_CHECK(fabs(skew_error_ppm) < l->max_skew_error_ppm, "%s: skew %.2f ppm, expected %.2f", l->name, clk.skew * 1e6,
+        l->skew_ppm);
+
+    // Mapping a remote stamp back lands where the offset says it should
+    uint64_t remote = (uint64_t)((double)t1 + true_ns);
+    double back_ns = (double)(int64_t)(pwar_clock_remote_to_local(&clk, remote) - t1);
+    PWAR_CHECK(fabs(back_ns + bias_ns) < 20000, "%s: remote to local off by %.0f ns", l->name, back_ns + bias_ns);
+    printf("  %-20s offset error %8.0f ns beyond %+.0f ns of asymmetry, skew error %6.3f ppm\n", l->name,
+        error_ns, bias_ns, skew_error_ppm);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seed = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); ++i)
+        run(&links[i], (seed ? seed : 1) + (uint32_t)i);
+    return pwar_test_done("clock");
+}
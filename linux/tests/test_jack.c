@@ -0,0 +1,197 @@
+/*
+ * test_jack.c - The JACK backend against a jackd of its own
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Starts `jackd -d dummy` under a server name nobody else uses and runs the
+ * backend on it, with a second client of the test's own to look at the
+ * graph. The latency callback must put pwar_bridge_latency_frames() on the
+ * ports in both directions, and when the probe client holds up a cycle the
+ * server's xrun must reach pwar_bridge_xrun(). Skipped when jackd is not
+ * installed.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <jack/jack.h>
+#include "pwar_backend.h"
+#include "pwar_test.h"
+
+#define QUANTUM 128
+#define NET_PERIOD 96                     // reblocking, so there is a latency to report
+#define PORT 47352                        // the bridge sends here, nobody answers
+#define MAX_ARGS 16
+#define SERVER "pwar_test"
+#define CLIENT "pwar_test"
+#define START_MS 5000                     // for jackd to come up
+#define LATENCY_MS 3000                   // the backend polls the latency once a second
+#define STALL_MS 100                      // many periods, short of jackd's client timeout
+
+static FILE *report;                      // stdout of the test, the bridge's own goes nowhere
+static struct pwar_bridge bridge;
+static int stall;                         // atomic, the probe's next cycle stalls
+
+struct run {
+    char *argv[MAX_ARGS];
+    int argc;
+    int result;
+};
+
+static void *run_thread(void *userdata) {
+    struct run *r = userdata;
+    r->result = pwar_backend_jack.run(&bridge, r->argc, r->argv);
+    return NULL;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// The probe is a client like any other, a late cycle of it is the graph's
+static int on_probe_process(jack_nframes_t nframes, void *arg) {
+    if (__atomic_exchange_n(&stall, 0, __ATOMIC_RELAXED))
+        sleep_ms(STALL_MS);
+    return 0;
+}
+
+static pid_t start_jackd(void) {
+    char period[16];
+    snprintf(period, sizeof(period), "%d", QUANTUM);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execlp("jackd", "jackd", "-n", SERVER, "-d", "dummy", "-r", "48000", "-p", period, (char *)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+// Connects once jackd is up, NULL when it never came or isn't installed
+static jack_client_t *connect_probe(pid_t jackd, int *missing) {
+    jack_status_t status;
+    *missing = 0;
+    for (int waited = 0; waited < START_MS; waited += 100) {
+        int wstatus;
+        if (waitpid(jackd, &wstatus, WNOHANG) == jackd) {
+            *missing = WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 127;
+            return NULL;
+        }
+        jack_client_t *probe = jack_client_open("probe", JackServerName | JackNoStartServer, &status, SERVER);
+        if (probe)
+            return probe;
+        sleep_ms(100);
+    }
+    return NULL;
+}
+
+static uint32_t port_latency(jack_client_t *probe, const char *port, jack_latency_callback_mode_t mode) {
+    jack_latency_range_t range = { 0, 0 };
+    jack_port_t *p = jack_port_by_name(probe, port);
+    if (p)
+        jack_port_get_latency_range(p, mode, &range);
+    PWAR_CHECK(range.min == range.max, "%s: latency range %u..%u", port, range.min, range.max);
+    return range.max;
+}
+
+int main(void) {
+    int test_stdout = dup(STDOUT_FILENO);
+    report = fdopen(dup(test_stdout), "w");
+    setvbuf(report, NULL, _IOLBF, 0);
+
+    pid_t jackd = start_jackd();
+    if (jackd < 0) {
+        perror("fork");
+        return 1;
+    }
+    int missing;
+    jack_client_t *probe = connect_probe(jackd, &missing);
+    if (!probe) {
+        if (missing) {
+            fprintf(report, "  skipped, jackd is not installed\n");
+            return pwar_test_done("jack");
+        }
+        PWAR_CHECK(probe, "jackd -d dummy did not come up within %d ms", START_MS);
+        kill(jackd, SIGKILL);
+        waitpid(jackd, NULL, 0);
+        return pwar_test_done("jack");
+    }
+    jack_set_process_callback(probe, on_probe_process, NULL);
+    jack_activate(probe);
+
+    char port_arg[16], local_arg[16], quantum_arg[16], net_arg[16];
+    snprintf(port_arg, sizeof(port_arg), "%d", PORT);
+    snprintf(local_arg, sizeof(local_arg), "%d", PORT + 1);
+    snprintf(quantum_arg, sizeof(quantum_arg), "%d", QUANTUM);
+    snprintf(net_arg, sizeof(net_arg), "%d", NET_PERIOD);
+    struct run r = {
+        .argv = { "test_jack", "--ip", "127.0.0.1", "--port", port_arg, "--local-port", local_arg,
+            "--quantum", quantum_arg, "--net-period", net_arg, "--no-mlock",
+            "--jack-server", SERVER, "--jack-name", CLIENT },
+        .argc = 15,
+    };
+    struct pwar_bridge_config cfg;
+    pwar_bridge_config_defaults(&cfg);
+    for (int i = 1; i < r.argc;) {
+        int used = pwar_bridge_parse_arg(&cfg, r.argc, r.argv, i);
+        if (used == 0)
+            used = pwar_backend_jack.parse_arg(r.argc, r.argv, i);
+        if (used <= 0) {
+            fprintf(stderr, "bad option %s\n", r.argv[i]);
+            return 1;
+        }
+        i += used;
+    }
+    if (pwar_bridge_init(&bridge, &cfg) < 0)
+        return 1;
+    int null = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+
+    pthread_t client;
+    pthread_create(&client, NULL, run_thread, &r);
+
+    // Nothing is connected, so each port carries the bridge's latency alone
+    uint32_t want = 0, out_capture = 0, in_playback = 0;
+    for (int waited = 0; waited < LATENCY_MS; waited += 100) {
+        sleep_ms(100);
+        want = pwar_bridge_latency_frames(&bridge);
+        out_capture = port_latency(probe, CLIENT ":output_1", JackCaptureLatency);
+        in_playback = port_latency(probe, CLIENT ":input_1", JackPlaybackLatency);
+        if (want && out_capture == want && in_playback == want)
+            break;
+    }
+    PWAR_CHECK(want > 0, "no latency to report with --net-period %d", NET_PERIOD);
+    PWAR_CHECK(out_capture == want, "output capture latency %u, not %u", out_capture, want);
+    PWAR_CHECK(in_playback == want, "input playback latency %u, not %u", in_playback, want);
+
+    uint64_t xruns = __atomic_load_n(&bridge.xruns, __ATOMIC_RELAXED);
+    __atomic_store_n(&stall, 1, __ATOMIC_RELAXED);
+    sleep_ms(STALL_MS + 500);
+    xruns = __atomic_load_n(&bridge.xruns, __ATOMIC_RELAXED) - xruns;
+    PWAR_CHECK(xruns >= 1, "a %d ms late cycle never reached pwar_bridge_xrun", STALL_MS);
+
+    kill(getpid(), SIGTERM);
+    pthread_join(client, NULL);
+    PWAR_CHECK(r.result == 0, "run returned %d", r.result);
+    jack_client_close(probe);
+    kill(jackd, SIGTERM);
+    waitpid(jackd, NULL, 0);
+    fflush(stdout);
+    dup2(test_stdout, STDOUT_FILENO);
+
+    fprintf(report, "  dummy    %u frames on the ports, %lu xruns after a %d ms late cycle\n", want,
+        (unsigned long)xruns, STALL_MS);
+    fclose(report);
+    return pwar_test_done("jack");
+}
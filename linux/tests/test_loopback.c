@@ -0,0 +1,377 @@
+/*
+ * test_loopback.c - The bridge core against a peer on the loopback interface
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Runs the real bridge (sockets, receiver and stats threads, playout and
+ * FIFOs) from a paced loop standing in for the audio backend, with a peer
+ * thread that answers every packet like pwar_listen --reply does. Each
+ * scenario runs in a child process of its own, so the threads a bridge
+ * leaves behind never meet the next one.
+ *
+ *   restart  the peer comes back with a new session mid-run; the bridge
+ *            must play clean audio again within 2 cycles
+ *   midi     impulse bursts with a note on their first sample; every burst
+ *            and every note must come back, the note at exactly the sample
+ *            the burst does
+ *   catchup  the peer stalls 50 ms once and then answers what queued up
+ *            back to back; newest and drop must be back at their target
+ *            on the next cycle, stretch within the periods it needs at
+ *            its most (PWAR_CATCHUP_STRETCH_MAX_PERIODS periods played
+ *            1/PWAR_CATCHUP_STRETCH_DIV faster) and 2 periods of jitter
+ *   mcast    the bridge sends to a group on lo, joined by the replying
+ *            peer and 2 receive-only listeners; every listener must get
+ *            every seq the bridge sent
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "pwar_bridge.h"
+#include "pwar_test.h"
+
+#define QUANTUM 128
+#define BASE_PORT 47310                   // two per scenario, peer and bridge
+#define MAX_ARGS 16
+#define MAX_CLEAN_CYCLES 2
+#define MIN_BURSTS 2                      // the stats thread analyses about one a second
+#define STALL_MS 50
+// A period more queued up by jitter while stretching costs DIV periods more
+#define JITTER_PERIODS 2
+#define STRETCH_PERIODS ((PWAR_CATCHUP_STRETCH_MAX_PERIODS + JITTER_PERIODS) * PWAR_CATCHUP_STRETCH_DIV)
+#define GROUP "239.255.80.1"
+#define MAX_LISTENERS 2
+#define MAX_SEQS 4096                     // a listener's record, periods from the first
+
+static FILE *report;                      // stdout of the test, the bridge's own goes nowhere
+
+struct peer {
+    int sockfd;
+    int reply_port;
+    uint32_t session;
+    uint64_t restart_after;               // packets answered before the new session, 0 never
+    uint64_t stall_after;                 // packets answered before one stall, 0 never
+};
+
+// A receive-only member of the group, like pwar_listen without --reply
+struct listener {
+    int sockfd;
+    uint64_t session;                     // the bridge's, in the top half like the seqs
+    uint8_t seen[MAX_SEQS / 8];           // atomic, by the bottom half of the seq
+};
+
+struct scenario {
+    const char *name;
+    const char *group;                    // the bridge sends here instead of to the peer
+    int listeners;
+    const char *args[MAX_ARGS];           // bridge options beyond addresses and quantum
+    double seconds;
+    struct peer peer;
+    void (*check)(const struct scenario *sc, struct pwar_bridge *bridge);
+    uint32_t recovery_periods;            // catchup: the longest a backlog may take
+    uint32_t deepest;                     // catchup: frames, the stall's backlog at its deepest
+    uint64_t backlogs;                    // catchup: seen so far
+    int backlogged;                       // catchup: one is being worked off
+    uint32_t backlog_cycle;               // catchup: the cycle it began in
+    uint32_t recovery_cycles;             // catchup: the longest one took
+    struct listener listener[MAX_LISTENERS];
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// The period a datagram carries, -1 for MIDI that goes with a later one
+static int receive_packet(pwar_midi_rx_t *midi_rx, const uint8_t *buf, size_t n, rt_stream_packet_t *pkt,
+                          pwar_midi_block_t *midi) {
+    size_t audio = pwar_midi_receive(midi_rx, buf, n, midi);
+    if (!audio)
+        return -1;
+    if (pwar_dtx_is_dtx(buf, audio))
+        return pwar_dtx_decode(buf, audio, pkt, NULL) < 0 ? -1 : 0;
+    memcpy(pkt, buf, sizeof(*pkt));
+    return 0;
+}
+
+// pwar_listen's reply: the input back on both channels, MIDI behind the audio
+static void *peer_thread(void *userdata) {
+    struct peer *p = userdata;
+    pwar_midi_rx_t midi_rx;
+    pwar_midi_rx_init(&midi_rx);
+    pwar_midi_block_t midi;
+    uint8_t buf[PWAR_MIDI_MAX_DATAGRAM];
+    uint64_t answered = 0;
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(p->sockfd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (n <= 0)
+            continue;
+        rt_stream_packet_t pkt;
+        if (receive_packet(&midi_rx, buf, n, &pkt, &midi) < 0)
+            continue;
+        if (p->restart_after && answered == p->restart_after)
+            p->session = pwar_session_new_id(now_ns() ^ p->session);
+        if (p->stall_after && answered == p->stall_after) {
+            // What arrives meanwhile queues in the socket
+            struct timespec ts = { 0, STALL_MS * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+        answered++;
+
+        memcpy(pkt.samples_ch2, pkt.samples_ch1, sizeof(pkt.samples_ch2));
+        pkt.session = p->session;
+        pkt.ts_asio_recv = pkt.ts_asio_send = now_ns();
+        from.sin_port = htons(p->reply_port);
+        uint8_t trailer[PWAR_MIDI_MAX_DATAGRAM];
+        uint32_t first = 0;
+        while (pwar_midi_size(&midi, first) > PWAR_MIDI_MAX_DATAGRAM - sizeof(pkt)) {
+            size_t len = pwar_midi_encode(&midi, &first, pkt.session, pkt.seq, trailer, PWAR_MIDI_MAX_DATAGRAM);
+            sendto(p->sockfd, trailer, len, 0, (struct sockaddr *)&from, sizeof(from));
+        }
+        size_t trailer_len = pwar_midi_encode(&midi, &first, pkt.session, pkt.seq, trailer,
+            PWAR_MIDI_MAX_DATAGRAM - sizeof(pkt));
+        memcpy(buf, &pkt, sizeof(pkt));
+        memcpy(buf + sizeof(pkt), trailer, trailer_len);
+        sendto(p->sockfd, buf, sizeof(pkt) + trailer_len, 0, (struct sockaddr *)&from, sizeof(from));
+    }
+    return NULL;
+}
+
+static void *listener_thread(void *userdata) {
+    struct listener *l = userdata;
+    pwar_midi_rx_t midi_rx;
+    pwar_midi_rx_init(&midi_rx);
+    pwar_midi_block_t midi;
+    uint8_t buf[PWAR_MIDI_MAX_DATAGRAM];
+    while (1) {
+        ssize_t n = recv(l->sockfd, buf, sizeof(buf), 0);
+        rt_stream_packet_t pkt;
+        if (n <= 0 || receive_packet(&midi_rx, buf, n, &pkt, &midi) < 0)
+            continue;
+        uint64_t session = __atomic_load_n(&l->session, __ATOMIC_RELAXED);
+        uint32_t seq = (uint32_t)pkt.seq;
+        if ((pkt.seq & ~0xffffffffull) == session && seq < MAX_SEQS)
+            __atomic_or_fetch(&l->seen[seq / 8], (uint8_t)(1u << seq % 8), __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// Bound to the group like pwar_listen, so every member gets every datagram
+static int join_group(const char *group, int port) {
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    int one = 1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(group);
+    struct ip_mreqn mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = addr.sin_addr;
+    mreq.imr_ifindex = if_nametoindex("lo");
+    if (sockfd < 0 || setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("joining " GROUP);
+        if (sockfd >= 0)
+            close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// The child: peer, bridge and the paced audio loop, then the checks
+static int run_scenario(struct scenario *sc, int port) {
+    // The bridge reports on stdout every second, the checks go to stderr
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout))
+        return 1;
+    struct peer *p = &sc->peer;
+    if (sc->group) {
+        p->sockfd = join_group(sc->group, port);
+        if (p->sockfd < 0)
+            return 1;
+    } else {
+        p->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (p->sockfd < 0 || bind(p->sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            perror("peer socket");
+            return 1;
+        }
+    }
+    for (int i = 0; i < sc->listeners; ++i) {
+        sc->listener[i].sockfd = join_group(sc->group, port);
+        if (sc->listener[i].sockfd < 0)
+            return 1;
+    }
+    p->reply_port = port + 1;
+    if (!p->session)
+        p->session = pwar_session_new_id(now_ns());
+    pthread_t tid;
+    pthread_create(&tid, NULL, peer_thread, p);
+
+    char port_arg[16], local_arg[16], quantum_arg[16];
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+    snprintf(local_arg, sizeof(local_arg), "%d", port + 1);
+    snprintf(quantum_arg, sizeof(quantum_arg), "%d", QUANTUM);
+    char *argv[2 * MAX_ARGS] = { "test_loopback", "--ip", sc->group ? (char *)sc->group : "127.0.0.1", "--port", port_arg,
+        "--local-port", local_arg, "--quantum", quantum_arg, "--no-mlock" };
+    int argc = 10;
+    for (int i = 0; i < MAX_ARGS && sc->args[i]; ++i)
+        argv[argc++] = (char *)sc->args[i];
+    struct pwar_bridge_config cfg;
+    pwar_bridge_config_defaults(&cfg);
+    for (int i = 1; i < argc;) {
+        int used = pwar_bridge_parse_arg(&cfg, argc, argv, i);
+        if (used <= 0) {
+            fprintf(stderr, "%s: bad bridge option %s\n", sc->name, argv[i]);
+            return 1;
+        }
+        i += used;
+    }
+    static struct pwar_bridge bridge;
+    if (pwar_bridge_init(&bridge, &cfg) < 0)
+        return 1;
+    for (int i = 0; i < sc->listeners; ++i) {
+        sc->listener[i].session = bridge.seq & ~0xffffffffull;
+        pthread_create(&tid, NULL, listener_thread, &sc->listener[i]);
+    }
+    pwar_bridge_start(&bridge);
+
+    static float in[QUANTUM], left[QUANTUM], right[QUANTUM];
+    float *out[PWAR_BRIDGE_OUT_CHANNELS] = { left, right };
+    const uint64_t period_ns = (uint64_t)QUANTUM * 1000000000 / PWAR_BRIDGE_RATE;
+    uint64_t t = now_ns();
+    const uint64_t end = t + (uint64_t)(sc->seconds * 1e9);
+    for (uint32_t cycle = 0; t < end; ++cycle) {
+        t += period_ns;
+        struct timespec ts = { t / 1000000000, t % 1000000000 };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        memset(in, 0, sizeof(in));
+        pwar_bridge_process(&bridge, in, out, QUANTUM);
+        if (bridge.catchup.backlogged && bridge.catchup.depth > sc->deepest)
+            sc->deepest = bridge.catchup.depth;
+        else if (bridge.catchup.last_depth > sc->deepest)
+            sc->deepest = bridge.catchup.last_depth;
+        // In audio cycles, a late wakeup of this loop is none of the policy's
+        // doing. Worked off in the cycle it began in is 0.
+        if (bridge.catchup.backlogs != sc->backlogs) {
+            sc->backlogs = bridge.catchup.backlogs;
+            sc->backlogged = 1;
+            sc->backlog_cycle = cycle;
+        }
+        if (sc->backlogged && !bridge.catchup.backlogged) {
+            sc->backlogged = 0;
+            if (cycle - sc->backlog_cycle > sc->recovery_cycles)
+                sc->recovery_cycles = cycle - sc->backlog_cycle;
+        }
+    }
+    sc->check(sc, &bridge);
+    fflush(report);
+    return pwar_test_failures ? 1 : 0;
+}
+
+static void check_restart(const struct scenario *sc, struct pwar_bridge *bridge) {
+    uint64_t resyncs = __atomic_load_n(&bridge->resyncs, __ATOMIC_RELAXED);
+    uint32_t clean = __atomic_load_n(&bridge->resync_clean_cycles, __ATOMIC_RELAXED);
+    fprintf(report, "  %-8s %lu resyncs, clean audio after %u cycles\n", sc->name, (unsigned long)resyncs, clean);
+    PWAR_CHECK(resyncs == 1, "%s: %lu resyncs for one restart of the peer", sc->name, (unsigned long)resyncs);
+    PWAR_CHECK(clean >= 1 && clean <= MAX_CLEAN_CYCLES, "%s: clean audio %u cycles after the restart",
+        sc->name, clean);
+    PWAR_CHECK(bridge->resync_cycles == 0, "%s: still resyncing at the end", sc->name);
+}
+
+static void check_midi(const struct scenario *sc, struct pwar_bridge *bridge) {
+    // With the audio loop stopped no new burst gets ready, wait for the
+    // analysis of the last one to finish
+    struct pwar_testsignal *ts = bridge->test_signal;
+    while (__atomic_load_n(&ts->capture_state, __ATOMIC_ACQUIRE) == PWAR_TEST_CAPTURE_READY)
+        usleep(10000);
+    const struct pwar_test_results *r = &ts->results;
+    fprintf(report, "  %-8s %lu bursts, latency %d samples, MIDI %+d samples off at worst, %lu notes missing\n",
+        sc->name, (unsigned long)r->bursts, r->latency, r->midi_max_error, (unsigned long)r->midi_missing);
+    PWAR_CHECK(r->bursts >= MIN_BURSTS, "%s: only %lu bursts analysed", sc->name, (unsigned long)r->bursts);
+    PWAR_CHECK(r->missing == 0, "%s: %lu bursts never came back", sc->name, (unsigned long)r->missing);
+    PWAR_CHECK(r->have_midi, "%s: no note came back with its burst", sc->name);
+    PWAR_CHECK(r->midi_max_error == 0, "%s: MIDI %+d samples off the audio", sc->name, r->midi_max_error);
+    PWAR_CHECK(r->midi_missing == 0, "%s: %lu notes never came back", sc->name, (unsigned long)r->midi_missing);
+}
+
+static void check_catchup(const struct scenario *sc, struct pwar_bridge *bridge) {
+    const pwar_catchup_t *c = &bridge->catchup;
+    uint32_t fill = pwar_fifo_fill(&bridge->reblock->out);
+    uint32_t keep = bridge->reblock->latency + c->target * QUANTUM;
+    fprintf(report, "  %-8s %lu backlogs, %u frames deep, worked off in %u cycles at worst, %u frames queued at the end\n",
+        sc->name, (unsigned long)c->backlogs, sc->deepest, sc->recovery_cycles, fill);
+    // At least half of what the stall held back has to have queued up
+    PWAR_CHECK(sc->deepest >= STALL_MS * PWAR_BRIDGE_RATE / 1000 / 2, "%s: %u frames deep after a %d ms stall",
+        sc->name, sc->deepest, STALL_MS);
+    PWAR_CHECK(!c->backlogged, "%s: still working a backlog off at the end", sc->name);
+    PWAR_CHECK(sc->recovery_cycles <= sc->recovery_periods, "%s: took %u cycles, allowed %u", sc->name,
+        sc->recovery_cycles, sc->recovery_periods);
+    PWAR_CHECK(fill <= keep, "%s: %u frames queued at the end, target %u", sc->name, fill, keep);
+}
+
+static void check_multicast(const struct scenario *sc, struct pwar_bridge *bridge) {
+    // The last period is still on its way to the listeners
+    usleep(50000);
+    uint32_t sent = (uint32_t)bridge->seq;
+    PWAR_CHECK(sent > 0 && sent <= MAX_SEQS, "%s: %u periods sent, expected 1 to %d", sc->name, sent, MAX_SEQS);
+    if (sent > MAX_SEQS)
+        sent = MAX_SEQS;
+    for (int i = 0; i < sc->listeners; ++i) {
+        const struct listener *l = &sc->listener[i];
+        uint32_t missing = 0, first_missing = 0;
+        for (uint32_t seq = 0; seq < sent; ++seq) {
+            if (!(__atomic_load_n(&l->seen[seq / 8], __ATOMIC_RELAXED) & (1u << seq % 8)) && !missing++)
+                first_missing = seq;
+        }
+        PWAR_CHECK(missing == 0, "%s: listener %d missed %u of %u seqs, the first %u", sc->name, i, missing, sent,
+            first_missing);
+    }
+    fprintf(report, "  %-8s %u seqs sent to the group, %d listeners\n", sc->name, sent, sc->listeners);
+}
+
+static struct scenario scenarios[] = {
+    { .name = "restart", .seconds = 2.0, .peer = { .restart_after = 375 }, .check = check_restart },
+    { .name = "midi", .seconds = 4.0, .args = { "--test-signal", "impulse", "--test-interval-ms", "200",
+      "--net-period", "96" },
+      .check = check_midi },
+    { .name = "newest", .seconds = 2.0, .args = { "--catchup", "newest" }, .peer = { .stall_after = 375 },
+      .check = check_catchup, .recovery_periods = 1 },
+    { .name = "drop", .seconds = 2.0, .args = { "--catchup", "drop" }, .peer = { .stall_after = 375 },
+      .check = check_catchup, .recovery_periods = 1 },
+    { .name = "stretch", .seconds = 2.5, .args = { "--catchup", "stretch" }, .peer = { .stall_after = 375 },
+      .check = check_catchup, .recovery_periods = STRETCH_PERIODS },
+    { .name = "mcast", .seconds = 2.0, .group = GROUP, .listeners = MAX_LISTENERS, .args = { "--mcast-iface", "lo" },
+      .check = check_multicast },
+};
+
+int main(void) {
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(run_scenario(&scenarios[i], BASE_PORT + 2 * (int)i));
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0)
+            status = -1;
+        PWAR_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "scenario %s", scenarios[i].name);
+    }
+    return pwar_test_done("loopback");
+}
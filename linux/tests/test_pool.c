@@ -0,0 +1,107 @@
+/*
+ * test_pool.c - Pool kernels against the plain kernels
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Splitting a payload into slices of channels must not change a byte of
+ * it: for every format, a few channel counts around the slice boundaries
+ * and a padded stride, the pool's payload and decoded channels have to
+ * equal those of one kernel over all channels, and the peaks it meters on
+ * the way the largest magnitude of each channel. Runs with as many
+ * workers as the machine has cores to spare, up to 3, and inline.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pwar_pool.h"
+#include "pwar_test.h"
+
+#define FRAMES 64
+#define PAD 5                             // padded stride, samples after each channel
+#define MAX_CHANNELS 67
+#define MAX_WORKERS 3
+#define SILENT_CHANNEL 2                  // passed as NULL, packs silence
+
+static float src[MAX_CHANNELS][FRAMES];
+static float pool_out[MAX_CHANNELS][FRAMES], plain_out[MAX_CHANNELS][FRAMES];
+static uint8_t pool_payload[MAX_CHANNELS * (FRAMES + PAD) * sizeof(float)];
+static uint8_t plain_payload[sizeof(pool_payload)];
+
+static float channel_peak(const float *ch) {
+    float p = 0.0f;
+    for (uint32_t i = 0; ch && i < FRAMES; ++i)
+        p = fmaxf(p, fabsf(ch[i]));
+    return p;
+}
+
+static void check_shape(struct pwar_pool *pool, uint32_t channels, uint32_t stride, enum pwar_sample_format format) {
+    const float *in[MAX_CHANNELS];
+    float *pool_dst[MAX_CHANNELS], *plain_dst[MAX_CHANNELS];
+    for (uint32_t c = 0; c < channels; ++c) {
+        in[c] = c == SILENT_CHANNEL ? NULL : src[c];
+        pool_dst[c] = pool_out[c];
+        plain_dst[c] = plain_out[c];
+    }
+    const char *name = pwar_kernel_format_name(format);
+    const size_t bytes = (size_t)channels * (stride ? stride : FRAMES) * pwar_kernel_sample_size(format);
+    memset(pool_payload, 0, sizeof(pool_payload));
+    memset(plain_payload, 0, sizeof(plain_payload));
+
+    pwar_kernel_t plain;
+    pwar_kernel_select(&plain, channels, FRAMES, stride, format);
+    plain.encode(&plain, in, plain_payload);
+    plain.decode(&plain, plain_payload, plain_dst);
+
+    struct pwar_pool_kernel pk;
+    float peak[MAX_CHANNELS];
+    pwar_pool_kernel_select(&pk, pool, channels, FRAMES, stride, format);
+    pwar_pool_encode(&pk, in, pool_payload, peak);
+    PWAR_CHECK(memcmp(pool_payload, plain_payload, bytes) == 0, "%s, %u channels in %u slices, stride %u: payloads differ",
+        name, channels, pk.slices, stride);
+    for (uint32_t c = 0; c < channels; ++c) {
+        PWAR_CHECK(peak[c] == channel_peak(in[c]), "%s, %u channels in %u slices: encode peak of channel %u is %g, not %g",
+            name, channels, pk.slices, c, peak[c], channel_peak(in[c]));
+    }
+
+    pwar_pool_decode(&pk, plain_payload, pool_dst, peak);
+    for (uint32_t c = 0; c < channels; ++c) {
+        PWAR_CHECK(memcmp(pool_out[c], plain_out[c], sizeof(pool_out[c])) == 0,
+            "%s, %u channels in %u slices, stride %u: channel %u decodes differently", name, channels, pk.slices, stride, c);
+        PWAR_CHECK(peak[c] == channel_peak(plain_out[c]), "%s, %u channels in %u slices: decode peak of channel %u is %g, not %g",
+            name, channels, pk.slices, c, peak[c], channel_peak(plain_out[c]));
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t state = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    if (!state)
+        state = 1;
+    // Up to +-1.5, so the integer formats clip too
+    for (uint32_t c = 0; c < MAX_CHANNELS; ++c) {
+        for (uint32_t i = 0; i < FRAMES; ++i)
+            src[c][i] = (float)(3.0 * pwar_test_random(&state) - 1.5);
+    }
+
+    static const uint32_t channels[] = { 1, 2, 3, 4, 7, 8, 16, 17, 33, MAX_CHANNELS };
+    int most = 0;
+    for (uint32_t w = 0; w <= MAX_WORKERS; ++w) {
+        struct pwar_pool pool;
+        int workers = pwar_pool_init(&pool, w, 1, NULL);
+        PWAR_CHECK(workers >= 0, "starting %u workers: %s", w, strerror(-workers));
+        if (workers < 0)
+            continue;
+        if (workers > most)
+            most = workers;
+        for (int f = 0; f < PWAR_FORMAT_COUNT; ++f) {
+            for (size_t i = 0; i < sizeof(channels) / sizeof(channels[0]); ++i) {
+                check_shape(&pool, channels[i], 0, (enum pwar_sample_format)f);
+                check_shape(&pool, channels[i], FRAMES + PAD, (enum pwar_sample_format)f);
+            }
+        }
+        pwar_pool_destroy(&pool);
+    }
+    printf("  inline and up to %d workers\n", most);
+    return pwar_test_done("pool");
+}
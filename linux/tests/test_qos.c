@@ -0,0 +1,94 @@
+/*
+ * test_qos.c - DSCP names and marking
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * pwar_qos_parse_dscp() must take every class name and number of the
+ * DSCP space and nothing else, and a socket marked with it must carry the
+ * code point in the top six bits of its TOS. The txtime modes must parse
+ * back from their names, and ETF must come out enabled or off.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include "pwar_qos.h"
+#include "pwar_test.h"
+
+struct dscp_case {
+    const char *name;
+    int dscp;                             // -EINVAL when refused
+};
+
+static const struct dscp_case dscp_cases[] = {
+    { "ef", 46 }, { "EF", 46 },
+    { "cs0", 0 }, { "cs1", 8 }, { "CS5", 40 }, { "cs7", 56 },
+    { "af11", 10 }, { "af12", 12 }, { "af13", 14 }, { "af21", 18 }, { "AF31", 26 }, { "af41", 34 }, { "af43", 38 },
+    { "0", 0 }, { "46", 46 }, { "63", 63 }, { "0x2e", 46 }, { "056", 46 },
+    { "64", -EINVAL }, { "-1", -EINVAL }, { "", -EINVAL }, { "46 ", -EINVAL }, { "4six", -EINVAL },
+    { "cs8", -EINVAL }, { "cs", -EINVAL }, { "cs10", -EINVAL },
+    { "af10", -EINVAL }, { "af14", -EINVAL }, { "af51", -EINVAL }, { "af1", -EINVAL }, { "af111", -EINVAL },
+    { "e", -EINVAL }, { "efx", -EINVAL }, { "be", -EINVAL },
+};
+
+static void check_parse(void) {
+    size_t n = sizeof(dscp_cases) / sizeof(dscp_cases[0]);
+    for (size_t i = 0; i < n; ++i) {
+        const struct dscp_case *c = &dscp_cases[i];
+        int dscp = PWAR_QOS_UNSET;
+        int rc = pwar_qos_parse_dscp(c->name, &dscp);
+        if (c->dscp < 0) {
+            PWAR_CHECK(rc == c->dscp, "\"%s\": returned %d, not -EINVAL", c->name, rc);
+            PWAR_CHECK(dscp == PWAR_QOS_UNSET, "\"%s\": refused but set %d", c->name, dscp);
+        } else {
+            PWAR_CHECK(rc == 0 && dscp == c->dscp, "\"%s\": returned %d and %d, not %d", c->name, rc, dscp,
+                c->dscp);
+        }
+    }
+    printf("  dscp     %zu names and numbers\n", n);
+}
+
+static void check_mark(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        PWAR_CHECK(fd >= 0, "no UDP socket to mark");
+        return;
+    }
+    int tos = -1;
+    socklen_t len = sizeof(tos);
+    PWAR_CHECK(pwar_qos_mark(fd, 46, PWAR_QOS_UNSET) == 0, "ef refused");
+    getsockopt(fd, IPPROTO_IP, IP_TOS, &tos, &len);
+    PWAR_CHECK(tos == 46 << 2, "TOS 0x%02x after marking ef, not 0x%02x", tos, 46 << 2);
+    // Unset leaves the mark alone
+    PWAR_CHECK(pwar_qos_mark(fd, PWAR_QOS_UNSET, PWAR_QOS_UNSET) == 0, "nothing to mark refused");
+    getsockopt(fd, IPPROTO_IP, IP_TOS, &tos, &len);
+    PWAR_CHECK(tos == 46 << 2, "TOS 0x%02x after an unset mark", tos);
+
+    enum pwar_txtime_mode got = pwar_txtime_enable(fd, PWAR_TXTIME_ETF);
+    PWAR_CHECK(got == PWAR_TXTIME_ETF || got == PWAR_TXTIME_OFF, "etf came out as %s", pwar_txtime_mode_name(got));
+    PWAR_CHECK(pwar_txtime_enable(fd, PWAR_TXTIME_PACE) == PWAR_TXTIME_PACE, "pace needs nothing of the socket");
+    close(fd);
+    printf("  mark     TOS 0x%02x for ef, etf %s\n", tos, got == PWAR_TXTIME_ETF ? "enabled" : "fell back to off");
+}
+
+static void check_txtime_names(void) {
+    static const enum pwar_txtime_mode modes[] = { PWAR_TXTIME_OFF, PWAR_TXTIME_PACE, PWAR_TXTIME_ETF };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+        enum pwar_txtime_mode mode = PWAR_TXTIME_OFF;
+        const char *name = pwar_txtime_mode_name(modes[i]);
+        PWAR_CHECK(pwar_txtime_parse_mode(name, &mode) == 0 && mode == modes[i], "%s does not parse back", name);
+    }
+    enum pwar_txtime_mode mode;
+    PWAR_CHECK(pwar_txtime_parse_mode("tai", &mode) == -EINVAL, "tai is no txtime mode");
+}
+
+int main(void) {
+    check_parse();
+    check_mark();
+    check_txtime_names();
+    return pwar_test_done("qos");
+}
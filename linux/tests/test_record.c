@@ -0,0 +1,278 @@
+/*
+ * test_record.c - The recording tap, read back from disk
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Records into a directory of its own and parses what the writer left: the
+ * WAV and W64 headers must describe the file, the samples must start at
+ * PWAR_RECORD_HEADER and hold every frame pushed, in order. A push larger
+ * than the ring is left out, and where pwar_record_push() reported a drop
+ * the file must hold silence of the same length. With rotation every file
+ * but the last is full and together they hold the session.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pwar_record.h"
+#include "pwar_test.h"
+
+#define CHANNELS 2
+#define RATE 48000
+#define QUANTUM 128
+#define FRAME_BYTES (CHANNELS * sizeof(float))
+#define RING_FRAMES (PWAR_RECORD_RING / FRAME_BYTES)
+#define BIG_FRAMES (RING_FRAMES + QUANTUM) // more than the ring holds
+
+static char dir[] = "/tmp/pwar_test_record.XXXXXX";
+static float *buffers[CHANNELS];
+
+// Channel 0 counts the frames from 1, channel 1 counts down, never 0
+static float sample(uint64_t frame, uint32_t c) {
+    return c ? -(float)(frame + 1) : (float)(frame + 1);
+}
+
+// One push as the file must show it
+struct push {
+    uint64_t frame;
+    uint32_t n;
+    int dropped;
+};
+
+struct session {
+    struct push *pushes;
+    size_t count;
+    size_t allocated;
+    uint64_t frames;
+    uint64_t dropped;
+};
+
+// The test pushes far faster than an audio thread: it waits for the writer
+// to keep up, like a disk that is fast enough would, so only the pushes
+// meant to be dropped are
+static void wait_for_writer(struct pwar_record *rec) {
+    while (rec->write_pos - __atomic_load_n(&rec->read_pos, __ATOMIC_ACQUIRE) >= PWAR_RECORD_CHUNK / sizeof(float))
+        usleep(1000);
+}
+
+static void push(struct pwar_record *rec, struct session *s, uint32_t n) {
+    wait_for_writer(rec);
+    for (uint32_t i = 0; i < n; ++i) {
+        for (uint32_t c = 0; c < CHANNELS; ++c)
+            buffers[c][i] = sample(s->frames + i, c);
+    }
+    int rc = pwar_record_push(rec, (const float *const *)buffers, n);
+    if (s->count == s->allocated) {
+        s->allocated = s->allocated ? 2 * s->allocated : 1024;
+        s->pushes = realloc(s->pushes, s->allocated * sizeof(*s->pushes));
+    }
+    s->pushes[s->count++] = (struct push){ s->frames, n, rc < 0 };
+    s->frames += n;
+    if (rc < 0)
+        s->dropped += n;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = (size_t)ftell(f);
+    rewind(f);
+    uint8_t *data = malloc(*size ? *size : 1);
+    if (fread(data, 1, *size, f) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+static uint16_t get16(const uint8_t *p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+static uint32_t get32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+static uint64_t get64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+static void file_path(char *path, size_t len, const char *name, uint32_t index, enum pwar_record_format format) {
+    snprintf(path, len, "%s/rec-%s-%03u.%s", dir, name, index, pwar_record_format_name(format));
+}
+
+// The fmt chunk body both layouts share: 32 bit IEEE float
+static void check_fmt(const char *path, const uint8_t *p) {
+    PWAR_CHECK(get16(p) == 3, "%s: format tag %u, not IEEE float", path, get16(p));
+    PWAR_CHECK(get16(p + 2) == CHANNELS, "%s: %u channels", path, get16(p + 2));
+    PWAR_CHECK(get32(p + 4) == RATE, "%s: rate %u", path, get32(p + 4));
+    PWAR_CHECK(get32(p + 8) == RATE * FRAME_BYTES, "%s: %u bytes per second", path, get32(p + 8));
+    PWAR_CHECK(get16(p + 12) == FRAME_BYTES, "%s: block align %u", path, get16(p + 12));
+    PWAR_CHECK(get16(p + 14) == 32, "%s: %u bits per sample", path, get16(p + 14));
+}
+
+// Returns the size of the samples the header gives, checked against the file
+static uint64_t check_header(const char *path, const uint8_t *h, size_t size, enum pwar_record_format format) {
+    static const uint8_t w64_tail[12] = { 0xf3, 0xac, 0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a };
+    static const uint8_t w64_riff[16] = { 'r', 'i', 'f', 'f', 0x2e, 0x91, 0xcf, 0x11, 0xa5, 0xd6, 0x28, 0xdb,
+        0x04, 0xc1, 0x00, 0x00 };
+    if (size < PWAR_RECORD_HEADER) {
+        PWAR_CHECK(size >= PWAR_RECORD_HEADER, "%s: %zu bytes, shorter than the header", path, size);
+        return 0;
+    }
+    uint64_t data;
+    if (format == PWAR_RECORD_WAV) {
+        PWAR_CHECK(memcmp(h, "RIFF", 4) == 0 && memcmp(h + 8, "WAVE", 4) == 0, "%s: no RIFF WAVE", path);
+        PWAR_CHECK(get32(h + 4) == size - 8, "%s: RIFF size %u, file %zu", path, get32(h + 4), size);
+        PWAR_CHECK(memcmp(h + 12, "fmt ", 4) == 0 && get32(h + 16) == 18, "%s: no 18 byte fmt chunk", path);
+        check_fmt(path, h + 20);
+        PWAR_CHECK(memcmp(h + PWAR_RECORD_HEADER - 8, "data", 4) == 0, "%s: no data chunk at %d", path,
+            PWAR_RECORD_HEADER - 8);
+        data = get32(h + PWAR_RECORD_HEADER - 4);
+    } else {
+        PWAR_CHECK(memcmp(h, w64_riff, 16) == 0, "%s: no riff GUID", path);
+        PWAR_CHECK(get64(h + 16) == size, "%s: riff size %lu, file %zu", path, (unsigned long)get64(h + 16), size);
+        PWAR_CHECK(memcmp(h + 24, "wave", 4) == 0 && memcmp(h + 28, w64_tail, 12) == 0, "%s: no wave GUID", path);
+        PWAR_CHECK(memcmp(h + 40, "fmt ", 4) == 0 && memcmp(h + 44, w64_tail, 12) == 0, "%s: no fmt GUID", path);
+        PWAR_CHECK(get64(h + 56) == 24 + 18, "%s: fmt size %lu", path, (unsigned long)get64(h + 56));
+        check_fmt(path, h + 64);
+        const uint8_t *d = h + PWAR_RECORD_HEADER - 24;
+        PWAR_CHECK(memcmp(d, "data", 4) == 0 && memcmp(d + 4, w64_tail, 12) == 0, "%s: no data GUID at %d", path,
+            PWAR_RECORD_HEADER - 24);
+        data = get64(d + 16) - 24;
+    }
+    PWAR_CHECK(PWAR_RECORD_HEADER + data == size, "%s: %lu bytes of samples in the header, %zu in the file", path,
+        (unsigned long)data, size - PWAR_RECORD_HEADER);
+    PWAR_CHECK(data % FRAME_BYTES == 0, "%s: %lu bytes of samples, not whole frames", path, (unsigned long)data);
+    return size - PWAR_RECORD_HEADER;
+}
+
+// Compares the samples of every file, in order, with the pushes
+static void check_samples(const float *samples, uint64_t frames, const struct session *s, const char *what) {
+    uint64_t wrong = 0, first_wrong = 0;
+    for (size_t p = 0; p < s->count; ++p) {
+        const struct push *ps = &s->pushes[p];
+        for (uint64_t f = ps->frame; f < ps->frame + ps->n && f < frames; ++f) {
+            for (uint32_t c = 0; c < CHANNELS; ++c) {
+                float want = ps->dropped ? 0.0f : sample(f, c);
+                if (samples[f * CHANNELS + c] != want && !wrong++)
+                    first_wrong = f;
+            }
+        }
+    }
+    PWAR_CHECK(frames == s->frames, "%s: %lu frames in the files, %lu pushed", what, (unsigned long)frames,
+        (unsigned long)s->frames);
+    PWAR_CHECK(wrong == 0, "%s: %lu samples differ, the first at frame %lu", what, (unsigned long)wrong,
+        (unsigned long)first_wrong);
+}
+
+// Reads back every file of a recording and joins their samples
+static float *read_recording(const char *name, enum pwar_record_format format, uint32_t files, uint64_t rotate_bytes,
+                             uint64_t *frames) {
+    float *samples = NULL;
+    uint64_t bytes = 0;
+    for (uint32_t i = 1; i <= files; ++i) {
+        char path[320];
+        size_t size;
+        file_path(path, sizeof(path), name, i, format);
+        uint8_t *data = read_file(path, &size);
+        PWAR_CHECK(data, "%s: %s", path, strerror(errno));
+        if (!data)
+            break;
+        uint64_t n = check_header(path, data, size, format);
+        if (i < files)
+            PWAR_CHECK(n == rotate_bytes, "%s: %lu bytes of samples before rotating, not %lu", path,
+                (unsigned long)n, (unsigned long)rotate_bytes);
+        samples = realloc(samples, bytes + n + 1);
+        memcpy((uint8_t *)samples + bytes, data + PWAR_RECORD_HEADER, n);
+        bytes += n;
+        free(data);
+        unlink(path);
+    }
+    char path[320];
+    file_path(path, sizeof(path), name, files + 1, format);
+    PWAR_CHECK(access(path, F_OK) != 0, "%s: one file too many", path);
+    *frames = bytes / FRAME_BYTES;
+    return samples;
+}
+
+// Periods around a push the ring can't take, the gap filled in after it
+static void check_drop(enum pwar_record_format format) {
+    const char *name = pwar_record_format_name(format);
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%s/rec", dir);
+    struct pwar_record rec;
+    int rc = pwar_record_start(&rec, prefix, name, format, CHANNELS, RATE, 0);
+    PWAR_CHECK(rc == 0, "%s: pwar_record_start: %s", name, strerror(-rc));
+    if (rc < 0)
+        return;
+    struct session s = { 0 };
+    for (int i = 0; i < 100; ++i)
+        push(&rec, &s, QUANTUM);
+    push(&rec, &s, BIG_FRAMES);
+    PWAR_CHECK(s.dropped == BIG_FRAMES, "%s: a push of %lu frames into a ring of %lu was not left out", name,
+        (unsigned long)BIG_FRAMES, (unsigned long)RING_FRAMES);
+    // The silence goes in SILENCE_PERIODS at a time, then the periods again
+    while (rec.gap_frames)
+        push(&rec, &s, QUANTUM);
+    for (int i = 0; i < 100; ++i)
+        push(&rec, &s, QUANTUM + i % 7);
+    uint64_t dropped = __atomic_load_n(&rec.dropped_frames, __ATOMIC_RELAXED);
+    pwar_record_stop(&rec);
+    PWAR_CHECK(dropped == s.dropped, "%s: %lu frames dropped, pushes reported %lu", name, (unsigned long)dropped,
+        (unsigned long)s.dropped);
+    PWAR_CHECK(rec.files == 1, "%s: %lu files", name, (unsigned long)rec.files);
+    PWAR_CHECK(rec.error == 0, "%s: %s", name, strerror(rec.error));
+
+    uint64_t frames;
+    float *samples = read_recording(name, format, 1, 0, &frames);
+    if (samples)
+        check_samples(samples, frames, &s, name);
+    printf("  %s      %lu frames, %lu left out and recorded as silence\n", name, (unsigned long)frames,
+        (unsigned long)s.dropped);
+    free(samples);
+    free(s.pushes);
+}
+
+// A rotation a second: files of whole chunks, one after the other
+static void check_rotation(void) {
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "%s/rec", dir);
+    struct pwar_record rec;
+    int rc = pwar_record_start(&rec, prefix, "rotate", PWAR_RECORD_WAV, CHANNELS, RATE, 1);
+    PWAR_CHECK(rc == 0, "rotate: pwar_record_start: %s", strerror(-rc));
+    if (rc < 0)
+        return;
+    const uint64_t rotate_bytes = rec.rotate_bytes;
+    const uint32_t files = 4;
+    struct session s = { 0 };
+    // Three files and a half, well within the ring
+    while (s.frames * FRAME_BYTES < (files - 1) * rotate_bytes + rotate_bytes / 2)
+        push(&rec, &s, QUANTUM);
+    pwar_record_stop(&rec);
+    PWAR_CHECK(s.dropped == 0, "rotate: %lu frames dropped", (unsigned long)s.dropped);
+    PWAR_CHECK(rec.files == files, "rotate: %lu files, not %u", (unsigned long)rec.files, files);
+
+    uint64_t frames;
+    float *samples = read_recording("rotate", PWAR_RECORD_WAV, files, rotate_bytes, &frames);
+    if (samples)
+        check_samples(samples, frames, &s, "rotate");
+    printf("  rotate   %lu frames in %lu files of %lu bytes\n", (unsigned long)frames, (unsigned long)rec.files,
+        (unsigned long)rotate_bytes);
+    free(samples);
+    free(s.pushes);
+}
+
+int main(void) {
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    for (uint32_t c = 0; c < CHANNELS; ++c)
+        buffers[c] = malloc(BIG_FRAMES * sizeof(float));
+    check_drop(PWAR_RECORD_WAV);
+    check_drop(PWAR_RECORD_W64);
+    check_rotation();
+    for (uint32_t c = 0; c < CHANNELS; ++c)
+        free(buffers[c]);
+    rmdir(dir);
+    return pwar_test_done("record");
+}
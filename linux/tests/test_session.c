@@ -0,0 +1,69 @@
+/*
+ * test_session.c - Session and seq classification
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * A packet behind the newest seq is late or reordered: it is stale and
+ * must not move the newest seq back, or what follows it plays twice. Only
+ * a step beyond PWAR_SESSION_MAX_JUMP either way is a resync. The counter
+ * wrapping in the bottom half is an ordinary step, and a restart leaves
+ * the previous session's packets stale.
+ */
+
+#include <stdio.h>
+#include "pwar_session.h"
+#include "pwar_test.h"
+
+#define OURS 0x5a5a0001u                  // in the top half of seq, like the sender's
+#define PEER 0x11110001u
+#define RESTARTED 0x22220001u
+
+static void expect(pwar_session_t *s, uint32_t session, uint64_t seq, enum pwar_session_event want, uint64_t newest,
+                   const char *what) {
+    enum pwar_session_event ev = pwar_session_check(s, session, seq);
+    PWAR_CHECK(ev == want, "%s: seq %08x got %s, not %s", what, (uint32_t)seq, pwar_session_event_name(ev),
+        pwar_session_event_name(want));
+    PWAR_CHECK(s->last_seq == newest, "%s: newest seq %08x, not %08x", what, (uint32_t)s->last_seq, (uint32_t)newest);
+}
+
+int main(void) {
+    pwar_session_t s;
+    pwar_session_init(&s);
+    const uint64_t base = PWAR_SESSION_SEQ(OURS, 1000);
+    expect(&s, PEER, base, PWAR_SESSION_FIRST, base, "first");
+    for (uint32_t i = 1; i <= 10; ++i)
+        expect(&s, PEER, base + i, PWAR_SESSION_SAME, base + i, "in order");
+    expect(&s, PEER, base + 10, PWAR_SESSION_DUPLICATE, base + 10, "second copy");
+
+    // Late by one, by a few and by the most that is still no resync
+    expect(&s, PEER, base + 9, PWAR_SESSION_STALE, base + 10, "late by one");
+    expect(&s, PEER, base + 4, PWAR_SESSION_STALE, base + 10, "late by six");
+    expect(&s, PEER, base + 10 - PWAR_SESSION_MAX_JUMP, PWAR_SESSION_STALE, base + 10, "late by the most");
+    expect(&s, PEER, base + 11, PWAR_SESSION_SAME, base + 11, "in order after late ones");
+    // Reordered: 13 ahead of 12
+    expect(&s, PEER, base + 13, PWAR_SESSION_SAME, base + 13, "ahead");
+    expect(&s, PEER, base + 12, PWAR_SESSION_STALE, base + 13, "behind the one ahead");
+    expect(&s, PEER, base + 14, PWAR_SESSION_SAME, base + 14, "in order after reordering");
+    PWAR_CHECK(s.stale == 4, "%lu stale, not 4", (unsigned long)s.stale);
+
+    // Beyond the jump either way resyncs to the new seq
+    expect(&s, PEER, base + 14 + PWAR_SESSION_MAX_JUMP + 1, PWAR_SESSION_JUMP,
+        base + 14 + PWAR_SESSION_MAX_JUMP + 1, "jump ahead");
+    expect(&s, PEER, base, PWAR_SESSION_JUMP, base, "jump back");
+    expect(&s, PEER, base + 1, PWAR_SESSION_SAME, base + 1, "after the jump back");
+    PWAR_CHECK(s.jumps == 2, "%lu jumps, not 2", (unsigned long)s.jumps);
+
+    // The counter wraps without touching the session
+    const uint64_t last = PWAR_SESSION_SEQ(OURS, 0xffffffffu);
+    expect(&s, PEER, last - 1, PWAR_SESSION_JUMP, last - 1, "near the wrap");
+    expect(&s, PEER, last, PWAR_SESSION_SAME, last, "last before the wrap");
+    expect(&s, PEER, pwar_session_next(last), PWAR_SESSION_SAME, pwar_session_next(last), "wrapped");
+    expect(&s, PEER, last, PWAR_SESSION_STALE, pwar_session_next(last), "late across the wrap");
+
+    // The peer restarts; what its previous run still had in flight is stale
+    expect(&s, RESTARTED, base + 500, PWAR_SESSION_RESTART, base + 500, "restart");
+    expect(&s, PEER, base + 501, PWAR_SESSION_STALE, base + 500, "previous session");
+    expect(&s, RESTARTED, base + 501, PWAR_SESSION_SAME, base + 501, "after the restart");
+    return pwar_test_done("session");
+}
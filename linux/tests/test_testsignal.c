@@ -0,0 +1,82 @@
+/*
+ * test_testsignal.c - The latency measurement against a known delay
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Loops the generated signal back through a delay line of DELAY samples,
+ * a period at a time like on_process does. Every burst type must measure
+ * exactly that delay. Between two bursts the line then loses a period of
+ * the return stream, and later plays one twice: the next analysis must
+ * count one dropped and then one duplicated period, and measure the delay
+ * that was left.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pwar_testsignal.h"
+#include "pwar_test.h"
+
+#define QUANTUM 128
+#define DELAY 1000                        // samples, no multiple of the period
+#define INTERVAL_MS 500
+#define BURSTS 9
+#define MAX_SAMPLES ((BURSTS + 2) * (INTERVAL_MS * PWAR_TEST_SAMPLE_RATE / 1000))
+
+static struct pwar_testsignal ts;
+static float history[MAX_SAMPLES];        // everything generated
+
+// The delay the line has before burst b is analysed, and the counts of
+// dropped and duplicated periods the analysis must have by then
+static void expected(uint32_t b, int32_t *delay, uint64_t *dropped, uint64_t *duplicated) {
+    *delay = DELAY;
+    *dropped = *duplicated = 0;
+    if (b >= BURSTS / 3) {
+        *delay -= QUANTUM;
+        *dropped = 1;
+    }
+    if (b >= 2 * BURSTS / 3) {
+        *delay += QUANTUM;
+        *duplicated = 1;
+    }
+}
+
+static void check_signal(enum pwar_test_signal type) {
+    const char *name = pwar_testsignal_name(type);
+    pwar_testsignal_init(&ts, type, 1000.0f, INTERVAL_MS);
+    int32_t delay = DELAY;
+    uint64_t dropped = 0, duplicated = 0;
+    uint32_t analysed = 0;
+    float out[QUANTUM], ret[QUANTUM];
+    for (uint64_t pos = 0; pos + QUANTUM <= MAX_SAMPLES && analysed < BURSTS; pos += QUANTUM) {
+        pwar_testsignal_generate(&ts, out, QUANTUM);
+        memcpy(history + pos, out, sizeof(out));
+        for (uint32_t i = 0; i < QUANTUM; ++i)
+            ret[i] = pos + i >= (uint64_t)delay ? history[pos + i - delay] : 0.0f;
+        pwar_testsignal_capture(&ts, ret, QUANTUM);
+        if (!pwar_testsignal_analyze(&ts))
+            continue;
+        const struct pwar_test_results *r = &ts.results;
+        PWAR_CHECK(r->missing == 0, "%s: burst %u not found", name, analysed);
+        PWAR_CHECK(r->latency == delay, "%s: burst %u measured %d samples, the line delays %d", name, analysed,
+            r->latency, delay);
+        PWAR_CHECK(r->dropped_periods == dropped && r->duplicated_periods == duplicated,
+            "%s: burst %u: %lu dropped and %lu duplicated periods, not %lu and %lu", name, analysed,
+            (unsigned long)r->dropped_periods, (unsigned long)r->duplicated_periods, (unsigned long)dropped,
+            (unsigned long)duplicated);
+        // Changed right after an analysis the line is silent, far from a burst
+        expected(++analysed, &delay, &dropped, &duplicated);
+    }
+    const struct pwar_test_results *r = &ts.results;
+    PWAR_CHECK(analysed == BURSTS, "%s: %u bursts analysed, not %d", name, analysed, BURSTS);
+    printf("  %-8s %lu bursts, latency %d to %d samples, %lu dropped and %lu duplicated periods\n", name,
+        (unsigned long)r->bursts, r->min_latency, r->max_latency, (unsigned long)r->dropped_periods,
+        (unsigned long)r->duplicated_periods);
+}
+
+int main(void) {
+    check_signal(PWAR_TEST_IMPULSE);
+    check_signal(PWAR_TEST_MLS);
+    check_signal(PWAR_TEST_CHIRP);
+    return pwar_test_done("testsignal");
+}
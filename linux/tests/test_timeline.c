@@ -0,0 +1,85 @@
+/*
+ * test_timeline.c - Buffer switch stamps against a skewed, jittery link
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * The sender's graph clock runs 100 ppm off the local one and every packet
+ * takes a fixed delay plus exponential queueing, one period never arrives.
+ * The stamps must only move forward, count the position in whole periods,
+ * and once the loop has locked stay close to when the periods really
+ * started, shifted by the fixed delay that no receiver can see. From one
+ * period to the next they must also vary at most a tenth as much as the
+ * arrival times do.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "pwar_timeline.h"
+#include "pwar_test.h"
+
+#define RATE 48000
+#define FRAMES 128
+#define PERIODS 7500                      // 20 s
+#define DROPPED 4000
+#define LOCKED 750                        // periods the loop gets to lock, again after the drop
+#define SKEW 100e-6
+#define DELAY_NS 400000.0
+#define JITTER_NS 100000.0                // mean queueing
+#define MAX_DEVIATION_NS 60000.0
+#define MAX_STEP_ERROR_NS 60000.0         // period to period, what a DAW sees as jitter
+
+int main(int argc, char **argv) {
+    uint32_t state = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    if (!state)
+        state = 1;
+    pwar_timeline_t tl;
+    pwar_timeline_init(&tl, PWAR_DLL_DEFAULT_BANDWIDTH);
+
+    const double period_ns = FRAMES * 1e9 / RATE;
+    const uint64_t remote_start = 5000000000000ull;
+    const double local_start = 123456789.0;
+    uint64_t last_ns = 0, last_position = 0;
+    double worst = 0, worst_step = 0, worst_arrival_step = 0, last_arrived = 0;
+    uint32_t updates = 0;
+    for (uint32_t seq = 1; seq <= PERIODS; ++seq) {
+        double sent = (seq - 1) * period_ns;
+        if (seq == DROPPED)
+            continue;
+        double started = local_start + sent * (1.0 + SKEW);
+        double arrived = started + DELAY_NS + pwar_test_exponential(&state, JITTER_NS);
+        pwar_timeline_update(&tl, seq, remote_start + (uint64_t)sent, (uint64_t)arrived, FRAMES, RATE);
+        double arrival_step = arrived - last_arrived;
+        last_arrived = arrived;
+
+        double step = (double)(int64_t)(tl.system_ns - last_ns);
+        if (updates++) {
+            PWAR_CHECK(tl.system_ns > last_ns, "period %u stamped at or before the one before it", seq);
+            PWAR_CHECK(tl.position == last_position + FRAMES, "period %u at position %lu after %lu", seq,
+                (unsigned long)tl.position, (unsigned long)last_position);
+        }
+        last_ns = tl.system_ns;
+        last_position = tl.position;
+
+        uint32_t since = seq < DROPPED ? seq : seq - DROPPED;
+        if (since < LOCKED)
+            continue;
+        double deviation = (double)tl.system_ns - (started + DELAY_NS);
+        double step_error = step - period_ns * (1.0 + SKEW);
+        PWAR_CHECK(fabs(deviation) < MAX_DEVIATION_NS, "period %u stamped %.0f ns off", seq, deviation);
+        PWAR_CHECK(fabs(step_error) < MAX_STEP_ERROR_NS, "period %u stamped %.0f ns off the period", seq,
+            step_error);
+        if (fabs(deviation) > worst)
+            worst = fabs(deviation);
+        if (fabs(step_error) > worst_step)
+            worst_step = fabs(step_error);
+        if (seq != DROPPED + 1 && fabs(arrival_step - period_ns) > worst_arrival_step)
+            worst_arrival_step = fabs(arrival_step - period_ns);
+    }
+    // Stamping by arrival would pass the queueing on in full
+    PWAR_CHECK(worst_step * 10 < worst_arrival_step, "period error %.0f ns against %.0f ns by arrival", worst_step,
+        worst_arrival_step);
+    printf("  worst deviation %.0f ns, period error %.0f ns (%.0f ns by arrival), %.0f ns mean queueing\n", worst,
+        worst_step, worst_arrival_step, JITTER_NS);
+    return pwar_test_done("timeline");
+}
@@ -1,23 +1,243 @@
+/*
+ * torture.c - Traffic generator for load testing the PWAR receive path
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Usage: pwar_torture [options] [ip [port [listen_port [restart_periods]]]]
+ *
+ * Sends one or many streams of rt_stream_packet_t the way the Linux side
+ * does, each with its own session and seq. Worker threads pace them on
+ * absolute CLOCK_MONOTONIC deadlines, so the rate never drifts; the streams
+ * are spread evenly over the period. Every 2s it reports the packets per
+ * second achieved against the plan, how late each send was against its
+ * deadline, and the replies that came back on listen_port.
+ *
+ * Separate ports let it run on the same host as a bridge in --driver mode.
+ * With restart_periods every stream starts a new session that often, like
+ * a restarted peer, and the time until its first reply is reported.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <time.h>
 #include "../protocol/pwar_packet.h"
+#include "../protocol/pwar_session.h"
 
 #define TORTURE_PORT 8321
 #define TORTURE_IP "192.168.66.3"
+#define MAX_STREAMS 4096
+#define MAX_THREADS 64
+#define JITTER_BUCKETS 10000              // 1 us each, the last one takes everything later
+#define REPORT_NS (2 * 1000000000ULL)
+#define FRAMES (RT_STREAM_PACKET_FRAME_SIZE / 2)
+
+enum pattern { PATTERN_RAMP, PATTERN_SINE, PATTERN_NOISE, PATTERN_SILENCE, PATTERN_IMPULSE };
+static const char *const pattern_names[] = { "ramp", "sine", "noise", "silence", "impulse" };
+
+struct config {
+    const char *ip;
+    int port;
+    int port_step;                        // stream i sends to port + i * port_step
+    int listen_port;
+    int streams;
+    int threads;
+    uint32_t frames;
+    uint32_t rate;
+    int channels;
+    enum pattern pattern;
+    uint32_t burst;                       // periods sent back to back, every burst periods
+    uint64_t jitter_ns;                   // random extra delay per send, up to this
+    uint64_t restart_periods;
+    int fifo_prio;                        // 0 leaves the scheduling alone
+    double duration;                      // seconds, 0 runs until interrupted
+};
+
+struct stream {
+    int index;
+    struct sockaddr_in addr;
+    uint32_t session;                     // atomic, the receiver matches replies against it
+    uint64_t seq;
+    uint64_t deadline_ns;
+    uint64_t periods;
+    uint64_t restart_ns;                  // atomic, 0 once the new session got a reply
+    uint32_t noise;
+    double phase, phase_inc;
+};
 
+// Written by one worker, read and cleared by the report in main, so every
+// field is only touched atomically.
+struct worker {
+    pthread_t tid;
+    int first;                            // streams first, first + threads, ...
+    int sockfd;
+    uint64_t sent, errors, missed;
+    uint64_t late_sum_ns, late_max_ns;
+    uint32_t late_hist[JITTER_BUCKETS];
+};
+
+static struct config cfg;
+static struct stream streams[MAX_STREAMS];
+static struct worker workers[MAX_THREADS];
+static uint64_t period_ns;
+static volatile sig_atomic_t running = 1;
 static int recv_sockfd;
-static pthread_mutex_t packet_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t packet_cond = PTHREAD_COND_INITIALIZER;
-static rt_stream_packet_t latest_packet;
-static int packet_available = 0;
+
+// Reply side, atomic
+static uint64_t replies, stale_replies;
+static uint64_t restarts_clean, restart_sum_ns, restart_max_ns;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && running)
+        ;
+}
+
+static void atomic_max(uint64_t *p, uint64_t v) {
+    uint64_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(p, &cur, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static void set_fifo(int prio) {
+    if (!prio)
+        return;
+    struct sched_param sp = { .sched_priority = prio };
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (rc)
+        fprintf(stderr, "SCHED_FIFO %d: %s\n", prio, strerror(rc));
+}
+
+// The stream index is the session modulo the stream count, so a reply is
+// matched to its stream without a lookup.
+static uint32_t stream_session(const struct stream *s, uint64_t entropy) {
+    uint32_t n = (uint32_t)cfg.streams;
+    uint32_t id = (pwar_session_new_id(entropy) >> 1) / n * n + (uint32_t)s->index;
+    return id ? id : n;
+}
+
+static void fill_payload(struct stream *s, rt_stream_packet_t *pkt) {
+    uint32_t n = cfg.frames;
+    float *ch1 = pkt->samples_ch1;
+    switch (cfg.pattern) {
+    case PATTERN_RAMP:
+        for (uint32_t i = 0; i < n; ++i)
+            ch1[i] = (float)i / n;
+        break;
+    case PATTERN_SINE:
+        for (uint32_t i = 0; i < n; ++i) {
+            ch1[i] = 0.5f * (float)sin(s->phase);
+            s->phase += s->phase_inc;
+        }
+        s->phase = fmod(s->phase, 2 * M_PI);
+        break;
+    case PATTERN_NOISE: {
+        uint32_t x = s->noise;
+        for (uint32_t i = 0; i < n; ++i) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            ch1[i] = (float)x * (1.0f / 4294967296.0f) - 0.5f;
+        }
+        s->noise = x;
+        break;
+    }
+    case PATTERN_SILENCE:
+        memset(ch1, 0, n * sizeof(float));
+        break;
+    case PATTERN_IMPULSE:
+        // One click a second
+        memset(ch1, 0, n * sizeof(float));
+        if (s->periods % (cfg.rate / n) == 0)
+            ch1[0] = 1.0f;
+        break;
+    }
+    if (cfg.channels > 1) {
+        for (uint32_t i = 0; i < n; ++i)
+            pkt->samples_ch2[i] = -ch1[i];
+    } else {
+        memset(pkt->samples_ch2, 0, n * sizeof(float));
+    }
+}
+
+static void send_period(struct worker *w, struct stream *s) {
+    if (cfg.restart_periods && s->periods && s->periods % cfg.restart_periods == 0) {
+        uint32_t id = stream_session(s, now_ns() ^ s->seq);
+        s->seq = PWAR_SESSION_SEQ(id, 0);
+        __atomic_store_n(&s->session, id, __ATOMIC_RELEASE);
+        __atomic_store_n(&s->restart_ns, now_ns(), __ATOMIC_RELAXED);
+    }
+    rt_stream_packet_t pkt;
+    pkt.n_samples = (uint16_t)cfg.frames;
+    pkt.session = __atomic_load_n(&s->session, __ATOMIC_RELAXED);
+    pkt.seq = s->seq;
+    s->seq = pwar_session_next(s->seq);
+    s->periods++;
+    fill_payload(s, &pkt);
+    pkt.ts_asio_recv = pkt.ts_asio_send = 0;
+    pkt.ts_pipewire_send = now_ns();
+    if (sendto(w->sockfd, &pkt, sizeof(pkt), 0, (struct sockaddr *)&s->addr, sizeof(s->addr)) != sizeof(pkt))
+        __atomic_add_fetch(&w->errors, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_add_fetch(&w->sent, 1, __ATOMIC_RELAXED);
+}
+
+// The streams of a worker are evenly spaced and all have the same period,
+// so their deadlines come up strictly in turn.
+static void *worker_thread(void *arg) {
+    struct worker *w = arg;
+    set_fifo(cfg.fifo_prio);
+    uint32_t rng = 0x9e3779b9u ^ (uint32_t)w->first;
+    int s_idx = w->first;
+    while (running) {
+        struct stream *s = &streams[s_idx];
+        uint64_t target = s->deadline_ns;
+        if (cfg.jitter_ns) {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            target += rng % cfg.jitter_ns;
+        }
+        sleep_until(target);
+        uint64_t late = now_ns() - target;
+        uint64_t bucket = late / 1000 < JITTER_BUCKETS ? late / 1000 : JITTER_BUCKETS - 1;
+        __atomic_add_fetch(&w->late_hist[bucket], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&w->late_sum_ns, late, __ATOMIC_RELAXED);
+        atomic_max(&w->late_max_ns, late);
+        for (uint32_t b = 0; b < cfg.burst; ++b)
+            send_period(w, s);
+        // Absolute deadlines: a late send never shifts the ones after it.
+        // Once a whole slot behind the periods in between are given up, so
+        // an overloaded run reports missed periods rather than a backlog.
+        s->deadline_ns += period_ns * cfg.burst;
+        if (late > period_ns * cfg.burst) {
+            uint64_t skip = (late - late % (period_ns * cfg.burst)) / (period_ns * cfg.burst);
+            s->deadline_ns += skip * period_ns * cfg.burst;
+            __atomic_add_fetch(&w->missed, skip * cfg.burst, __ATOMIC_RELAXED);
+        }
+        s_idx += cfg.threads;
+        if (s_idx >= cfg.streams)
+            s_idx = w->first;
+    }
+    return NULL;
+}
 
 static void setup_recv_socket(int port) {
     recv_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -25,8 +245,11 @@ static void setup_recv_socket(int port) {
         perror("recv socket creation failed");
         exit(EXIT_FAILURE);
     }
-    int rcvbuf = 1024 * 1024;
+    int rcvbuf = 4 * 1024 * 1024;
     setsockopt(recv_sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    // Lets the report notice when the run is over even without replies
+    struct timeval tv = { .tv_sec = 0, .tv_usec = 200000 };
+    setsockopt(recv_sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     struct sockaddr_in recv_addr;
     memset(&recv_addr, 0, sizeof(recv_addr));
     recv_addr.sin_family = AF_INET;
@@ -39,56 +262,226 @@ static void setup_recv_socket(int port) {
 }
 
 static void *receiver_thread(void *userdata) {
-    struct sched_param sp = { .sched_priority = 90 };
-    pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    (void)userdata;
+    set_fifo(cfg.fifo_prio);
     rt_stream_packet_t packet;
-    while (1) {
+    while (running) {
         ssize_t n = recvfrom(recv_sockfd, &packet, sizeof(packet), 0, NULL, NULL);
-        if (n == (ssize_t)sizeof(packet)) {
-            pthread_mutex_lock(&packet_mutex);
-            latest_packet = packet;
-            packet_available = 1;
-            pthread_cond_signal(&packet_cond);
-            pthread_mutex_unlock(&packet_mutex);
-            //printf("[RECV] Got packet seq=%lu n_samples=%u\n", packet.seq, packet.n_samples);
+        if (n != (ssize_t)sizeof(packet))
+            continue;
+        uint32_t session = PWAR_SESSION_OF(packet.seq);
+        struct stream *s = &streams[session % (uint32_t)cfg.streams];
+        if (session != __atomic_load_n(&s->session, __ATOMIC_ACQUIRE)) {
+            __atomic_add_fetch(&stale_replies, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_add_fetch(&replies, 1, __ATOMIC_RELAXED);
+        uint64_t since = __atomic_exchange_n(&s->restart_ns, 0, __ATOMIC_RELAXED);
+        if (since) {
+            uint64_t ns = now_ns() - since;
+            __atomic_add_fetch(&restarts_clean, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&restart_sum_ns, ns, __ATOMIC_RELAXED);
+            atomic_max(&restart_max_ns, ns);
         }
     }
     return NULL;
 }
 
-int main() {
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) { perror("socket"); exit(1); }
-    struct sockaddr_in servaddr;
-    memset(&servaddr, 0, sizeof(servaddr));
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_port = htons(TORTURE_PORT);
-    servaddr.sin_addr.s_addr = inet_addr(TORTURE_IP);
+static void report(double secs) {
+    uint64_t sent = 0, errors = 0, missed = 0, late_sum = 0, late_max = 0;
+    static uint64_t hist[JITTER_BUCKETS];
+    memset(hist, 0, sizeof(hist));
+    for (int t = 0; t < cfg.threads; ++t) {
+        struct worker *w = &workers[t];
+        sent += __atomic_exchange_n(&w->sent, 0, __ATOMIC_RELAXED);
+        errors += __atomic_exchange_n(&w->errors, 0, __ATOMIC_RELAXED);
+        missed += __atomic_exchange_n(&w->missed, 0, __ATOMIC_RELAXED);
+        late_sum += __atomic_exchange_n(&w->late_sum_ns, 0, __ATOMIC_RELAXED);
+        uint64_t m = __atomic_exchange_n(&w->late_max_ns, 0, __ATOMIC_RELAXED);
+        late_max = m > late_max ? m : late_max;
+        for (int b = 0; b < JITTER_BUCKETS; ++b)
+            hist[b] += __atomic_exchange_n(&w->late_hist[b], 0, __ATOMIC_RELAXED);
+    }
+    uint64_t wakeups = 0, p99 = 0, acc = 0;
+    for (int b = 0; b < JITTER_BUCKETS; ++b)
+        wakeups += hist[b];
+    for (int b = 0; b < JITTER_BUCKETS; ++b) {
+        acc += hist[b];
+        if (acc * 100 >= wakeups * 99) {
+            p99 = b;
+            break;
+        }
+    }
+    double planned = cfg.streams * 1e9 / period_ns;
+    printf("[%.1fs] %.0f pps of %.0f planned, %lu missed, send late avg %.1f us p99 %s%lu us max %.1f us, "
+        "%.0f replies/s, %lu stale, %lu send errors\n",
+        secs, sent / secs, planned, missed, wakeups ? late_sum / 1000.0 / wakeups : 0.0,
+        p99 == JITTER_BUCKETS - 1 ? ">" : "<", p99 == JITTER_BUCKETS - 1 ? p99 : p99 + 1, late_max / 1000.0,
+        __atomic_exchange_n(&replies, 0, __ATOMIC_RELAXED) / secs,
+        __atomic_exchange_n(&stale_replies, 0, __ATOMIC_RELAXED), errors);
+    uint64_t clean = __atomic_exchange_n(&restarts_clean, 0, __ATOMIC_RELAXED);
+    if (clean) {
+        uint64_t sum = __atomic_exchange_n(&restart_sum_ns, 0, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_exchange_n(&restart_max_ns, 0, __ATOMIC_RELAXED);
+        printf("[restart] %lu sessions clean after avg %.2f periods (%.3f ms), max %.2f periods\n",
+            clean, (double)sum / clean / period_ns, sum / 1e6 / clean, (double)max / period_ns);
+    }
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
 
-    setup_recv_socket(TORTURE_PORT);
-    pthread_t recv_thread;
-    pthread_create(&recv_thread, NULL, receiver_thread, NULL);
+static int usage(void) {
+    fprintf(stderr,
+        "usage: pwar_torture [options] [ip [port [listen_port [restart_periods]]]]\n"
+        "  --streams N        concurrent streams (1)\n"
+        "  --threads N        sending threads (up to one per stream, at most the cpu count)\n"
+        "  --port-step N      stream i sends to port + i * N (0, all to one port)\n"
+        "  --frames N         frames per period, at most %d (128)\n"
+        "  --rate HZ          sample rate the period is timed at (48000)\n"
+        "  --channels 1|2     channels carrying audio (1)\n"
+        "  --pattern NAME     ramp, sine, noise, silence or impulse (ramp)\n"
+        "  --burst N          send N periods back to back every N periods (1)\n"
+        "  --jitter-us US     delay each send randomly by up to US\n"
+        "  --fifo PRIO        run the threads SCHED_FIFO\n"
+        "  --duration S       stop after S seconds\n", FRAMES);
+    return 2;
+}
 
-    uint64_t seq = 0;
-    while (1) {
-        rt_stream_packet_t packet;
-        packet.n_samples = RT_STREAM_PACKET_FRAME_SIZE/2;
-        packet.seq = seq++;
-        struct timespec ts;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-        packet.ts_pipewire_send = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
-        packet.ts_asio_send = 0;
-        for (int i = 0; i < RT_STREAM_PACKET_FRAME_SIZE/2; ++i) {
-            packet.samples_ch1[i] = (float)i;
-            packet.samples_ch2[i] = (float)(RT_STREAM_PACKET_FRAME_SIZE/2 - i);
+static int parse_pattern(const char *name, enum pattern *p) {
+    for (size_t i = 0; i < sizeof(pattern_names) / sizeof(pattern_names[0]); ++i) {
+        if (strcmp(name, pattern_names[i]) == 0) {
+            *p = (enum pattern)i;
+            return 0;
         }
-        ssize_t sent = sendto(sockfd, &packet, sizeof(packet), 0, (struct sockaddr *)&servaddr, sizeof(servaddr));
-        if (sent != sizeof(packet)) {
-            perror("sendto");
-        } else {
-            //printf("[SEND] Sent packet seq=%lu\n", packet.seq);
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    cfg.ip = TORTURE_IP;
+    cfg.port = TORTURE_PORT;
+    cfg.listen_port = -1;
+    cfg.streams = 1;
+    cfg.frames = FRAMES;
+    cfg.rate = 48000;
+    cfg.channels = 1;
+    cfg.burst = 1;
+
+    int pos = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strncmp(arg, "--", 2) != 0) {
+            switch (pos++) {
+            case 0: cfg.ip = arg; break;
+            case 1: cfg.port = atoi(arg); break;
+            case 2: cfg.listen_port = atoi(arg); break;
+            case 3: cfg.restart_periods = strtoull(arg, NULL, 10); break;
+            default: return usage();
+            }
+            continue;
+        }
+        if (!val)
+            return usage();
+        if (strcmp(arg, "--streams") == 0)
+            cfg.streams = atoi(val);
+        else if (strcmp(arg, "--threads") == 0)
+            cfg.threads = atoi(val);
+        else if (strcmp(arg, "--port-step") == 0)
+            cfg.port_step = atoi(val);
+        else if (strcmp(arg, "--frames") == 0)
+            cfg.frames = strtoul(val, NULL, 10);
+        else if (strcmp(arg, "--rate") == 0)
+            cfg.rate = strtoul(val, NULL, 10);
+        else if (strcmp(arg, "--channels") == 0)
+            cfg.channels = atoi(val);
+        else if (strcmp(arg, "--pattern") == 0) {
+            if (parse_pattern(val, &cfg.pattern) < 0)
+                return usage();
+        } else if (strcmp(arg, "--burst") == 0)
+            cfg.burst = strtoul(val, NULL, 10);
+        else if (strcmp(arg, "--jitter-us") == 0)
+            cfg.jitter_ns = strtoull(val, NULL, 10) * 1000;
+        else if (strcmp(arg, "--fifo") == 0)
+            cfg.fifo_prio = atoi(val);
+        else if (strcmp(arg, "--duration") == 0)
+            cfg.duration = strtod(val, NULL);
+        else
+            return usage();
+        ++i;
+    }
+    if (cfg.listen_port < 0)
+        cfg.listen_port = cfg.port;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!cfg.threads)
+        cfg.threads = cfg.streams < cpus ? cfg.streams : (int)cpus;
+    if (cfg.threads > cfg.streams)
+        cfg.threads = cfg.streams;
+    if (cfg.streams < 1 || cfg.streams > MAX_STREAMS || cfg.threads < 1 || cfg.threads > MAX_THREADS ||
+        !cfg.frames || cfg.frames > FRAMES || !cfg.rate || !cfg.burst || cfg.channels < 1 || cfg.channels > 2)
+        return usage();
+    period_ns = (uint64_t)cfg.frames * 1000000000 / cfg.rate;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    setup_recv_socket(cfg.listen_port);
+
+    // Streams are spread evenly over one period
+    uint64_t start = now_ns() + 10 * 1000000;
+    for (int i = 0; i < cfg.streams; ++i) {
+        struct stream *s = &streams[i];
+        s->index = i;
+        memset(&s->addr, 0, sizeof(s->addr));
+        s->addr.sin_family = AF_INET;
+        s->addr.sin_port = htons(cfg.port + i * cfg.port_step);
+        s->addr.sin_addr.s_addr = inet_addr(cfg.ip);
+        s->session = stream_session(s, start ^ ((uint64_t)getpid() << 32) ^ (uint64_t)i);
+        s->seq = PWAR_SESSION_SEQ(s->session, 0);
+        s->deadline_ns = start + period_ns * i / cfg.streams;
+        s->noise = 0x2545f491u + (uint32_t)i;
+        s->phase_inc = 2 * M_PI * (220.0 + 10.0 * i) / cfg.rate;
+    }
+    for (int t = 0; t < cfg.threads; ++t) {
+        workers[t].first = t;
+        workers[t].sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (workers[t].sockfd < 0) {
+            perror("socket");
+            return 1;
         }
-        usleep(2600); // 2.6ms
     }
+    printf("%d streams on %d threads to %s:%d, %u frames at %u Hz (%.3f ms), %s on %d channels",
+        cfg.streams, cfg.threads, cfg.ip, cfg.port, cfg.frames, cfg.rate, period_ns / 1e6,
+        pattern_names[cfg.pattern], cfg.channels);
+    if (cfg.burst > 1)
+        printf(", bursts of %u", cfg.burst);
+    if (cfg.jitter_ns)
+        printf(", jitter up to %lu us", cfg.jitter_ns / 1000);
+    printf("\n");
+
+    pthread_t recv_thread;
+    pthread_create(&recv_thread, NULL, receiver_thread, NULL);
+    for (int t = 0; t < cfg.threads; ++t)
+        pthread_create(&workers[t].tid, NULL, worker_thread, &workers[t]);
+
+    uint64_t end = cfg.duration > 0 ? start + (uint64_t)(cfg.duration * 1e9) : 0;
+    uint64_t last = start;
+    while (running) {
+        uint64_t next = last + REPORT_NS;
+        if (end && next > end)
+            next = end;
+        sleep_until(next);
+        uint64_t now = now_ns();
+        if (now > last)
+            report((now - last) / 1e9);
+        last = now;
+        if (end && now >= end)
+            running = 0;
+    }
+    for (int t = 0; t < cfg.threads; ++t)
+        pthread_join(workers[t].tid, NULL);
+    pthread_join(recv_thread, NULL);
     return 0;
 }
@@ -0,0 +1,127 @@
+/*
+ * pwar_adapt.c - Adaptive payload encoding for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pwar_adapt.h"
+
+// Packing by step, smallest last
+static const enum pwar_sample_format packing[] = { PWAR_FORMAT_F32, PWAR_FORMAT_S24, PWAR_FORMAT_S16 };
+#define PACK_STEPS (sizeof(packing) / sizeof(packing[0]))
+
+void pwar_adapt_init(pwar_adapt_t *a) {
+    memset(a, 0, sizeof(*a));
+    a->loss_pct = PWAR_ADAPT_DEFAULT_LOSS_PCT;
+    a->clean_pct = PWAR_ADAPT_DEFAULT_CLEAN_PCT;
+    a->jitter_share = PWAR_ADAPT_DEFAULT_JITTER;
+    a->rtt_rise_ms = PWAR_ADAPT_DEFAULT_RTT_RISE_MS;
+    a->hold = PWAR_ADAPT_DEFAULT_HOLD;
+    pwar_adapt_reset(a);
+}
+
+void pwar_adapt_reset(pwar_adapt_t *a) {
+    a->pack = 0;
+    a->copies = 1;
+    a->clean_windows = 0;
+    a->backoff = a->hold;
+    a->probe_windows = 0;
+    a->rtt_base_ms = 0.0;
+    a->choice.format = PWAR_FORMAT_F32;
+    a->choice.copies = 1;
+    a->loss = 0.0;
+    a->congested = 0;
+}
+
+// Copies cost packing: 2 in s24 and 3 in s16 stay within 1.5x of one f32
+static struct pwar_adapt_choice choose(const pwar_adapt_t *a) {
+    uint32_t step = a->copies - 1;
+    if (step < a->pack)
+        step = a->pack;
+    if (step >= PACK_STEPS)
+        step = PACK_STEPS - 1;
+    struct pwar_adapt_choice c = { packing[step], a->copies };
+    return c;
+}
+
+int pwar_adapt_update(pwar_adapt_t *a, const struct pwar_adapt_window *w) {
+    if (!w->periods)
+        return 0;
+    a->loss = 100.0 * w->lost / w->periods;
+    if (w->rtt_ms > 0.0) {
+        // The baseline forgets a low outlier or a route change over about
+        // a minute of windows, a queue that builds up takes effect at once
+        if (a->rtt_base_ms == 0.0 || w->rtt_ms < a->rtt_base_ms)
+            a->rtt_base_ms = w->rtt_ms;
+        else
+            a->rtt_base_ms += (w->rtt_ms - a->rtt_base_ms) / 32.0;
+    }
+    a->congested = w->jitter_ms > a->jitter_share * w->period_ms ||
+        (w->rtt_ms > 0.0 && w->rtt_ms - a->rtt_base_ms > a->rtt_rise_ms);
+
+    const char *why = NULL;
+    int worse = a->congested || a->loss >= a->loss_pct;
+    if (a->probe_windows) {
+        if (worse) {
+            // The last step back did not hold
+            a->backoff = a->backoff * 2 < PWAR_ADAPT_MAX_HOLD ? a->backoff * 2 : PWAR_ADAPT_MAX_HOLD;
+            a->probe_windows = 0;
+        } else if (++a->probe_windows > a->hold) {
+            a->backoff = a->hold;
+            a->probe_windows = 0;
+        }
+    }
+    if (a->congested) {
+        // Only sending less helps: a copy goes and the packing shrinks, so
+        // copies added again later cost less
+        a->clean_windows = 0;
+        if (a->copies > 1)
+            a->copies--;
+        if (a->pack + 1 < PACK_STEPS)
+            a->pack++;
+        why = "congestion";
+    } else if (a->loss >= a->loss_pct) {
+        a->clean_windows = 0;
+        if (a->copies < PWAR_ADAPT_MAX_COPIES) {
+            a->copies++;
+            why = "loss";
+        }
+    } else if (a->loss < a->clean_pct) {
+        if (++a->clean_windows >= a->backoff && (a->copies > 1 || a->pack > 0)) {
+            a->clean_windows = 0;
+            a->probe_windows = 1;
+            // Copies cost the most, they go first
+            if (a->copies > 1)
+                a->copies--;
+            else
+                a->pack--;
+            why = "clean";
+        }
+    } else {
+        a->clean_windows = 0;
+    }
+
+    struct pwar_adapt_choice c = choose(a);
+    if (c.format == a->choice.format && c.copies == a->choice.copies)
+        return 0;
+    a->choice = c;
+    a->why = why;
+    a->switches++;
+    return 1;
+}
+
+int pwar_adapt_describe(const pwar_adapt_t *a, const struct pwar_adapt_window *w, char *buf, size_t size) {
+    int n = snprintf(buf, size, "%s x%u (%s): loss %.2f%% of %u periods, jitter %.3f ms",
+                     pwar_kernel_format_name(a->choice.format), a->choice.copies, a->why ? a->why : "start",
+                     a->loss, w->periods, w->jitter_ms);
+    if (n >= 0 && (size_t)n < size && w->rtt_ms > 0.0)
+        n += snprintf(buf + n, size - n, ", rtt %.3f ms over a baseline of %.3f ms", w->rtt_ms, a->rtt_base_ms);
+    return n;
+}
+
+double pwar_adapt_cost(const struct pwar_adapt_choice *c) {
+    return (double)c->copies * pwar_kernel_sample_size(c->format) / sizeof(float);
+}
@@ -0,0 +1,112 @@
+/*
+ * pwar_adapt.h - Adaptive payload encoding for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Each side picks how it packs the periods it sends from what its own
+ * stats say about the link, one window at a time. Loss on a link whose
+ * delay holds steady looks random and gets redundant copies of every
+ * period, which the receiver drops once one got through. Rising round trip
+ * times or a growing spread in arrivals mean a queue is building, and
+ * sending more would only make it longer, so a copy goes and the samples
+ * get packed smaller: s24, then s16. Copies are paid for with packing too,
+ * a period never takes more than half again its f32 size (2 copies in s24,
+ * 3 in s16).
+ *
+ * A worse link takes effect on the next window, a better one only after
+ * hold clean windows in a row, and then one step at a time. The copies
+ * themselves hide the loss they repair, so a step back is a probe: when
+ * the link turns bad again within hold windows, the wait before the next
+ * probe doubles, up to PWAR_ADAPT_MAX_HOLD windows. Every period
+ * says in its DTX header how it is packed, so switching needs no
+ * handshake and happens on a period boundary.
+ */
+
+#ifndef PWAR_ADAPT
+#define PWAR_ADAPT
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pwar_kernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_ADAPT_MAX_COPIES 3
+#define PWAR_ADAPT_DEFAULT_HOLD 3         // clean windows before a step back
+#define PWAR_ADAPT_MAX_HOLD 48
+#define PWAR_ADAPT_DEFAULT_LOSS_PCT 1.0   // loss that adds a copy
+#define PWAR_ADAPT_DEFAULT_CLEAN_PCT 0.1  // loss that still counts as clean
+#define PWAR_ADAPT_DEFAULT_JITTER 0.5     // share of a period
+#define PWAR_ADAPT_DEFAULT_RTT_RISE_MS 2.0
+
+// What one window of stats says about the link
+struct pwar_adapt_window {
+    uint32_t periods;                     // sent, or expected from the peer
+    uint32_t lost;                        // of those, never played: lost, late or concealed
+    double rtt_ms;                        // average round trip, 0 when this side cannot measure it
+    double jitter_ms;                     // average delay above the window's lowest
+    double period_ms;
+};
+
+struct pwar_adapt_choice {
+    enum pwar_sample_format format;
+    uint32_t copies;                      // datagrams per period, 1 to PWAR_ADAPT_MAX_COPIES
+};
+
+typedef struct {
+    // Tunables, set by pwar_adapt_init()
+    double loss_pct;
+    double clean_pct;
+    double jitter_share;
+    double rtt_rise_ms;
+    uint32_t hold;
+    // State
+    uint32_t pack;                        // packing steps taken for congestion, 0 is f32
+    uint32_t copies;
+    uint32_t clean_windows;
+    uint32_t backoff;                     // clean windows wanted now, hold and up
+    uint32_t probe_windows;               // since the last step back, 0 once it held
+    double rtt_base_ms;                   // lowest round trip seen, drifting up slowly
+    struct pwar_adapt_choice choice;
+    const char *why;                      // of the last switch
+    uint64_t switches;
+    // The last window, for reporting
+    double loss;                          // percent
+    int congested;
+} pwar_adapt_t;
+
+void pwar_adapt_init(pwar_adapt_t *a);
+
+// Feeds one window. Returns 1 when a->choice changed, 0 otherwise; windows
+// without periods change nothing.
+int pwar_adapt_update(pwar_adapt_t *a, const struct pwar_adapt_window *w);
+
+// Forgets the link, e.g. after the peer restarted; back to f32 and 1 copy
+void pwar_adapt_reset(pwar_adapt_t *a);
+
+// One line describing the current choice and the window that led to it
+int pwar_adapt_describe(const pwar_adapt_t *a, const struct pwar_adapt_window *w, char *buf, size_t size);
+
+// Bytes per period per channel, all copies, against one f32 copy
+double pwar_adapt_cost(const struct pwar_adapt_choice *c);
+
+// Packs a choice into one word for handing it between threads, and back
+static inline uint32_t pwar_adapt_pack(const struct pwar_adapt_choice *c) {
+    return (uint32_t)c->format | (c->copies << 8);
+}
+
+static inline struct pwar_adapt_choice pwar_adapt_unpack(uint32_t word) {
+    struct pwar_adapt_choice c;
+    c.format = (enum pwar_sample_format)(word & 0xff);
+    c.copies = word >> 8;
+    return c;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_ADAPT */
@@ -0,0 +1,404 @@
+/*
+ * pwar_auth.c - Pre-shared key authentication and encryption of PWAR datagrams
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "pwar_auth.h"
+
+static inline uint32_t load32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void store32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void store64(uint8_t *p, uint64_t v) {
+    store32(p, (uint32_t)v);
+    store32(p + 4, (uint32_t)(v >> 32));
+}
+
+// ChaCha20
+
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTER(a, b, c, d)                       \
+    a += b; d ^= a; d = ROTL(d, 16);              \
+    c += d; b ^= c; b = ROTL(b, 12);              \
+    a += b; d ^= a; d = ROTL(d, 8);               \
+    c += d; b ^= c; b = ROTL(b, 7)
+
+static void chacha_block(const uint32_t key[8], uint32_t counter, const uint8_t nonce[PWAR_AUTH_NONCE_SIZE],
+                         uint8_t out[64]) {
+    uint32_t s[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        counter, load32(nonce), load32(nonce + 4), load32(nonce + 8),
+    };
+    uint32_t x[16];
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; ++i) {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i)
+        store32(out + 4 * i, x[i] + s[i]);
+}
+
+// CHACHA_LANES blocks side by side, each word an array the compiler can
+// keep in one vector register
+#define CHACHA_LANES 4
+#define QUARTER_LANES(a, b, c, d)                                       \
+    for (int l = 0; l < CHACHA_LANES; ++l) {                            \
+        QUARTER(x[a][l], x[b][l], x[c][l], x[d][l]);                    \
+    }
+
+static void chacha_lanes(const uint32_t key[8], uint32_t counter, const uint8_t nonce[PWAR_AUTH_NONCE_SIZE],
+                         uint8_t out[64 * CHACHA_LANES]) {
+    const uint32_t init[16] = {
+        0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+        key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+        counter, load32(nonce), load32(nonce + 4), load32(nonce + 8),
+    };
+    uint32_t s[16][CHACHA_LANES], x[16][CHACHA_LANES];
+    for (int i = 0; i < 16; ++i) {
+        for (int l = 0; l < CHACHA_LANES; ++l)
+            s[i][l] = init[i] + (i == 12 ? (uint32_t)l : 0);
+    }
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; ++i) {
+        QUARTER_LANES(0, 4, 8, 12);
+        QUARTER_LANES(1, 5, 9, 13);
+        QUARTER_LANES(2, 6, 10, 14);
+        QUARTER_LANES(3, 7, 11, 15);
+        QUARTER_LANES(0, 5, 10, 15);
+        QUARTER_LANES(1, 6, 11, 12);
+        QUARTER_LANES(2, 7, 8, 13);
+        QUARTER_LANES(3, 4, 9, 14);
+    }
+    for (int l = 0; l < CHACHA_LANES; ++l) {
+        for (int i = 0; i < 16; ++i)
+            store32(out + 64 * l + 4 * i, x[i][l] + s[i][l]);
+    }
+}
+
+// XORs the key stream from block 1 on into buf, block 0 keys Poly1305
+static void chacha_xor(const uint32_t key[8], const uint8_t nonce[PWAR_AUTH_NONCE_SIZE], uint8_t *buf, size_t len) {
+    uint8_t stream[64 * CHACHA_LANES];
+    uint32_t counter = 1;
+    for (; len >= sizeof(stream); counter += CHACHA_LANES) {
+        chacha_lanes(key, counter, nonce, stream);
+        for (size_t i = 0; i < sizeof(stream); ++i)
+            buf[i] ^= stream[i];
+        buf += sizeof(stream);
+        len -= sizeof(stream);
+    }
+    for (; len; ++counter) {
+        size_t n = len < 64 ? len : 64;
+        chacha_block(key, counter, nonce, stream);
+        for (size_t i = 0; i < n; ++i)
+            buf[i] ^= stream[i];
+        buf += n;
+        len -= n;
+    }
+}
+
+// Poly1305 on 26 bit limbs
+
+typedef struct {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+    uint8_t buf[16];
+    size_t left;
+} poly1305_t;
+
+static void poly_init(poly1305_t *p, const uint8_t key[32]) {
+    p->r[0] = load32(key) & 0x3ffffff;
+    p->r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+    p->r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+    p->r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+    p->r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+    memset(p->h, 0, sizeof(p->h));
+    for (int i = 0; i < 4; ++i)
+        p->pad[i] = load32(key + 16 + 4 * i);
+    p->left = 0;
+}
+
+static void poly_blocks(poly1305_t *p, const uint8_t *m, size_t len, uint32_t hibit) {
+    const uint32_t r0 = p->r[0], r1 = p->r[1], r2 = p->r[2], r3 = p->r[3], r4 = p->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4];
+    for (; len >= 16; m += 16, len -= 16) {
+        h0 += load32(m) & 0x3ffffff;
+        h1 += (load32(m + 3) >> 2) & 0x3ffffff;
+        h2 += (load32(m + 6) >> 4) & 0x3ffffff;
+        h3 += (load32(m + 9) >> 6) & 0x3ffffff;
+        h4 += (load32(m + 12) >> 8) | hibit;
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+        uint32_t c = (uint32_t)(d0 >> 26);
+        h0 = (uint32_t)d0 & 0x3ffffff;
+        d1 += c; c = (uint32_t)(d1 >> 26); h1 = (uint32_t)d1 & 0x3ffffff;
+        d2 += c; c = (uint32_t)(d2 >> 26); h2 = (uint32_t)d2 & 0x3ffffff;
+        d3 += c; c = (uint32_t)(d3 >> 26); h3 = (uint32_t)d3 & 0x3ffffff;
+        d4 += c; c = (uint32_t)(d4 >> 26); h4 = (uint32_t)d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+    }
+    p->h[0] = h0; p->h[1] = h1; p->h[2] = h2; p->h[3] = h3; p->h[4] = h4;
+}
+
+static void poly_update(poly1305_t *p, const uint8_t *m, size_t len) {
+    if (!len)
+        return;
+    if (p->left) {
+        size_t n = 16 - p->left < len ? 16 - p->left : len;
+        memcpy(p->buf + p->left, m, n);
+        p->left += n;
+        m += n;
+        len -= n;
+        if (p->left < 16)
+            return;
+        poly_blocks(p, p->buf, 16, 1u << 24);
+        p->left = 0;
+    }
+    size_t whole = len & ~(size_t)15;
+    poly_blocks(p, m, whole, 1u << 24);
+    memcpy(p->buf, m + whole, len - whole);
+    p->left = len - whole;
+}
+
+// Zeros up to the next 16 bytes of input, as the AEAD lays it out
+static void poly_pad(poly1305_t *p) {
+    static const uint8_t zero[16] = { 0 };
+    if (p->left)
+        poly_update(p, zero, 16 - p->left);
+}
+
+static void poly_finish(poly1305_t *p, uint8_t mac[16]) {
+    if (p->left) {
+        p->buf[p->left] = 1;
+        memset(p->buf + p->left + 1, 0, 15 - p->left);
+        poly_blocks(p, p->buf, 16, 0);
+    }
+    uint32_t h0 = p->h[0], h1 = p->h[1], h2 = p->h[2], h3 = p->h[3], h4 = p->h[4], c;
+    c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+    // h - p, kept when it does not go negative
+    uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1u << 26);
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+    // To 128 bits, plus the pad
+    uint64_t f;
+    f = (uint64_t)(h0 | (h1 << 26)) + p->pad[0];
+    store32(mac, (uint32_t)f);
+    f = (uint64_t)((h1 >> 6) | (h2 << 20)) + p->pad[1] + (f >> 32);
+    store32(mac + 4, (uint32_t)f);
+    f = (uint64_t)((h2 >> 12) | (h3 << 14)) + p->pad[2] + (f >> 32);
+    store32(mac + 8, (uint32_t)f);
+    f = (uint64_t)((h3 >> 18) | (h4 << 8)) + p->pad[3] + (f >> 32);
+    store32(mac + 12, (uint32_t)f);
+}
+
+// The AEAD tag of aad and the ciphertext ct under the nonce
+static void aead_tag(const uint32_t key[8], const uint8_t nonce[PWAR_AUTH_NONCE_SIZE], const uint8_t *aad,
+                     size_t aad_len, const uint8_t *ct, size_t ct_len, uint8_t tag[16]) {
+    uint8_t block[64];
+    poly1305_t p;
+    chacha_block(key, 0, nonce, block);
+    poly_init(&p, block);
+    poly_update(&p, aad, aad_len);
+    poly_pad(&p);
+    poly_update(&p, ct, ct_len);
+    poly_pad(&p);
+    uint8_t lengths[16];
+    store64(lengths, aad_len);
+    store64(lengths + 8, ct_len);
+    poly_update(&p, lengths, sizeof(lengths));
+    poly_finish(&p, tag);
+}
+
+const char *pwar_auth_mode_name(enum pwar_auth_mode mode) {
+    switch (mode) {
+    case PWAR_AUTH_OFF: return "off";
+    case PWAR_AUTH_SIGN: return "sign";
+    case PWAR_AUTH_ENCRYPT: return "encrypt";
+    }
+    return "unknown";
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+int pwar_auth_parse_key(const char *hex, uint8_t key[PWAR_AUTH_KEY_SIZE]) {
+    for (int i = 0; i < PWAR_AUTH_KEY_SIZE; ++i) {
+        int hi = hex_digit(hex[2 * i]);
+        int lo = hi < 0 ? -1 : hex_digit(hex[2 * i + 1]);
+        if (lo < 0)
+            return -EINVAL;
+        key[i] = (uint8_t)(hi << 4 | lo);
+    }
+    const char *end = hex + 2 * PWAR_AUTH_KEY_SIZE;
+    while (*end == '\r' || *end == '\n' || *end == ' ' || *end == '\t')
+        end++;
+    return *end ? -EINVAL : 0;
+}
+
+int pwar_auth_load_key(const char *path, uint8_t key[PWAR_AUTH_KEY_SIZE]) {
+    char line[2 * PWAR_AUTH_KEY_SIZE + 8];
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -errno;
+    int rc = fgets(line, sizeof(line), f) ? pwar_auth_parse_key(line, key) : -EINVAL;
+    fclose(f);
+    memset(line, 0, sizeof(line));
+    return rc;
+}
+
+void pwar_auth_init(pwar_auth_t *a, enum pwar_auth_mode mode, const uint8_t key[PWAR_AUTH_KEY_SIZE], uint32_t id) {
+    memset(a, 0, sizeof(*a));
+    a->mode = mode;
+    for (int i = 0; i < PWAR_AUTH_KEY_SIZE / 4; ++i)
+        a->key[i] = load32(key + 4 * i);
+    a->id = id;
+    a->silence_ns = PWAR_AUTH_SILENCE_NS;
+}
+
+size_t pwar_auth_seal(pwar_auth_t *a, uint8_t *buf, size_t len) {
+    uint8_t *nonce = buf + len;
+    uint8_t tag[16];
+    store32(nonce, a->id);
+    store64(nonce + 4, a->counter++);
+    if (a->mode == PWAR_AUTH_ENCRYPT) {
+        chacha_xor(a->key, nonce, buf, len);
+        aead_tag(a->key, nonce, nonce, PWAR_AUTH_NONCE_SIZE, buf, len, tag);
+    } else {
+        aead_tag(a->key, nonce, buf, len + PWAR_AUTH_NONCE_SIZE, NULL, 0, tag);
+    }
+    memcpy(nonce + PWAR_AUTH_NONCE_SIZE, tag, PWAR_AUTH_TAG_SIZE);
+    return len + PWAR_AUTH_OVERHEAD;
+}
+
+// Whether counter from the current peer is new to the window
+static int window_fresh(const pwar_auth_t *a, uint64_t counter) {
+    if (counter > a->highest)
+        return 1;
+    uint64_t age = a->highest - counter;
+    return age < PWAR_AUTH_REPLAY_WINDOW && !((a->window >> age) & 1);
+}
+
+static void window_accept(pwar_auth_t *a, uint64_t counter) {
+    if (counter > a->highest) {
+        uint64_t shift = counter - a->highest;
+        a->window = shift >= PWAR_AUTH_REPLAY_WINDOW ? 0 : a->window << shift;
+        a->window |= 1;
+        a->highest = counter;
+    } else {
+        a->window |= 1ull << (a->highest - counter);
+    }
+}
+
+int pwar_auth_open(pwar_auth_t *a, uint8_t *buf, size_t len, uint64_t now_ns) {
+    if (len < PWAR_AUTH_OVERHEAD) {
+        a->bad_tag++;
+        return -EBADMSG;
+    }
+    size_t payload = len - PWAR_AUTH_OVERHEAD;
+    const uint8_t *nonce = buf + payload;
+    uint32_t id = load32(nonce);
+    uint64_t counter = (uint64_t)load32(nonce + 4) | (uint64_t)load32(nonce + 8) << 32;
+    int same_peer = a->have_peer && id == a->peer;
+    int candidate = !same_peer && a->candidate_count && id == a->candidate;
+    if (id == a->id || (same_peer && !window_fresh(a, counter)) ||
+        (candidate && counter <= a->candidate_highest)) {
+        a->replayed++;
+        return -EALREADY;
+    }
+
+    uint8_t tag[16];
+    if (a->mode == PWAR_AUTH_ENCRYPT)
+        aead_tag(a->key, nonce, nonce, PWAR_AUTH_NONCE_SIZE, buf, payload, tag);
+    else
+        aead_tag(a->key, nonce, buf, payload + PWAR_AUTH_NONCE_SIZE, NULL, 0, tag);
+    uint8_t diff = 0;
+    for (int i = 0; i < PWAR_AUTH_TAG_SIZE; ++i)
+        diff |= tag[i] ^ nonce[PWAR_AUTH_NONCE_SIZE + i];
+    if (diff) {
+        a->bad_tag++;
+        return -EBADMSG;
+    }
+
+    if (same_peer) {
+        window_accept(a, counter);
+        a->candidate_count = 0;
+        a->peer_ns = now_ns;
+    } else if (!a->have_peer) {
+        a->have_peer = 1;
+        a->peer = id;
+        a->highest = counter;
+        a->window = 1;
+        a->peer_ns = now_ns;
+    } else {
+        // Only a run of fresh datagrams with the peer silent meanwhile is
+        // a restart, a replayed one on its own stays refused. A run alone
+        // can be replayed too, so the peer must also have gone quiet.
+        if (!candidate) {
+            a->candidate = id;
+            a->candidate_count = 0;
+        }
+        a->candidate_highest = counter;
+        if (a->candidate_count < PWAR_AUTH_CONFIRM)
+            a->candidate_count++;
+        if (a->candidate_count < PWAR_AUTH_CONFIRM || now_ns - a->peer_ns < a->silence_ns) {
+            a->unconfirmed++;
+            return -EAGAIN;
+        }
+        // What it sent before this one was refused, and stays so
+        a->peer = id;
+        a->highest = counter;
+        a->window = ~0ull;
+        a->candidate_count = 0;
+        a->peer_ns = now_ns;
+        a->peer_changes++;
+    }
+    if (a->mode == PWAR_AUTH_ENCRYPT)
+        chacha_xor(a->key, nonce, buf, payload);
+    a->opened++;
+    return (int)payload;
+}
@@ -0,0 +1,109 @@
+/*
+ * pwar_auth.h - Pre-shared key authentication and encryption of PWAR datagrams
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Without it, anything that can reach the port can play into the stream.
+ * With a key shared by both sides, every datagram, audio and MIDI alike,
+ * gets a trailer of the sender's id, a datagram counter and a Poly1305 tag
+ * truncated to PWAR_AUTH_TAG_SIZE bytes (ChaCha20-Poly1305, RFC 8439,
+ * in portable C). The id and the counter form the nonce. In sign mode the
+ * payload travels in the clear and only the tag covers it; in encrypt
+ * mode it is encrypted as well.
+ *
+ * The counter is the datagram's, not the audio seq: replies echo the seq
+ * they answer and a period's MIDI may go out ahead of it with the same
+ * seq, either would repeat a nonce. The receiver keeps a window of the
+ * last PWAR_AUTH_REPLAY_WINDOW counters of its peer and drops anything
+ * seen before or older, and refuses datagrams carrying its own id (our
+ * own datagrams sent back at us).
+ *
+ * A datagram under another id than the peer's may be a restarted peer or
+ * a recording of some earlier session played back at us; the tag cannot
+ * tell. The new id only takes over after PWAR_AUTH_CONFIRM datagrams in a
+ * row with rising counters and nothing from the current peer in between,
+ * and once the peer has been silent for PWAR_AUTH_SILENCE_NS. A restarted
+ * peer reaches both within a few periods of its old run ending. Until then
+ * its datagrams are refused, so neither a stray replay nor a burst of
+ * them played over a live peer moves the peer. Both
+ * sides only ever touch caller memory, sealing and opening are real-time
+ * safe.
+ */
+
+#ifndef PWAR_AUTH
+#define PWAR_AUTH
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_AUTH_KEY_SIZE 32
+#define PWAR_AUTH_TAG_SIZE 8              // of Poly1305's 16
+#define PWAR_AUTH_NONCE_SIZE 12           // sender id, then the counter, little endian
+#define PWAR_AUTH_OVERHEAD (PWAR_AUTH_NONCE_SIZE + PWAR_AUTH_TAG_SIZE)
+#define PWAR_AUTH_REPLAY_WINDOW 64
+#define PWAR_AUTH_CONFIRM 8               // datagrams in a row before a new id is the peer
+#define PWAR_AUTH_SILENCE_NS 100000000ULL // of the peer before a new id can take over
+
+enum pwar_auth_mode {
+    PWAR_AUTH_OFF,
+    PWAR_AUTH_SIGN,                       // tag only
+    PWAR_AUTH_ENCRYPT,                    // tag and encrypted payload
+};
+
+typedef struct {
+    enum pwar_auth_mode mode;
+    uint32_t key[PWAR_AUTH_KEY_SIZE / 4];
+    // Sender: one thread seals
+    uint32_t id;
+    uint64_t counter;                     // of the next datagram
+    // Receiver: one thread opens
+    int have_peer;
+    uint32_t peer;
+    uint64_t highest;                     // highest counter accepted
+    uint64_t window;                      // bit i set: highest - i accepted
+    uint64_t peer_ns;                     // monotonic, when the peer was last accepted
+    uint64_t silence_ns;                  // PWAR_AUTH_SILENCE_NS unless changed after init
+    // Another id heard since the peer was last, not the peer yet
+    uint32_t candidate;
+    uint32_t candidate_count;             // datagrams in a row, 0 for none
+    uint64_t candidate_highest;
+    // Written by the receiver, read by whoever reports
+    uint64_t opened;
+    uint64_t bad_tag;                     // short, forged or the wrong key
+    uint64_t replayed;                    // seen before, too old or our own
+    uint64_t unconfirmed;                 // from a new id before it took over
+    uint64_t peer_changes;
+} pwar_auth_t;
+
+const char *pwar_auth_mode_name(enum pwar_auth_mode mode);
+
+// 64 hex digits, e.g. from `openssl rand -hex 32`. Returns 0 or -EINVAL.
+int pwar_auth_parse_key(const char *hex, uint8_t key[PWAR_AUTH_KEY_SIZE]);
+// The same from the first line of a file. Returns 0 or a negative errno.
+int pwar_auth_load_key(const char *path, uint8_t key[PWAR_AUTH_KEY_SIZE]);
+
+// id tells our datagrams from the peer's under the same key, a fresh
+// random one per run such as a session id
+void pwar_auth_init(pwar_auth_t *a, enum pwar_auth_mode mode, const uint8_t key[PWAR_AUTH_KEY_SIZE], uint32_t id);
+
+// Appends the trailer to the len bytes at buf, encrypting them first in
+// encrypt mode. buf must have room for PWAR_AUTH_OVERHEAD more. Returns
+// the length to send.
+size_t pwar_auth_seal(pwar_auth_t *a, uint8_t *buf, size_t len);
+
+// Checks a received datagram and in encrypt mode decrypts it in place.
+// now_ns is a monotonic time of its arrival. Returns the payload length,
+// or -EBADMSG for a bad tag, -EALREADY for a replay and -EAGAIN for a new
+// id not confirmed yet, counted in bad_tag, replayed and unconfirmed.
+int pwar_auth_open(pwar_auth_t *a, uint8_t *buf, size_t len, uint64_t now_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_AUTH */
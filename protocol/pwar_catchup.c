@@ -0,0 +1,107 @@
+/*
+ * pwar_catchup.c - Catch-up policy for received periods that queued up
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include "pwar_catchup.h"
+
+const char *pwar_catchup_policy_name(enum pwar_catchup_policy policy) {
+    switch (policy) {
+    case PWAR_CATCHUP_OFF: return "off";
+    case PWAR_CATCHUP_NEWEST: return "newest";
+    case PWAR_CATCHUP_DROP: return "drop";
+    case PWAR_CATCHUP_STRETCH: return "stretch";
+    }
+    return "unknown";
+}
+
+int pwar_catchup_parse(const char *name, enum pwar_catchup_policy *policy) {
+    if (strcmp(name, "off") == 0)
+        *policy = PWAR_CATCHUP_OFF;
+    else if (strcmp(name, "newest") == 0)
+        *policy = PWAR_CATCHUP_NEWEST;
+    else if (strcmp(name, "drop") == 0)
+        *policy = PWAR_CATCHUP_DROP;
+    else if (strcmp(name, "stretch") == 0)
+        *policy = PWAR_CATCHUP_STRETCH;
+    else
+        return -EINVAL;
+    return 0;
+}
+
+void pwar_catchup_init(pwar_catchup_t *c, enum pwar_catchup_policy policy, uint32_t target) {
+    memset(c, 0, sizeof(*c));
+    c->policy = policy;
+    c->target = policy == PWAR_CATCHUP_NEWEST ? 0 : target;
+}
+
+pwar_catchup_action_t pwar_catchup_update(pwar_catchup_t *c, uint32_t queued, uint32_t period, uint64_t now_ns) {
+    pwar_catchup_action_t act = { 0, 0, 0 };
+    uint32_t keep = c->target * period;
+    if (c->policy == PWAR_CATCHUP_OFF || (queued <= keep && !c->backlogged))
+        return act;
+
+    if (!c->backlogged) {
+        c->backlogged = 1;
+        c->since_ns = now_ns;
+        c->depth = 0;
+        c->backlogs++;
+    }
+    if (queued > c->depth)
+        c->depth = queued;
+    uint32_t excess = queued > keep ? queued - keep : 0;
+    switch (c->policy) {
+    case PWAR_CATCHUP_NEWEST:
+        act.drop = queued;
+        break;
+    case PWAR_CATCHUP_DROP:
+        act.drop = excess;
+        break;
+    case PWAR_CATCHUP_STRETCH: {
+        uint32_t max = PWAR_CATCHUP_STRETCH_MAX_PERIODS * period;
+        uint32_t step = period / PWAR_CATCHUP_STRETCH_DIV ? period / PWAR_CATCHUP_STRETCH_DIV : 1;
+        if (excess > max) {
+            act.drop = excess - max;
+            excess = max;
+        }
+        act.stretch = excess < step ? excess : step;
+        break;
+    }
+    case PWAR_CATCHUP_OFF:
+        break;
+    }
+    c->dropped_frames += act.drop;
+    c->stretched_frames += act.stretch;
+
+    if (act.drop + act.stretch >= excess) {
+        uint64_t took = now_ns - c->since_ns;
+        c->last_depth = c->depth;
+        c->last_period = period;
+        c->last_recovery_ns = took;
+        if (took > c->max_recovery_ns)
+            c->max_recovery_ns = took;
+        c->backlogged = 0;
+        act.recovered = 1;
+    }
+    return act;
+}
+
+void pwar_catchup_stretch(const float *in, uint32_t in_frames, float *out, uint32_t out_frames) {
+    if (in_frames == out_frames) {
+        memcpy(out, in, out_frames * sizeof(float));
+        return;
+    }
+    double step = (double)in_frames / out_frames;
+    for (uint32_t i = 0; i < out_frames; ++i) {
+        double pos = i * step;
+        uint32_t idx = (uint32_t)pos;
+        float frac = (float)(pos - idx);
+        float a = in[idx];
+        float b = idx + 1 < in_frames ? in[idx + 1] : a;
+        out[i] = a + (b - a) * frac;
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * pwar_catchup.h - Catch-up policy for received periods that queued up
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * After a stall on either side, several periods arrive at once. Played in
+ * order, they add their length to the latency for good. The policy decides
+ * what the backlog costs instead, once per played period:
+ *
+ *   newest   skip all of it and play the newest period
+ *   drop     skip the oldest until at most target periods remain queued
+ *   stretch  play the backlog up to 1/PWAR_CATCHUP_STRETCH_DIV faster until
+ *            target periods remain, skipping first what is beyond
+ *            PWAR_CATCHUP_STRETCH_MAX_PERIODS
+ *
+ * The caller owns the queue and says how many frames wait behind the period
+ * it is about to play. Both the Linux output FIFO and the ASIO listener's
+ * packet backlog go through here.
+ */
+
+#ifndef PWAR_CATCHUP
+#define PWAR_CATCHUP
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_CATCHUP_STRETCH_DIV 16       // about a semitone up while catching up
+#define PWAR_CATCHUP_STRETCH_MAX_PERIODS 8
+
+enum pwar_catchup_policy {
+    PWAR_CATCHUP_OFF,                     // play everything in order
+    PWAR_CATCHUP_NEWEST,
+    PWAR_CATCHUP_DROP,
+    PWAR_CATCHUP_STRETCH,
+};
+
+typedef struct {
+    uint32_t drop;                        // frames to skip from the front of the queue
+    uint32_t stretch;                     // extra frames to squeeze into this period
+    int recovered;                        // this call ended a backlog
+} pwar_catchup_action_t;
+
+// Written by the thread that plays, read by whoever reports
+typedef struct {
+    enum pwar_catchup_policy policy;
+    uint32_t target;                      // periods left queued, drop and stretch
+    uint64_t dropped_frames;
+    uint64_t stretched_frames;
+    uint64_t backlogs;
+    // The backlog in progress, and the last one worked off
+    int backlogged;
+    uint64_t since_ns;
+    uint32_t depth;                       // deepest it got, frames
+    uint32_t last_depth;
+    uint32_t last_period;
+    uint64_t last_recovery_ns;
+    uint64_t max_recovery_ns;
+} pwar_catchup_t;
+
+const char *pwar_catchup_policy_name(enum pwar_catchup_policy policy);
+int pwar_catchup_parse(const char *name, enum pwar_catchup_policy *policy);
+
+void pwar_catchup_init(pwar_catchup_t *c, enum pwar_catchup_policy policy, uint32_t target);
+
+// queued frames wait behind the period of period frames about to be played.
+// Returns what to do with them; the caller skips drop frames and then plays
+// period + stretch frames in the time of period, e.g. with
+// pwar_catchup_stretch().
+pwar_catchup_action_t pwar_catchup_update(pwar_catchup_t *c, uint32_t queued, uint32_t period, uint64_t now_ns);
+
+// Resamples in_frames of one channel into out_frames by linear
+// interpolation. Consecutive calls line up when each one continues where
+// the last one's input ended.
+void pwar_catchup_stretch(const float *in, uint32_t in_frames, float *out, uint32_t out_frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_CATCHUP */
@@ -0,0 +1,93 @@
+/*
+ * pwar_clock.c - Cross-host clock offset and skew estimation for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include "pwar_clock.h"
+
+void pwar_clock_init(pwar_clock_t *clk) {
+    memset(clk, 0, sizeof(*clk));
+    clk->window_best_delay = UINT64_MAX;
+}
+
+static void fit(pwar_clock_t *clk) {
+    double mean_t = 0, mean_o = 0;
+    for (uint32_t i = 0; i < clk->n_points; ++i) {
+        mean_t += clk->points[i].local_ns;
+        mean_o += clk->points[i].offset_ns;
+    }
+    mean_t /= clk->n_points;
+    mean_o /= clk->n_points;
+
+    double cov = 0, var = 0;
+    for (uint32_t i = 0; i < clk->n_points; ++i) {
+        double dt = clk->points[i].local_ns - mean_t;
+        cov += dt * (clk->points[i].offset_ns - mean_o);
+        var += dt * dt;
+    }
+    clk->ref_ns = mean_t;
+    clk->offset_ns = mean_o;
+    clk->skew = var > 0 ? cov / var : 0;
+    clk->valid = 1;
+}
+
+void pwar_clock_update(pwar_clock_t *clk, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4) {
+    if (t2 == 0 || t3 < t2 || t4 < t1)
+        return;
+    uint64_t rtt = t4 - t1;
+    uint64_t remote = t3 - t2;
+    if (remote > rtt)
+        return;
+    // Done in signed 64 bit: the two clocks may be arbitrarily far apart
+    int64_t offset = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+    if (!clk->have_base) {
+        clk->base_ns = t1;
+        clk->base_offset_ns = offset;
+        clk->have_base = 1;
+    }
+    uint64_t delay = rtt - remote;
+    clk->last_delay_ns = delay;
+
+    if (delay < clk->window_best_delay) {
+        clk->window_best_delay = delay;
+        clk->window_best.local_ns = (double)(int64_t)(t1 + rtt / 2 - clk->base_ns);
+        clk->window_best.offset_ns = (double)(offset - clk->base_offset_ns);
+    }
+    // Until the first window completes use whatever we have so the stats
+    // are usable right after start.
+    if (!clk->valid || clk->n_points == 0) {
+        clk->ref_ns = clk->window_best.local_ns;
+        clk->offset_ns = clk->window_best.offset_ns;
+        clk->skew = 0;
+        clk->valid = 1;
+    }
+    if (++clk->window_count < PWAR_CLOCK_WINDOW)
+        return;
+
+    clk->points[clk->next_point] = clk->window_best;
+    clk->next_point = (clk->next_point + 1) % PWAR_CLOCK_POINTS;
+    if (clk->n_points < PWAR_CLOCK_POINTS)
+        clk->n_points++;
+    clk->window_count = 0;
+    clk->window_best_delay = UINT64_MAX;
+    fit(clk);
+}
+
+int64_t pwar_clock_offset_at(const pwar_clock_t *clk, uint64_t local_ns) {
+    if (!clk->valid)
+        return 0;
+    double t = (double)(int64_t)(local_ns - clk->base_ns);
+    return clk->base_offset_ns + (int64_t)(clk->offset_ns + clk->skew * (t - clk->ref_ns));
+}
+
+uint64_t pwar_clock_remote_to_local(const pwar_clock_t *clk, uint64_t remote_ns) {
+    if (!clk->valid)
+        return remote_ns;
+    // Solve local = remote - offset(local) for the linear model
+    double g = (double)(int64_t)(remote_ns - (uint64_t)clk->base_offset_ns - clk->base_ns) - clk->offset_ns;
+    double local = g - clk->skew * (g - clk->ref_ns) / (1.0 + clk->skew);
+    return clk->base_ns + (uint64_t)(int64_t)local;
+}
@@ -0,0 +1,74 @@
+/*
+ * pwar_clock.h - Cross-host clock offset and skew estimation for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Every round trip gives the four NTP timestamps
+ *   t1 = ts_pipewire_send  (local clock)
+ *   t2 = ts_asio_recv      (remote clock)
+ *   t3 = ts_asio_send      (remote clock)
+ *   t4 = reply received    (local clock)
+ * From them offset = ((t2 - t1) + (t3 - t4)) / 2 and
+ * delay = (t4 - t1) - (t3 - t2). Offsets from exchanges with a large delay
+ * are mostly queueing noise, so each window of exchanges contributes only its
+ * minimum-delay sample, and a line fitted through the recent window minima
+ * gives the offset and the skew between the two clocks.
+ */
+
+#ifndef PWAR_CLOCK
+#define PWAR_CLOCK
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_CLOCK_WINDOW 32              // exchanges per filtered sample
+#define PWAR_CLOCK_POINTS 64              // filtered samples used for the fit
+
+typedef struct {
+    double local_ns;                      // midpoint of t1 and t4, relative to base_ns
+    double offset_ns;                     // remote - local, relative to base_offset_ns
+} pwar_clock_point_t;
+
+typedef struct {
+    // Origins that keep the fit in double range whatever the two epochs are
+    uint64_t base_ns;                     // local time origin
+    int64_t base_offset_ns;               // first observed offset
+    int have_base;
+
+    // Current window
+    uint32_t window_count;
+    uint64_t window_best_delay;
+    pwar_clock_point_t window_best;
+
+    pwar_clock_point_t points[PWAR_CLOCK_POINTS];
+    uint32_t n_points;
+    uint32_t next_point;
+
+    // Fitted model: offset(t) = base_offset_ns + offset_ns + skew * (t - ref_ns)
+    int valid;
+    double ref_ns;
+    double offset_ns;
+    double skew;                          // remote seconds gained per local second
+    uint64_t last_delay_ns;
+} pwar_clock_t;
+
+void pwar_clock_init(pwar_clock_t *clk);
+
+// Feeds one completed exchange. Samples with a zero remote timestamp (a
+// peer that does not stamp) or a negative delay are ignored.
+void pwar_clock_update(pwar_clock_t *clk, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
+// remote - local at the given local time, in ns
+int64_t pwar_clock_offset_at(const pwar_clock_t *clk, uint64_t local_ns);
+
+uint64_t pwar_clock_remote_to_local(const pwar_clock_t *clk, uint64_t remote_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_CLOCK */
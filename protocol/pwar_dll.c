@@ -0,0 +1,64 @@
+/*
+ * pwar_dll.c - Delay-locked loop for smoothing period timestamps in PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "pwar_dll.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void pwar_dll_init(pwar_dll_t *dll, double bandwidth) {
+    memset(dll, 0, sizeof(*dll));
+    dll->bandwidth = bandwidth;
+}
+
+void pwar_dll_reset(pwar_dll_t *dll, uint64_t now_ns, uint32_t frames, uint32_t rate) {
+    dll->nominal_ns = (double)frames * 1e9 / rate;
+    double omega = 2 * M_PI * dll->bandwidth * frames / rate;
+    dll->b = sqrt(2.0) * omega;
+    dll->c = omega * omega;
+    dll->origin_ns = now_ns;
+    dll->e2 = dll->nominal_ns;
+    dll->t0 = 0;
+    dll->t1 = dll->e2;
+    dll->error_ns = 0;
+    dll->running = 1;
+}
+
+void pwar_dll_update(pwar_dll_t *dll, uint64_t now_ns, uint32_t frames, uint32_t rate) {
+    if (!dll->running || dll->nominal_ns != (double)frames * 1e9 / rate) {
+        pwar_dll_reset(dll, now_ns, frames, rate);
+        return;
+    }
+    double e = (double)(int64_t)(now_ns - dll->origin_ns) - dll->t1;
+    dll->error_ns = e;
+    dll->t0 = dll->t1;
+    dll->t1 += dll->b * e + dll->e2;
+    dll->e2 += dll->c * e;
+
+    // Move the origin along once in a while so the doubles stay exact
+    if (dll->t0 > 1e12) {
+        uint64_t shift = (uint64_t)dll->t0;
+        dll->origin_ns += shift;
+        dll->t0 -= shift;
+        dll->t1 -= shift;
+    }
+}
+
+uint64_t pwar_dll_period_ns(const pwar_dll_t *dll) {
+    return dll->origin_ns + (uint64_t)llround(dll->t0);
+}
+
+uint64_t pwar_dll_next_ns(const pwar_dll_t *dll) {
+    return dll->origin_ns + (uint64_t)llround(dll->t1);
+}
+
+double pwar_dll_rate_ratio(const pwar_dll_t *dll) {
+    return dll->nominal_ns > 0 ? dll->e2 / dll->nominal_ns : 1.0;
+}
@@ -0,0 +1,55 @@
+/*
+ * pwar_dll.h - Delay-locked loop for smoothing period timestamps in PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Second order DLL after F. Adriaensen, "Using a DLL to filter time". Fed the
+ * (jittery) time at which each period arrived, it tracks a smoothed period
+ * start t0, the predicted start of the next period t1 and the measured
+ * period length, whose ratio to the nominal one is the rate of the remote
+ * clock as seen from ours.
+ */
+
+#ifndef PWAR_DLL
+#define PWAR_DLL
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_DLL_DEFAULT_BANDWIDTH 1.0    // Hz, low enough to reject network jitter
+
+typedef struct {
+    double bandwidth;
+    double nominal_ns;                    // period length at the nominal rate
+    double b, c;                          // loop coefficients
+    double t0, t1;                        // smoothed start of this and of the next period, ns
+    double e2;                            // filtered period length, ns
+    double error_ns;                      // last arrival minus prediction
+    uint64_t origin_ns;                   // keeps t0/t1 small enough for double precision
+    int running;
+} pwar_dll_t;
+
+void pwar_dll_init(pwar_dll_t *dll, double bandwidth);
+
+// Restarts the loop at now_ns for periods of n frames at the given rate.
+void pwar_dll_reset(pwar_dll_t *dll, uint64_t now_ns, uint32_t frames, uint32_t rate);
+
+// One period arrived at now_ns. Starts the loop if it is not running.
+void pwar_dll_update(pwar_dll_t *dll, uint64_t now_ns, uint32_t frames, uint32_t rate);
+
+// Smoothed start of the current and the next period, in ns of the input clock
+uint64_t pwar_dll_period_ns(const pwar_dll_t *dll);
+uint64_t pwar_dll_next_ns(const pwar_dll_t *dll);
+
+// Measured period over the nominal one; > 1 when the remote runs slow
+double pwar_dll_rate_ratio(const pwar_dll_t *dll);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_DLL */
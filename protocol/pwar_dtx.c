@@ -0,0 +1,179 @@
+/*
+ * pwar_dtx.c - Discontinuous transmission of silent channels for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "pwar_dtx.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PWAR_DTX_SSE2 1
+#endif
+
+float pwar_dtx_level(double db) {
+    return (float)pow(10.0, db / 20.0);
+}
+
+int pwar_dtx_is_silent(const float *s, uint32_t n, float threshold) {
+    uint32_t i = 0;
+#ifdef PWAR_DTX_SSE2
+    // Clear the sign bits and compare eight samples per step, checking the
+    // result once at the end; silent periods are the common case.
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 thr = _mm_set1_ps(threshold);
+    __m128 loud = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_and_ps(_mm_loadu_ps(s + i), abs_mask);
+        __m128 b = _mm_and_ps(_mm_loadu_ps(s + i + 4), abs_mask);
+        loud = _mm_or_ps(loud, _mm_or_ps(_mm_cmpge_ps(a, thr), _mm_cmpge_ps(b, thr)));
+    }
+    if (_mm_movemask_ps(loud))
+        return 0;
+#endif
+    for (; i < n; ++i) {
+        if (fabsf(s[i]) >= threshold)
+            return 0;
+    }
+    return 1;
+}
+
+size_t pwar_dtx_encode(const rt_stream_packet_t *pkt, uint32_t channels, float threshold,
+                       void *buf, uint32_t *silent) {
+    return pwar_dtx_encode_format(pkt, channels, threshold, PWAR_FORMAT_F32, buf, silent);
+}
+
+size_t pwar_dtx_encode_format(const rt_stream_packet_t *pkt, uint32_t channels, float threshold,
+                              enum pwar_sample_format format, void *buf, uint32_t *silent) {
+    const float *src[PWAR_DTX_CHANNELS] = { pkt->samples_ch1, pkt->samples_ch2 };
+    struct pwar_dtx_header hdr;
+    uint32_t n = pkt->n_samples;
+    if (n > RT_STREAM_PACKET_FRAME_SIZE / 2)
+        n = RT_STREAM_PACKET_FRAME_SIZE / 2;
+    if (channels > PWAR_DTX_CHANNELS)
+        channels = PWAR_DTX_CHANNELS;
+    hdr.magic = PWAR_DTX_MAGIC;
+    hdr.n_samples = (uint16_t)n;
+    hdr.channels = (uint8_t)channels;
+    hdr.active = 0;
+    hdr.session = pkt->session;
+    hdr.format = (uint8_t)format;
+    hdr.copy = 0;
+    hdr.reserved = 0;
+    hdr.seq = pkt->seq;
+    hdr.ts_pipewire_send = pkt->ts_pipewire_send;
+    hdr.ts_asio_recv = pkt->ts_asio_recv;
+    hdr.ts_asio_send = pkt->ts_asio_send;
+
+    uint8_t *p = (uint8_t *)buf + sizeof(hdr);
+    size_t bytes = n * pwar_kernel_sample_size(format);
+    pwar_kernel_t k;
+    if (format != PWAR_FORMAT_F32)
+        pwar_kernel_generic(&k, 1, n, 0, format);
+    uint32_t left_out = 0;
+    for (uint32_t ch = 0; ch < channels; ++ch) {
+        if (threshold > 0.0f && pwar_dtx_is_silent(src[ch], n, threshold)) {
+            left_out++;
+            continue;
+        }
+        hdr.active |= (uint8_t)(1u << ch);
+        if (format == PWAR_FORMAT_F32)
+            memcpy(p, src[ch], bytes);
+        else
+            k.encode(&k, &src[ch], p);
+        p += bytes;
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    if (silent)
+        *silent = left_out;
+    return (size_t)(p - (uint8_t *)buf);
+}
+
+int pwar_dtx_is_dtx(const void *buf, size_t len) {
+    uint32_t magic;
+    if (len < sizeof(struct pwar_dtx_header))
+        return 0;
+    memcpy(&magic, buf, sizeof(magic));
+    return magic == PWAR_DTX_MAGIC;
+}
+
+size_t pwar_dtx_size(const void *buf, size_t len) {
+    struct pwar_dtx_header hdr;
+    if (!pwar_dtx_is_dtx(buf, len))
+        return 0;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.n_samples > RT_STREAM_PACKET_FRAME_SIZE / 2 || hdr.channels > PWAR_DTX_CHANNELS ||
+        hdr.format >= PWAR_FORMAT_COUNT)
+        return 0;
+    size_t size = sizeof(hdr);
+    for (uint32_t ch = 0; ch < hdr.channels; ++ch) {
+        if (hdr.active & (1u << ch))
+            size += hdr.n_samples * pwar_kernel_sample_size((enum pwar_sample_format)hdr.format);
+    }
+    return size <= len ? size : 0;
+}
+
+void pwar_dtx_noise_init(pwar_dtx_noise_t *noise, float level) {
+    noise->level = level;
+    noise->state = 0x9e3779b9u;
+}
+
+// White noise from a xorshift generator, uniform in [-level, level)
+static void fill_noise(pwar_dtx_noise_t *noise, float *out, uint32_t n) {
+    const float scale = noise->level * (2.0f / 4294967296.0f);
+    uint32_t x = noise->state;
+    for (uint32_t i = 0; i < n; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = (float)x * scale - noise->level;
+    }
+    noise->state = x;
+}
+
+int pwar_dtx_decode(const void *buf, size_t len, rt_stream_packet_t *pkt, pwar_dtx_noise_t *noise) {
+    float *dst[PWAR_DTX_CHANNELS] = { pkt->samples_ch1, pkt->samples_ch2 };
+    struct pwar_dtx_header hdr;
+    if (!pwar_dtx_is_dtx(buf, len))
+        return -1;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (hdr.n_samples > RT_STREAM_PACKET_FRAME_SIZE / 2 || hdr.channels > PWAR_DTX_CHANNELS ||
+        hdr.format >= PWAR_FORMAT_COUNT)
+        return -1;
+
+    const uint8_t *p = (const uint8_t *)buf + sizeof(hdr);
+    enum pwar_sample_format format = (enum pwar_sample_format)hdr.format;
+    size_t bytes = hdr.n_samples * pwar_kernel_sample_size(format);
+    pwar_kernel_t k;
+    if (format != PWAR_FORMAT_F32)
+        pwar_kernel_generic(&k, 1, hdr.n_samples, 0, format);
+    int silent = 0;
+    pkt->n_samples = hdr.n_samples;
+    pkt->session = hdr.session;
+    pkt->seq = hdr.seq;
+    pkt->ts_pipewire_send = hdr.ts_pipewire_send;
+    pkt->ts_asio_recv = hdr.ts_asio_recv;
+    pkt->ts_asio_send = hdr.ts_asio_send;
+    for (uint32_t ch = 0; ch < PWAR_DTX_CHANNELS; ++ch) {
+        if (ch < hdr.channels && (hdr.active & (1u << ch))) {
+            if ((size_t)(p - (const uint8_t *)buf) + bytes > len)
+                return -1;
+            if (format == PWAR_FORMAT_F32)
+                memcpy(dst[ch], p, bytes);
+            else
+                k.decode(&k, p, &dst[ch]);
+            p += bytes;
+        } else {
+            if (ch < hdr.channels)
+                silent++;
+            if (noise && noise->level > 0 && ch < hdr.channels)
+                fill_noise(noise, dst[ch], hdr.n_samples);
+            else
+                memset(dst[ch], 0, hdr.n_samples * sizeof(float));
+        }
+    }
+    return silent;
+}
@@ -0,0 +1,99 @@
+/*
+ * pwar_dtx.h - Discontinuous transmission of silent channels for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * A DTX packet is a small header followed by the samples of the channels
+ * that are not silent, n_samples floats each. Silent channels are only a
+ * cleared bit in the header's active map; the receiver fills them with
+ * zeros, or with comfort noise when configured. The header starts with a
+ * magic that can never be the n_samples of a full rt_stream_packet_t, so
+ * receivers take both and senders opt in.
+ *
+ * The samples are floats unless the header's format says otherwise (see
+ * pwar_adapt.h); senders that predate it leave the field at 0, which is
+ * PWAR_FORMAT_F32. copy numbers the redundant copies of a period, 0 for
+ * the first; receivers keep whichever arrives first.
+ */
+
+#ifndef PWAR_DTX
+#define PWAR_DTX
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pwar_packet.h"
+#include "pwar_kernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_DTX_MAGIC 0x58445750u        // "PWDX" on the (little endian) wire
+#define PWAR_DTX_CHANNELS 2
+#define PWAR_DTX_DEFAULT_THRESHOLD_DB -90.0
+
+struct pwar_dtx_header {
+    uint32_t magic;
+    uint16_t n_samples;
+    uint8_t channels;                     // channels in the period
+    uint8_t active;                       // bit c set: channel c follows
+    uint32_t session;
+    uint8_t format;                       // enum pwar_sample_format of the samples
+    uint8_t copy;
+    uint16_t reserved;
+    uint64_t seq;
+    uint64_t ts_pipewire_send;
+    uint64_t ts_asio_recv;
+    uint64_t ts_asio_send;
+};
+
+#define PWAR_DTX_MAX_PACKET (sizeof(struct pwar_dtx_header) + \
+    PWAR_DTX_CHANNELS * (RT_STREAM_PACKET_FRAME_SIZE / 2) * sizeof(float))
+
+// Comfort noise for silent channels; level 0 gives exact zeros
+typedef struct {
+    float level;
+    uint32_t state;
+} pwar_dtx_noise_t;
+
+// Linear amplitude of a dBFS threshold or noise level
+float pwar_dtx_level(double db);
+
+// True when no sample of s reaches threshold in magnitude. Uses SSE where
+// the target has it.
+int pwar_dtx_is_silent(const float *s, uint32_t n, float threshold);
+
+// Writes pkt with its first channels channels to buf, which must hold
+// PWAR_DTX_MAX_PACKET bytes. Returns the bytes to send; *silent is set to
+// the number of channels left out when not NULL.
+size_t pwar_dtx_encode(const rt_stream_packet_t *pkt, uint32_t channels, float threshold,
+                       void *buf, uint32_t *silent);
+
+// The same with the samples packed in format. A threshold of 0 keeps
+// every channel.
+size_t pwar_dtx_encode_format(const rt_stream_packet_t *pkt, uint32_t channels, float threshold,
+                              enum pwar_sample_format format, void *buf, uint32_t *silent);
+
+// Marks an encoded packet as the copy-th copy of its period
+static inline void pwar_dtx_set_copy(void *buf, uint32_t copy) {
+    ((struct pwar_dtx_header *)buf)->copy = (uint8_t)copy;
+}
+
+int pwar_dtx_is_dtx(const void *buf, size_t len);
+
+// Bytes of the DTX packet at the start of buf, 0 when it is malformed.
+// Anything after it in the datagram is a trailer, see pwar_midi.h.
+size_t pwar_dtx_size(const void *buf, size_t len);
+
+void pwar_dtx_noise_init(pwar_dtx_noise_t *noise, float level);
+
+// Fills pkt from a DTX packet. Returns the number of silent channels, or -1
+// when the packet is malformed.
+int pwar_dtx_decode(const void *buf, size_t len, rt_stream_packet_t *pkt, pwar_dtx_noise_t *noise);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_DTX */
@@ -0,0 +1,263 @@
+/*
+ * pwar_kernels.c - Packet payload kernels specialised per shape for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Every kernel is one of the *_body functions below. The specialised ones
+ * call it with constant channel and frame counts and format, so after
+ * inlining the compiler sees fixed trip counts and fixed memcpy sizes; the
+ * generic ones pass the shape through at run time.
+ */
+
+#include <string.h>
+#include "pwar_kernels.h"
+
+#if defined(_MSC_VER)
+#define PWAR_KERNEL_INLINE static __forceinline
+#define PWAR_KERNEL_NOINLINE static __declspec(noinline)
+#else
+#define PWAR_KERNEL_INLINE static inline __attribute__((always_inline))
+#define PWAR_KERNEL_NOINLINE static __attribute__((noinline))
+#endif
+
+// Up to this many bytes a fixed size copy expanded inline wins; above it
+// the library's vectorised memcpy is faster than what gets expanded.
+#define PWAR_KERNEL_INLINE_BYTES 256
+
+// Shapes with their own kernels, for each format
+#define PWAR_KERNEL_CHANNELS(X, N, F) X(1, N, F) X(2, N, F) X(8, N, F) X(16, N, F) X(32, N, F)
+#define PWAR_KERNEL_SHAPES(X, F) \
+    PWAR_KERNEL_CHANNELS(X, 32, F) PWAR_KERNEL_CHANNELS(X, 64, F) \
+    PWAR_KERNEL_CHANNELS(X, 128, F) PWAR_KERNEL_CHANNELS(X, 256, F)
+
+PWAR_KERNEL_INLINE int16_t to_s16(float v) {
+    v *= 32767.0f;
+    v = v > 32767.0f ? 32767.0f : v;
+    v = v < -32767.0f ? -32767.0f : v;
+    return (int16_t)v;
+}
+
+PWAR_KERNEL_INLINE void to_s24(uint8_t *d, float v) {
+    v *= 8388607.0f;
+    v = v > 8388607.0f ? 8388607.0f : v;
+    v = v < -8388607.0f ? -8388607.0f : v;
+    uint32_t x = (uint32_t)(int32_t)v;
+    d[0] = (uint8_t)x;
+    d[1] = (uint8_t)(x >> 8);
+    d[2] = (uint8_t)(x >> 16);
+}
+
+PWAR_KERNEL_INLINE float from_s24(const uint8_t *s) {
+    // Into the top 24 bits, so the shift back down extends the sign
+    int32_t x = (int32_t)(((uint32_t)s[0] << 8) | ((uint32_t)s[1] << 16) | ((uint32_t)s[2] << 24));
+    return (x >> 8) * (1.0f / 8388607.0f);
+}
+
+PWAR_KERNEL_NOINLINE void copy_bytes(void *dst, const void *src, size_t n) {
+    memcpy(dst, src, n);
+}
+
+PWAR_KERNEL_NOINLINE void zero_bytes(void *dst, size_t n) {
+    memset(dst, 0, n);
+}
+
+PWAR_KERNEL_INLINE void copy_floats(float *dst, const float *src, uint32_t frames) {
+    if (frames * sizeof(float) <= PWAR_KERNEL_INLINE_BYTES)
+        memcpy(dst, src, frames * sizeof(float));
+    else
+        copy_bytes(dst, src, frames * sizeof(float));
+}
+
+PWAR_KERNEL_INLINE void zero_floats(float *dst, uint32_t frames) {
+    if (frames * sizeof(float) <= PWAR_KERNEL_INLINE_BYTES)
+        memset(dst, 0, frames * sizeof(float));
+    else
+        zero_bytes(dst, frames * sizeof(float));
+}
+
+PWAR_KERNEL_INLINE void encode_body(const float *const *src, void *payload, uint32_t channels,
+                                    uint32_t frames, uint32_t stride, enum pwar_sample_format format) {
+    for (uint32_t c = 0; c < channels; ++c) {
+        const float *s = src[c];
+        if (format == PWAR_FORMAT_F32) {
+            float *d = (float *)payload + (size_t)c * stride;
+            if (s)
+                copy_floats(d, s, frames);
+            else
+                zero_floats(d, frames);
+        } else if (format == PWAR_FORMAT_S16) {
+            int16_t *d = (int16_t *)payload + (size_t)c * stride;
+            if (s) {
+                for (uint32_t i = 0; i < frames; ++i)
+                    d[i] = to_s16(s[i]);
+            } else {
+                memset(d, 0, frames * sizeof(int16_t));
+            }
+        } else {
+            uint8_t *d = (uint8_t *)payload + (size_t)c * stride * 3;
+            if (s) {
+                for (uint32_t i = 0; i < frames; ++i)
+                    to_s24(d + 3 * i, s[i]);
+            } else {
+                memset(d, 0, frames * 3);
+            }
+        }
+    }
+}
+
+PWAR_KERNEL_INLINE void decode_body(const void *payload, float *const *dst, uint32_t channels,
+                                    uint32_t frames, uint32_t stride, enum pwar_sample_format format) {
+    for (uint32_t c = 0; c < channels; ++c) {
+        float *d = dst[c];
+        if (!d)
+            continue;
+        if (format == PWAR_FORMAT_F32) {
+            copy_floats(d, (const float *)payload + (size_t)c * stride, frames);
+        } else if (format == PWAR_FORMAT_S16) {
+            const int16_t *s = (const int16_t *)payload + (size_t)c * stride;
+            for (uint32_t i = 0; i < frames; ++i)
+                d[i] = s[i] * (1.0f / 32767.0f);
+        } else {
+            const uint8_t *s = (const uint8_t *)payload + (size_t)c * stride * 3;
+            for (uint32_t i = 0; i < frames; ++i)
+                d[i] = from_s24(s + 3 * i);
+        }
+    }
+}
+
+PWAR_KERNEL_INLINE void copy_body(const float *const *src, float *const *dst, uint32_t channels, uint32_t frames) {
+    for (uint32_t c = 0; c < channels; ++c) {
+        if (!dst[c])
+            continue;
+        if (src[c])
+            copy_floats(dst[c], src[c], frames);
+        else
+            zero_floats(dst[c], frames);
+    }
+}
+
+PWAR_KERNEL_INLINE void zero_body(float *const *dst, uint32_t channels, uint32_t frames) {
+    for (uint32_t c = 0; c < channels; ++c) {
+        if (dst[c])
+            zero_floats(dst[c], frames);
+    }
+}
+
+#define PWAR_KERNEL_DEFINE(C, N, F) \
+    static void encode_##F##_##C##x##N(const pwar_kernel_t *k, const float *const *src, void *payload) { \
+        encode_body(src, payload, C, N, k->stride, PWAR_FORMAT_##F); \
+    } \
+    static void decode_##F##_##C##x##N(const pwar_kernel_t *k, const void *payload, float *const *dst) { \
+        decode_body(payload, dst, C, N, k->stride, PWAR_FORMAT_##F); \
+    } \
+    static void copy_##F##_##C##x##N(const pwar_kernel_t *k, const float *const *src, float *const *dst) { \
+        (void)k; \
+        copy_body(src, dst, C, N); \
+    } \
+    static void zero_##F##_##C##x##N(const pwar_kernel_t *k, float *const *dst) { \
+        (void)k; \
+        zero_body(dst, C, N); \
+    }
+
+PWAR_KERNEL_SHAPES(PWAR_KERNEL_DEFINE, F32)
+PWAR_KERNEL_SHAPES(PWAR_KERNEL_DEFINE, S16)
+PWAR_KERNEL_SHAPES(PWAR_KERNEL_DEFINE, S24)
+
+#define PWAR_KERNEL_GENERIC(F) \
+    static void encode_##F##_generic(const pwar_kernel_t *k, const float *const *src, void *payload) { \
+        encode_body(src, payload, k->channels, k->frames, k->stride, PWAR_FORMAT_##F); \
+    } \
+    static void decode_##F##_generic(const pwar_kernel_t *k, const void *payload, float *const *dst) { \
+        decode_body(payload, dst, k->channels, k->frames, k->stride, PWAR_FORMAT_##F); \
+    }
+
+PWAR_KERNEL_GENERIC(F32)
+PWAR_KERNEL_GENERIC(S16)
+PWAR_KERNEL_GENERIC(S24)
+
+static void copy_generic(const pwar_kernel_t *k, const float *const *src, float *const *dst) {
+    copy_body(src, dst, k->channels, k->frames);
+}
+
+static void zero_generic(const pwar_kernel_t *k, float *const *dst) {
+    zero_body(dst, k->channels, k->frames);
+}
+
+struct pwar_kernel_entry {
+    uint32_t channels;
+    uint32_t frames;
+    enum pwar_sample_format format;
+    void (*encode)(const pwar_kernel_t *, const float *const *, void *);
+    void (*decode)(const pwar_kernel_t *, const void *, float *const *);
+    void (*copy)(const pwar_kernel_t *, const float *const *, float *const *);
+    void (*zero)(const pwar_kernel_t *, float *const *);
+};
+
+#define PWAR_KERNEL_ENTRY(C, N, F) \
+    { C, N, PWAR_FORMAT_##F, encode_##F##_##C##x##N, decode_##F##_##C##x##N, \
+      copy_##F##_##C##x##N, zero_##F##_##C##x##N },
+
+static const struct pwar_kernel_entry kernels[] = {
+    PWAR_KERNEL_SHAPES(PWAR_KERNEL_ENTRY, F32)
+    PWAR_KERNEL_SHAPES(PWAR_KERNEL_ENTRY, S16)
+    PWAR_KERNEL_SHAPES(PWAR_KERNEL_ENTRY, S24)
+};
+
+uint32_t pwar_kernel_sample_size(enum pwar_sample_format format) {
+    switch (format) {
+    case PWAR_FORMAT_S16: return sizeof(int16_t);
+    case PWAR_FORMAT_S24: return 3;
+    default: return sizeof(float);
+    }
+}
+
+const char *pwar_kernel_format_name(enum pwar_sample_format format) {
+    switch (format) {
+    case PWAR_FORMAT_F32: return "f32";
+    case PWAR_FORMAT_S16: return "s16";
+    case PWAR_FORMAT_S24: return "s24";
+    default: return "?";
+    }
+}
+
+void pwar_kernel_generic(pwar_kernel_t *k, uint32_t channels, uint32_t frames, uint32_t stride,
+                         enum pwar_sample_format format) {
+    k->channels = channels;
+    k->frames = frames;
+    k->stride = stride ? stride : frames;
+    k->format = format;
+    k->specialised = 0;
+    switch (format) {
+    case PWAR_FORMAT_S16:
+        k->encode = encode_S16_generic;
+        k->decode = decode_S16_generic;
+        break;
+    case PWAR_FORMAT_S24:
+        k->encode = encode_S24_generic;
+        k->decode = decode_S24_generic;
+        break;
+    default:
+        k->encode = encode_F32_generic;
+        k->decode = decode_F32_generic;
+        break;
+    }
+    k->copy = copy_generic;
+    k->zero = zero_generic;
+}
+
+void pwar_kernel_select(pwar_kernel_t *k, uint32_t channels, uint32_t frames, uint32_t stride,
+                        enum pwar_sample_format format) {
+    pwar_kernel_generic(k, channels, frames, stride, format);
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+        const struct pwar_kernel_entry *e = &kernels[i];
+        if (e->channels == channels && e->frames == frames && e->format == format) {
+            k->encode = e->encode;
+            k->decode = e->decode;
+            k->copy = e->copy;
+            k->zero = e->zero;
+            k->specialised = 1;
+            return;
+        }
+    }
+}
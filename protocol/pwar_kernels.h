@@ -0,0 +1,71 @@
+/*
+ * pwar_kernels.h - Packet payload kernels specialised per shape for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * A payload holds the frames of each channel one channel after the other,
+ * channel c starting stride samples after channel c - 1 (for
+ * rt_stream_packet_t, stride is RT_STREAM_PACKET_FRAME_SIZE / 2 and the
+ * channels are samples_ch1 and samples_ch2). The kernels move audio between
+ * planar float buffers and a payload.
+ *
+ * At 32 and 64 frame periods the loop overhead of a generic copy is a real
+ * share of the cycle, so the common shapes get versions with the channel
+ * and frame counts and the sample format fixed at compile time. Anything
+ * else falls back to the generic version. The kernel is picked once, when
+ * the stream's shape is known, and called through its function pointers
+ * from then on.
+ */
+
+#ifndef PWAR_KERNELS
+#define PWAR_KERNELS
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum pwar_sample_format {
+    PWAR_FORMAT_F32,                      // native floats, what the wire carries today
+    PWAR_FORMAT_S16,                      // 16 bit, clipped
+    PWAR_FORMAT_S24,                      // 24 bit packed in 3 bytes, little endian, clipped
+    PWAR_FORMAT_COUNT
+};
+
+typedef struct pwar_kernel pwar_kernel_t;
+
+struct pwar_kernel {
+    uint32_t channels;
+    uint32_t frames;
+    uint32_t stride;                      // samples from one channel's start to the next
+    enum pwar_sample_format format;
+    int specialised;                      // 0 for the generic fallback
+
+    // src[ch] == NULL packs silence, dst[ch] == NULL skips the channel
+    void (*encode)(const pwar_kernel_t *k, const float *const *src, void *payload);
+    void (*decode)(const pwar_kernel_t *k, const void *payload, float *const *dst);
+    void (*copy)(const pwar_kernel_t *k, const float *const *src, float *const *dst);
+    void (*zero)(const pwar_kernel_t *k, float *const *dst);
+};
+
+// Picks the kernel for a shape; always succeeds, the generic one covers
+// every shape. stride 0 packs the channels back to back.
+void pwar_kernel_select(pwar_kernel_t *k, uint32_t channels, uint32_t frames, uint32_t stride,
+                        enum pwar_sample_format format);
+
+// The generic kernel for a shape, for comparison
+void pwar_kernel_generic(pwar_kernel_t *k, uint32_t channels, uint32_t frames, uint32_t stride,
+                         enum pwar_sample_format format);
+
+// Bytes per sample of a format
+uint32_t pwar_kernel_sample_size(enum pwar_sample_format format);
+
+const char *pwar_kernel_format_name(enum pwar_sample_format format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_KERNELS */
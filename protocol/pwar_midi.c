@@ -0,0 +1,158 @@
+/*
+ * pwar_midi.c - Sample accurate MIDI alongside the PWAR audio stream
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "pwar_midi.h"
+#include "pwar_dtx.h"
+#include "pwar_packet.h"
+
+#define EVENT_HEADER 3                    // offset and size in front of the bytes
+
+int pwar_midi_add(pwar_midi_block_t *b, uint32_t offset, const uint8_t *data, uint32_t size) {
+    if (b->count >= PWAR_MIDI_MAX_EVENTS || !size || size > PWAR_MIDI_MAX_EVENT_SIZE || offset > 0xffff) {
+        b->dropped++;
+        return -1;
+    }
+    // Sources deliver in order, so this rarely moves anything
+    uint32_t i = b->count;
+    while (i > 0 && b->events[i - 1].offset > offset) {
+        b->events[i] = b->events[i - 1];
+        --i;
+    }
+    pwar_midi_event_t *ev = &b->events[i];
+    ev->offset = (uint16_t)offset;
+    ev->size = (uint16_t)size;
+    memcpy(ev->data, data, size);
+    b->count++;
+    return 0;
+}
+
+void pwar_midi_append(pwar_midi_block_t *b, const pwar_midi_block_t *src, uint32_t shift) {
+    for (uint32_t i = 0; i < src->count; ++i) {
+        const pwar_midi_event_t *ev = &src->events[i];
+        pwar_midi_add(b, ev->offset + shift, ev->data, ev->size);
+    }
+    b->dropped += src->dropped;
+}
+
+void pwar_midi_copy(pwar_midi_block_t *dst, const pwar_midi_block_t *src) {
+    dst->count = src->count;
+    dst->dropped = src->dropped;
+    memcpy(dst->events, src->events, src->count * sizeof(src->events[0]));
+}
+
+size_t pwar_midi_size(const pwar_midi_block_t *b, uint32_t first) {
+    if (first >= b->count)
+        return 0;
+    size_t size = sizeof(struct pwar_midi_header);
+    for (uint32_t i = first; i < b->count; ++i)
+        size += EVENT_HEADER + b->events[i].size;
+    return size;
+}
+
+size_t pwar_midi_encode(const pwar_midi_block_t *b, uint32_t *first, uint32_t session, uint64_t seq,
+                        void *buf, size_t cap) {
+    uint32_t i = *first;
+    if (i >= b->count || cap < sizeof(struct pwar_midi_header) + EVENT_HEADER + b->events[i].size)
+        return 0;
+    uint8_t *start = (uint8_t *)buf;
+    uint8_t *p = start + sizeof(struct pwar_midi_header);
+    for (; i < b->count; ++i) {
+        const pwar_midi_event_t *ev = &b->events[i];
+        if ((size_t)(p - start) + EVENT_HEADER + ev->size > cap)
+            break;
+        memcpy(p, &ev->offset, sizeof(ev->offset));
+        p[2] = (uint8_t)ev->size;
+        memcpy(p + EVENT_HEADER, ev->data, ev->size);
+        p += EVENT_HEADER + ev->size;
+    }
+    struct pwar_midi_header hdr;
+    hdr.magic = PWAR_MIDI_MAGIC;
+    hdr.count = (uint16_t)(i - *first);
+    hdr.bytes = (uint16_t)(p - start - sizeof(hdr));
+    hdr.session = session;
+    hdr.reserved = 0;
+    hdr.seq = seq;
+    memcpy(start, &hdr, sizeof(hdr));
+    *first = i;
+    return (size_t)(p - start);
+}
+
+int pwar_midi_is_midi(const void *buf, size_t len) {
+    uint32_t magic;
+    if (len < sizeof(struct pwar_midi_header))
+        return 0;
+    memcpy(&magic, buf, sizeof(magic));
+    return magic == PWAR_MIDI_MAGIC;
+}
+
+int pwar_midi_decode(const void *buf, size_t len, uint64_t *seq, pwar_midi_block_t *b) {
+    struct pwar_midi_header hdr;
+    if (!pwar_midi_is_midi(buf, len))
+        return -1;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (sizeof(hdr) + hdr.bytes > len)
+        return -1;
+    const uint8_t *p = (const uint8_t *)buf + sizeof(hdr);
+    const uint8_t *end = p + hdr.bytes;
+    for (uint32_t n = 0; n < hdr.count; ++n) {
+        uint16_t offset;
+        if (end - p < EVENT_HEADER || end - p < EVENT_HEADER + p[2])
+            return -1;
+        memcpy(&offset, p, sizeof(offset));
+        pwar_midi_add(b, offset, p + EVENT_HEADER, p[2]);
+        p += EVENT_HEADER + p[2];
+    }
+    if (seq)
+        *seq = hdr.seq;
+    return hdr.count;
+}
+
+void pwar_midi_rx_init(pwar_midi_rx_t *rx) {
+    pwar_midi_clear(&rx->pending);
+    rx->pending_seq = 0;
+    rx->lost = 0;
+}
+
+size_t pwar_midi_receive(pwar_midi_rx_t *rx, const void *buf, size_t len, pwar_midi_block_t *out) {
+    uint64_t seq;
+    size_t audio;
+    pwar_midi_clear(out);
+    if (pwar_midi_is_midi(buf, len)) {
+        struct pwar_midi_header hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        if (rx->pending.count && rx->pending_seq != hdr.seq) {
+            rx->lost += rx->pending.count;
+            pwar_midi_clear(&rx->pending);
+        }
+        rx->pending_seq = hdr.seq;
+        pwar_midi_decode(buf, len, NULL, &rx->pending);
+        return 0;
+    }
+    if (pwar_dtx_is_dtx(buf, len)) {
+        audio = pwar_dtx_size(buf, len);
+        if (!audio)
+            return 0;
+        memcpy(&seq, (const uint8_t *)buf + offsetof(struct pwar_dtx_header, seq), sizeof(seq));
+    } else if (len >= sizeof(rt_stream_packet_t)) {
+        audio = sizeof(rt_stream_packet_t);
+        memcpy(&seq, (const uint8_t *)buf + offsetof(rt_stream_packet_t, seq), sizeof(seq));
+    } else {
+        return 0;
+    }
+    if (rx->pending.count) {
+        if (rx->pending_seq == seq)
+            pwar_midi_copy(out, &rx->pending);
+        else
+            rx->lost += rx->pending.count;
+        pwar_midi_clear(&rx->pending);
+    }
+    if (len > audio)
+        pwar_midi_decode((const uint8_t *)buf + audio, len - audio, NULL, out);
+    return audio;
+}
@@ -0,0 +1,107 @@
+/*
+ * pwar_midi.h - Sample accurate MIDI alongside the PWAR audio stream
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * The MIDI of a period travels as a block of events, each stamped with its
+ * frame offset into the period, so it reaches the other side with exactly
+ * the latency of the audio next to it. The block rides behind the audio in
+ * the same datagram as long as that stays within PWAR_MIDI_MAX_DATAGRAM.
+ * What does not fit goes ahead of the audio in MIDI only datagrams of the
+ * same seq, which the receiver holds until the audio arrives.
+ *
+ * A block starts with a magic that is neither a DTX magic nor the n_samples
+ * of a full rt_stream_packet_t, so receivers that do not know about MIDI
+ * ignore the trailer and drop MIDI only datagrams.
+ */
+
+#ifndef PWAR_MIDI
+#define PWAR_MIDI
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_MIDI_MAGIC 0x494d5750u       // "PWMI" on the (little endian) wire
+#define PWAR_MIDI_MAX_EVENTS 64           // per period, more are dropped and counted
+#define PWAR_MIDI_MAX_EVENT_SIZE 32       // longer SysEx is dropped and counted
+#define PWAR_MIDI_MAX_DATAGRAM 1472       // an Ethernet frame's UDP payload, no fragments
+
+typedef struct {
+    uint16_t offset;                      // frame into the period
+    uint16_t size;
+    uint8_t data[PWAR_MIDI_MAX_EVENT_SIZE];
+} pwar_midi_event_t;
+
+// Events are kept in offset order, events at the same offset in the order
+// they were added.
+typedef struct {
+    uint32_t count;
+    uint32_t dropped;                     // since the last clear
+    pwar_midi_event_t events[PWAR_MIDI_MAX_EVENTS];
+} pwar_midi_block_t;
+
+// On the wire each event is a 16 bit offset, an 8 bit size and the bytes
+struct pwar_midi_header {
+    uint32_t magic;
+    uint16_t count;
+    uint16_t bytes;                       // of events after the header
+    uint32_t session;
+    uint32_t reserved;
+    uint64_t seq;                         // the period the events belong to
+};
+
+// Receive side state, one per socket
+typedef struct {
+    pwar_midi_block_t pending;            // from MIDI only datagrams, waiting for their audio
+    uint64_t pending_seq;
+    uint64_t lost;                        // events whose audio never came
+} pwar_midi_rx_t;
+
+static inline void pwar_midi_clear(pwar_midi_block_t *b) {
+    b->count = 0;
+    b->dropped = 0;
+}
+
+// Adds one event. Returns -1, and counts it as dropped, when the block is
+// full or the event too long.
+int pwar_midi_add(pwar_midi_block_t *b, uint32_t offset, const uint8_t *data, uint32_t size);
+
+// Adds the events of src to b, moving each one to offset + shift
+void pwar_midi_append(pwar_midi_block_t *b, const pwar_midi_block_t *src, uint32_t shift);
+
+// Copies only the events in use, cheaper than a struct copy
+void pwar_midi_copy(pwar_midi_block_t *dst, const pwar_midi_block_t *src);
+
+// Bytes pwar_midi_encode needs for the events from first on, 0 when none are left
+size_t pwar_midi_size(const pwar_midi_block_t *b, uint32_t first);
+
+// Writes a block with as many of the events from *first on as fit in cap
+// bytes and advances *first past them. Returns the bytes written, 0 when no
+// event is left or none fits.
+size_t pwar_midi_encode(const pwar_midi_block_t *b, uint32_t *first, uint32_t session, uint64_t seq,
+                        void *buf, size_t cap);
+
+int pwar_midi_is_midi(const void *buf, size_t len);
+
+// Adds the events of a block at buf to b and returns their count, or -1 when
+// it is malformed. *seq is set to the block's period when not NULL.
+int pwar_midi_decode(const void *buf, size_t len, uint64_t *seq, pwar_midi_block_t *b);
+
+void pwar_midi_rx_init(pwar_midi_rx_t *rx);
+
+// Handles one received datagram. Returns the bytes of audio it starts with,
+// a full rt_stream_packet_t or a DTX packet, and fills out with the events
+// of that period. Returns 0 for a MIDI only datagram, which is kept for the
+// audio of its period, and for anything malformed.
+size_t pwar_midi_receive(pwar_midi_rx_t *rx, const void *buf, size_t len, pwar_midi_block_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_MIDI */
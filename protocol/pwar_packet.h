@@ -14,9 +14,13 @@
 
 typedef struct {
     uint16_t n_samples;
-    uint64_t seq;
+    uint32_t session;              // the sending peer's session, see pwar_session.h
+    uint64_t seq;                  // session of the numbering peer in the top 32 bits
 
+    // ts_pipewire_send is on the Linux clock, the ts_asio_* stamps on the
+    // ASIO host's clock. See pwar_clock.h for how the two are related.
     uint64_t ts_pipewire_send;     // when PipeWire sends input
+    uint64_t ts_asio_recv;        // when the ASIO side received the input
     uint64_t ts_asio_send;        // when DAW finishes processing and returns
 
     float samples_ch1[RT_STREAM_PACKET_FRAME_SIZE/2];
@@ -0,0 +1,77 @@
+/*
+ * pwar_session.c - Session identity and resynchronisation for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include "pwar_session.h"
+
+uint32_t pwar_session_new_id(uint64_t entropy) {
+    // splitmix64 finaliser, so close entropy values give unrelated ids
+    uint64_t z = entropy + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    uint32_t id = (uint32_t)(z ^ (z >> 32));
+    return id ? id : 1;
+}
+
+void pwar_session_init(pwar_session_t *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+enum pwar_session_event pwar_session_check(pwar_session_t *s, uint32_t session, uint64_t seq) {
+    if (session && session != s->peer) {
+        if (session == s->previous) {
+            s->stale++;
+            return PWAR_SESSION_STALE;
+        }
+        int first = !s->peer;
+        s->previous = s->peer;
+        s->peer = session;
+        s->last_seq = seq;
+        s->have_seq = 1;
+        if (first)
+            return PWAR_SESSION_FIRST;
+        s->restarts++;
+        return PWAR_SESSION_RESTART;
+    }
+
+    if (!s->have_seq) {
+        s->last_seq = seq;
+        s->have_seq = 1;
+        return PWAR_SESSION_FIRST;
+    }
+    // The counter wraps in the bottom half without touching the session
+    int64_t step = PWAR_SESSION_OF(seq) == PWAR_SESSION_OF(s->last_seq) ?
+        (int32_t)((uint32_t)seq - (uint32_t)s->last_seq) : INT64_MAX;
+    if (step == 0) {
+        s->duplicates++;
+        return PWAR_SESSION_DUPLICATE;
+    }
+    if (step < 0 && step >= -PWAR_SESSION_MAX_JUMP) {
+        // Late or reordered, what came after it is already through
+        s->stale++;
+        return PWAR_SESSION_STALE;
+    }
+    s->last_seq = seq;
+    if (step > PWAR_SESSION_MAX_JUMP || step < -PWAR_SESSION_MAX_JUMP) {
+        s->jumps++;
+        return PWAR_SESSION_JUMP;
+    }
+    return PWAR_SESSION_SAME;
+}
+
+const char *pwar_session_event_name(enum pwar_session_event ev) {
+    switch (ev) {
+    case PWAR_SESSION_SAME: return "same";
+    case PWAR_SESSION_FIRST: return "first";
+    case PWAR_SESSION_RESTART: return "restart";
+    case PWAR_SESSION_JUMP: return "jump";
+    case PWAR_SESSION_STALE: return "stale";
+    case PWAR_SESSION_DUPLICATE: return "duplicate";
+    }
+    return "?";
+}
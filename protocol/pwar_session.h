@@ -0,0 +1,73 @@
+/*
+ * pwar_session.h - Session identity and resynchronisation for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Every peer picks a random non-zero session id when it starts streaming
+ * and puts it in each packet it sends. The peer that numbers the periods
+ * also puts its id in the top half of seq, and the other side echoes seq,
+ * so a reply to a previous run of the sender can never be mistaken for a
+ * current one. A new id from the other side means it restarted: whatever
+ * was learned about it is flushed, and packets still in flight from its
+ * previous run are dropped. A seq jump within a session is handled the
+ * same way. A packet a little behind the newest seq seen arrived late or
+ * reordered and is dropped too; the newest seq stays where it was.
+ */
+
+#ifndef PWAR_SESSION
+#define PWAR_SESSION
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_SESSION_MAX_JUMP 256         // periods; a larger seq step is a resync
+
+#define PWAR_SESSION_SEQ(session, n) (((uint64_t)(session) << 32) | (uint32_t)(n))
+#define PWAR_SESSION_OF(seq) ((uint32_t)((seq) >> 32))
+
+enum pwar_session_event {
+    PWAR_SESSION_SAME,                    // nothing to do
+    PWAR_SESSION_FIRST,                   // first packet from the peer
+    PWAR_SESSION_RESTART,                 // the peer came back with a new session
+    PWAR_SESSION_JUMP,                    // seq moved by more than PWAR_SESSION_MAX_JUMP
+    PWAR_SESSION_STALE,                   // from the peer's previous session or behind its newest seq, drop it
+    PWAR_SESSION_DUPLICATE,               // the seq just seen again, a redundant copy: drop it
+};
+
+typedef struct {
+    uint32_t peer;                        // current session of the other side, 0 before the first packet
+    uint32_t previous;
+    uint64_t last_seq;                    // newest seen
+    int have_seq;
+    uint64_t restarts;
+    uint64_t jumps;
+    uint64_t stale;                       // previous session and late ones
+    uint64_t duplicates;
+} pwar_session_t;
+
+// A non-zero id from some entropy, e.g. a clock reading and the process id
+uint32_t pwar_session_new_id(uint64_t entropy);
+
+// The next seq after seq; the counter wraps without touching the session
+static inline uint64_t pwar_session_next(uint64_t seq) {
+    return PWAR_SESSION_SEQ(PWAR_SESSION_OF(seq), (uint32_t)seq + 1);
+}
+
+void pwar_session_init(pwar_session_t *s);
+
+// Classifies a packet carrying the peer's session and seq and tracks it.
+// A session of 0 comes from a peer that does not set one; only seq is
+// checked then.
+enum pwar_session_event pwar_session_check(pwar_session_t *s, uint32_t session, uint64_t seq);
+
+const char *pwar_session_event_name(enum pwar_session_event ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_SESSION */
@@ -0,0 +1,53 @@
+/*
+ * pwar_timeline.c - Sample position and system time stamping for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <string.h>
+#include "pwar_timeline.h"
+
+void pwar_timeline_init(pwar_timeline_t *tl, double bandwidth) {
+    memset(tl, 0, sizeof(*tl));
+    pwar_dll_init(&tl->dll, bandwidth);
+}
+
+void pwar_timeline_reset(pwar_timeline_t *tl) {
+    pwar_timeline_init(tl, tl->dll.bandwidth);
+}
+
+void pwar_timeline_update(pwar_timeline_t *tl, uint64_t seq, uint64_t remote_send_ns,
+                          uint64_t local_ns, uint32_t frames, uint32_t rate) {
+    if (tl->started && seq != tl->next_seq) {
+        // Lost or reordered periods: the remote stamps no longer line up
+        // with whole periods, so the loop locks again from here.
+        tl->dll.running = 0;
+    }
+    tl->next_seq = seq + 1;
+    pwar_dll_update(&tl->dll, remote_send_ns, frames, rate);
+    uint64_t remote = pwar_dll_period_ns(&tl->dll);
+
+    // Arrivals are never early, only late by queueing, so the smallest
+    // difference is the real one. Drops are taken at once, rises slowly to
+    // follow the drift between the two clocks.
+    double offset = (double)(int64_t)(local_ns - remote);
+    if (!tl->have_offset || offset < tl->offset_ns) {
+        tl->offset_ns = offset;
+        tl->have_offset = 1;
+    } else {
+        tl->offset_ns += (offset - tl->offset_ns) * PWAR_TIMELINE_OFFSET_RISE;
+    }
+    uint64_t system_ns = remote + (uint64_t)(int64_t)tl->offset_ns;
+
+    if (!tl->started) {
+        tl->position = 0;
+        tl->system_ns = system_ns;
+        tl->started = 1;
+    } else {
+        tl->position += tl->frames;
+        // An offset drop can pull the stamp back; time only moves forward
+        tl->system_ns = system_ns > tl->system_ns ? system_ns : tl->system_ns + 1;
+    }
+    tl->frames = frames;
+}
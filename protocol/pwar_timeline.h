@@ -0,0 +1,54 @@
+/*
+ * pwar_timeline.h - Sample position and system time stamping for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Packet arrival times carry the network's jitter, the sender's
+ * ts_pipewire_send stamps do not: they come from the Linux graph clock.
+ * A DLL smooths those remote stamps into a clean period timeline, and the
+ * lower envelope of arrival minus smoothed send time maps it onto the
+ * local clock, so each period start gets a local time that follows the
+ * remote rate without the jitter the packet picked up on the way.
+ */
+
+#ifndef PWAR_TIMELINE
+#define PWAR_TIMELINE
+
+#include <stdint.h>
+#include "pwar_dll.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_TIMELINE_OFFSET_RISE 0.01    // per period, how fast the offset follows a later arrival
+
+typedef struct {
+    pwar_dll_t dll;                       // on the remote send stamps
+    double offset_ns;                     // local arrival minus smoothed remote send, lower envelope
+    int have_offset;
+    uint64_t next_seq;
+    uint64_t position;                    // first frame of the current period
+    uint64_t system_ns;                   // local time of position
+    uint32_t frames;                      // frames in the current period
+    int started;
+} pwar_timeline_t;
+
+void pwar_timeline_init(pwar_timeline_t *tl, double bandwidth);
+
+// Starts over at position 0, for a new stream
+void pwar_timeline_reset(pwar_timeline_t *tl);
+
+// Stamps the period seq, sent at remote_send_ns on the remote clock and
+// received at local_ns. Afterwards position/system_ns describe its first
+// frame. system_ns never goes backwards; a seq gap restarts the DLL but
+// keeps the position counting.
+void pwar_timeline_update(pwar_timeline_t *tl, uint64_t seq, uint64_t remote_send_ns,
+                          uint64_t local_ns, uint32_t frames, uint32_t rate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_TIMELINE */
@@ -0,0 +1,154 @@
+/*
+ * pwar_trace.c - Per-cycle timeline tracing for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+#include "pwar_trace.h"
+
+#ifdef _WIN32
+uint64_t pwar_trace_now(void) {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (uint64_t)t.QuadPart;
+}
+
+static double ticks_to_us(uint64_t ticks) {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return (double)ticks * 1e6 / (double)f.QuadPart;
+}
+
+static uint32_t next_ring(struct pwar_trace *trace) {
+    return (uint32_t)InterlockedIncrement((volatile LONG *)&trace->n_rings) - 1;
+}
+
+static uint32_t load_rings(struct pwar_trace *trace) {
+    return *(volatile uint32_t *)&trace->n_rings;
+}
+#else
+static double ticks_to_us(uint64_t ticks) {
+    return ticks / 1000.0;
+}
+
+static uint32_t next_ring(struct pwar_trace *trace) {
+    return __atomic_fetch_add(&trace->n_rings, 1, __ATOMIC_ACQ_REL);
+}
+
+static uint32_t load_rings(struct pwar_trace *trace) {
+    return __atomic_load_n(&trace->n_rings, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static const char *const point_names[PWAR_TRACE_POINT_COUNT] = {
+    [PWAR_TRACE_PROCESS_BEGIN] = "process",
+    [PWAR_TRACE_PROCESS_END] = "process",
+    [PWAR_TRACE_SEND] = "send",
+    [PWAR_TRACE_WAIT_BEGIN] = "wait",
+    [PWAR_TRACE_WAIT_END] = "wait",
+    [PWAR_TRACE_OUTPUT_WRITE] = "output write",
+    [PWAR_TRACE_REPLY_RECV] = "reply received",
+    [PWAR_TRACE_ASIO_RECV] = "receive",
+    [PWAR_TRACE_ASIO_SWITCH_BEGIN] = "bufferSwitch",
+    [PWAR_TRACE_ASIO_SWITCH_END] = "bufferSwitch",
+    [PWAR_TRACE_ASIO_REPLY_SEND] = "reply send",
+};
+
+// Chrome phase: B and E open and close a slice, i is an instant
+static char point_phase(enum pwar_trace_point point) {
+    switch (point) {
+    case PWAR_TRACE_PROCESS_BEGIN:
+    case PWAR_TRACE_WAIT_BEGIN:
+    case PWAR_TRACE_ASIO_SWITCH_BEGIN:
+        return 'B';
+    case PWAR_TRACE_PROCESS_END:
+    case PWAR_TRACE_WAIT_END:
+    case PWAR_TRACE_ASIO_SWITCH_END:
+        return 'E';
+    default:
+        return 'i';
+    }
+}
+
+const char *pwar_trace_point_name(enum pwar_trace_point point) {
+    return point < PWAR_TRACE_POINT_COUNT ? point_names[point] : "unknown";
+}
+
+void pwar_trace_init(struct pwar_trace *trace) {
+    memset(trace, 0, sizeof(*trace));
+}
+
+struct pwar_trace_ring *pwar_trace_register(struct pwar_trace *trace, const char *name) {
+    uint32_t i = next_ring(trace);
+    if (i >= PWAR_TRACE_MAX_THREADS)
+        return NULL;
+    struct pwar_trace_ring *ring = &trace->rings[i];
+    strncpy(ring->name, name, sizeof(ring->name) - 1);
+    return ring;
+}
+
+// Copies the ring's valid events into out, oldest first
+static uint32_t snapshot_ring(const struct pwar_trace_ring *ring, struct pwar_trace_event *out) {
+    uint64_t end = PWAR_TRACE_LOAD(&ring->head);
+    uint64_t start = end > PWAR_TRACE_RING_EVENTS ? end - PWAR_TRACE_RING_EVENTS : 0;
+    for (uint64_t i = start; i < end; ++i)
+        out[i - start] = ring->events[i & (PWAR_TRACE_RING_EVENTS - 1)];
+    // Anything the owner wrapped over while we copied may be torn, and so
+    // may the slot of event now, which it can be writing before it stores
+    // the head
+    uint64_t now = PWAR_TRACE_LOAD(&ring->head);
+    uint64_t valid = now >= PWAR_TRACE_RING_EVENTS ? now - PWAR_TRACE_RING_EVENTS + 1 : 0;
+    if (valid <= start)
+        return (uint32_t)(end - start);
+    if (valid >= end)
+        return 0;
+    memmove(out, out + (valid - start), (size_t)(end - valid) * sizeof(*out));
+    return (uint32_t)(end - valid);
+}
+
+int pwar_trace_dump(struct pwar_trace *trace, const char *path) {
+    struct pwar_trace_event *events = malloc(PWAR_TRACE_RING_EVENTS * sizeof(*events));
+    if (!events)
+        return -ENOMEM;
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        int err = errno;
+        free(events);
+        return -err;
+    }
+
+    uint32_t n_rings = load_rings(trace);
+    if (n_rings > PWAR_TRACE_MAX_THREADS)
+        n_rings = PWAR_TRACE_MAX_THREADS;
+    int total = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"PWAR\"}}");
+    for (uint32_t r = 0; r < n_rings; ++r) {
+        const struct pwar_trace_ring *ring = &trace->rings[r];
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            r + 1, ring->name);
+        uint32_t n = snapshot_ring(ring, events);
+        for (uint32_t i = 0; i < n; ++i) {
+            const struct pwar_trace_event *ev = &events[i];
+            char phase = point_phase(ev->point);
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,%s\"args\":{\"seq\":%u}}",
+                pwar_trace_point_name(ev->point), phase, ticks_to_us(ev->ticks), r + 1,
+                phase == 'i' ? "\"s\":\"t\"," : "", ev->seq);
+        }
+        total += n;
+    }
+    fprintf(f, "\n]}\n");
+    int err = ferror(f) ? -EIO : 0;
+    fclose(f);
+    free(events);
+    return err < 0 ? err : total;
+}
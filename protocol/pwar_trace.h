@@ -0,0 +1,115 @@
+/*
+ * pwar_trace.h - Per-cycle timeline tracing for PWAR
+ *
+ * (c) 2025 Philip K. Gisslow
+ * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Every thread that records trace points owns one ring of fixed size
+ * events. Recording is a clock read and three stores, with no locks and no
+ * syscalls beyond the vDSO clock, so it is safe from the audio threads. A
+ * dump copies what the rings hold and writes it as Chrome trace-event JSON,
+ * which chrome://tracing and ui.perfetto.dev both open.
+ */
+
+#ifndef PWAR_TRACE
+#define PWAR_TRACE
+
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PWAR_TRACE_MAX_THREADS 8
+#define PWAR_TRACE_RING_EVENTS 8192      // per thread, power of two
+#define PWAR_TRACE_NAME_SIZE 16
+
+enum pwar_trace_point {
+    // Linux bridge
+    PWAR_TRACE_PROCESS_BEGIN,
+    PWAR_TRACE_PROCESS_END,
+    PWAR_TRACE_SEND,
+    PWAR_TRACE_WAIT_BEGIN,
+    PWAR_TRACE_WAIT_END,
+    PWAR_TRACE_OUTPUT_WRITE,
+    PWAR_TRACE_REPLY_RECV,
+    // ASIO driver
+    PWAR_TRACE_ASIO_RECV,
+    PWAR_TRACE_ASIO_SWITCH_BEGIN,
+    PWAR_TRACE_ASIO_SWITCH_END,
+    PWAR_TRACE_ASIO_REPLY_SEND,
+    PWAR_TRACE_POINT_COUNT,
+};
+
+struct pwar_trace_event {
+    uint64_t ticks;
+    uint32_t seq;
+    uint32_t point;
+};
+
+struct pwar_trace_ring {
+    char name[PWAR_TRACE_NAME_SIZE];
+    uint64_t head;                        // events written so far, only the owner stores it
+    struct pwar_trace_event events[PWAR_TRACE_RING_EVENTS];
+};
+
+struct pwar_trace {
+    uint32_t n_rings;
+    struct pwar_trace_ring rings[PWAR_TRACE_MAX_THREADS];
+};
+
+// MSVC gives volatile accesses acquire/release semantics (/volatile:ms),
+// which is all the single writer rings need.
+#if defined(_MSC_VER)
+#define PWAR_TRACE_LOAD(p) (*(volatile uint64_t *)(p))
+#define PWAR_TRACE_STORE(p, v) (*(volatile uint64_t *)(p) = (v))
+#else
+#define PWAR_TRACE_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define PWAR_TRACE_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+// Monotonic clock in ticks; ns on Linux, QueryPerformanceCounter on Windows
+#ifdef _WIN32
+uint64_t pwar_trace_now(void);
+#else
+static inline uint64_t pwar_trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+void pwar_trace_init(struct pwar_trace *trace);
+
+// Hands out a ring for the calling thread, once per thread and before its
+// first trace point. Returns NULL when all rings are taken; a NULL ring
+// records nothing.
+struct pwar_trace_ring *pwar_trace_register(struct pwar_trace *trace, const char *name);
+
+static inline void pwar_trace_point(struct pwar_trace_ring *ring, enum pwar_trace_point point, uint32_t seq) {
+    if (!ring)
+        return;
+    uint64_t head = ring->head;
+    struct pwar_trace_event *ev = &ring->events[head & (PWAR_TRACE_RING_EVENTS - 1)];
+    ev->ticks = pwar_trace_now();
+    ev->seq = seq;
+    ev->point = point;
+    PWAR_TRACE_STORE(&ring->head, head + 1);
+}
+
+const char *pwar_trace_point_name(enum pwar_trace_point point);
+
+// Writes everything the rings hold to path. Safe while the owners keep
+// recording; events they overwrite during the copy are left out. Returns
+// the number of events written or a negative errno.
+int pwar_trace_dump(struct pwar_trace *trace, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PWAR_TRACE */
@@ -21,6 +21,7 @@
 #include "pwarASIOLog.h"
 #include "../../protocol/pwar_packet.h"
 #include <avrt.h>
+#include <qos2.h>
 #pragma comment(lib, "ws2_32.lib")
 #pragma comment(lib, "avrt.lib")
 
@@ -105,7 +106,11 @@ pwarASIO::pwarASIO(LPUNKNOWN pUnk, HRESULT* phr)
         outMap[i] = 0;
     }
     callbacks = nullptr;
+    pwarASIOLog::Init();
+    pwar_timeline_init(&timeline, PWAR_DLL_DEFAULT_BANDWIDTH);
     parseConfigFile();
+    startTrace();
+    openMidi();
     initUdpSender();
     startUdpListener();
 }
@@ -113,8 +118,11 @@ pwarASIO::pwarASIO(LPUNKNOWN pUnk, HRESULT* phr)
 pwarASIO::~pwarASIO() {
     closeUdpSender();
     stopUdpListener();
+    closeMidi();
     stop();
+    stopTrace();
     disposeBuffers();
+    pwarASIOLog::Shutdown();
 }
 
 void pwarASIO::getDriverName(char* name) {
@@ -139,12 +147,18 @@ ASIOError pwarASIO::start() {
     started = false;
     samplePosition = 0;
     theSystemTime.lo = theSystemTime.hi = 0;
+    pwar_timeline_reset(&timeline);
+    // ASIO system time is timeGetTime() based, our stamps come from the steady clock
+    systemTimeOffset = static_cast<int64_t>(timeGetTime()) * 1000000 - static_cast<int64_t>(steadyNowNs());
+    sessionId = pwar_session_new_id(steadyNowNs() ^ (static_cast<uint64_t>(GetCurrentProcessId()) << 32));
     toggle = 0;
     started = true;
     return ASE_OK;
 }
 
 ASIOError pwarASIO::stop() {
+    if (started && trace)
+        dumpTrace("stop");
     started = false;
     return ASE_OK;
 }
@@ -208,14 +222,22 @@ ASIOError pwarASIO::setClockSource(long index) {
 }
 
 ASIOError pwarASIO::getSamplePosition(ASIOSamples* sPos, ASIOTimeStamp* tStamp) {
-    tStamp->lo = theSystemTime.lo;
-    tStamp->hi = theSystemTime.hi;
-    if (samplePosition >= TWO_RAISED_TO_32) {
-        sPos->hi = static_cast<unsigned long>(samplePosition * TWO_RAISED_TO_32_RECIP);
-        sPos->lo = static_cast<unsigned long>(samplePosition - (sPos->hi * TWO_RAISED_TO_32));
+    double position;
+    ASIOTimeStamp time;
+    uint32_t seq;
+    do {
+        seq = stampSeq.load(std::memory_order_acquire);
+        position = samplePosition;
+        time = theSystemTime;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != stampSeq.load(std::memory_order_relaxed));
+    *tStamp = time;
+    if (position >= TWO_RAISED_TO_32) {
+        sPos->hi = static_cast<unsigned long>(position * TWO_RAISED_TO_32_RECIP);
+        sPos->lo = static_cast<unsigned long>(position - (sPos->hi * TWO_RAISED_TO_32));
     } else {
         sPos->hi = 0;
-        sPos->lo = static_cast<unsigned long>(samplePosition);
+        sPos->lo = static_cast<unsigned long>(position);
     }
     return ASE_OK;
 }
@@ -296,6 +318,9 @@ error:
         return ASE_NoMemory;
     }
     this->callbacks = callbacks;
+    // The shapes hold until the next createBuffers, so the kernels are picked here
+    pwar_kernel_select(&inputKernel, activeInputs, blockFrames, 0, PWAR_FORMAT_F32);
+    pwar_kernel_select(&outputKernel, kNumOutputs, blockFrames, RT_STREAM_PACKET_FRAME_SIZE / 2, PWAR_FORMAT_F32);
     if (callbacks->asioMessage(kAsioSupportsTimeInfo, 0, 0, 0)) {
         timeInfoMode = true;
         asioTime.timeInfo.speed = 1.0;
@@ -340,47 +365,122 @@ ASIOError pwarASIO::future(long selector, void* opt) {
     return ASE_NotPresent;
 }
 
-void pwarASIO::output(const rt_stream_packet_t& packet) {
+void pwarASIO::sendDatagram(const void* data, size_t len, const void* trailer, size_t trailerLen) {
+    if (authEnabled) {
+        // Sealed in one piece; output() left room for the auth trailer
+        memcpy(authBuffer, data, len);
+        if (trailerLen)
+            memcpy(authBuffer + len, trailer, trailerLen);
+        len = pwar_auth_seal(&auth, authBuffer, len + trailerLen);
+        data = authBuffer;
+        trailerLen = 0;
+    }
+    WSABUF buffers[2];
+    buffers[0].buf = reinterpret_cast<CHAR*>(const_cast<void*>(data));
+    buffers[0].len = static_cast<ULONG>(len);
+    buffers[1].buf = reinterpret_cast<CHAR*>(const_cast<void*>(trailer));
+    buffers[1].len = static_cast<ULONG>(trailerLen);
+    DWORD bytesSent = 0;
+    int flags = 0;
+    WSASendTo(udpSendSocket, buffers, trailerLen ? 2 : 1, &bytesSent, flags,
+              reinterpret_cast<sockaddr*>(&udpSendAddr), sizeof(udpSendAddr), NULL, NULL);
+}
+
+// The reply's MIDI rides behind the audio; only what does not fit goes
+// ahead of it on its own
+void pwarASIO::output(const rt_stream_packet_t& packet, const pwar_midi_block_t& midi) {
     if (udpSendSocket != INVALID_SOCKET) {
-        WSABUF buffer;
-        buffer.buf = reinterpret_cast<CHAR*>(const_cast<rt_stream_packet_t*>(&packet));
-        buffer.len = sizeof(rt_stream_packet_t);
-        DWORD bytesSent = 0;
-        int flags = 0;
-        WSASendTo(udpSendSocket, &buffer, 1, &bytesSent, flags,
-                  reinterpret_cast<sockaddr*>(&udpSendAddr), sizeof(udpSendAddr), NULL, NULL);
+        const void* audio = &packet;
+        size_t len = sizeof(rt_stream_packet_t);
+        uint8_t dtxBuffer[PWAR_DTX_MAX_PACKET];
+        struct pwar_adapt_choice choice = adapt.choice;
+        if (dtxEnabled || adaptEnabled) {
+            audio = dtxBuffer;
+            len = pwar_dtx_encode_format(&packet, kNumOutputs, dtxEnabled ? dtxThreshold : 0.0f, choice.format,
+                                         dtxBuffer, nullptr);
+        }
+        const size_t datagramMax = PWAR_MIDI_MAX_DATAGRAM - (authEnabled ? PWAR_AUTH_OVERHEAD : 0);
+        uint8_t trailer[PWAR_MIDI_MAX_DATAGRAM];
+        uint32_t first = 0;
+        while (pwar_midi_size(&midi, first) > datagramMax - len) {
+            size_t n = pwar_midi_encode(&midi, &first, packet.session, packet.seq, trailer, datagramMax);
+            sendDatagram(trailer, n, nullptr, 0);
+        }
+        size_t trailerLen = pwar_midi_encode(&midi, &first, packet.session, packet.seq, trailer, datagramMax - len);
+        sendDatagram(audio, len, trailer, trailerLen);
+        // The copies go without the MIDI, the receiver takes it from the first
+        for (uint32_t copy = 1; copy < choice.copies; ++copy) {
+            pwar_dtx_set_copy(dtxBuffer, copy);
+            sendDatagram(audio, len, nullptr, 0);
+        }
     }
 }
 
-void pwarASIO::switchBuffersFromPwarPacket(const rt_stream_packet_t& packet) {
-    size_t to_copy = (blockFrames < packet.n_samples) ? blockFrames : packet.n_samples;
-    for (long i = 0; i < activeInputs; ++i) {
-        float* dest = inputBuffers[i] + (toggle ? blockFrames : 0);
-        memcpy(dest, packet.samples_ch1, to_copy * sizeof(float));
-        for (size_t j = to_copy; j < blockFrames; ++j)
-            dest[j] = 0.0f;
+void pwarASIO::switchBuffersFromPwarPacket(const rt_stream_packet_t& packet, const pwar_midi_block_t& midi) {
+    const long half = toggle ? blockFrames : 0;
+    if (packet.n_samples == blockFrames) {
+        const float* sources[kNumInputs];
+        float* inputs[kNumInputs];
+        for (long i = 0; i < activeInputs; ++i) {
+            sources[i] = packet.samples_ch1;
+            inputs[i] = inputBuffers[i] + half;
+        }
+        inputKernel.copy(&inputKernel, sources, inputs);
+    } else {
+        size_t to_copy = (blockFrames < packet.n_samples) ? blockFrames : packet.n_samples;
+        for (long i = 0; i < activeInputs; ++i) {
+            float* dest = inputBuffers[i] + half;
+            memcpy(dest, packet.samples_ch1, to_copy * sizeof(float));
+            for (size_t j = to_copy; j < blockFrames; ++j)
+                dest[j] = 0.0f;
+        }
     }
     rt_stream_packet_t out_packet;
     out_packet.ts_pipewire_send = packet.ts_pipewire_send;
-    samplePosition += blockFrames;
+    stampPeriod(packet);
+    // The DAW gets the period's events as the period starts
+    playMidi(midi);
+    collectMidi(midiReply, _timestamp);
+    pwar_trace_point(traceRing, PWAR_TRACE_ASIO_SWITCH_BEGIN, (uint32_t)packet.seq);
     if (timeInfoMode) {
         bufferSwitchX();
     } else {
         callbacks->bufferSwitch(toggle, ASIOFalse);
     }
-    float* outputSamplesCh1 = outputBuffers[0] + (toggle ? blockFrames : 0);
-    float* outputSamplesCh2 = outputBuffers[1] + (toggle ? blockFrames : 0);
+    pwar_trace_point(traceRing, PWAR_TRACE_ASIO_SWITCH_END, (uint32_t)packet.seq);
+    const float* outputs[kNumOutputs] = { outputBuffers[0] + half, outputBuffers[1] + half };
     out_packet.n_samples = blockFrames;
-    memcpy(out_packet.samples_ch1, outputSamplesCh1, out_packet.n_samples * sizeof(float));
-    memcpy(out_packet.samples_ch2, outputSamplesCh2, out_packet.n_samples * sizeof(float));
+    // samples_ch2 follows samples_ch1, so the packet is one payload
+    outputKernel.encode(&outputKernel, outputs, out_packet.samples_ch1);
     out_packet.seq = packet.seq;
-    uint64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-    out_packet.ts_asio_send = (nowNs - _timestamp) + packet.ts_pipewire_send;
-    output(out_packet);
+    out_packet.session = sessionId.load(std::memory_order_relaxed);
+    // Both stamps are on our own clock; the Linux side estimates the offset
+    out_packet.ts_asio_recv = _timestamp;
+    out_packet.ts_asio_send = steadyNowNs();
+    if (!listenOnly)
+        output(out_packet, midiReply);
+    pwar_trace_point(traceRing, PWAR_TRACE_ASIO_REPLY_SEND, (uint32_t)packet.seq);
     toggle = toggle ? 0 : 1;
 }
 
+uint64_t pwarASIO::steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stamps the period about to be switched with its smoothed arrival time
+void pwarASIO::stampPeriod(const rt_stream_packet_t& packet) {
+    pwar_timeline_update(&timeline, packet.seq, packet.ts_pipewire_send, _timestamp,
+                         static_cast<uint32_t>(blockFrames), static_cast<uint32_t>(sampleRate));
+    uint64_t systemTime = timeline.system_ns + systemTimeOffset;
+    stampSeq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    samplePosition = static_cast<double>(timeline.position);
+    theSystemTime.lo = static_cast<unsigned long>(systemTime & 0xffffffff);
+    theSystemTime.hi = static_cast<unsigned long>(systemTime >> 32);
+    stampSeq.fetch_add(1, std::memory_order_release);
+}
+
 void pwarASIO::bufferSwitchX() {
     getSamplePosition(&asioTime.timeInfo.samplePosition, &asioTime.timeInfo.systemTime);
     if (tcRead) {
@@ -398,9 +498,8 @@ ASIOError pwarASIO::outputReady() {
 void pwarASIO::udp_packet_listener() {
     WSADATA wsaData;
     SOCKET sockfd;
-    sockaddr_in servaddr{}, cliaddr{};
+    sockaddr_in servaddr{};
     int n;
-    socklen_t len;
     char buffer[2048];
 
     // --- Raise thread priority and register with MMCSS ---
@@ -431,8 +530,9 @@ void pwarASIO::udp_packet_listener() {
         if (mmcssHandle) AvRevertMmThreadCharacteristics(mmcssHandle);
         return;
     }
-    // Set SO_RCVBUF to minimal size for low latency
-    int rcvbuf = 1024; // 1 KB
+    // Set SO_RCVBUF to minimal size for low latency, unless a catch-up
+    // policy decides what to do with the periods that queue up
+    int rcvbuf = catchupPolicy == PWAR_CATCHUP_OFF ? 1024 : 64 * 1024;
     setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
     // Disable UDP connection reset behavior
     DWORD bytesReturned = 0;
@@ -442,34 +542,228 @@ void pwarASIO::udp_packet_listener() {
     servaddr.sin_family = AF_INET;
     servaddr.sin_addr.s_addr = INADDR_ANY;
     servaddr.sin_port = htons(8321);
+    if (!multicastGroup.empty()) {
+        // Other listeners on this host share the port
+        BOOL reuse = TRUE;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+    }
     if (bind(sockfd, reinterpret_cast<sockaddr*>(&servaddr), sizeof(servaddr)) == SOCKET_ERROR) {
         closesocket(sockfd);
         WSACleanup();
         return;
     }
+    if (!multicastGroup.empty()) {
+        ip_mreq mreq = {};
+        inet_pton(AF_INET, multicastGroup.c_str(), &mreq.imr_multiaddr);
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        if (!multicastIface.empty())
+            inet_pton(AF_INET, multicastIface.c_str(), &mreq.imr_interface);
+        if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, reinterpret_cast<const char*>(&mreq), sizeof(mreq)) == SOCKET_ERROR)
+            pwarASIOLog::Send("Failed to join the multicast group");
+        else
+            pwarASIOLog::Send("Joined the multicast group");
+    }
+    if (trace)
+        traceRing = pwar_trace_register(trace, "asio listener");
     udpListenerRunning = true;
+    pwar_catchup_init(&catchup, catchupPolicy, catchupTarget);
+    pwar_adapt_init(&adapt);
+    adaptWindowNs = adaptLastSeq = 0;
+    adaptPeriods = adaptLost = adaptDelayCount = 0;
+    adaptDelayBase = 0;
+    adaptDelaySum = 0;
+    adaptDelayMin = INT64_MAX;
+    if (adaptEnabled)
+        pwarASIOLog::Send("Adapt: packing and copies follow the link, f32, s24 or s16, up to 3 copies");
+    if (authEnabled) {
+        pwar_auth_init(&auth, authEncrypt ? PWAR_AUTH_ENCRYPT : PWAR_AUTH_SIGN, authKey,
+                       pwar_session_new_id(steadyNowNs() ^ (static_cast<uint64_t>(GetCurrentThreadId()) << 32)));
+    }
     while (udpListenerRunning) {
-        len = sizeof(cliaddr);
-        WSABUF wsaBuf;
-        wsaBuf.buf = buffer;
-        wsaBuf.len = sizeof(buffer);
-        DWORD bytesReceived = 0;
-        DWORD flags = 0;
-        int res = WSARecvFrom(sockfd, &wsaBuf, 1, &bytesReceived, &flags, reinterpret_cast<sockaddr*>(&cliaddr), &len, NULL, NULL);
-        if (res == 0 && bytesReceived >= sizeof(rt_stream_packet_t)) {
-            rt_stream_packet_t pkt;
-            memcpy(&pkt, buffer, sizeof(rt_stream_packet_t));
-            _timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-            if (started) {
-                switchBuffersFromPwarPacket(pkt);
-            }
+        if (!receivePacket(sockfd, buffer, sizeof(buffer), backlog[0]))
+            continue;
+        backlogCount = 1;
+        // What queued behind it arrived while the DAW was still busy
+        u_long pending = 0;
+        while (catchupPolicy != PWAR_CATCHUP_OFF && backlogCount < kBacklogSlots &&
+               ioctlsocket(sockfd, FIONREAD, &pending) == 0 && pending > 0) {
+            if (receivePacket(sockfd, buffer, sizeof(buffer), backlog[backlogCount]))
+                ++backlogCount;
         }
+        if (started)
+            playBacklog();
     }
     closesocket(sockfd);
     WSACleanup();
 }
 
+// Receives and decodes one datagram into entry. False for a MIDI only
+// datagram, which waits in midiRx for its audio, and for what is not ours.
+bool pwarASIO::receivePacket(SOCKET sockfd, char* buffer, ULONG size, BacklogEntry& entry) {
+    sockaddr_in cliaddr{};
+    socklen_t len = sizeof(cliaddr);
+    WSABUF wsaBuf;
+    wsaBuf.buf = buffer;
+    wsaBuf.len = size;
+    DWORD bytesReceived = 0;
+    DWORD flags = 0;
+    int res = WSARecvFrom(sockfd, &wsaBuf, 1, &bytesReceived, &flags, reinterpret_cast<sockaddr*>(&cliaddr), &len, NULL, NULL);
+    if (res != 0 || authKeyInvalid)
+        return false;
+    if (authEnabled) {
+        int opened = pwar_auth_open(&auth, reinterpret_cast<uint8_t*>(buffer), bytesReceived, steadyNowNs());
+        if (opened < 0) {
+            logAuthRefusals();
+            return false;
+        }
+        bytesReceived = static_cast<DWORD>(opened);
+    }
+    // MIDI behind the audio, or ahead of it on its own, ends up in entry.midi
+    size_t audio = pwar_midi_receive(&midiRx, buffer, bytesReceived, &entry.midi);
+    if (!audio)
+        return false;
+    if (pwar_dtx_is_dtx(buffer, audio)) {
+        if (pwar_dtx_decode(buffer, audio, &entry.packet, &dtxNoise) < 0)
+            return false;
+    } else {
+        memcpy(&entry.packet, buffer, sizeof(rt_stream_packet_t));
+    }
+    entry.recvNs = steadyNowNs();
+    if (!checkSession(entry.packet))
+        return false;
+    pwar_trace_point(traceRing, PWAR_TRACE_ASIO_RECV, (uint32_t)entry.packet.seq);
+    if (adaptEnabled) {
+        // Periods between two that arrived never did; late ones are stale
+        // and already dropped by checkSession
+        uint64_t step = adaptLastSeq && entry.packet.seq > adaptLastSeq ? entry.packet.seq - adaptLastSeq : 1;
+        adaptPeriods += static_cast<uint32_t>(step);
+        adaptLost += static_cast<uint32_t>(step - 1);
+        adaptLastSeq = entry.packet.seq;
+        // Either clock may be ahead and the raw delay wraps; against the
+        // window's first one it is small and signed
+        uint64_t raw = entry.recvNs - entry.packet.ts_pipewire_send;
+        if (!adaptDelayCount)
+            adaptDelayBase = raw;
+        int64_t delay = static_cast<int64_t>(raw - adaptDelayBase);
+        adaptDelaySum += delay;
+        if (delay < adaptDelayMin)
+            adaptDelayMin = delay;
+        ++adaptDelayCount;
+        if (!adaptWindowNs)
+            adaptWindowNs = entry.recvNs;
+        else if (entry.recvNs - adaptWindowNs >= 2000000000ull)
+            adaptWindow(entry.recvNs);
+    }
+    // A seq gap means Linux missed a deadline somewhere; keep the timeline
+    if (traceRing && traceLastSeq && entry.packet.seq != traceLastSeq + 1)
+        traceDumpRequested = true;
+    traceLastSeq = entry.packet.seq;
+    return true;
+}
+
+// The first refusal of each kind, and then every 1000th
+void pwarASIO::logAuthRefusals() {
+    if (auth.bad_tag != authBadTagLogged && (authBadTagLogged == 0 || auth.bad_tag - authBadTagLogged >= 1000)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Auth: refused %llu datagrams with a bad tag (wrong key or forged)",
+                 static_cast<unsigned long long>(auth.bad_tag));
+        pwarASIOLog::Send(msg);
+        authBadTagLogged = auth.bad_tag;
+    }
+    if (auth.replayed != authReplayedLogged && (authReplayedLogged == 0 || auth.replayed - authReplayedLogged >= 1000)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Auth: refused %llu replayed datagrams", static_cast<unsigned long long>(auth.replayed));
+        pwarASIOLog::Send(msg);
+        authReplayedLogged = auth.replayed;
+    }
+    if (auth.unconfirmed != authUnconfirmedLogged && (authUnconfirmedLogged == 0 || auth.unconfirmed - authUnconfirmedLogged >= 1000)) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Auth: refused %llu datagrams from a new peer before it took over",
+                 static_cast<unsigned long long>(auth.unconfirmed));
+        pwarASIOLog::Send(msg);
+        authUnconfirmedLogged = auth.unconfirmed;
+    }
+}
+
+// Switches the received periods oldest first. The policy skips whole
+// periods from the front; their MIDI still plays, at the start of the
+// period that is switched.
+void pwarASIO::playBacklog() {
+    const uint32_t period = static_cast<uint32_t>(blockFrames);
+    uint32_t i = 0;
+    while (i < backlogCount) {
+        pwar_catchup_action_t act = pwar_catchup_update(&catchup, (backlogCount - i - 1) * period, period, steadyNowNs());
+        for (uint32_t skip = act.drop / period; skip > 0 && i + 1 < backlogCount; --skip, ++i) {
+            uint32_t first = midiCarry.count;
+            pwar_midi_append(&midiCarry, &backlog[i].midi, 0);
+            for (uint32_t j = first; j < midiCarry.count; ++j)
+                midiCarry.events[j].offset = 0;
+        }
+        BacklogEntry& entry = backlog[i++];
+        if (midiCarry.count) {
+            pwar_midi_append(&midiCarry, &entry.midi, 0);
+            pwar_midi_copy(&entry.midi, &midiCarry);
+            pwar_midi_clear(&midiCarry);
+        }
+        _timestamp = entry.recvNs;
+        switchBuffersFromPwarPacket(entry.packet, entry.midi);
+        if (act.recovered)
+            logCatchup();
+    }
+}
+
+// Rare enough to log from the listener, once per backlog worked off
+void pwarASIO::logCatchup() {
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Catch-up (%s): backlog of %u periods worked off, %llu backlogs and %llu periods skipped since start",
+             pwar_catchup_policy_name(catchup.policy), catchup.last_depth / catchup.last_period,
+             (unsigned long long)catchup.backlogs, (unsigned long long)(catchup.dropped_frames / catchup.last_period));
+    pwarASIOLog::Send(msg);
+}
+
+// Feeds the window to the controller every 2 s, like the bridge's stats;
+// rare enough to log from the listener
+void pwarASIO::adaptWindow(uint64_t nowNs) {
+    struct pwar_adapt_window w = {};
+    w.periods = adaptPeriods;
+    w.lost = adaptLost;
+    w.jitter_ms = adaptDelayCount ? (static_cast<double>(adaptDelaySum) / adaptDelayCount - adaptDelayMin) / 1e6 : 0.0;
+    w.period_ms = blockFrames * 1000.0 / sampleRate;
+    if (pwar_adapt_update(&adapt, &w)) {
+        char line[192];
+        char msg[224];
+        pwar_adapt_describe(&adapt, &w, line, sizeof(line));
+        snprintf(msg, sizeof(msg), "Adapt: now sending %s", line);
+        pwarASIOLog::Send(msg);
+    }
+    adaptPeriods = adaptLost = adaptDelayCount = 0;
+    adaptDelayBase = 0;
+    adaptDelaySum = 0;
+    adaptDelayMin = INT64_MAX;
+    adaptWindowNs = nowNs;
+}
+
+// Drops packets still in flight from a previous run of the Linux side and
+// ones behind the newest seq, late or reordered. A restart or a seq jump
+// starts the timeline's loop over right away instead of waiting for it to
+// notice.
+bool pwarASIO::checkSession(const rt_stream_packet_t& pkt) {
+    enum pwar_session_event ev = pwar_session_check(&linuxSession, pkt.session, pkt.seq);
+    if (ev == PWAR_SESSION_STALE || ev == PWAR_SESSION_DUPLICATE)
+        return false;
+    if (ev == PWAR_SESSION_RESTART || ev == PWAR_SESSION_JUMP) {
+        timeline.dll.running = 0;
+        traceLastSeq = 0;
+        adaptLastSeq = 0;
+        // Rare enough to log from here; the log never allocates
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Linux side %s, session %08x: resynced",
+                 ev == PWAR_SESSION_RESTART ? "restarted" : "jumped", linuxSession.peer);
+        pwarASIOLog::Send(msg);
+    }
+    return true;
+}
+
 void pwarASIO::startUdpListener() {
     if (!udpListenerRunning) {
         udpListenerRunning = true;
@@ -485,6 +779,7 @@ void pwarASIO::stopUdpListener() {
 }
 
 void pwarASIO::parseConfigFile() {
+    dtxThreshold = pwar_dtx_level(PWAR_DTX_DEFAULT_THRESHOLD_DB);
     std::string configPath;
     const char* home = getenv("USERPROFILE");
     if (home && *home) {
@@ -504,11 +799,208 @@ void pwarASIO::parseConfigFile() {
             if (key == "udp_send_ip") {
                 udpSendIp = value;
                 pwarASIOLog::Send("Read ip from config");
+            } else if (key == "dtx") {
+                dtxEnabled = value == "1";
+            } else if (key == "adapt") {
+                adaptEnabled = value == "1";
+            } else if (key == "dtx_threshold_db") {
+                dtxThreshold = pwar_dtx_level(atof(value.c_str()));
+            } else if (key == "dtx_noise_db") {
+                pwar_dtx_noise_init(&dtxNoise, pwar_dtx_level(atof(value.c_str())));
+            } else if (key == "auth_key") {
+                authEnabled = true;
+                if (pwar_auth_parse_key(value.c_str(), authKey) < 0) {
+                    pwarASIOLog::Send("Invalid auth_key (64 hex digits expected), every packet is refused");
+                    authKeyInvalid = true;
+                } else {
+                    pwarASIOLog::Send("Packets are authenticated with the pre-shared key");
+                }
+            } else if (key == "encrypt") {
+                authEncrypt = value == "1";
+            } else if (key == "multicast_group") {
+                multicastGroup = value;
+            } else if (key == "multicast_iface") {
+                multicastIface = value;
+            } else if (key == "listen_only") {
+                listenOnly = value == "1";
+            } else if (key == "dscp") {
+                dscp = atoi(value.c_str());
+            } else if (key == "catchup") {
+                if (pwar_catchup_parse(value.c_str(), &catchupPolicy) < 0) {
+                    pwarASIOLog::Send("Unknown catchup policy, catch-up stays off");
+                    catchupPolicy = PWAR_CATCHUP_OFF;
+                } else if (catchupPolicy == PWAR_CATCHUP_STRETCH) {
+                    // Every buffer switch answers one packet, so periods
+                    // can only be skipped here, not played faster
+                    pwarASIOLog::Send("catchup=stretch is Linux only, dropping instead");
+                    catchupPolicy = PWAR_CATCHUP_DROP;
+                }
+            } else if (key == "catchup_target") {
+                catchupTarget = static_cast<uint32_t>(atoi(value.c_str()));
+            } else if (key == "midi_out") {
+                midiOutName = value;
+            } else if (key == "midi_in") {
+                midiInName = value;
+            } else if (key == "trace_path") {
+                tracePath = value;
+                pwarASIOLog::Send("Tracing enabled from config");
             }
         }
     }
 }
 
+// Bytes of a short MIDI message by its status byte
+static uint32_t midiMessageSize(uint8_t status) {
+    switch (status & 0xf0) {
+        case 0xc0: case 0xd0: return 2;
+        case 0xf0:
+            if (status == 0xf1 || status == 0xf3) return 2;
+            if (status == 0xf2) return 3;
+            return 1;
+    }
+    return 3;
+}
+
+// Ports are opened by name once, for the driver's lifetime
+void pwarASIO::openMidi() {
+    if (!midiOutName.empty()) {
+        UINT count = midiOutGetNumDevs();
+        for (UINT i = 0; i < count && !midiOut; ++i) {
+            MIDIOUTCAPSA caps;
+            if (midiOutGetDevCapsA(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR && midiOutName == caps.szPname &&
+                midiOutOpen(&midiOut, i, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR)
+                midiOut = nullptr;
+        }
+        pwarASIOLog::Send(midiOut ? "MIDI out port opened" : "MIDI out port not found");
+    }
+    if (!midiInName.empty()) {
+        UINT count = midiInGetNumDevs();
+        for (UINT i = 0; i < count && !midiIn; ++i) {
+            MIDIINCAPSA caps;
+            if (midiInGetDevCapsA(i, &caps, sizeof(caps)) == MMSYSERR_NOERROR && midiInName == caps.szPname &&
+                midiInOpen(&midiIn, i, reinterpret_cast<DWORD_PTR>(&pwarASIO::midiInProc),
+                           reinterpret_cast<DWORD_PTR>(this), CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+                midiIn = nullptr;
+        }
+        if (midiIn)
+            midiInStart(midiIn);
+        pwarASIOLog::Send(midiIn ? "MIDI in port opened" : "MIDI in port not found");
+    }
+}
+
+void pwarASIO::closeMidi() {
+    if (midiIn) {
+        midiInStop(midiIn);
+        midiInReset(midiIn);
+        midiInClose(midiIn);
+        midiIn = nullptr;
+    }
+    if (midiOut) {
+        midiOutReset(midiOut);
+        midiOutClose(midiOut);
+        midiOut = nullptr;
+    }
+}
+
+// Windows MIDI stamps events as they arrive, so playing them at the buffer
+// switch puts them in the right period; the offset within it is not kept.
+void pwarASIO::playMidi(const pwar_midi_block_t& midi) {
+    if (!midiOut)
+        return;
+    for (uint32_t i = 0; i < midi.count; ++i) {
+        const pwar_midi_event_t& ev = midi.events[i];
+        // SysEx would need midiOutLongMsg's buffer handshake on this thread
+        if (ev.size > 3)
+            continue;
+        DWORD msg = ev.data[0];
+        if (ev.size > 1)
+            msg |= static_cast<DWORD>(ev.data[1]) << 8;
+        if (ev.size > 2)
+            msg |= static_cast<DWORD>(ev.data[2]) << 16;
+        midiOutShortMsg(midiOut, msg);
+    }
+}
+
+// Runs on the MIDI driver's thread; short messages only, no SysEx buffers are added
+void CALLBACK pwarASIO::midiInProc(HMIDIIN handle, UINT msg, DWORD_PTR instance, DWORD_PTR param1, DWORD_PTR param2) {
+    (void)handle;
+    (void)param2;
+    pwarASIO* self = reinterpret_cast<pwarASIO*>(instance);
+    if (msg != MIM_DATA || !self->started)
+        return;
+    uint32_t w = self->midiInWrite.load(std::memory_order_relaxed);
+    if (w - self->midiInRead.load(std::memory_order_acquire) >= kMidiInSlots)
+        return;
+    MidiInEvent& ev = self->midiInEvents[w % kMidiInSlots];
+    ev.ns = steadyNowNs();
+    ev.msg = static_cast<DWORD>(param1);
+    self->midiInWrite.store(w + 1, std::memory_order_release);
+}
+
+// Events from midi_in since the previous switch, at the offsets they
+// arrived at within that period
+void pwarASIO::collectMidi(pwar_midi_block_t& out, uint64_t switchNs) {
+    pwar_midi_clear(&out);
+    uint32_t r = midiInRead.load(std::memory_order_relaxed);
+    uint32_t w = midiInWrite.load(std::memory_order_acquire);
+    const double framesPerNs = sampleRate / 1e9;
+    for (; r != w; ++r) {
+        const MidiInEvent& ev = midiInEvents[r % kMidiInSlots];
+        uint8_t bytes[3] = {
+            static_cast<uint8_t>(ev.msg & 0xff),
+            static_cast<uint8_t>((ev.msg >> 8) & 0xff),
+            static_cast<uint8_t>((ev.msg >> 16) & 0xff),
+        };
+        double offset = lastSwitchNs && ev.ns > lastSwitchNs ? (ev.ns - lastSwitchNs) * framesPerNs : 0.0;
+        if (offset > blockFrames - 1)
+            offset = static_cast<double>(blockFrames - 1);
+        pwar_midi_add(&out, static_cast<uint32_t>(offset), bytes, midiMessageSize(bytes[0]));
+    }
+    midiInRead.store(r, std::memory_order_release);
+    lastSwitchNs = switchNs;
+}
+
+void pwarASIO::startTrace() {
+    if (tracePath.empty())
+        return;
+    trace = new pwar_trace;
+    pwar_trace_init(trace);
+    traceRunning = true;
+    traceThread = std::thread(&pwarASIO::traceDumper, this);
+}
+
+void pwarASIO::stopTrace() {
+    traceRunning = false;
+    if (traceThread.joinable())
+        traceThread.join();
+    traceRing = nullptr;
+    delete trace;
+    trace = nullptr;
+}
+
+void pwarASIO::traceDumper() {
+    while (traceRunning) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        if (traceDumpRequested.exchange(false))
+            dumpTrace("seq gap");
+    }
+}
+
+// Writes <trace_path>-NNNN.json; called from the dumper thread and stop()
+void pwarASIO::dumpTrace(const char* reason) {
+    static std::mutex dumpMutex;
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    char path[512];
+    snprintf(path, sizeof(path), "%s-%04u.json", tracePath.c_str(), ++traceDumps);
+    int n = pwar_trace_dump(trace, path);
+    char msg[600];
+    if (n < 0)
+        snprintf(msg, sizeof(msg), "Trace dump to %s failed (%d)", path, n);
+    else
+        snprintf(msg, sizeof(msg), "Trace (%s): %d events written to %s", reason, n, path);
+    pwarASIOLog::Send(msg);
+}
+
 void pwarASIO::initUdpSender() {
     constexpr int udp_port = 8321;
     if (!udpWSAInitialized) {
@@ -535,13 +1027,47 @@ void pwarASIO::initUdpSender() {
             BOOL bNewBehavior = FALSE;
             WSAIoctl(udpSendSocket, SIO_UDP_CONNRESET, &bNewBehavior, sizeof(bNewBehavior),
                      NULL, 0, &bytesReturned, NULL, NULL);
+            markUdpSender();
         } else {
             pwarASIOLog::Send("Failed to create UDP send socket");
         }
     }
 }
 
+// Windows ignores IP_TOS; qWAVE marks the flow instead. A DSCP of our own
+// choosing needs administrator rights, without them the audio/video traffic
+// type still gets its default marking.
+void pwarASIO::markUdpSender() {
+    if (dscp < 0 || dscp > 63)
+        return;
+    QOS_VERSION version = { 1, 0 };
+    if (!qosHandle && !QOSCreateHandle(&version, &qosHandle)) {
+        qosHandle = nullptr;
+        pwarASIOLog::Send("QOSCreateHandle failed, sending unmarked");
+        return;
+    }
+    QOS_FLOWID flow = 0;
+    if (!QOSAddSocketToFlow(qosHandle, udpSendSocket, reinterpret_cast<sockaddr*>(&udpSendAddr),
+                            QOSTrafficTypeAudioVideo, QOS_NON_ADAPTIVE_FLOW, &flow)) {
+        pwarASIOLog::Send("QOSAddSocketToFlow failed, sending unmarked");
+        return;
+    }
+    qosFlow = flow;
+    DWORD value = static_cast<DWORD>(dscp);
+    if (!QOSSetFlow(qosHandle, qosFlow, QOSSetOutgoingDSCPValue, sizeof(value), &value, 0, nullptr))
+        pwarASIOLog::Send("QOSSetFlow failed (needs administrator rights), using the audio/video default");
+    else
+        pwarASIOLog::Send("Marking sent packets with the configured DSCP");
+}
+
 void pwarASIO::closeUdpSender() {
+    if (qosHandle) {
+        if (qosFlow)
+            QOSRemoveSocketFromFlow(qosHandle, udpSendSocket, qosFlow, 0);
+        QOSCloseHandle(qosHandle);
+        qosHandle = nullptr;
+        qosFlow = 0;
+    }
     if (udpSendSocket != INVALID_SOCKET) {
         closesocket(udpSendSocket);
         udpSendSocket = INVALID_SOCKET;
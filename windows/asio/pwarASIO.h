@@ -9,9 +9,19 @@
 #define __PWAR_ASIO_H__
 
 #include "asiosys.h"
+#include <atomic>
 #include <thread>
 #include <string>
 #include "../../protocol/pwar_packet.h"
+#include "../../protocol/pwar_adapt.h"
+#include "../../protocol/pwar_auth.h"
+#include "../../protocol/pwar_catchup.h"
+#include "../../protocol/pwar_dtx.h"
+#include "../../protocol/pwar_kernels.h"
+#include "../../protocol/pwar_midi.h"
+#include "../../protocol/pwar_session.h"
+#include "../../protocol/pwar_timeline.h"
+#include "../../protocol/pwar_trace.h"
 
 #include "rpc.h"
 #include "rpcndr.h"
@@ -19,6 +29,7 @@
 #include <windows.h>
 #include "ole2.h"
 #endif
+#include <mmsystem.h>
 #include "combase.h"
 #include "iasiodrv.h"
 
@@ -60,16 +71,41 @@ public:
     long getMilliSeconds() const { return milliSeconds; }
 
 private:
-    void output(const rt_stream_packet_t& packet);
+    void output(const rt_stream_packet_t& packet, const pwar_midi_block_t& midi);
+    void sendDatagram(const void* data, size_t len, const void* trailer, size_t trailerLen);
     void bufferSwitchX();
-    void switchBuffersFromPwarPacket(const rt_stream_packet_t& packet);
+    void switchBuffersFromPwarPacket(const rt_stream_packet_t& packet, const pwar_midi_block_t& midi);
     void udp_packet_listener();
+    struct BacklogEntry;
+    bool receivePacket(SOCKET sockfd, char* buffer, ULONG size, BacklogEntry& entry);
+    void logAuthRefusals();
+    void playBacklog();
+    void logCatchup();
+    void adaptWindow(uint64_t nowNs);
     void startUdpListener();
     void stopUdpListener();
     void initUdpSender();
     void closeUdpSender();
+    void markUdpSender();
     void parseConfigFile();
+    void startTrace();
+    void stopTrace();
+    void traceDumper();
+    void dumpTrace(const char* reason);
 
+    void openMidi();
+    void closeMidi();
+    void playMidi(const pwar_midi_block_t& midi);
+    void collectMidi(pwar_midi_block_t& out, uint64_t switchNs);
+    static void CALLBACK midiInProc(HMIDIIN handle, UINT msg, DWORD_PTR instance, DWORD_PTR param1, DWORD_PTR param2);
+
+    void stampPeriod(const rt_stream_packet_t& packet);
+    bool checkSession(const rt_stream_packet_t& packet);
+    static uint64_t steadyNowNs();
+
+    // samplePosition and theSystemTime always describe the same instant. The
+    // listener writes them under stampSeq (odd while writing) so
+    // getSamplePosition, called from any thread, never mixes two periods.
     double samplePosition;
     double sampleRate;
     ASIOCallbacks* callbacks;
@@ -92,12 +128,106 @@ private:
     bool tcRead;
     char errorMessage[128]{};
     uint64_t _timestamp = 0;
+    pwar_kernel_t inputKernel{};              // packet -> input buffers, set in createBuffers
+    pwar_kernel_t outputKernel{};             // output buffers -> reply packet
+    pwar_timeline_t timeline;                 // listener thread only
+    std::atomic<uint32_t> stampSeq{0};
+    int64_t systemTimeOffset = 0;             // steady clock ns to timeGetTime() ns
+    // A new session on every start(), so Linux can tell a restarted DAW
+    // from a live one; linuxSession notices the Linux side restarting.
+    std::atomic<uint32_t> sessionId{0};
+    pwar_session_t linuxSession{};            // listener thread only
     std::thread udpListenerThread;
     bool udpListenerRunning = false;
     SOCKET udpSendSocket = INVALID_SOCKET;
     bool udpWSAInitialized = false;
     struct sockaddr_in udpSendAddr;
     std::string udpSendIp = "192.168.66.2";
+    // dscp=N marks what we send through qWAVE, like the bridge's --dscp
+    int dscp = -1;
+    HANDLE qosHandle = nullptr;
+    unsigned long qosFlow = 0;
+    // Multicast: listen on multicast_group (joined on multicast_iface, a
+    // local address) instead of only unicast. With listen_only=1 nothing is
+    // sent back, for every listener but the one the bridge plays.
+    std::string multicastGroup;
+    std::string multicastIface;
+    bool listenOnly = false;
+    // DTX: dtx=1 sends silent output channels as a bit only; full packets
+    // and DTX packets are both accepted on receive.
+    bool dtxEnabled = false;
+    float dtxThreshold = 0.0f;
+    pwar_dtx_noise_t dtxNoise{};              // listener thread only
+    // Adapt: adapt=1 packs the replies and sends copies of them by what
+    // the Linux side's periods show of the link, like the bridge's
+    // --adapt. The delay is on two clocks, so only its spread is used: each
+    // window's delays are kept signed against its first one, which is the
+    // clock offset plus that packet's delay.
+    bool adaptEnabled = false;
+    pwar_adapt_t adapt{};                     // listener thread only, as the rest below
+    uint64_t adaptWindowNs = 0;
+    uint64_t adaptLastSeq = 0;
+    uint32_t adaptPeriods = 0, adaptLost = 0;
+    uint64_t adaptDelayBase = 0;
+    int64_t adaptDelaySum = 0, adaptDelayMin = INT64_MAX;
+    uint32_t adaptDelayCount = 0;
+    // Pre-shared key: auth_key=HEX (64 digits, the same as the Linux side's
+    // key file) seals everything sent and drops what does not verify,
+    // encrypt=1 encrypts the payload too. A key that does not parse drops
+    // everything rather than falling back to accepting anything.
+    bool authEnabled = false;
+    bool authEncrypt = false;
+    bool authKeyInvalid = false;
+    uint8_t authKey[PWAR_AUTH_KEY_SIZE] = {};
+    pwar_auth_t auth{};                       // listener thread only
+    uint8_t authBuffer[PWAR_MIDI_MAX_DATAGRAM]; // listener thread only, the datagram being sealed
+    uint64_t authBadTagLogged = 0, authReplayedLogged = 0, authUnconfirmedLogged = 0;
+    // MIDI: the events of each period from Linux play to the midi_out port
+    // at its buffer switch, typically a virtual loopback port the DAW
+    // records from. What arrives on midi_in goes back with the reply,
+    // stamped by arrival time within the period.
+    std::string midiOutName;
+    std::string midiInName;
+    HMIDIOUT midiOut = nullptr;
+    HMIDIIN midiIn = nullptr;
+    pwar_midi_rx_t midiRx{};                  // listener thread only
+    pwar_midi_block_t midiCarry{};            // listener thread only, of skipped periods
+    pwar_midi_block_t midiReply{};            // listener thread only, to Linux
+    uint64_t lastSwitchNs = 0;                // listener thread only
+    // midiInProc -> listener thread, single producer ring
+    struct MidiInEvent {
+        uint64_t ns;
+        DWORD msg;
+    };
+    static constexpr uint32_t kMidiInSlots = 256;
+    MidiInEvent midiInEvents[kMidiInSlots];
+    std::atomic<uint32_t> midiInWrite{0};
+    std::atomic<uint32_t> midiInRead{0};
+    // Catch-up: with catchup=newest or drop the listener also takes what
+    // queued in the socket behind each packet and skips periods until at
+    // most catchup_target remain. Off keeps the 1 KB socket buffer, which
+    // holds about one packet and lets the kernel drop the rest.
+    enum pwar_catchup_policy catchupPolicy = PWAR_CATCHUP_OFF;
+    uint32_t catchupTarget = 1;
+    pwar_catchup_t catchup{};                 // listener thread only
+    struct BacklogEntry {
+        rt_stream_packet_t packet;
+        pwar_midi_block_t midi;
+        uint64_t recvNs;
+    };
+    static constexpr uint32_t kBacklogSlots = 16;
+    BacklogEntry backlog[kBacklogSlots];      // listener thread only
+    uint32_t backlogCount = 0;
+    // Tracing, enabled by trace_path in the config file. Seq gaps are
+    // dumped by traceDumper, never from the listener thread itself.
+    std::string tracePath;
+    pwar_trace* trace = nullptr;
+    pwar_trace_ring* traceRing = nullptr;     // listener thread only
+    uint64_t traceLastSeq = 0;                // listener thread only
+    unsigned traceDumps = 0;
+    std::atomic<bool> traceDumpRequested{false};
+    std::atomic<bool> traceRunning{false};
+    std::thread traceThread;
 };
 
 #endif // __PWAR_ASIO_H__
@@ -8,21 +8,45 @@
 #include "pwarASIOLog.h"
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <mutex>
+#include <thread>
 #pragma comment(lib, "ws2_32.lib")
 
+// Bounded multi-producer ring. A slot is free for lap L of the write
+// position when its seq is 2L and holds a line when it is 2L + 1; zero
+// initialised, every slot is free for the first lap.
+static constexpr uint64_t kSlots = 64;
+static constexpr size_t kLineSize = 256;
+struct LogSlot {
+    std::atomic<uint64_t> seq;
+    char text[kLineSize];
+};
+static LogSlot slots[kSlots];
+static std::atomic<uint64_t> writePos{0};
+static uint64_t readPos = 0;              // writer thread only
+static std::atomic<uint64_t> dropped{0};
+static uint64_t droppedReported = 0;      // writer thread only
+
+// Writer side, under g_udpLogMutex
 static SOCKET sock = INVALID_SOCKET;
 static sockaddr_in serverAddr = {};
 static bool initialized = false;
 static std::mutex g_udpLogMutex;
 static std::string log_ip = "10.0.0.171";
 static int log_port = 1338;
+static std::thread writer;
+static std::atomic<bool> writerRunning{false};
 
 pwarASIOLog::pwarASIOLog(const char* ip, int port) {
     std::lock_guard<std::mutex> lock(g_udpLogMutex);
     log_ip = ip;
     log_port = port;
-    initialized = false; // force re-init on next send
+    serverAddr.sin_port = htons(log_port);
+    serverAddr.sin_addr.s_addr = inet_addr(log_ip.c_str());
 }
 
 void pwarASIOLog::Init() {
@@ -40,9 +64,14 @@ void pwarASIOLog::Init() {
     serverAddr.sin_port = htons(log_port);
     serverAddr.sin_addr.s_addr = inet_addr(log_ip.c_str());
     initialized = true;
+    writerRunning = true;
+    writer = std::thread(&pwarASIOLog::Writer);
 }
 
 void pwarASIOLog::Shutdown() {
+    writerRunning = false;
+    if (writer.joinable())
+        writer.join();
     std::lock_guard<std::mutex> lock(g_udpLogMutex);
     if (!initialized) return;
     closesocket(sock);
@@ -51,15 +80,61 @@ void pwarASIOLog::Shutdown() {
     initialized = false;
 }
 
-void pwarASIOLog::EnsureInit() {
-    if (!initialized) Init();
+// Polls instead of being woken, so Send() never makes a syscall
+void pwarASIOLog::Writer() {
+    while (writerRunning) {
+        Drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    Drain();
 }
 
-void pwarASIOLog::Send(const char* msg) {
-    EnsureInit();
-    if (!initialized) return;
+void pwarASIOLog::Drain() {
     std::lock_guard<std::mutex> lock(g_udpLogMutex);
-    std::string out(msg);
-    if (out.empty() || out.back() != '\n') out += "\r\n";
-    sendto(sock, out.c_str(), (int)out.size(), 0, (struct sockaddr*)&serverAddr, sizeof(serverAddr));
+    for (;;) {
+        LogSlot& slot = slots[readPos % kSlots];
+        uint64_t full = readPos / kSlots * 2 + 1;
+        if (slot.seq.load(std::memory_order_acquire) != full)
+            break;
+        sendto(sock, slot.text, (int)strnlen(slot.text, kLineSize), 0,
+               (struct sockaddr*)&serverAddr, sizeof(serverAddr));
+        slot.seq.store(full + 1, std::memory_order_release);
+        ++readPos;
+    }
+    uint64_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost != droppedReported) {
+        char line[96];
+        int len = snprintf(line, sizeof(line), "Log: %llu lines dropped, the ring was full\r\n",
+                           static_cast<unsigned long long>(lost - droppedReported));
+        sendto(sock, line, len, 0, (struct sockaddr*)&serverAddr, sizeof(serverAddr));
+        droppedReported = lost;
+    }
+}
+
+void pwarASIOLog::Send(const char* msg) {
+    uint64_t pos = writePos.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &slots[pos % kSlots];
+        uint64_t seq = slot->seq.load(std::memory_order_acquire);
+        uint64_t free = pos / kSlots * 2;
+        if (seq == free) {
+            if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (seq < free) {
+            // Still holds a line from the lap before: the writer is behind
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = writePos.load(std::memory_order_relaxed);
+        }
+    }
+    size_t len = strnlen(msg, kLineSize - 3);
+    memcpy(slot->text, msg, len);
+    if (len == 0 || slot->text[len - 1] != '\n') {
+        slot->text[len++] = '\r';
+        slot->text[len++] = '\n';
+    }
+    slot->text[len] = '\0';
+    slot->seq.store(pos / kSlots * 2 + 1, std::memory_order_release);
 }
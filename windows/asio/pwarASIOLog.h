@@ -3,6 +3,12 @@
  *
  * (c) 2025 Philip K. Gisslow
  * This file is part of the PipeWire ASIO Relay (PWAR) project.
+ *
+ * Send() only copies the line into a lock-free ring, so it is safe on the
+ * listener thread that drives bufferSwitch. A writer thread, started by
+ * Init() and stopped by Shutdown(), sends what queued over UDP. Lines
+ * sent before Init() wait in the ring, and lines that find it full are
+ * dropped and counted.
  */
 
 #pragma once
@@ -15,5 +21,6 @@ public:
     static void Shutdown();
     static void Send(const char* msg);
 private:
-    static void EnsureInit();
+    static void Writer();
+    static void Drain();
 };
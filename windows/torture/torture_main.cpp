@@ -78,8 +78,11 @@ void udp_receive_thread() {
         if (bytesReceived >= (int)sizeof(rt_stream_packet_t)) {
             rt_stream_packet_t pkt;
             memcpy(&pkt, buffer, sizeof(rt_stream_packet_t));
-            // Respond with the same seq
+            // Respond with the same seq, stamped like the driver does
             rt_stream_packet_t resp = pkt;
+            resp.ts_asio_recv = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            resp.ts_asio_send = resp.ts_asio_recv;
             sendto(send_sock, reinterpret_cast<const char*>(&resp), sizeof(resp), 0,
                    reinterpret_cast<sockaddr*>(&dest_addr), sizeof(dest_addr));
         }